@@ -1,17 +1,14 @@
-import socket
+from wallet_client import WalletClient
 
 SERVER_IP = "127.0.0.1"
 PORT = 8080
 
 logged_in_user = None
+wallet = WalletClient(SERVER_IP, PORT)  # keeps the connection and the session between commands
 
 def send_request(request):
-    client = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-    client.connect((SERVER_IP, PORT))
-    client.send(request.encode())
-    response = client.recv(4096).decode()  # Increased buffer for large responses like SHOW_ALL_USERS
+    response = wallet.send_command(request)
     print("Server:", response)
-    client.close()
     return response  # Return to parse login result
 
 print("Welcome to Secure Wallet!")
@@ -70,12 +67,19 @@ while True:
 
     elif choice == "5":
         if logged_in_user:
-            send_request(f"HISTORY {logged_in_user}")
+            response = send_request("HISTORY")
+            # Each page ends with "Next: <cursor>" while older transactions remain
+            while "Next: " in response:
+                if input("Show older transactions? (y/n): ").strip().lower() != "y":
+                    break
+                cursor = response.split("Next: ", 1)[1].split()[0]
+                response = send_request(f"HISTORY 20 {cursor}")
         else:
             print("Goodbye!")
             break
 
     elif choice == "6" and logged_in_user:
+        send_request("LOGOUT")
         print(f"Logged out from {logged_in_user}")
         logged_in_user = None
 
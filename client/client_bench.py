@@ -0,0 +1,104 @@
+"""Throughput of the Python client: a new connection per command, as the
+clients used to make, against WalletClient's pooled connection and the
+pipelined AsyncWalletClient, each over the plain and the encrypted protocol.
+
+    python3 client_bench.py --user alice --password pw --to bob --requests 2000
+
+Each mode runs the same number of BALANCE and then TRANSFER requests (0.01 to
+--to) on one thread. The server needs both users; --signup creates them, and it
+must accept plain clients (WALLET_SECURE_ONLY unset) for the plain column.
+"""
+
+import argparse
+import asyncio
+import time
+
+from wallet_client import OP_RESUME, AsyncWalletClient, Connection, WalletClient, WalletError, _token_of, encode_command
+
+
+def per_request_connect(args, token, command, secure):
+    # What client.py's send_request did: a new connection for every command.
+    # It sent the token with the command; a fresh connection now resumes it.
+    conn = Connection(args.host, args.port, secure)
+    conn.request(OP_RESUME, token.encode())
+    reply = conn.request(*encode_command(command))[1]
+    conn.close()
+    return reply
+
+
+def run_connect(args, token, command, secure):
+    for _ in range(args.requests):
+        per_request_connect(args, token, command, secure)
+
+
+# The session is resumed from the token rather than logged in again: a LOGIN
+# hashes the password, which would cost more than the requests being timed
+def run_pooled(args, token, command, secure):
+    client = WalletClient(args.host, args.port, secure=secure)
+    client.token = token
+    for _ in range(args.requests):
+        client.send_command(command)
+    client.disconnect()
+
+
+async def run_async(args, token, command, secure):
+    client = AsyncWalletClient(args.host, args.port, secure=secure)
+    await client.connect()
+    await client.request(OP_RESUME, token.encode())
+
+    # --depth requests in flight; each task sends its next as a reply arrives
+    async def worker(count):
+        for _ in range(count):
+            await client.command(command)
+
+    share, extra = divmod(args.requests, args.depth)
+    await asyncio.gather(*(worker(share + (i < extra)) for i in range(args.depth)))
+    await client.close()
+
+
+def rate(args, run):
+    start = time.perf_counter()
+    run()
+    return args.requests / (time.perf_counter() - start)
+
+
+def main(args):
+    client = WalletClient(args.host, args.port)
+    if args.signup:
+        for user in (args.user, args.to):
+            client.send_command(f"SIGNUP {user} {args.password}")
+    reply = client.send_command(f"LOGIN {args.user} {args.password}")
+    token = _token_of(reply)
+    if not token:
+        raise WalletError(f"Cannot log in as {args.user}: {reply.strip()}")
+
+    modes = (
+        ("connect per request", run_connect),
+        ("pooled connection", run_pooled),
+        (f"async, depth {args.depth}", lambda *a: asyncio.run(run_async(*a))),
+    )
+    rows = []
+    for command in ("BALANCE", f"TRANSFER {args.to} 0.01"):
+        for label, run in modes:
+            plain = rate(args, lambda: run(args, token, command, False))
+            encrypted = rate(args, lambda: run(args, token, command, True))
+            rows.append((label, command.split()[0], plain, encrypted))
+    client.disconnect()
+
+    print(f"{'mode':<22} {'command':<10} {'plain/s':>10} {'encrypted/s':>12} {'cost':>6}")
+    for label, command, plain, encrypted in rows:
+        print(f"{label:<22} {command:<10} {plain:>10.0f} {encrypted:>12.0f} {1 - encrypted / plain:>6.0%}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--user", default="pybench0")
+    parser.add_argument("--to", default="pybench1")
+    parser.add_argument("--password", default="pw")
+    parser.add_argument("--signup", action="store_true", help="create --user and --to first")
+    parser.add_argument("--requests", type=int, default=2000, help="per mode, command and protocol")
+    parser.add_argument("--depth", type=int, default=64, help="async requests in flight")
+    args = parser.parse_args()
+    main(args)
@@ -4,11 +4,11 @@ from collections import defaultdict
 import re
 import pyperclip
 from wallet_client import WalletClient  # Handles socket communication
-import sqlite3
 import os
 
 
 client = WalletClient()  # Connects to server on start
+HISTORY_PAGE = 500  # rows per HISTORY request, the server's largest page
 
 class WalletApp:
     def __init__(self, root):
@@ -116,18 +116,9 @@ class WalletApp:
         scrollbar.config(command=text_widget.yview)
 
         # Fetch data
-        conn = sqlite3.connect('/Users/kashishvarmaa/Documents/6 Sem/NS/Digital Secure Wallet System/server/wallet.db')
-        c = conn.cursor()
-        try:
-            c.execute(
-                "SELECT sender, receiver, amount, timestamp FROM transactions WHERE sender=? OR receiver=? ORDER BY timestamp DESC",
-                (user_id, user_id)
-            )
-            transactions = c.fetchall()
-        except sqlite3.OperationalError as e:
-            text_widget.insert("end", f"Error fetching transactions: {e}")
-            transactions = []
-        conn.close()
+        transactions, error = self.fetch_history()
+        if error:
+            text_widget.insert("end", f"Error fetching transactions: {error}\n")
 
         if not transactions:
             text_widget.insert("end", "No transactions found.\n")
@@ -139,6 +130,34 @@ class WalletApp:
 
 
 
+    def fetch_history(self):
+        """Every transaction of the logged-in user, newest first, read page by
+        page with HISTORY so archived rows and every shard are included.
+        Returns (transactions, error)."""
+        transactions = []
+        cursor = ""
+        while True:
+            response = client.send_command(f"HISTORY {HISTORY_PAGE} {cursor}".strip())
+            lines = response.splitlines()
+            if not lines or lines[0] != "Transaction History:":
+                return transactions, response.strip()
+
+            cursor = ""
+            for line in lines[1:]:
+                if line.startswith("Next: "):
+                    cursor = line.split(": ", 1)[1].strip()
+                    continue
+                # "<time> | From: <sender> | To: <receiver> | ₹<amount>"
+                parts = [part.strip() for part in line.split("|")]
+                if len(parts) != 4:
+                    continue
+                sender = parts[1].split(":", 1)[1].strip()
+                receiver = parts[2].split(":", 1)[1].strip()
+                amount = float(parts[3].lstrip("₹"))
+                transactions.append((sender, receiver, amount, parts[0]))
+            if not cursor:
+                return transactions, None
+
     def send_money(self):
         recipient = self.recipient_entry.get()
         amount = self.amount_entry.get()
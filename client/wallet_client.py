@@ -1,28 +1,316 @@
+"""Client library for the wallet server.
+
+WalletClient keeps a small pool of persistent connections that speak the
+server's binary protocol (server/protocol.h), so a command costs one round trip
+instead of a new TCP connection, and long replies such as HISTORY or
+SHOW_ALL_USERS arrive whole however many frames they take. It still accepts the
+text commands ("TRANSFER bob 12.50") and turns them into frames.
+
+AsyncWalletClient is the asyncio version for scripts: one connection, many
+requests in flight at once, each reply matched to its request by id.
+
+Both encrypt by default: every connection starts with an X25519 key exchange
+and sends its frames in AES-256-GCM records, so passwords and tokens never
+cross the wire in the clear. secure=False speaks the plain binary protocol to a
+server that still allows it. The crypto is in wire_crypto.py.
+"""
+
+import asyncio
+import itertools
+import select
 import socket
+import struct
+import threading
+import time
+
+from wire_crypto import RECORD_HEADER, WIRE_KEY_SIZE, SecureChannel
+
+# Mirrors server/protocol.h
+WIRE_MAGIC = b"\0WB1"
+WIRE_SECURE_MAGIC = b"\0WE1"
+HEADER = struct.Struct(">IIB")  # length, request_id, opcode or status
+NAME_SIZE = 50
+TOKEN_SIZE = 32
+CURSOR_SIZE = 64
+MAX_PIPELINE = 256  # requests the server runs at once per connection
+
+OP_SIGNUP = 1
+OP_LOGIN = 2
+OP_LOGOUT = 3
+OP_RESUME = 4
+OP_BALANCE = 5
+OP_TRANSFER = 6
+OP_HISTORY = 7
+OP_SHOW_ALL_USERS = 8
+OP_ADMIN_STATS = 9
+OP_QUEUE_STATS = 10
+OP_METRICS = 11
+OP_LOG_LEVEL = 12
+OP_TRANSFER_BATCH = 13
+OP_SET_TIER = 14
+
+WIRE_OK = 0
+WIRE_FAILED = 1
+WIRE_BUSY = 2
+WIRE_BAD_REQUEST = 3
+WIRE_MORE = 4
+
+POOL_SIZE = 4
+POOL_IDLE_SECONDS = 240  # drop pooled sockets before the server's 300 s idle timeout
+CONNECT_TIMEOUT = 5
+REPLY_TIMEOUT = 60
+
+
+class WalletError(Exception):
+    pass
+
+
+def _name(value):
+    data = value.encode()
+    if not data or len(data) >= NAME_SIZE:
+        raise WalletError(f"'{value}' must be 1 to {NAME_SIZE - 1} bytes")
+    return data.ljust(NAME_SIZE, b"\0")
+
+
+def _paise(amount):
+    return struct.pack(">q", round(float(amount) * 100))
+
+
+def _number(value, default):
+    try:
+        return int(value)
+    except (TypeError, ValueError):
+        return default
+
+
+def encode_command(command):
+    """Turn a text command into (opcode, fields). Arguments the binary protocol
+    does not take, such as the username older clients send with BALANCE, are
+    ignored as the server ignores them in text."""
+    words = command.split()
+    if not words:
+        raise WalletError("Empty command")
+    verb, args = words[0].upper(), words[1:]
+
+    if verb in ("SIGNUP", "LOGIN") and len(args) >= 2:
+        return (OP_SIGNUP if verb == "SIGNUP" else OP_LOGIN), _name(args[0]) + _name(args[1])
+    if verb == "LOGOUT":
+        return OP_LOGOUT, b""
+    if verb == "BALANCE":
+        return OP_BALANCE, b""
+    if verb == "TRANSFER" and len(args) >= 2:
+        return OP_TRANSFER, _name(args[0]) + _paise(args[1])
+    if verb == "TRANSFER_BATCH":
+        best_effort = 1 if args and args[0].upper() == "BEST_EFFORT" else 0
+        args = args[best_effort:]
+        count = _number(args[0] if args else None, 0)
+        pairs = args[1:]
+        if count < 1 or len(pairs) != 2 * count:
+            raise WalletError("Use: TRANSFER_BATCH [BEST_EFFORT] <count> <recipient> <amount> ...")
+        lines = b"".join(_name(pairs[i]) + _paise(pairs[i + 1]) for i in range(0, len(pairs), 2))
+        return OP_TRANSFER_BATCH, struct.pack(">BI", best_effort, count) + lines
+    if verb == "HISTORY":
+        limit = _number(args[0] if args else None, None)
+        if limit is None:
+            return OP_HISTORY, b""
+        cursor = args[1].encode() if len(args) > 1 else b""
+        return OP_HISTORY, struct.pack(">I", limit) + cursor.ljust(CURSOR_SIZE, b"\0")[:CURSOR_SIZE]
+    if verb == "SHOW_ALL_USERS":
+        if len(args) < 3:
+            return OP_SHOW_ALL_USERS, b""
+        prefix = args[2].encode().ljust(NAME_SIZE, b"\0")[:NAME_SIZE]
+        return OP_SHOW_ALL_USERS, struct.pack(">I", _number(args[0], 0)) + _paise(args[1]) + prefix
+    if verb == "ADMIN_STATS":
+        k = _number(args[0] if args else None, None)
+        return OP_ADMIN_STATS, b"" if k is None else struct.pack(">I", k)
+    if verb == "QUEUE_STATS":
+        return OP_QUEUE_STATS, b""
+    if verb == "METRICS":
+        return OP_METRICS, b""
+    if verb == "LOG_LEVEL":
+        return OP_LOG_LEVEL, _name(args[0]) if args else b""
+    if verb == "SET_TIER" and len(args) >= 2:
+        return OP_SET_TIER, _name(args[0]) + bytes([_number(args[1], 0) & 0xFF])
+    raise WalletError("Invalid command!")
+
+
+def _frame(request_id, opcode, fields):
+    return HEADER.pack(HEADER.size - 4 + len(fields), request_id, opcode) + fields
+
+
+def _token_of(text):
+    for line in text.splitlines():
+        if line.startswith("Token: "):
+            return line.split(": ", 1)[1].strip()
+    return None
+
+
+class Connection:
+    """One persistent socket, one request at a time."""
+
+    def __init__(self, host, port, secure=True):
+        self.sock = socket.create_connection((host, port), timeout=CONNECT_TIMEOUT)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_KEEPALIVE, 1)
+        # Linux names; elsewhere the system keepalive defaults apply
+        for option, value in (("TCP_KEEPIDLE", 60), ("TCP_KEEPINTVL", 10), ("TCP_KEEPCNT", 3)):
+            if hasattr(socket, option):
+                self.sock.setsockopt(socket.IPPROTO_TCP, getattr(socket, option), value)
+        self.sock.settimeout(REPLY_TIMEOUT)
+        self.buffer = bytearray()   # plaintext not yet read
+        self.records = bytearray()  # received records not yet opened
+        self.channel = None
+        self.ids = itertools.count(1)
+        self.token = None  # session this socket is logged in to
+        self.last_used = time.monotonic()
+
+        if secure:
+            channel = SecureChannel()
+            self.sock.sendall(WIRE_SECURE_MAGIC + channel.public_key)
+            reply = self._read(len(WIRE_SECURE_MAGIC) + WIRE_KEY_SIZE)
+            if reply[:len(WIRE_SECURE_MAGIC)] != WIRE_SECURE_MAGIC:
+                self.close()
+                raise WalletError("The server does not speak the encrypted protocol")
+            channel.accept(reply[len(WIRE_SECURE_MAGIC):])
+            self.channel = channel
+        else:
+            self.sock.sendall(WIRE_MAGIC)
+            if self._read(len(WIRE_MAGIC)) != WIRE_MAGIC:
+                self.close()
+                raise WalletError("The server does not speak the binary protocol")
+
+    def _receive(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise ConnectionError("Server closed the connection")
+        if not self.channel:
+            self.buffer += data
+            return
+        self.records += data
+        while len(self.records) >= RECORD_HEADER.size:
+            (length,) = RECORD_HEADER.unpack_from(self.records)
+            end = RECORD_HEADER.size + length
+            if len(self.records) < end:
+                break
+            self.buffer += self.channel.open(bytes(self.records[:RECORD_HEADER.size]),
+                                             bytes(self.records[RECORD_HEADER.size:end]))
+            del self.records[:end]
+
+    def _read(self, size):
+        while len(self.buffer) < size:
+            self._receive()
+        data = bytes(self.buffer[:size])
+        del self.buffer[:size]
+        return data
+
+    def alive(self):
+        """False once the server has closed the socket, e.g. after its idle timeout."""
+        if time.monotonic() - self.last_used > POOL_IDLE_SECONDS:
+            return False
+        try:
+            readable, _, _ = select.select([self.sock], [], [], 0)
+            return not readable  # an idle socket has nothing to say but EOF
+        except (OSError, ValueError):
+            return False
+
+    def request(self, opcode, fields=b""):
+        """Send one request and return (status, text), joining WIRE_MORE parts."""
+        request_id = next(self.ids) & 0xFFFFFFFF
+        frame = _frame(request_id, opcode, fields)
+        self.sock.sendall(self.channel.seal(frame) if self.channel else frame)
+
+        parts = []
+        while True:
+            length, reply_id, status = HEADER.unpack(self._read(HEADER.size))
+            body = self._read(length - (HEADER.size - 4))
+            if reply_id != request_id:
+                raise WalletError(f"Reply to request {reply_id} while waiting for {request_id}")
+            parts.append(body)
+            if status != WIRE_MORE:
+                self.last_used = time.monotonic()
+                return status, b"".join(parts).decode(errors="replace")
+
+    def close(self):
+        try:
+            self.sock.close()
+        except OSError:
+            pass
+
 
 class WalletClient:
-    def __init__(self, host='localhost', port=8080):
+    """Thread-safe client with a pool of persistent connections.
+
+    The session is the client's, not a socket's: after LOGIN the token is kept,
+    and any other pooled connection resumes it before its next command."""
+
+    def __init__(self, host='localhost', port=8080, pool_size=POOL_SIZE, secure=True):
         self.host = host
         self.port = port
-        self.sock = None
+        self.pool_size = pool_size
+        self.secure = secure
+        self.idle = []
+        self.lock = threading.Lock()
+        self.token = None
 
     def connect(self):
-        if not self.sock:
-            self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-            self.sock.connect((self.host, self.port))
+        """Open a connection up front so the first command does not wait for it."""
+        self._checkin(self._checkout())
 
     def disconnect(self):
-        if self.sock:
-            self.sock.close()
-            self.sock = None
+        with self.lock:
+            idle, self.idle = self.idle, []
+        for conn in idle:
+            conn.close()
+
+    def _checkout(self):
+        with self.lock:
+            while self.idle:
+                conn = self.idle.pop()
+                if conn.alive():
+                    return conn
+                conn.close()
+        return Connection(self.host, self.port, self.secure)
+
+    def _checkin(self, conn):
+        with self.lock:
+            if len(self.idle) < self.pool_size:
+                self.idle.append(conn)
+                return
+        conn.close()
+
+    def request(self, opcode, fields=b""):
+        """Run one request on a pooled connection; returns (status, text)."""
+        conn = self._checkout()
+        try:
+            token = self.token
+            if token and conn.token != token and opcode not in (OP_SIGNUP, OP_LOGIN, OP_RESUME):
+                status, text = conn.request(OP_RESUME, token.encode())
+                if status != WIRE_OK:
+                    self.token = None
+                    conn.close()
+                    return status, text
+                conn.token = token
+
+            status, text = conn.request(opcode, fields)
+        except Exception:
+            conn.close()
+            raise
+
+        if opcode == OP_LOGIN and status == WIRE_OK:
+            self.token = conn.token = _token_of(text)
+        if opcode == OP_LOGOUT:
+            # The other sockets still hold the old session; never reuse them
+            self.token = None
+            conn.close()
+            self.disconnect()
+            return status, text
+        self._checkin(conn)
+        return status, text
 
     def send_command(self, command):
         try:
-            if not self.sock:
-                self.connect()
-            self.sock.sendall(command.encode())
-            response = self.sock.recv(4096).decode()
-            return response
+            opcode, fields = encode_command(command)
+            return self.request(opcode, fields)[1]
         except Exception as e:
             return f"[ERROR] {str(e)}"
 
@@ -36,4 +324,128 @@ class WalletClient:
                 response = self.send_command(cmd)
                 print(response)
         finally:
-            self.disconnect()
\ No newline at end of file
+            self.disconnect()
+
+
+class AsyncWalletClient:
+    """Pipelined asyncio client on one connection.
+
+        client = AsyncWalletClient()
+        await client.connect()
+        await client.command("LOGIN alice pw")
+        balances = await asyncio.gather(*(client.command("BALANCE") for _ in range(100)))
+
+    Requests are written without waiting for earlier replies; the ones made in
+    one pass of the event loop go out together in one write (and, encrypted, in
+    one record). Up to MAX_PIPELINE are in flight and later ones wait for a
+    slot. The session belongs to this connection."""
+
+    def __init__(self, host='localhost', port=8080, secure=True):
+        self.host = host
+        self.port = port
+        self.secure = secure
+        self.channel = None
+        self.buffer = bytearray()  # opened plaintext not yet read
+        self.unsent = []           # frames to write together at the end of this loop pass
+        self.reader = self.writer = None
+        self.pending = {}  # request_id -> (future, parts)
+        self.ids = itertools.count(1)
+        self.slots = None
+        self.read_task = None
+
+    async def connect(self):
+        self.reader, self.writer = await asyncio.wait_for(
+            asyncio.open_connection(self.host, self.port), CONNECT_TIMEOUT)
+        sock = self.writer.get_extra_info("socket")
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_KEEPALIVE, 1)
+        if self.secure:
+            channel = SecureChannel()
+            self.writer.write(WIRE_SECURE_MAGIC + channel.public_key)
+            reply = await self.reader.readexactly(len(WIRE_SECURE_MAGIC) + WIRE_KEY_SIZE)
+            if reply[:len(WIRE_SECURE_MAGIC)] != WIRE_SECURE_MAGIC:
+                self.writer.close()
+                raise WalletError("The server does not speak the encrypted protocol")
+            channel.accept(reply[len(WIRE_SECURE_MAGIC):])
+            self.channel = channel
+        else:
+            self.writer.write(WIRE_MAGIC)
+            if await self.reader.readexactly(len(WIRE_MAGIC)) != WIRE_MAGIC:
+                self.writer.close()
+                raise WalletError("The server does not speak the binary protocol")
+        self.slots = asyncio.Semaphore(MAX_PIPELINE)
+        self.read_task = asyncio.create_task(self._read_replies())
+
+    async def _read(self, size):
+        if not self.channel:
+            return await self.reader.readexactly(size)
+        while len(self.buffer) < size:
+            header = await self.reader.readexactly(RECORD_HEADER.size)
+            (length,) = RECORD_HEADER.unpack(header)
+            self.buffer += self.channel.open(header, await self.reader.readexactly(length))
+        data = bytes(self.buffer[:size])
+        del self.buffer[:size]
+        return data
+
+    def _send(self, frame):
+        if not self.unsent:
+            asyncio.get_running_loop().call_soon(self._flush)
+        self.unsent.append(frame)
+
+    def _flush(self):
+        data, self.unsent = b"".join(self.unsent), []
+        if not self.writer.is_closing():
+            self.writer.write(self.channel.seal(data) if self.channel else data)
+
+    async def _read_replies(self):
+        error = ConnectionError("Server closed the connection")
+        try:
+            while True:
+                length, reply_id, status = HEADER.unpack(await self._read(HEADER.size))
+                body = await self._read(length - (HEADER.size - 4))
+                waiting = self.pending.get(reply_id)
+                if not waiting:
+                    raise WalletError(f"Reply to request {reply_id} that was never sent")
+                future, parts = waiting
+                parts.append(body)
+                if status == WIRE_MORE:
+                    continue
+                del self.pending[reply_id]
+                if not future.done():
+                    future.set_result((status, b"".join(parts).decode(errors="replace")))
+        except asyncio.IncompleteReadError:
+            pass
+        except Exception as e:
+            error = e
+        for future, _ in self.pending.values():
+            if not future.done():
+                future.set_exception(error)
+        self.pending.clear()
+
+    async def request(self, opcode, fields=b""):
+        """Send one request and wait for its (status, text)."""
+        async with self.slots:
+            if self.read_task.done():
+                raise ConnectionError("Connection closed")
+            request_id = next(self.ids) & 0xFFFFFFFF
+            future = asyncio.get_running_loop().create_future()
+            self.pending[request_id] = (future, [])
+            self._send(_frame(request_id, opcode, fields))
+            if self.writer.transport.get_write_buffer_size() > 65536:
+                await self.writer.drain()
+            return await future
+
+    async def command(self, command):
+        """A text command, as WalletClient.send_command takes it; returns the reply text."""
+        opcode, fields = encode_command(command)
+        return (await self.request(opcode, fields))[1]
+
+    async def close(self):
+        if self.writer:
+            self.writer.close()
+            try:
+                await self.writer.wait_closed()
+            except (ConnectionError, OSError):
+                pass
+        if self.read_task:
+            await asyncio.gather(self.read_task, return_exceptions=True)
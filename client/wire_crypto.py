@@ -0,0 +1,222 @@
+"""The client's end of the encrypted binary protocol (server/wire_crypto.h): an
+ephemeral X25519 key exchange, HKDF-SHA256 over the shared secret, then
+AES-256-GCM records with a key and nonce counter per direction.
+
+X25519 and AES-GCM come from OpenSSL's libcrypto, the library the server links,
+through ctypes. Each direction keeps one cipher context with its key schedule
+and only sets a new nonce per record, which makes a small record cost a few
+microseconds rather than a fresh key setup.
+"""
+
+import ctypes
+import ctypes.util
+import hashlib
+import hmac
+import struct
+
+# Mirrors server/protocol.h
+WIRE_KEY_SIZE = 32  # X25519 public key
+WIRE_SECURE_INFO = b"wallet wire v1"
+RECORD_HEADER = struct.Struct(">I")  # length of the ciphertext and tag
+WIRE_TAG_SIZE = 16
+WIRE_MAX_RECORD = 65536  # largest record the server takes
+
+KEY_SIZE = 32  # AES-256
+IV_SIZE = 12
+
+EVP_PKEY_X25519 = 1034
+EVP_CTRL_GCM_GET_TAG = 0x10
+EVP_CTRL_GCM_SET_TAG = 0x11
+
+LIBCRYPTO_NAMES = ("libcrypto.so.3", "libcrypto.so.1.1", "libcrypto.dylib",
+                   "/opt/homebrew/opt/openssl@3/lib/libcrypto.dylib",
+                   "/usr/local/opt/openssl@3/lib/libcrypto.dylib")
+
+
+class ChannelError(Exception):
+    pass
+
+
+def _load_libcrypto():
+    names = [ctypes.util.find_library("crypto"), *LIBCRYPTO_NAMES]
+    for name in filter(None, names):
+        try:
+            lib = ctypes.CDLL(name)
+            break
+        except OSError:
+            continue
+    else:
+        return None
+
+    ptr, size, integer = ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int
+    signatures = {
+        "EVP_PKEY_CTX_new_id": (ptr, [integer, ptr]),
+        "EVP_PKEY_CTX_new": (ptr, [ptr, ptr]),
+        "EVP_PKEY_CTX_free": (None, [ptr]),
+        "EVP_PKEY_keygen_init": (integer, [ptr]),
+        "EVP_PKEY_keygen": (integer, [ptr, ctypes.POINTER(ptr)]),
+        "EVP_PKEY_get_raw_public_key": (integer, [ptr, ctypes.c_char_p, ctypes.POINTER(size)]),
+        "EVP_PKEY_new_raw_public_key": (ptr, [integer, ptr, ctypes.c_char_p, size]),
+        "EVP_PKEY_free": (None, [ptr]),
+        "EVP_PKEY_derive_init": (integer, [ptr]),
+        "EVP_PKEY_derive_set_peer": (integer, [ptr, ptr]),
+        "EVP_PKEY_derive": (integer, [ptr, ctypes.c_char_p, ctypes.POINTER(size)]),
+        "EVP_aes_256_gcm": (ptr, []),
+        "EVP_CIPHER_CTX_new": (ptr, []),
+        "EVP_CIPHER_CTX_free": (None, [ptr]),
+        "EVP_CipherInit_ex": (integer, [ptr, ptr, ptr, ctypes.c_char_p, ctypes.c_char_p, integer]),
+        "EVP_CipherUpdate": (integer, [ptr, ptr, ctypes.POINTER(integer), ctypes.c_char_p, integer]),
+        "EVP_CipherFinal_ex": (integer, [ptr, ptr, ctypes.POINTER(integer)]),
+        "EVP_CIPHER_CTX_ctrl": (integer, [ptr, integer, integer, ptr]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(lib, name)
+        function.restype = restype
+        function.argtypes = argtypes
+    return lib
+
+
+_lib = _load_libcrypto()
+
+
+def _hkdf_sha256(secret, salt, info, length):
+    # RFC 5869
+    prk = hmac.new(salt, secret, hashlib.sha256).digest()
+    out, block = b"", b""
+    for counter in range(1, -(-length // hashlib.sha256().digest_size) + 1):
+        block = hmac.new(prk, block + info + bytes([counter]), hashlib.sha256).digest()
+        out += block
+    return out[:length]
+
+
+class _Direction:
+    """One direction of a channel: the key lives in the context, set up once."""
+
+    def __init__(self, key, iv, encrypt):
+        self.ctx = _lib.EVP_CIPHER_CTX_new()
+        self.iv = int.from_bytes(iv, "big")
+        self.records = 0  # sealed or opened so far; the nonce counter
+        self.length = ctypes.c_int()  # output length OpenSSL reports, never needed
+        self.length_ref = ctypes.byref(self.length)
+        if not self.ctx or _lib.EVP_CipherInit_ex(self.ctx, _lib.EVP_aes_256_gcm(), None, key, None,
+                                                  1 if encrypt else 0) <= 0:
+            raise ChannelError("Cannot set up AES-256-GCM")
+
+    def begin(self, header):
+        # The IV with the record counter XORed into its last 8 bytes
+        nonce = (self.iv ^ self.records).to_bytes(IV_SIZE, "big")
+        self.records += 1
+        return (_lib.EVP_CipherInit_ex(self.ctx, None, None, None, nonce, -1) > 0 and
+                _lib.EVP_CipherUpdate(self.ctx, None, self.length_ref, header, len(header)) > 0)
+
+    def free(self):
+        if self.ctx:
+            _lib.EVP_CIPHER_CTX_free(self.ctx)
+            self.ctx = None
+
+
+class SecureChannel:
+    """Start a handshake with a fresh key pair; send public_key, then pass the
+    server's key to accept(). A channel belongs to one connection."""
+
+    def __init__(self):
+        if not _lib:
+            raise ChannelError("Encrypted connections need OpenSSL's libcrypto")
+        self.key = ctypes.c_void_p()
+        self.seal_dir = self.open_dir = None
+
+        ctx = _lib.EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, None)
+        public_key = ctypes.create_string_buffer(WIRE_KEY_SIZE)
+        length = ctypes.c_size_t(WIRE_KEY_SIZE)
+        success = (ctx and _lib.EVP_PKEY_keygen_init(ctx) > 0 and
+                   _lib.EVP_PKEY_keygen(ctx, ctypes.byref(self.key)) > 0 and
+                   _lib.EVP_PKEY_get_raw_public_key(self.key, public_key, ctypes.byref(length)) > 0 and
+                   length.value == WIRE_KEY_SIZE)
+        _lib.EVP_PKEY_CTX_free(ctx)
+        if not success:
+            self.close()
+            raise ChannelError("Cannot make an X25519 key")
+        self.public_key = public_key.raw
+
+    def _shared_secret(self, server_public):
+        peer = _lib.EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, None, server_public, WIRE_KEY_SIZE)
+        ctx = _lib.EVP_PKEY_CTX_new(self.key, None) if peer else None
+        secret = ctypes.create_string_buffer(WIRE_KEY_SIZE)
+        length = ctypes.c_size_t(WIRE_KEY_SIZE)
+        success = (ctx and _lib.EVP_PKEY_derive_init(ctx) > 0 and
+                   _lib.EVP_PKEY_derive_set_peer(ctx, peer) > 0 and
+                   _lib.EVP_PKEY_derive(ctx, secret, ctypes.byref(length)) > 0 and
+                   length.value == WIRE_KEY_SIZE)
+        _lib.EVP_PKEY_CTX_free(ctx)
+        _lib.EVP_PKEY_free(peer)
+
+        # A low-order server key makes the secret all zeros, whatever our key was
+        if not success or secret.raw == bytes(WIRE_KEY_SIZE):
+            raise ChannelError("The server's key gives no usable secret")
+        return secret.raw
+
+    def accept(self, server_public):
+        """Finish the handshake and derive the key and IV for each direction."""
+        if len(server_public) != WIRE_KEY_SIZE:
+            raise ChannelError("Malformed server key")
+        try:
+            secret = self._shared_secret(server_public)
+        finally:
+            _lib.EVP_PKEY_free(self.key)
+            self.key = ctypes.c_void_p()
+
+        # c2s key | c2s IV | s2c key | s2c IV
+        keys = _hkdf_sha256(secret, self.public_key + server_public, WIRE_SECURE_INFO, 2 * (KEY_SIZE + IV_SIZE))
+        s2c = KEY_SIZE + IV_SIZE
+        self.seal_dir = _Direction(keys[:KEY_SIZE], keys[KEY_SIZE:s2c], True)
+        self.open_dir = _Direction(keys[s2c:s2c + KEY_SIZE], keys[s2c + KEY_SIZE:], False)
+
+    def seal(self, data):
+        """Encrypt data as records, split where the server's record limit needs it."""
+        records = []
+        direction = self.seal_dir
+        ctx, length = direction.ctx, direction.length_ref
+        step = WIRE_MAX_RECORD - WIRE_TAG_SIZE
+        for start in range(0, len(data), step):
+            piece = bytes(data[start:start + step]) if len(data) > step else bytes(data)
+            size = len(piece)
+            header = RECORD_HEADER.pack(size + WIRE_TAG_SIZE)
+            record = ctypes.create_string_buffer(size + WIRE_TAG_SIZE)
+            if not (direction.begin(header) and
+                    _lib.EVP_CipherUpdate(ctx, record, length, piece, size) > 0 and
+                    _lib.EVP_CipherFinal_ex(ctx, record, length) > 0 and
+                    _lib.EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, WIRE_TAG_SIZE,
+                                             ctypes.byref(record, size)) > 0):
+                raise ChannelError("Cannot seal a record")
+            records += (header, record.raw)
+        return b"".join(records)
+
+    def open(self, header, body):
+        """Decrypt one record from the server: its header, then ciphertext and
+        tag. Fails for a record that does not authenticate."""
+        if len(body) < WIRE_TAG_SIZE:
+            raise ChannelError("Malformed record from the server")
+        size = len(body) - WIRE_TAG_SIZE
+        plain = ctypes.create_string_buffer(max(size, 1))
+        tag = ctypes.create_string_buffer(body[size:], WIRE_TAG_SIZE)
+        direction = self.open_dir
+        ctx, length = direction.ctx, direction.length_ref
+        if not (ctx and direction.begin(header) and
+                _lib.EVP_CipherUpdate(ctx, plain, length, body, size) > 0 and
+                _lib.EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, WIRE_TAG_SIZE, tag) > 0 and
+                _lib.EVP_CipherFinal_ex(ctx, plain, length) > 0):
+            self.open_dir.free()  # the stream is out of step from here on
+            raise ChannelError("A record from the server failed authentication")
+        return plain.raw[:size]
+
+    def close(self):
+        if self.key:
+            _lib.EVP_PKEY_free(self.key)
+            self.key = ctypes.c_void_p()
+        for direction in (self.seal_dir, self.open_dir):
+            if direction:
+                direction.free()
+
+    def __del__(self):
+        if _lib:
+            self.close()
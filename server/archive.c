@@ -0,0 +1,674 @@
+#include "archive.h"
+#include "db.h"
+#include "journal.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SEGMENT_MAGIC "WSEG"
+#define SEGMENT_HEADER_SIZE 64
+#define SEGMENT_COLUMNS 5
+#define BLOOM_BITS_PER_USER 10  // about 1% false positives with 7 hashes
+#define BLOOM_HASHES 7
+#define BLOOM_MIN_BYTES 64
+#define VARINT_MAX 10
+#define PATH_SIZE 512
+
+enum column { COLUMN_TIMESTAMP, COLUMN_ID, COLUMN_SENDER, COLUMN_RECEIVER, COLUMN_AMOUNT };
+
+// A loaded segment; the file stays mapped and the page cache decides what is in memory
+struct segment {
+    int64_t id;
+    uint32_t rows;
+    int64_t min_timestamp, max_timestamp;
+    unsigned char *map;
+    size_t size;
+    const unsigned char *bloom;
+    uint32_t bloom_bytes;
+    const unsigned char *columns[SEGMENT_COLUMNS];
+    uint32_t column_bytes[SEGMENT_COLUMNS];
+    uint32_t body_crc;
+    _Atomic int verified;  // 1 once the body crc has passed, -1 if it failed
+};
+
+// Sorted newest max_timestamp first, so a query can stop at the first one too old.
+// Segments are only ever added; readers hold the lock for a whole query.
+static pthread_rwlock_t segments_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct segment **segments = NULL;
+static int segment_count = 0;
+static int segment_capacity = 0;
+static int64_t archived_rows = 0;
+static int64_t next_segment_id = 1;
+
+static int hot_seconds = 0;
+static int rows_per_segment = 0;
+static int check_interval = 0;
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static unsigned char *put_varint(unsigned char *p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    return p;
+}
+
+// NULL if the column ends mid-number
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint64_t *value) {
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// splitmix64's finalizer; user ids are sequential, so they need spreading out
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static void bloom_add(unsigned char *bloom, uint32_t bytes, int64_t user) {
+    uint64_t h = mix((uint64_t)user);
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1, mask = bytes * 8 - 1;
+    for (uint32_t i = 0; i < BLOOM_HASHES; i++) {
+        uint32_t bit = (h1 + i * h2) & mask;
+        bloom[bit >> 3] |= (unsigned char)(1 << (bit & 7));
+    }
+}
+
+static int bloom_has(const unsigned char *bloom, uint32_t bytes, int64_t user) {
+    uint64_t h = mix((uint64_t)user);
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1, mask = bytes * 8 - 1;
+    for (uint32_t i = 0; i < BLOOM_HASHES; i++) {
+        uint32_t bit = (h1 + i * h2) & mask;
+        if (!(bloom[bit >> 3] & (1 << (bit & 7)))) return 0;
+    }
+    return 1;
+}
+
+// (timestamp, id) order, which is the order HISTORY pages in
+static int newer(const struct archive_row *a, const struct archive_row *b) {
+    return a->timestamp > b->timestamp || (a->timestamp == b->timestamp && a->id > b->id);
+}
+
+static int compare_oldest_first(const void *a, const void *b) {
+    const struct archive_row *x = a, *y = b;
+    return newer(x, y) ? 1 : newer(y, x) ? -1 : 0;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void segment_path(char *path, size_t size, int64_t id, const char *suffix) {
+    snprintf(path, size, "%s/%016llx.wseg%s", ARCHIVE_DIR, (unsigned long long)id, suffix);
+}
+
+// Encode rows, sorted oldest first, as a segment file. Returns a malloc'd buffer.
+static unsigned char *encode_segment(const struct archive_row *rows, int count, size_t *size) {
+    // Size the bloom filter for the distinct users on either side
+    int64_t *users = malloc(2 * (size_t)count * sizeof(int64_t));
+    if (!users) return NULL;
+    for (int i = 0; i < count; i++) {
+        users[2 * i] = rows[i].sender_id;
+        users[2 * i + 1] = rows[i].receiver_id;
+    }
+    qsort(users, 2 * (size_t)count, sizeof(int64_t), compare_ids);
+    int distinct = 0;
+    for (int i = 0; i < 2 * count; i++)
+        if (i == 0 || users[i] != users[i - 1]) users[distinct++] = users[i];
+
+    uint32_t bloom_bytes = BLOOM_MIN_BYTES;
+    while ((uint64_t)bloom_bytes * 8 < (uint64_t)distinct * BLOOM_BITS_PER_USER) bloom_bytes <<= 1;
+
+    size_t capacity = SEGMENT_HEADER_SIZE + bloom_bytes + (size_t)count * SEGMENT_COLUMNS * VARINT_MAX;
+    unsigned char *buffer = calloc(1, capacity);
+    if (!buffer) {
+        free(users);
+        return NULL;
+    }
+
+    unsigned char *body = buffer + SEGMENT_HEADER_SIZE;
+    for (int i = 0; i < distinct; i++) bloom_add(body, bloom_bytes, users[i]);
+    free(users);
+
+    uint32_t column_bytes[SEGMENT_COLUMNS];
+    unsigned char *p = body + bloom_bytes;
+    for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+        unsigned char *start = p;
+        for (int i = 0; i < count; i++) {
+            const struct archive_row *r = &rows[i];
+            switch (c) {
+            case COLUMN_TIMESTAMP:
+                p = put_varint(p, (uint64_t)(i == 0 ? r->timestamp : r->timestamp - rows[i - 1].timestamp));
+                break;
+            case COLUMN_ID:
+                p = put_varint(p, zigzag(i == 0 ? r->id : r->id - rows[i - 1].id));
+                break;
+            case COLUMN_SENDER:
+                p = put_varint(p, (uint64_t)r->sender_id);
+                break;
+            case COLUMN_RECEIVER:
+                p = put_varint(p, (uint64_t)r->receiver_id);
+                break;
+            default:
+                p = put_varint(p, zigzag(r->amount));
+                break;
+            }
+        }
+        column_bytes[c] = (uint32_t)(p - start);
+    }
+
+    size_t body_size = (size_t)(p - body);
+    unsigned char *h = buffer;
+    memcpy(h, SEGMENT_MAGIC, 4);
+    put_u32(h + 4, ARCHIVE_VERSION);
+    put_u32(h + 8, (uint32_t)count);
+    put_u32(h + 12, bloom_bytes);
+    put_u64(h + 16, (uint64_t)rows[0].timestamp);
+    put_u64(h + 24, (uint64_t)rows[count - 1].timestamp);
+    for (int c = 0; c < SEGMENT_COLUMNS; c++) put_u32(h + 32 + 4 * c, column_bytes[c]);
+    put_u32(h + 52, journal_crc32c(0, body, body_size));
+    put_u32(h + 56, journal_crc32c(0, h, 56));
+
+    *size = SEGMENT_HEADER_SIZE + body_size;
+    return buffer;
+}
+
+// fsync the archive directory, so a rename in it is durable
+static int sync_dir() {
+    int fd = open(ARCHIVE_DIR, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+static int write_segment(int64_t id, const unsigned char *data, size_t size) {
+    char path[PATH_SIZE], tmp_path[PATH_SIZE];
+    segment_path(path, sizeof(path), id, "");
+    segment_path(tmp_path, sizeof(tmp_path), id, ".tmp");
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int ok = fd >= 0;
+    for (size_t done = 0; ok && done < size;) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) done += (size_t)n;
+    }
+    if (fd >= 0) {
+        ok = ok && fsync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+    }
+    if (!ok || rename(tmp_path, path) != 0 || !sync_dir()) {
+        log_error("Cannot write archive segment %s: %s", path, strerror(errno));
+        unlink(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Map a segment and check its header; the body is checked on first use
+static struct segment *load_segment(int64_t id) {
+    char path[PATH_SIZE];
+    segment_path(path, sizeof(path), id, "");
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SEGMENT_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    struct segment *s = calloc(1, sizeof(*s));
+    const unsigned char *h = map;
+    int ok = s && memcmp(h, SEGMENT_MAGIC, 4) == 0 && get_u32(h + 4) == ARCHIVE_VERSION &&
+             get_u32(h + 56) == journal_crc32c(0, h, 56);
+    if (ok) {
+        s->id = id;
+        s->map = map;
+        s->size = size;
+        s->rows = get_u32(h + 8);
+        s->bloom_bytes = get_u32(h + 12);
+        s->min_timestamp = (int64_t)get_u64(h + 16);
+        s->max_timestamp = (int64_t)get_u64(h + 24);
+        s->body_crc = get_u32(h + 52);
+        s->bloom = map + SEGMENT_HEADER_SIZE;
+
+        // The filter must be a power of two and the columns must fill the rest of the file
+        uint64_t expected = SEGMENT_HEADER_SIZE + (uint64_t)s->bloom_bytes;
+        ok = s->bloom_bytes >= BLOOM_MIN_BYTES && (s->bloom_bytes & (s->bloom_bytes - 1)) == 0;
+        const unsigned char *column = s->bloom + s->bloom_bytes;
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            s->column_bytes[c] = get_u32(h + 32 + 4 * c);
+            s->columns[c] = column;
+            column += s->column_bytes[c];
+            expected += s->column_bytes[c];
+        }
+        ok = ok && expected == size;
+    }
+    if (!ok) {
+        munmap(map, size);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void unload_segment(struct segment *s) {
+    munmap(s->map, s->size);
+    free(s);
+}
+
+static int verify_segment(struct segment *s) {
+    if (s->verified == 0) {
+        size_t body = s->size - SEGMENT_HEADER_SIZE;
+        s->verified = journal_crc32c(0, s->map + SEGMENT_HEADER_SIZE, body) == s->body_crc ? 1 : -1;
+        if (s->verified < 0) log_error("Archive segment %016llx is damaged; HISTORY cannot read it",
+                                       (unsigned long long)s->id);
+    }
+    return s->verified > 0;
+}
+
+// Caller holds segments_lock for writing
+static int add_segment(struct segment *s) {
+    if (segment_count == segment_capacity) {
+        int capacity = segment_capacity ? segment_capacity * 2 : 64;
+        struct segment **grown = realloc(segments, capacity * sizeof(*grown));
+        if (!grown) return 0;
+        segments = grown;
+        segment_capacity = capacity;
+    }
+    int i = segment_count++;
+    while (i > 0 && segments[i - 1]->max_timestamp < s->max_timestamp) {
+        segments[i] = segments[i - 1];
+        i--;
+    }
+    segments[i] = s;
+    return 1;
+}
+
+static void remove_segment(struct segment *s) {
+    pthread_rwlock_wrlock(&segments_lock);
+    for (int i = 0; i < segment_count; i++) {
+        if (segments[i] != s) continue;
+        memmove(&segments[i], &segments[i + 1], (segment_count - i - 1) * sizeof(*segments));
+        segment_count--;
+        break;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+}
+
+// Put row into the page, newest first, dropping whatever falls off the end
+static void merge_row(struct archive_row *rows, int *count, int max, const struct archive_row *row) {
+    int n = *count;
+    if (n == max && !newer(row, &rows[n - 1])) return;
+
+    int pos = n;
+    while (pos > 0 && newer(row, &rows[pos - 1])) pos--;
+    if (pos > 0 && rows[pos - 1].id == row->id) return;  // also read from the table mid-move
+
+    if (n == max) n--;
+    memmove(&rows[pos + 1], &rows[pos], (n - pos) * sizeof(*rows));
+    rows[pos] = *row;
+    *count = n + 1;
+}
+
+static int scan_segment(struct segment *s, int64_t user_id, const struct archive_row *before,
+                        struct archive_row *rows, int *count, int max) {
+    if (!verify_segment(s)) return 0;
+
+    const unsigned char *p[SEGMENT_COLUMNS], *end[SEGMENT_COLUMNS];
+    for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+        p[c] = s->columns[c];
+        end[c] = p[c] + s->column_bytes[c];
+    }
+
+    struct archive_row row = {0};
+    for (uint32_t i = 0; i < s->rows; i++) {
+        uint64_t v[SEGMENT_COLUMNS];
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            p[c] = get_varint(p[c], end[c], &v[c]);
+            if (!p[c]) {
+                s->verified = -1;
+                log_error("Archive segment %016llx is damaged; HISTORY cannot read it",
+                          (unsigned long long)s->id);
+                return 0;
+            }
+        }
+        row.timestamp = i == 0 ? (int64_t)v[COLUMN_TIMESTAMP] : row.timestamp + (int64_t)v[COLUMN_TIMESTAMP];
+        row.id += unzigzag(v[COLUMN_ID]);
+        row.sender_id = (int64_t)v[COLUMN_SENDER];
+        row.receiver_id = (int64_t)v[COLUMN_RECEIVER];
+        row.amount = unzigzag(v[COLUMN_AMOUNT]);
+
+        if (!newer(before, &row)) break;  // oldest first, so the rest are past the cursor too
+        if (row.sender_id == user_id || row.receiver_id == user_id) merge_row(rows, count, max, &row);
+    }
+    return 1;
+}
+
+int archive_history(int64_t user_id, int64_t before_timestamp, int64_t before_id,
+                    struct archive_row *rows, int *count, int max) {
+    struct archive_row before = {.id = before_id, .timestamp = before_timestamp};
+    int success = 1;
+
+    pthread_rwlock_rdlock(&segments_lock);
+    for (int i = 0; i < segment_count && max > 0; i++) {
+        struct segment *s = segments[i];
+
+        // Everything from here on is older than a full page
+        if (*count == max && rows[max - 1].timestamp > s->max_timestamp) break;
+        if (s->min_timestamp > before_timestamp) continue;
+        if (!bloom_has(s->bloom, s->bloom_bytes, user_id)) continue;
+        if (!scan_segment(s, user_id, &before, rows, count, max)) success = 0;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+    return success;
+}
+
+int64_t archive_rows() {
+    pthread_rwlock_rdlock(&segments_lock);
+    int64_t rows = archived_rows;
+    pthread_rwlock_unlock(&segments_lock);
+    return rows;
+}
+
+int archive_segments() {
+    pthread_rwlock_rdlock(&segments_lock);
+    int count = segment_count;
+    pthread_rwlock_unlock(&segments_lock);
+    return count;
+}
+
+static int run_statement(int shard, enum db_statement id) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, id);
+    if (!stmt) return 0;
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Delete the rows, credit their senders' archived counts and record the segment,
+// all in one commit to the shard they came from. The stats total is put back,
+// since the rows still count.
+static int commit_move(int shard, int64_t id, struct archive_row *rows, int count) {
+    if (!run_statement(shard, STMT_BEGIN)) return 0;
+    int success = 1;
+
+    for (int i = 0; success && i < count; i++) {
+        sqlite3_stmt *stmt = db_shard_statement(shard, STMT_DELETE_TRANSACTION);
+        success = stmt != NULL;
+        if (!success) break;
+        sqlite3_bind_int64(stmt, 1, rows[i].id);
+        success = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(db_shard_handle(shard)) == 1;
+        sqlite3_reset(stmt);
+    }
+
+    // One upsert per sender
+    int64_t *senders = success ? malloc((size_t)count * sizeof(int64_t)) : NULL;
+    success = senders != NULL;
+    for (int i = 0; success && i < count; i++) senders[i] = rows[i].sender_id;
+    if (success) qsort(senders, (size_t)count, sizeof(int64_t), compare_ids);
+    for (int i = 0; success && i < count;) {
+        int run = 1;
+        while (i + run < count && senders[i + run] == senders[i]) run++;
+        sqlite3_stmt *stmt = db_shard_statement(shard, STMT_ARCHIVE_SENDER);
+        success = stmt != NULL;
+        if (!success) break;
+        sqlite3_bind_int64(stmt, 1, senders[i]);
+        sqlite3_bind_int64(stmt, 2, run);
+        success = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+        i += run;
+    }
+    free(senders);
+
+    sqlite3_stmt *stmt = success ? db_shard_statement(shard, STMT_ADJUST_STAT) : NULL;
+    if (stmt) {
+        sqlite3_bind_text(stmt, 1, "transactions", -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, count);
+        success = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    } else {
+        success = 0;
+    }
+
+    stmt = success ? db_shard_statement(shard, STMT_ADD_SEGMENT) : NULL;
+    if (stmt) {
+        sqlite3_bind_int64(stmt, 1, id);
+        sqlite3_bind_int(stmt, 2, count);
+        sqlite3_bind_int64(stmt, 3, rows[0].timestamp);
+        sqlite3_bind_int64(stmt, 4, rows[count - 1].timestamp);
+        success = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    } else {
+        success = 0;
+    }
+
+    if (!success || !run_statement(shard, STMT_COMMIT)) {
+        log_error("Archive move failed: %s", sqlite3_errmsg(db_shard_handle(shard)));
+        run_statement(shard, STMT_ROLLBACK);
+        return 0;
+    }
+    return 1;
+}
+
+// Move one segment's worth of a shard's rows older than cutoff. Returns 1 if it
+// did, 0 if there were too few, -1 on an error.
+static int archive_once(int shard, int64_t cutoff, struct archive_row *rows) {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    // Rows are inserted roughly in time order, so the oldest have the lowest ids
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_ARCHIVE_CANDIDATES);
+    if (!stmt) return -1;
+    sqlite3_bind_int64(stmt, 1, cutoff);
+    sqlite3_bind_int(stmt, 2, rows_per_segment);
+    int count = 0, rc;
+    while (count < rows_per_segment && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        struct archive_row *r = &rows[count++];
+        r->id = sqlite3_column_int64(stmt, 0);
+        r->timestamp = sqlite3_column_int64(stmt, 1);
+        r->sender_id = sqlite3_column_int64(stmt, 2);
+        r->receiver_id = sqlite3_column_int64(stmt, 3);
+        r->amount = sqlite3_column_int64(stmt, 4);
+    }
+    sqlite3_reset(stmt);
+    if (count < rows_per_segment) return 0;
+
+    qsort(rows, (size_t)count, sizeof(*rows), compare_oldest_first);
+    size_t size;
+    unsigned char *data = encode_segment(rows, count, &size);
+    int64_t id = next_segment_id;
+    int written = data && write_segment(id, data, size);
+    free(data);
+    struct segment *s = written ? load_segment(id) : NULL;
+    if (!s) return -1;
+
+    // Readers see the segment before the rows leave the table; they skip the doubles
+    pthread_rwlock_wrlock(&segments_lock);
+    int added = add_segment(s);
+    pthread_rwlock_unlock(&segments_lock);
+
+    char path[PATH_SIZE];
+    segment_path(path, sizeof(path), id, "");
+    if (!added || !commit_move(shard, id, rows, count)) {
+        if (added) remove_segment(s);
+        unload_segment(s);
+        unlink(path);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&segments_lock);
+    archived_rows += count;
+    pthread_rwlock_unlock(&segments_lock);
+    next_segment_id++;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    log_info("Archived %d transactions into %s (%zu bytes) in %.0f ms", count, path, size,
+             (now.tv_sec - started.tv_sec) * 1e3 + (now.tv_nsec - started.tv_nsec) / 1e6);
+    return 1;
+}
+
+static void *archiver_main(void *unused) {
+    (void)unused;
+    struct archive_row *rows = malloc((size_t)rows_per_segment * sizeof(*rows));
+    if (!rows) {
+        log_error("Archiver could not allocate %d rows", rows_per_segment);
+        return NULL;
+    }
+
+    while (1) {
+        for (int shard = 0; shard < db_shard_count(); shard++) {
+            while (archive_once(shard, (int64_t)time(NULL) - hot_seconds, rows) > 0) {
+                sleep(1);  // let the applier have the write lock between segments
+            }
+        }
+        sleep(check_interval);
+    }
+    return NULL;
+}
+
+// Whether name is <16 hex digits>.wseg or a leftover .tmp of one, and its id
+static int parse_segment_name(const char *name, int64_t *id) {
+    unsigned long long value;
+    int consumed = 0;
+    if (strlen(name) < 21 || sscanf(name, "%16llx.wseg%n", &value, &consumed) != 1 || consumed != 21) return 0;
+    if (strcmp(name + 21, "") != 0 && strcmp(name + 21, ".tmp") != 0) return 0;
+    *id = (int64_t)value;
+    return 1;
+}
+
+int archive_open() {
+    if (mkdir(ARCHIVE_DIR, 0700) != 0 && errno != EEXIST) {
+        printf("[ERROR] Cannot create %s: %s\n", ARCHIVE_DIR, strerror(errno));
+        return 0;
+    }
+
+    // Each shard lists the segments it moved out; ids are unique across them
+    int64_t *known = NULL;
+    int known_count = 0, known_capacity = 0;
+    for (int shard = 0; shard < db_shard_count(); shard++) {
+        sqlite3_stmt *stmt = db_shard_statement(shard, STMT_LIST_SEGMENTS);
+        if (!stmt) {
+            free(known);
+            return 0;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int64_t id = sqlite3_column_int64(stmt, 0);
+            int64_t rows = sqlite3_column_int64(stmt, 1);
+            archived_rows += rows;
+            if (id >= next_segment_id) next_segment_id = id + 1;
+
+            if (known_count == known_capacity) {
+                known_capacity = known_capacity ? known_capacity * 2 : 64;
+                known = realloc(known, known_capacity * sizeof(*known));
+                if (!known) break;
+            }
+            known[known_count++] = id;
+
+            struct segment *s = load_segment(id);
+            if (!s || !add_segment(s)) {
+                printf("[ERROR] Archive segment %016llx is missing or damaged; HISTORY cannot show its %lld transactions\n",
+                       (unsigned long long)id, (long long)rows);
+                if (s) unload_segment(s);
+            }
+        }
+        sqlite3_reset(stmt);
+        if (known_count > 0 && !known) break;
+    }
+    if (known_count > 0 && !known) {
+        printf("[ERROR] Out of memory loading the archive\n");
+        return 0;
+    }
+
+    // A file the table does not list is from a move that never committed
+    DIR *dir = opendir(ARCHIVE_DIR);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir))) {
+        int64_t id;
+        if (!parse_segment_name(entry->d_name, &id)) continue;
+        int listed = 0;
+        for (int i = 0; !listed && i < known_count; i++) listed = known[i] == id;
+        if (listed && !strstr(entry->d_name, ".tmp")) continue;
+
+        char path[PATH_SIZE];
+        snprintf(path, sizeof(path), "%s/%s", ARCHIVE_DIR, entry->d_name);
+        printf("[INFO] Removing %s, left by an archive move that did not commit\n", path);
+        unlink(path);
+    }
+    if (dir) closedir(dir);
+    free(known);
+
+    printf("[INFO] Archive holds %lld transactions in %d segments\n", (long long)archived_rows, segment_count);
+    return 1;
+}
+
+int archive_start(int hot_days, int segment_rows, int check_seconds) {
+    hot_seconds = (hot_days > 1 ? hot_days : 1) * 86400;
+    rows_per_segment = segment_rows > 0 ? segment_rows : 65536;
+    check_interval = check_seconds > 0 ? check_seconds : 3600;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, archiver_main, NULL) != 0) {
+        perror("Archiver thread creation failed");
+        return 0;
+    }
+    pthread_detach(thread);
+    return 1;
+}
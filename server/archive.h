@@ -0,0 +1,65 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+
+// Cold storage for old transactions. The transactions table keeps the recent
+// ones; a background thread moves rows older than the hot window into
+// immutable segment files of ARCHIVE_SEGMENT_ROWS, deleting them from the table
+// in the same commit that records the segment in archive_segments. Each
+// database shard archives its own rows. HISTORY reads the tables and the
+// segments together.
+//
+// Format, version 1. All integers are little-endian.
+//
+//   archive/<segment id as 16 hex digits>.wseg
+//
+//   header (64 bytes):
+//     "WSEG" | u32 version | u32 rows | u32 bloom bytes | i64 min_timestamp |
+//     i64 max_timestamp | u32 column bytes x 5 | u32 crc32c of the body |
+//     u32 crc32c of the 56 bytes before it | zeros
+//   body:
+//     bloom filter over the user ids on either side of a row, then the columns,
+//     rows sorted by (timestamp, id):
+//       timestamp    varint, the first absolute, then the increase over the row before
+//       id           zigzag varint of the difference from the row before
+//       sender_id    varint
+//       receiver_id  varint
+//       amount       zigzag varint, paise
+//
+// A query skips a segment whose timestamps are all past its cursor or whose
+// bloom filter rules its user out, and stops once the segments left are older
+// than the page it has.
+
+#define ARCHIVE_DIR "archive"
+#define ARCHIVE_VERSION 1
+
+// One transaction as HISTORY sees it
+struct archive_row {
+    int64_t id;
+    int64_t timestamp;
+    int64_t sender_id;
+    int64_t receiver_id;
+    int64_t amount;  // paise
+};
+
+// Load the segments archive_segments lists and delete files left by a move
+// that did not commit. Call once at startup on the main thread.
+int archive_open();
+
+// Move rows older than hot_days into segments of segment_rows, checking every
+// check_seconds; only whole segments are moved
+int archive_start(int hot_days, int segment_rows, int check_seconds);
+
+// Merge user's archived transactions before (before_timestamp, before_id) into
+// rows, which holds *count of at most max rows newest first, (timestamp, id)
+// descending. A row already there is not added twice. Returns 0 if a segment
+// could not be read.
+int archive_history(int64_t user_id, int64_t before_timestamp, int64_t before_id,
+                    struct archive_row *rows, int *count, int max);
+
+// Rows and segments archived so far
+int64_t archive_rows();
+int archive_segments();
+
+#endif
@@ -1,7 +0,0 @@
-#ifndef AUTH_H
-#define AUTH_H
-
-int signup_user(const char *username, const char *password);
-int login_user(const char *username, const char *password);
-
-#endif
\ No newline at end of file
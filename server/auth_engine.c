@@ -0,0 +1,89 @@
+#include "auth_engine.h"
+#include "pbkdf2_mb.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+// Each job needs HASH_SIZE / 32 chains, so this many jobs fill the SIMD lanes
+#define AUTH_BATCH (PBKDF2_MAX_LANES / ((HASH_SIZE + 31) / 32))
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static struct auth_job *queue_head = NULL;
+static struct auth_job *queue_tail = NULL;
+static int queued = 0;
+static int depth_limit = 1;
+
+static void *auth_main(void *unused) {
+    (void)unused;
+    struct auth_job *batch[AUTH_BATCH];
+    struct pbkdf2_job work[AUTH_BATCH];
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_head == NULL)
+            pthread_cond_wait(&queue_cond, &queue_lock);
+
+        int n = 0;
+        while (queue_head && n < AUTH_BATCH) {
+            batch[n++] = queue_head;
+            queue_head = queue_head->next;
+            queued--;
+        }
+        if (queue_head == NULL) queue_tail = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        uint64_t start = metrics_now();
+        for (int i = 0; i < n; i++) {
+            metrics_time(TIMER_PBKDF2_WAIT, start - batch[i]->queued_at);
+            work[i].password = batch[i]->password;
+            work[i].password_len = strlen(batch[i]->password);
+            work[i].salt = batch[i]->salt;
+            work[i].salt_len = SALT_SIZE;
+            work[i].out = batch[i]->derived;
+            work[i].out_len = HASH_SIZE;
+        }
+        pbkdf2_sha256_many(work, n, ITERATIONS);
+        metrics_time(TIMER_PBKDF2, metrics_now() - start);
+        metrics_count(COUNTER_PBKDF2_DERIVATIONS, n);
+
+        for (int i = 0; i < n; i++)
+            batch[i]->done(batch[i]);
+    }
+    return NULL;
+}
+
+int auth_engine_start(int threads, int queue_depth) {
+    depth_limit = queue_depth > 0 ? queue_depth : 1;
+
+    for (int i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, auth_main, NULL) != 0) {
+            perror("Auth engine thread creation failed");
+            return 0;
+        }
+        pthread_detach(thread);
+    }
+
+    printf("[INFO] Auth engine using %s PBKDF2 kernel\n", pbkdf2_kernel_name());
+    return 1;
+}
+
+int auth_engine_submit(struct auth_job *job) {
+    job->next = NULL;
+    job->queued_at = metrics_now();
+
+    pthread_mutex_lock(&queue_lock);
+    if (queued >= depth_limit) {
+        pthread_mutex_unlock(&queue_lock);
+        return 0;
+    }
+    if (queue_tail) queue_tail->next = job;
+    else queue_head = job;
+    queue_tail = job;
+    queued++;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    return 1;
+}
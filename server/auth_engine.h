@@ -0,0 +1,35 @@
+#ifndef AUTH_ENGINE_H
+#define AUTH_ENGINE_H
+
+#include <stdint.h>
+#include "db.h"
+
+#define AUTH_NAME_SIZE 100
+
+struct auth_job;
+
+// Called on an auth engine thread once job->derived holds the PBKDF2 output
+typedef void (*auth_done_fn)(struct auth_job *job);
+
+// One password derivation. LOGIN fills salt and expected from the users table;
+// SIGNUP fills a fresh salt and stores derived.
+struct auth_job {
+    char username[AUTH_NAME_SIZE];
+    char password[AUTH_NAME_SIZE];
+    unsigned char salt[SALT_SIZE];
+    unsigned char expected[HASH_SIZE];
+    unsigned char derived[HASH_SIZE];
+    auth_done_fn done;
+    void *ctx;
+    uint64_t queued_at;  // set by auth_engine_submit()
+    struct auth_job *next;
+};
+
+// Start the engine threads. Each drains whatever derivations are queued, up to
+// one SIMD batch, and computes them together with pbkdf2_sha256_many().
+int auth_engine_start(int threads, int queue_depth);
+
+// Queue a derivation. Returns 0 if the queue is full; the caller still owns job.
+int auth_engine_submit(struct auth_job *job);
+
+#endif
@@ -0,0 +1,102 @@
+// Logins per second per core for the password hash used by LOGIN/SIGNUP.
+//
+// Build from the server folder:
+//   cc -O2 -I. bench/pbkdf2_bench.c pbkdf2_mb.c -o pbkdf2_bench -lcrypto
+//   ./pbkdf2_bench [seconds-per-kernel]
+//
+// Runs single-threaded, so every figure is per core. It first checks that the
+// scalar and SIMD kernels give byte-identical output to OpenSSL.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "../db.h"
+#include "../pbkdf2_mb.h"
+
+#define BATCH 4  // passwords per SIMD pass: 8 lanes / 2 output blocks each
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int self_check() {
+    const char *passwords[] = { "", "pw", "correct horse battery staple",
+                                "a-password-that-is-longer-than-one-sha256-block-so-the-key-gets-hashed-first" };
+    int n = sizeof(passwords) / sizeof(passwords[0]);
+    unsigned char salt[SALT_SIZE], expected[HASH_SIZE], got[HASH_SIZE];
+
+    for (int simd = 0; simd <= 1; simd++) {
+        pbkdf2_use_simd(simd);
+        for (int i = 0; i < n; i++) {
+            RAND_bytes(salt, sizeof(salt));
+            PKCS5_PBKDF2_HMAC(passwords[i], strlen(passwords[i]), salt, SALT_SIZE,
+                              1000, EVP_sha256(), HASH_SIZE, expected);
+
+            struct pbkdf2_job job = { passwords[i], strlen(passwords[i]), salt, SALT_SIZE, got, HASH_SIZE };
+            pbkdf2_sha256_many(&job, 1, 1000);
+            if (memcmp(got, expected, HASH_SIZE) != 0) {
+                printf("Self-check FAILED for %s kernel\n", pbkdf2_kernel_name());
+                return 0;
+            }
+        }
+        printf("Self-check ok: %s kernel matches OpenSSL\n", pbkdf2_kernel_name());
+    }
+    return 1;
+}
+
+static void bench_openssl(double seconds) {
+    unsigned char salt[SALT_SIZE], out[HASH_SIZE];
+    RAND_bytes(salt, sizeof(salt));
+
+    long logins = 0;
+    double start = now_seconds(), elapsed;
+    do {
+        PKCS5_PBKDF2_HMAC("password", 8, salt, SALT_SIZE, ITERATIONS, EVP_sha256(), HASH_SIZE, out);
+        logins++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < seconds);
+
+    printf("%-10s %8.2f logins/sec/core  (one PKCS5_PBKDF2_HMAC per login, as before)\n", "openssl", logins / elapsed);
+}
+
+static void bench_kernel(int simd, double seconds) {
+    if (simd && !pbkdf2_use_simd(1)) {
+        printf("%-10s not supported on this CPU\n", "avx2-x8");
+        return;
+    }
+    if (!simd) pbkdf2_use_simd(0);
+
+    unsigned char salts[BATCH][SALT_SIZE], outs[BATCH][HASH_SIZE];
+    struct pbkdf2_job jobs[BATCH];
+    for (int i = 0; i < BATCH; i++) {
+        RAND_bytes(salts[i], SALT_SIZE);
+        jobs[i] = (struct pbkdf2_job){ "password", 8, salts[i], SALT_SIZE, outs[i], HASH_SIZE };
+    }
+
+    long logins = 0;
+    double start = now_seconds(), elapsed;
+    do {
+        pbkdf2_sha256_many(jobs, BATCH, ITERATIONS);
+        logins += BATCH;
+        elapsed = now_seconds() - start;
+    } while (elapsed < seconds);
+
+    printf("%-10s %8.2f logins/sec/core\n", pbkdf2_kernel_name(), logins / elapsed);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+
+    if (!self_check()) return 1;
+
+    printf("\nPBKDF2-HMAC-SHA256, %d iterations, %d-byte output\n", ITERATIONS, HASH_SIZE);
+    bench_openssl(seconds);
+    bench_kernel(0, seconds);
+    bench_kernel(1, seconds);
+    return 0;
+}
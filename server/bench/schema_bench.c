@@ -0,0 +1,192 @@
+// Before/after figures for the schema version 2 migration.
+//
+// Build from the server folder:
+//   cc -O2 -I. bench/schema_bench.c schema.c -o schema_bench -lsqlite3
+//   ./schema_bench [transactions] [users] [database]
+//
+// Generates a version 1 database (TEXT usernames, REAL rupees), measures it,
+// migrates it with migrate_schema(), and measures again. Defaults to 10M
+// transactions across 10k users, one of whom is a heavy user with a tenth of
+// all rows. The database file is left behind for inspection.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "../schema.h"
+
+#define HISTORY_SAMPLES 500
+#define PAGE_ROWS 20
+
+// The queries the server ran against each layout
+static const char *history_v1 =
+    "SELECT id, timestamp, sender, receiver, amount FROM ("
+    "SELECT id, timestamp, sender, receiver, amount FROM transactions "
+    "WHERE sender = ?1 AND (timestamp, id) < (?2, ?3) ORDER BY timestamp DESC, id DESC LIMIT ?4) "
+    "UNION ALL "
+    "SELECT id, timestamp, sender, receiver, amount FROM ("
+    "SELECT id, timestamp, sender, receiver, amount FROM transactions "
+    "WHERE receiver = ?1 AND sender <> ?1 AND (timestamp, id) < (?2, ?3) ORDER BY timestamp DESC, id DESC LIMIT ?4) "
+    "ORDER BY timestamp DESC, id DESC LIMIT ?4";
+
+static const char *history_v2 =
+    "SELECT p.id, p.timestamp, datetime(p.timestamp, 'unixepoch'), s.username, r.username, p.amount FROM ("
+    "SELECT * FROM (SELECT id, timestamp, sender_id, receiver_id, amount FROM transactions "
+    "WHERE sender_id = (SELECT id FROM users WHERE username = ?1) AND (timestamp, id) < (?2, ?3) "
+    "ORDER BY timestamp DESC, id DESC LIMIT ?4) "
+    "UNION ALL "
+    "SELECT * FROM (SELECT id, timestamp, sender_id, receiver_id, amount FROM transactions "
+    "WHERE receiver_id = (SELECT id FROM users WHERE username = ?1) AND sender_id <> receiver_id "
+    "AND (timestamp, id) < (?2, ?3) ORDER BY timestamp DESC, id DESC LIMIT ?4) "
+    "ORDER BY timestamp DESC, id DESC LIMIT ?4) p "
+    "JOIN users s ON s.id = p.sender_id JOIN users r ON r.id = p.receiver_id "
+    "ORDER BY p.timestamp DESC, p.id DESC";
+
+static const char *top_senders_v1 =
+    "SELECT sender, COUNT(*) as txn_count FROM transactions GROUP BY sender ORDER BY txn_count DESC LIMIT 3;";
+
+static const char *top_senders_v2 =
+    "SELECT u.username, t.txn_count FROM (SELECT sender_id, COUNT(*) as txn_count FROM transactions "
+    "GROUP BY sender_id ORDER BY txn_count DESC LIMIT 3) t JOIN users u ON u.id = t.sender_id "
+    "ORDER BY t.txn_count DESC;";
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void exec_or_die(sqlite3 *handle, const char *sql) {
+    char *err_msg = NULL;
+    if (sqlite3_exec(handle, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        printf("[ERROR] %s\n", err_msg);
+        exit(1);
+    }
+}
+
+// Run a query to completion; returns seconds taken
+static double time_query(sqlite3 *handle, const char *sql) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+
+    double start = now_seconds();
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        ;
+    double elapsed = now_seconds() - start;
+    sqlite3_finalize(stmt);
+    return elapsed;
+}
+
+static void print_value(sqlite3 *handle, const char *label, const char *sql) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) != SQLITE_OK) return;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        printf("  %-28s %s\n", label, (const char *)sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+}
+
+// Average microseconds for the first HISTORY page of `samples` users
+static double time_history(sqlite3 *handle, int version, int users, int samples, int heavy_only) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(handle, version == 1 ? history_v1 : history_v2, -1, &stmt, NULL) != SQLITE_OK) {
+        printf("[ERROR] %s\n", sqlite3_errmsg(handle));
+        return -1;
+    }
+
+    char username[32];
+    srand(42);
+    double start = now_seconds();
+    for (int i = 0; i < samples; i++) {
+        snprintf(username, sizeof(username), "user%d", heavy_only ? 0 : rand() % users);
+        sqlite3_bind_text(stmt, 1, username, -1, SQLITE_TRANSIENT);
+        if (version == 1) sqlite3_bind_text(stmt, 2, "9999-12-31 23:59:59", -1, SQLITE_STATIC);
+        else sqlite3_bind_int64(stmt, 2, INT64_MAX);
+        sqlite3_bind_int64(stmt, 3, INT64_MAX);
+        sqlite3_bind_int(stmt, 4, PAGE_ROWS + 1);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            ;
+        sqlite3_reset(stmt);
+    }
+    double elapsed = now_seconds() - start;
+    sqlite3_finalize(stmt);
+    return elapsed / samples * 1e6;
+}
+
+static void measure(sqlite3 *handle, int version, int users) {
+    printf("\nSchema version %d\n", version);
+    print_value(handle, "live size (bytes)",
+                "SELECT (page_count - freelist_count) * page_size FROM pragma_page_count, pragma_freelist_count, pragma_page_size;");
+
+    // Warm the page cache so both layouts are timed from memory
+    time_query(handle, "SELECT COUNT(*) FROM transactions;");
+
+    printf("  %-28s %.1f us\n", "HISTORY page, random user", time_history(handle, version, users, HISTORY_SAMPLES, 0));
+    printf("  %-28s %.1f us\n", "HISTORY page, heavy user", time_history(handle, version, users, HISTORY_SAMPLES, 1));
+    printf("  %-28s %.1f ms\n", "ADMIN_STATS total balance", time_query(handle, "SELECT SUM(balance) FROM users;") * 1e3);
+    printf("  %-28s %.1f ms\n", "ADMIN_STATS txn count", time_query(handle, "SELECT COUNT(*) FROM transactions;") * 1e3);
+    printf("  %-28s %.1f ms\n", "ADMIN_STATS top senders",
+           time_query(handle, version == 1 ? top_senders_v1 : top_senders_v2) * 1e3);
+    if (version >= 3)
+        printf("  %-28s %.3f ms\n", "ADMIN_STATS stored totals", time_query(handle, "SELECT name, value FROM stats;") * 1e3);
+
+    double start = now_seconds();
+    if (version == 1) print_value(handle, "sum of amounts (rupees)", "SELECT printf('%.6f', SUM(amount)) FROM transactions;");
+    else print_value(handle, "sum of amounts (rupees)", "SELECT printf('%d.%02d', SUM(amount) / 100, SUM(amount) % 100) FROM transactions;");
+    printf("  %-28s %.1f ms\n", "sum of amounts time", (now_seconds() - start) * 1e3);
+}
+
+int main(int argc, char **argv) {
+    long long transactions = argc > 1 ? atoll(argv[1]) : 10000000;
+    int users = argc > 2 ? atoi(argv[2]) : 10000;
+    const char *path = argc > 3 ? argv[3] : "schema_bench.db";
+    char sql[1024];
+
+    remove(path);
+    sqlite3 *handle;
+    if (sqlite3_open(path, &handle) != SQLITE_OK) return 1;
+    exec_or_die(handle, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL; PRAGMA cache_size=-262144;");
+
+    printf("Generating %lld transactions across %d users...\n", transactions, users);
+    double start = now_seconds();
+    exec_or_die(handle,
+        "CREATE TABLE users (id INTEGER PRIMARY KEY AUTOINCREMENT, username TEXT UNIQUE, password TEXT, "
+        "salt TEXT, balance REAL DEFAULT 1000.0, is_admin INTEGER DEFAULT 0);"
+        "CREATE TABLE transactions (id INTEGER PRIMARY KEY AUTOINCREMENT, sender TEXT NOT NULL, "
+        "receiver TEXT NOT NULL, amount REAL NOT NULL, timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);");
+
+    snprintf(sql, sizeof(sql),
+        "WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i + 1 < %d) "
+        "INSERT INTO users (username, password, salt, balance) "
+        "SELECT 'user' || i, hex(randomblob(64)), hex(randomblob(16)), (abs(random()) %% 1000000) / 100.0 FROM n;",
+        users);
+    exec_or_die(handle, sql);
+
+    // user0 sends a tenth of everything; the rest is spread evenly, with paise amounts
+    snprintf(sql, sizeof(sql),
+        "WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i + 1 < %lld) "
+        "INSERT INTO transactions (sender, receiver, amount, timestamp) "
+        "SELECT 'user' || CASE WHEN i %% 10 = 0 THEN 0 ELSE abs(random()) %% %d END, "
+        "'user' || (abs(random()) %% %d), (1 + abs(random()) %% 100000) / 100.0, "
+        "datetime(1700000000 + i / 20, 'unixepoch') FROM n;",
+        transactions, users, users);
+    exec_or_die(handle, "BEGIN;");
+    exec_or_die(handle, sql);
+    exec_or_die(handle, "COMMIT;");
+    exec_or_die(handle,
+        "CREATE INDEX idx_transactions_sender ON transactions (sender, timestamp, id);"
+        "CREATE INDEX idx_transactions_receiver ON transactions (receiver, timestamp, id);");
+    printf("  generated in %.1f s\n", now_seconds() - start);
+
+    measure(handle, 1, users);
+
+    printf("\nMigrating...\n");
+    start = now_seconds();
+    if (!migrate_schema(handle, MIGRATE_BATCH_ROWS)) return 1;
+    printf("  migrated in %.1f s\n", now_seconds() - start);
+
+    measure(handle, SCHEMA_VERSION, users);
+
+    sqlite3_close(handle);
+    return 0;
+}
@@ -0,0 +1,867 @@
+// Load generator and latency benchmark for a running server.
+//
+// Build from the server folder:
+//   cc -O2 -I. bench/wallet_bench.c protocol.c wire_crypto.c -o wallet_bench -lpthread -lcrypto
+//   ./wallet_bench [options]
+//
+//   --host ADDR --port N   server address (default 127.0.0.1:8080)
+//   --users N              simulated users, one connection each (default 1000)
+//   --threads N            client threads sharing the users (default 1)
+//   --prefix NAME          users are <prefix><first> .. (default "bench")
+//   --first K              number of the first user (default 0)
+//   --password PW          (default "pw")
+//   --no-signup            the users already exist (tools/wallet_seed.c)
+//   --secure               encrypt every connection (WIRE_SECURE_MAGIC)
+//   --mix SPEC             weights, e.g. balance=60,transfer=30,history=10
+//   --rate R               open loop: R requests a second in total; 0 runs
+//                          closed loop, each user sending as soon as it can
+//   --depth N              requests in flight per user (default 1, most 64)
+//   --duration S           measured seconds (default 30)
+//   --warmup S             seconds run before measuring (default 5)
+//   --amount PAISE         per TRANSFER (default 100)
+//   --history-rows N       per HISTORY page (default 20)
+//   --max-p99 US           exit with status 2 if any command's p99 is higher
+//   --max-errors PCT       exit with status 2 if more requests than this fail
+//
+// Every user connects with the binary protocol, signs up, logs in, and then
+// sends BALANCE/TRANSFER/HISTORY picked at random by weight. Latencies go into
+// log-linear histograms with 0.1% resolution, one set per thread, merged at
+// the end. In open loop a request's latency runs from when the schedule said
+// to send it, so time spent waiting for a free slot counts too; a server that
+// falls behind the rate shows it in the percentiles. With --secure the
+// requests a user has queued go out sealed in one record, and its latency
+// includes the client's own encryption, as a real client's would.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "../protocol.h"
+#include "../wire_crypto.h"
+
+#define MAX_THREADS 64
+#define MAX_DEPTH 64           // request slots per user
+#define OUT_BUFFER_SIZE 8192   // unsent request bytes per user
+#define MAX_EVENTS 256
+#define SETUP_TIMEOUT_S 600    // give up on users still not logged in by then
+#define POLL_INTERVAL_NS 100000000ULL
+
+// Histogram layout: exact below 2048 ns, then 1024 buckets per power of two
+#define HIST_SUB_BITS 10
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (2 * HIST_SUB + 30 * HIST_SUB)  // up to about 18 minutes
+
+enum command {
+    CMD_SIGNUP,
+    CMD_LOGIN,
+    CMD_BALANCE,
+    CMD_TRANSFER,
+    CMD_HISTORY,
+    CMD_COUNT
+};
+
+#define FIRST_RUN_COMMAND CMD_BALANCE
+
+static const char *command_names[CMD_COUNT] = {"SIGNUP", "LOGIN", "BALANCE", "TRANSFER", "HISTORY"};
+
+enum user_state {
+    USER_HANDSHAKE,  // waiting for the magic (and with --secure the server's key) to come back
+    USER_SETUP,      // SIGNUP or LOGIN in flight
+    USER_READY,
+    USER_DEAD
+};
+
+struct histogram {
+    long long count;
+    uint64_t max;
+    double sum;
+    long long *buckets;  // HIST_BUCKETS
+};
+
+struct command_stats {
+    struct histogram latency;
+    long long ok, failed, busy, bad, lost;
+};
+
+struct pending {
+    int used;
+    int command;
+    uint64_t start;  // ns; when the request was due
+};
+
+struct user {
+    int fd;
+    int number;
+    enum user_state state;
+    char name[WIRE_NAME_SIZE];
+    uint32_t next_id;
+    int inflight;
+    struct pending pending[MAX_DEPTH];  // by request_id % MAX_DEPTH
+
+    // Reply parsing: a header, then payload bytes that are skipped
+    unsigned char header[WIRE_MAGIC_SIZE + WIRE_KEY_SIZE];
+    size_t header_len;
+    uint32_t skip;
+
+    // --secure: records are collected whole and opened where they sit
+    struct wire_channel *channel;
+    unsigned char *records;
+    size_t records_len, records_cap;
+
+    unsigned char out[OUT_BUFFER_SIZE];
+    size_t out_len;
+    size_t sealed;  // bytes at the front of out already in a record
+};
+
+struct client_thread {
+    pthread_t thread;
+    int index;
+    int epoll_fd;
+    struct user *users;
+    int count;
+    int ready;
+    int dead;
+    int started;  // users logged in when the mix began
+    uint64_t random;
+    uint64_t measure_start, measure_end;  // ns
+    long long late;  // open loop: due requests never sent
+    struct command_stats stats[CMD_COUNT];
+};
+
+// Options
+static const char *host = "127.0.0.1";
+static int port = 8080;
+static int user_count = 1000;
+static int thread_count = 1;
+static const char *prefix = "bench";
+static int first_user = 0;
+static const char *password = "pw";
+static int do_signup = 1;
+static int secure = 0;
+static int weights[CMD_COUNT] = {0, 0, 60, 30, 10};
+static double rate = 0;
+static int depth = 1;
+static int duration = 30;
+static int warmup = 5;
+static long long amount = 100;
+static int history_rows = 20;
+static double max_p99_us = 0;
+static double max_error_percent = -1;
+
+static struct sockaddr_in server_address;
+static pthread_barrier_t setup_done;
+static struct client_thread threads[MAX_THREADS];
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static int bucket_of(uint64_t value) {
+    if (value < 2 * HIST_SUB) return (int)value;
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;  // value >> shift is in [1024, 2048)
+    int index = 2 * HIST_SUB + (shift - 1) * HIST_SUB + (int)((value >> shift) - HIST_SUB);
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+// Largest value counted in a bucket, so percentiles never understate
+static uint64_t bucket_top(int index) {
+    if (index < 2 * HIST_SUB) return index;
+    int shift = (index - 2 * HIST_SUB) / HIST_SUB + 1;
+    uint64_t sub = (index - 2 * HIST_SUB) % HIST_SUB + HIST_SUB;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void histogram_record(struct histogram *h, uint64_t value) {
+    h->buckets[bucket_of(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+}
+
+static void histogram_merge(struct histogram *into, const struct histogram *from) {
+    for (int i = 0; i < HIST_BUCKETS; i++) into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->max > into->max) into->max = from->max;
+}
+
+static uint64_t histogram_percentile(const struct histogram *h, double percent) {
+    if (h->count == 0) return 0;
+    long long rank = (long long)(percent / 100.0 * h->count + 0.5);
+    if (rank < 1) rank = 1;
+
+    long long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) return bucket_top(i) < h->max ? bucket_top(i) : h->max;
+    }
+    return h->max;
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    wire_put_u32(p, value >> 32);
+    wire_put_u32(p + 4, (uint32_t)value);
+}
+
+static void user_name(char *out, int number) {
+    snprintf(out, WIRE_NAME_SIZE, "%s%d", prefix, number);
+}
+
+// Seal the requests queued since the last flush into one record, in place
+static int seal_user(struct user *u) {
+    size_t plain = u->out_len - u->sealed;
+    unsigned char *record = u->out + u->sealed;
+    memmove(record + WIRE_RECORD_HEADER, record, plain);
+    wire_put_u32(record, (uint32_t)(plain + WIRE_TAG_SIZE));
+    if (!wire_seal_begin(u->channel, record) || !wire_seal_update(u->channel, record + WIRE_RECORD_HEADER, plain) ||
+        !wire_seal_end(u->channel, record + WIRE_RECORD_HEADER + plain))
+        return 0;
+    u->out_len += WIRE_RECORD_HEADER + WIRE_TAG_SIZE;
+    u->sealed = u->out_len;
+    return 1;
+}
+
+static int flush_user(struct user *u) {
+    if (u->channel && u->out_len > u->sealed && !seal_user(u)) return 0;
+
+    size_t sent = 0;
+    while (sent < u->out_len) {
+        ssize_t n = send(u->fd, u->out + sent, u->out_len - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return 0;
+        sent += n;
+    }
+    memmove(u->out, u->out + sent, u->out_len - sent);
+    u->out_len -= sent;
+    if (u->channel) u->sealed -= sent;
+    return 1;
+}
+
+// Queue one request due at `start`; returns 0 if the user cannot take it
+static int send_request(struct client_thread *t, struct user *u, int command, uint64_t start) {
+    unsigned char frame[WIRE_HEADER_SIZE + 2 * WIRE_NAME_SIZE];
+    size_t size = 0;
+    memset(frame, 0, sizeof(frame));
+
+    switch (command) {
+    case CMD_SIGNUP:
+    case CMD_LOGIN:
+        frame[8] = command == CMD_SIGNUP ? OP_SIGNUP : OP_LOGIN;
+        memcpy(frame + WIRE_HEADER_SIZE, u->name, strlen(u->name));
+        memcpy(frame + WIRE_HEADER_SIZE + WIRE_NAME_SIZE, password, strlen(password));
+        size = 2 * WIRE_NAME_SIZE;
+        break;
+    case CMD_BALANCE:
+        frame[8] = OP_BALANCE;
+        break;
+    case CMD_TRANSFER: {
+        int receiver = next_random(&t->random) % (user_count - 1);
+        if (receiver >= u->number - first_user) receiver++;
+        frame[8] = OP_TRANSFER;
+        user_name((char *)frame + WIRE_HEADER_SIZE, first_user + receiver);
+        put_u64(frame + WIRE_HEADER_SIZE + WIRE_NAME_SIZE, (uint64_t)amount);
+        size = WIRE_NAME_SIZE + WIRE_AMOUNT_SIZE;
+        break;
+    }
+    case CMD_HISTORY:
+        frame[8] = OP_HISTORY;
+        wire_put_u32(frame + WIRE_HEADER_SIZE, history_rows);  // followed by an empty cursor
+        size = WIRE_LIMIT_SIZE + WIRE_CURSOR_SIZE;
+        break;
+    }
+    size_t overhead = secure ? WIRE_RECORD_HEADER + WIRE_TAG_SIZE : 0;
+    if (u->inflight >= MAX_DEPTH || u->out_len + WIRE_HEADER_SIZE + size + overhead > OUT_BUFFER_SIZE) return 0;
+
+    while (u->pending[u->next_id % MAX_DEPTH].used) u->next_id++;
+    struct pending *p = &u->pending[u->next_id % MAX_DEPTH];
+    p->used = 1;
+    p->command = command;
+    p->start = start;
+    u->inflight++;
+
+    wire_put_u32(frame, 5 + size);
+    wire_put_u32(frame + 4, u->next_id++);
+    memcpy(u->out + u->out_len, frame, WIRE_HEADER_SIZE + size);
+    u->out_len += WIRE_HEADER_SIZE + size;
+    return 1;
+}
+
+static int pick_command(struct client_thread *t) {
+    int total = 0;
+    for (int i = FIRST_RUN_COMMAND; i < CMD_COUNT; i++) total += weights[i];
+
+    int pick = next_random(&t->random) % total;
+    for (int i = FIRST_RUN_COMMAND; i < CMD_COUNT; i++) {
+        if (pick < weights[i]) return i;
+        pick -= weights[i];
+    }
+    return CMD_BALANCE;
+}
+
+// Setup replies always count; the mix counts only inside the measured window
+static int counted(const struct client_thread *t, const struct pending *p) {
+    return p->command < FIRST_RUN_COMMAND || (p->start >= t->measure_start && p->start < t->measure_end);
+}
+
+// Requests still in flight on a lost connection count as lost, but not at the
+// end of the run, when they simply had no time left
+static void drop_user(struct client_thread *t, struct user *u, int count_lost) {
+    if (u->state == USER_DEAD) return;
+    for (int i = 0; i < MAX_DEPTH; i++) {
+        if (count_lost && u->pending[i].used && counted(t, &u->pending[i])) t->stats[u->pending[i].command].lost++;
+        u->pending[i].used = 0;
+    }
+    u->inflight = 0;
+    if (u->state == USER_READY) t->ready--;
+    u->state = USER_DEAD;
+    t->dead++;
+    close(u->fd);
+    wire_channel_free(u->channel);
+    u->channel = NULL;
+    free(u->records);
+    u->records = NULL;
+    u->records_len = u->records_cap = 0;
+}
+
+static void kill_user(struct client_thread *t, struct user *u) {
+    drop_user(t, u, 1);
+}
+
+static void complete(struct client_thread *t, struct user *u, uint32_t request_id, int status) {
+    struct pending *p = &u->pending[request_id % MAX_DEPTH];
+    if (!p->used) {
+        printf("[ERROR] %s got a reply to request %u it never sent\n", u->name, request_id);
+        kill_user(t, u);
+        return;
+    }
+    p->used = 0;
+    u->inflight--;
+
+    if (counted(t, p)) {
+        struct command_stats *s = &t->stats[p->command];
+        histogram_record(&s->latency, now_ns() - p->start);
+        if (status == WIRE_OK) s->ok++;
+        else if (status == WIRE_FAILED) s->failed++;
+        else if (status == WIRE_BUSY) s->busy++;
+        else s->bad++;
+    }
+
+    // A taken username still logs in, so reruns can skip --no-signup
+    if (p->command == CMD_SIGNUP) {
+        send_request(t, u, CMD_LOGIN, now_ns());
+    } else if (p->command == CMD_LOGIN && status == WIRE_BUSY) {
+        send_request(t, u, CMD_LOGIN, now_ns());
+    } else if (p->command == CMD_LOGIN) {
+        if (status != WIRE_OK) {
+            kill_user(t, u);
+            return;
+        }
+        u->state = USER_READY;
+        t->ready++;
+    } else if (rate == 0 && t->measure_end && now_ns() < t->measure_end) {
+        send_request(t, u, pick_command(t), now_ns());
+    }
+}
+
+// The opening reply: the magic, and with --secure the server's public key.
+// Returns the bytes of data it used, or -1 once the user is dropped.
+static ssize_t read_handshake(struct client_thread *t, struct user *u, const unsigned char *data, size_t n) {
+    size_t want = WIRE_MAGIC_SIZE + (secure ? WIRE_KEY_SIZE : 0);
+    size_t used = 0;
+    while (u->header_len < want && used < n) u->header[u->header_len++] = data[used++];
+    if (u->header_len < want) return (ssize_t)used;
+    u->header_len = 0;
+
+    if (memcmp(u->header, secure ? WIRE_SECURE_MAGIC : WIRE_MAGIC, WIRE_MAGIC_SIZE) != 0) {
+        printf("[ERROR] %s: the server does not speak the %s protocol\n", u->name, secure ? "encrypted" : "binary");
+        kill_user(t, u);
+        return -1;
+    }
+    if (secure && !wire_channel_accept(u->channel, u->header + WIRE_MAGIC_SIZE, 0)) {
+        printf("[ERROR] %s: the server's key exchange failed\n", u->name);
+        kill_user(t, u);
+        return -1;
+    }
+    u->state = USER_SETUP;
+    send_request(t, u, do_signup ? CMD_SIGNUP : CMD_LOGIN, now_ns());
+    return (ssize_t)used;
+}
+
+// Act on each complete reply in a run of frame bytes
+static void read_frames(struct client_thread *t, struct user *u, const unsigned char *data, size_t n) {
+    for (size_t i = 0; i < n && u->state != USER_DEAD;) {
+        if (u->skip > 0) {
+            uint32_t step = n - i < u->skip ? (uint32_t)(n - i) : u->skip;
+            u->skip -= step;
+            i += step;
+            continue;
+        }
+
+        while (u->header_len < WIRE_HEADER_SIZE && i < n) u->header[u->header_len++] = data[i++];
+        if (u->header_len < WIRE_HEADER_SIZE) break;
+        u->header_len = 0;
+
+        uint32_t length = wire_get_u32(u->header);
+        if (length < WIRE_HEADER_SIZE - 4) {
+            kill_user(t, u);
+            return;
+        }
+        u->skip = length - (WIRE_HEADER_SIZE - 4);
+        if (u->header[8] != WIRE_MORE) complete(t, u, wire_get_u32(u->header + 4), u->header[8]);
+    }
+}
+
+// Collect records and read the frames in each one that is complete
+static void read_records(struct client_thread *t, struct user *u, const unsigned char *data, size_t n) {
+    if (u->records_len + n > u->records_cap) {
+        size_t cap = u->records_cap ? u->records_cap : 65536;
+        while (cap < u->records_len + n) cap *= 2;
+        unsigned char *grown = realloc(u->records, cap);
+        if (!grown) {
+            kill_user(t, u);
+            return;
+        }
+        u->records = grown;
+        u->records_cap = cap;
+    }
+    memcpy(u->records + u->records_len, data, n);
+    u->records_len += n;
+
+    size_t used = 0;
+    while (u->state != USER_DEAD && u->records_len - used >= WIRE_RECORD_HEADER) {
+        unsigned char *record = u->records + used;
+        uint32_t length = wire_get_u32(record);
+        if (length < WIRE_TAG_SIZE) {
+            kill_user(t, u);
+            return;
+        }
+        if (u->records_len - used < WIRE_RECORD_HEADER + (size_t)length) break;
+
+        size_t plain = length - WIRE_TAG_SIZE;
+        unsigned char *body = record + WIRE_RECORD_HEADER;
+        if (!wire_open(u->channel, record, body, plain, body + plain)) {
+            printf("[ERROR] %s: a reply record failed authentication\n", u->name);
+            kill_user(t, u);
+            return;
+        }
+        read_frames(t, u, body, plain);
+        used += WIRE_RECORD_HEADER + length;
+    }
+    if (u->state == USER_DEAD) return;
+    memmove(u->records, u->records + used, u->records_len - used);
+    u->records_len -= used;
+}
+
+// Read everything available and act on each complete reply
+static void read_replies(struct client_thread *t, struct user *u) {
+    unsigned char buffer[65536];
+
+    while (u->state != USER_DEAD) {
+        ssize_t n = recv(u->fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            kill_user(t, u);
+            return;
+        }
+
+        ssize_t used = u->state == USER_HANDSHAKE ? read_handshake(t, u, buffer, n) : 0;
+        if (used < 0 || used == n) continue;
+        if (secure) read_records(t, u, buffer + used, n - used);
+        else read_frames(t, u, buffer + used, n - used);
+    }
+    if (u->state != USER_DEAD && !flush_user(u)) kill_user(t, u);
+}
+
+static int connect_user(struct client_thread *t, struct user *u) {
+    u->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (u->fd < 0) return 0;
+    if (connect(u->fd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0) {
+        close(u->fd);
+        return 0;
+    }
+
+    int on = 1;
+    setsockopt(u->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    // The opening goes out in the clear: the magic, then our public key
+    unsigned char opening[WIRE_MAGIC_SIZE + WIRE_KEY_SIZE];
+    size_t size = WIRE_MAGIC_SIZE;
+    memcpy(opening, secure ? WIRE_SECURE_MAGIC : WIRE_MAGIC, WIRE_MAGIC_SIZE);
+    if (secure) {
+        u->channel = wire_channel_new(opening + WIRE_MAGIC_SIZE);
+        size += WIRE_KEY_SIZE;
+    }
+    if ((secure && !u->channel) || send(u->fd, opening, size, MSG_NOSIGNAL) != (ssize_t)size) {
+        wire_channel_free(u->channel);
+        u->channel = NULL;
+        close(u->fd);
+        return 0;
+    }
+    fcntl(u->fd, F_SETFL, fcntl(u->fd, F_GETFL, 0) | O_NONBLOCK);
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = u};
+    return epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, u->fd, &ev) == 0;
+}
+
+// Waits with nanosecond precision so open loop sends close to the schedule
+static void poll_users(struct client_thread *t, uint64_t timeout_ns) {
+    struct epoll_event events[MAX_EVENTS];
+    struct timespec timeout = {timeout_ns / 1000000000ULL, timeout_ns % 1000000000ULL};
+    int n = epoll_pwait2(t->epoll_fd, events, MAX_EVENTS, &timeout, NULL);
+    for (int i = 0; i < n; i++) {
+        struct user *u = events[i].data.ptr;
+        if (u->state == USER_DEAD) continue;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) kill_user(t, u);
+        else if (events[i].events & EPOLLIN) read_replies(t, u);
+        else if (!flush_user(u)) kill_user(t, u);
+    }
+}
+
+// Open loop: due times that found no free slot wait here, oldest first
+struct backlog {
+    uint64_t *due;
+    size_t head, len, capacity;
+};
+
+static int backlog_push(struct backlog *b, uint64_t due) {
+    if (b->len == b->capacity) {
+        size_t capacity = b->capacity ? b->capacity * 2 : 1024;
+        uint64_t *grown = malloc(capacity * sizeof(*grown));
+        if (!grown) return 0;
+        for (size_t i = 0; i < b->len; i++) grown[i] = b->due[(b->head + i) % b->capacity];
+        free(b->due);
+        b->due = grown;
+        b->head = 0;
+        b->capacity = capacity;
+    }
+    b->due[(b->head + b->len++) % b->capacity] = due;
+    return 1;
+}
+
+static void run_open_loop(struct client_thread *t) {
+    uint64_t interval = (uint64_t)(1e9 * thread_count / rate);
+    uint64_t next_due = now_ns();
+    struct backlog backlog = {0};
+    int cursor = 0;
+
+    while (now_ns() < t->measure_end && t->ready > 0) {
+        uint64_t now = now_ns();
+        while (next_due <= now) {
+            if (!backlog_push(&backlog, next_due)) break;
+            next_due += interval;
+        }
+
+        // Hand each due request to the next user with a free slot
+        int scanned = 0;
+        while (backlog.len > 0 && scanned < t->count) {
+            struct user *u = &t->users[cursor];
+            cursor = (cursor + 1) % t->count;
+            if (u->state != USER_READY || u->inflight >= depth ||
+                !send_request(t, u, pick_command(t), backlog.due[backlog.head])) {
+                scanned++;
+                continue;
+            }
+            backlog.head = (backlog.head + 1) % backlog.capacity;
+            backlog.len--;
+            scanned = 0;
+            if (!flush_user(u)) kill_user(t, u);
+        }
+
+        now = now_ns();
+        poll_users(t, next_due > now ? next_due - now : 0);
+    }
+
+    // Due inside the window but never sent: the server fell behind the rate
+    for (size_t i = 0; i < backlog.len; i++) {
+        uint64_t due = backlog.due[(backlog.head + i) % backlog.capacity];
+        if (due >= t->measure_start && due < t->measure_end) t->late++;
+    }
+    free(backlog.due);
+}
+
+static void run_closed_loop(struct client_thread *t) {
+    for (int i = 0; i < t->count; i++) {
+        struct user *u = &t->users[i];
+        for (int j = 0; u->state == USER_READY && j < depth; j++) send_request(t, u, pick_command(t), now_ns());
+        if (u->state == USER_READY && !flush_user(u)) kill_user(t, u);
+    }
+
+    // Each reply sends the next request from read_replies()
+    while (now_ns() < t->measure_end && t->ready > 0) poll_users(t, POLL_INTERVAL_NS);
+}
+
+static void *client_main(void *arg) {
+    struct client_thread *t = arg;
+    uint64_t setup_deadline = now_ns() + SETUP_TIMEOUT_S * 1000000000ULL;
+
+    // Connections open one by one so the listen backlog never overflows
+    for (int i = 0; i < t->count; i++) {
+        struct user *u = &t->users[i];
+        if (!connect_user(t, u)) {
+            printf("[ERROR] %s could not connect: %s\n", u->name, strerror(errno));
+            u->state = USER_DEAD;
+            t->dead++;
+        }
+    }
+    while (t->ready + t->dead < t->count && now_ns() < setup_deadline) poll_users(t, POLL_INTERVAL_NS);
+    for (int i = 0; i < t->count; i++) {
+        if (t->users[i].state != USER_READY) kill_user(t, &t->users[i]);
+    }
+    t->started = t->ready;
+
+    pthread_barrier_wait(&setup_done);
+    t->measure_start = now_ns() + warmup * 1000000000ULL;
+    t->measure_end = t->measure_start + duration * 1000000000ULL;
+
+    if (rate > 0) run_open_loop(t);
+    else run_closed_loop(t);
+
+    for (int i = 0; i < t->count; i++) drop_user(t, &t->users[i], 0);
+    return NULL;
+}
+
+// "balance=60,transfer=30,history=10"; commands left out get no weight
+static int parse_mix(const char *spec) {
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    for (int i = FIRST_RUN_COMMAND; i < CMD_COUNT; i++) weights[i] = 0;
+
+    int total = 0;
+    for (char *item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+        char *equals = strchr(item, '=');
+        if (!equals) return 0;
+        *equals = '\0';
+
+        int found = 0;
+        for (int i = FIRST_RUN_COMMAND; i < CMD_COUNT; i++) {
+            if (strcasecmp(item, command_names[i]) == 0) {
+                weights[i] = atoi(equals + 1);
+                total += weights[i];
+                found = 1;
+            }
+        }
+        if (!found) return 0;
+    }
+    return total > 0;
+}
+
+static int parse_options(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--no-signup") == 0) {
+            do_signup = 0;
+            continue;
+        }
+        if (strcmp(argv[i], "--secure") == 0) {
+            secure = 1;
+            continue;
+        }
+        if (!value) return 0;
+        i++;
+
+        if (strcmp(argv[i - 1], "--host") == 0) host = value;
+        else if (strcmp(argv[i - 1], "--port") == 0) port = atoi(value);
+        else if (strcmp(argv[i - 1], "--users") == 0) user_count = atoi(value);
+        else if (strcmp(argv[i - 1], "--threads") == 0) thread_count = atoi(value);
+        else if (strcmp(argv[i - 1], "--prefix") == 0) prefix = value;
+        else if (strcmp(argv[i - 1], "--first") == 0) first_user = atoi(value);
+        else if (strcmp(argv[i - 1], "--password") == 0) password = value;
+        else if (strcmp(argv[i - 1], "--mix") == 0) { if (!parse_mix(value)) return 0; }
+        else if (strcmp(argv[i - 1], "--rate") == 0) rate = atof(value);
+        else if (strcmp(argv[i - 1], "--depth") == 0) depth = atoi(value);
+        else if (strcmp(argv[i - 1], "--duration") == 0) duration = atoi(value);
+        else if (strcmp(argv[i - 1], "--warmup") == 0) warmup = atoi(value);
+        else if (strcmp(argv[i - 1], "--amount") == 0) amount = atoll(value);
+        else if (strcmp(argv[i - 1], "--history-rows") == 0) history_rows = atoi(value);
+        else if (strcmp(argv[i - 1], "--max-p99") == 0) max_p99_us = atof(value);
+        else if (strcmp(argv[i - 1], "--max-errors") == 0) max_error_percent = atof(value);
+        else return 0;
+    }
+
+    if (thread_count > user_count) thread_count = user_count;
+    return user_count >= 2 && thread_count >= 1 && thread_count <= MAX_THREADS &&
+           depth >= 1 && depth <= MAX_DEPTH && duration > 0 && warmup >= 0 && rate >= 0 &&
+           strlen(password) < WIRE_NAME_SIZE && strlen(prefix) + 11 < WIRE_NAME_SIZE;
+}
+
+// One connection per user, so raise the descriptor limit as far as allowed
+static void raise_file_limit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (limit.rlim_cur < (rlim_t)user_count + 64)
+        printf("[ERROR] Open file limit %ld is too low for %d users\n", (long)limit.rlim_cur, user_count);
+}
+
+static int start_threads() {
+    for (int i = 0; i < thread_count; i++) {
+        struct client_thread *t = &threads[i];
+        int first = (long long)user_count * i / thread_count;
+        int last = (long long)user_count * (i + 1) / thread_count;
+
+        t->index = i;
+        t->count = last - first;
+        t->random = 0x9e3779b97f4a7c15ULL * (i + 1);
+        t->users = calloc(t->count, sizeof(struct user));
+        t->epoll_fd = epoll_create1(0);
+        if (!t->users || t->epoll_fd < 0) return 0;
+
+        for (int j = 0; j < t->count; j++) {
+            t->users[j].number = first_user + first + j;
+            user_name(t->users[j].name, t->users[j].number);
+        }
+        for (int c = 0; c < CMD_COUNT; c++) {
+            t->stats[c].latency.buckets = calloc(HIST_BUCKETS, sizeof(long long));
+            if (!t->stats[c].latency.buckets) return 0;
+        }
+        if (pthread_create(&t->thread, NULL, client_main, t) != 0) {
+            perror("Client thread creation failed");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void print_row(const char *name, const struct command_stats *s) {
+    const struct histogram *h = &s->latency;
+    printf("%-10s %9lld %9lld %7lld %7lld %7lld %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+           name, h->count, s->ok, s->failed, s->busy + s->bad, s->lost,
+           h->count ? h->sum / h->count / 1e3 : 0.0,
+           histogram_percentile(h, 50) / 1e3, histogram_percentile(h, 90) / 1e3,
+           histogram_percentile(h, 99) / 1e3, histogram_percentile(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+// Prints the merged results; returns 0 if a --max-p99 or --max-errors gate failed
+static int report(double setup_seconds) {
+    struct command_stats total[CMD_COUNT];
+    int started = 0;
+    long long late = 0;
+
+    memset(total, 0, sizeof(total));
+    for (int c = 0; c < CMD_COUNT; c++) total[c].latency.buckets = threads[0].stats[c].latency.buckets;
+    for (int i = 0; i < thread_count; i++) {
+        struct client_thread *t = &threads[i];
+        started += t->started;
+        late += t->late;
+        for (int c = 0; c < CMD_COUNT; c++) {
+            struct command_stats *s = &t->stats[c];
+            if (i > 0) histogram_merge(&total[c].latency, &s->latency);
+            else total[c].latency = s->latency;
+            total[c].ok += s->ok;
+            total[c].failed += s->failed;
+            total[c].busy += s->busy;
+            total[c].bad += s->bad;
+            total[c].lost += s->lost;
+        }
+    }
+
+    printf("\nSetup took %.1f s\n", setup_seconds);
+    printf("%-10s %9s %9s %7s %7s %7s %10s %10s %10s %10s %10s %10s\n", "command", "count", "ok", "failed",
+           "busy", "lost", "mean(us)", "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)");
+    for (int c = 0; c < FIRST_RUN_COMMAND; c++) {
+        if (total[c].latency.count > 0) print_row(command_names[c], &total[c]);
+    }
+    printf("\nMeasured %d s\n", duration);
+
+    struct command_stats all;
+    memset(&all, 0, sizeof(all));
+    all.latency.buckets = calloc(HIST_BUCKETS, sizeof(long long));
+    for (int c = FIRST_RUN_COMMAND; c < CMD_COUNT; c++) {
+        if (weights[c] == 0) continue;
+        print_row(command_names[c], &total[c]);
+        if (all.latency.buckets) histogram_merge(&all.latency, &total[c].latency);
+        all.ok += total[c].ok;
+        all.failed += total[c].failed;
+        all.busy += total[c].busy;
+        all.bad += total[c].bad;
+        all.lost += total[c].lost;
+    }
+    if (all.latency.buckets) print_row("all", &all);
+
+    long long requests = all.latency.count + all.lost + late;
+    long long errors = requests - all.ok;
+    printf("\nThroughput: %.1f requests/s", all.ok / (double)duration);
+    if (rate > 0) printf(" of %.1f offered", rate);
+    printf("\nUsers: %d of %d logged in%s\n", started, user_count, secure ? ", encrypted" : "");
+    if (late > 0) printf("[ERROR] %lld requests fell due but were never sent; the server could not keep up\n", late);
+
+    int passed = 1;
+    for (int c = FIRST_RUN_COMMAND; max_p99_us > 0 && c < CMD_COUNT; c++) {
+        double p99 = histogram_percentile(&total[c].latency, 99) / 1e3;
+        if (p99 > max_p99_us) {
+            printf("[ERROR] %s p99 of %.1f us is over the %.1f us limit\n", command_names[c], p99, max_p99_us);
+            passed = 0;
+        }
+    }
+    double error_percent = requests ? 100.0 * errors / requests : 100.0;
+    if (max_error_percent >= 0 && error_percent > max_error_percent) {
+        printf("[ERROR] %.2f%% of requests failed, over the %.2f%% limit\n", error_percent, max_error_percent);
+        passed = 0;
+    }
+    free(all.latency.buckets);
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    if (!parse_options(argc, argv)) {
+        printf("Usage: %s [--host ADDR] [--port N] [--users N] [--threads N] [--prefix NAME] [--first K]\n"
+               "       [--password PW] [--no-signup] [--mix balance=60,transfer=30,history=10] [--rate R]\n"
+               "       [--depth N] [--duration S] [--warmup S] [--amount PAISE] [--history-rows N]\n"
+               "       [--max-p99 US] [--max-errors PCT]\n", argv[0]);
+        return 1;
+    }
+
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_address.sin_addr) != 1) {
+        printf("[ERROR] Bad server address %s\n", host);
+        return 1;
+    }
+    raise_file_limit();
+
+    if (rate > 0) printf("[INFO] %d users on %s:%d, %d client threads, open loop at %.1f requests/s, up to %d in flight per user\n",
+                         user_count, host, port, thread_count, rate, depth);
+    else printf("[INFO] %d users on %s:%d, %d client threads, closed loop with %d in flight per user\n",
+                user_count, host, port, thread_count, depth);
+    printf("[INFO] %s users, then %d s of warmup and %d s measured\n", do_signup ? "Signing up and logging in" : "Logging in",
+           warmup, duration);
+    fflush(stdout);
+
+    // Every thread finishes setup before any starts the mix
+    pthread_barrier_init(&setup_done, NULL, thread_count + 1);
+    double setup_start = now_ns() / 1e9;
+    if (!start_threads()) {
+        printf("[ERROR] Could not start %d client threads\n", thread_count);
+        return 1;
+    }
+    pthread_barrier_wait(&setup_done);
+    double setup_seconds = now_ns() / 1e9 - setup_start;
+
+    for (int i = 0; i < thread_count; i++) pthread_join(threads[i].thread, NULL);
+    return report(setup_seconds) ? 0 : 2;
+}
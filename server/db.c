@@ -4,51 +4,393 @@
 #include <sqlite3.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "db.h"
+#include "ledger.h"
+#include "schema.h"
+#include "metrics.h"
+#include "logger.h"
+#include "journal.h"
+#include "store.h"
+#include "archive.h"
+
+#define DB_PATH "wallet.db"
+#define BUSY_TIMEOUT_MS 5000
+#define AUTOCHECKPOINT_PAGES 1000  // SQLite's default, until the checkpoint thread takes over
+#define CHECKPOINT_WAIT_MS 100     // longest a checkpoint waits for writers or old readers
+
+sqlite3 *db;  // bootstrap handle: schema setup only, workers use their own connection
+
+// Bootstrap handles of every shard; db is the first
+static sqlite3 *shard_db[DB_MAX_SHARDS];
+static int shard_count = 1;
+
+// Transaction ids are unique across the shards, so they are handed out here
+// rather than by each file's AUTOINCREMENT
+static _Atomic sqlite3_int64 last_transaction_id = 0;
+
+// SQL for every cached statement, indexed by enum db_statement. Money is in paise.
+static const char *statement_sql[STMT_COUNT] = {
+    [STMT_INSERT_USER] = "INSERT INTO users (id, username, password, salt, balance) VALUES (?, ?, ?, ?, 100000)",
+    [STMT_USER_CREDENTIALS] = "SELECT password, salt FROM users WHERE username=?",
+    [STMT_APPLY_USER] = "INSERT OR IGNORE INTO users (id, username, password, salt, balance) VALUES (?, ?, ?, ?, ?)",
+    [STMT_DELETE_USER] = "DELETE FROM users WHERE id = ?",
+    [STMT_SET_TIER] = "UPDATE users SET tier = ?1 WHERE username = ?2",
+    [STMT_DEBIT] = "UPDATE users SET balance = balance - ? WHERE username = ?",
+    [STMT_CREDIT] = "UPDATE users SET balance = balance + ? WHERE username = ?",
+    [STMT_USER_ID] = "SELECT id FROM users WHERE username = ?",
+    [STMT_USERNAME] = "SELECT username FROM users WHERE id = ?1",
+    [STMT_CREDIT_RETURNING_ID] = "UPDATE users SET balance = balance + ?1 WHERE username = ?2 RETURNING id",
+    [STMT_INSERT_TRANSACTION_IDS] = "INSERT INTO transactions (id, sender_id, receiver_id, amount, timestamp) "
+                                    "VALUES (?1, ?2, ?3, ?4, ?5)",
+    [STMT_JOURNAL_APPLIED] = "SELECT applied_seq FROM journal_state WHERE id = 1",
+    [STMT_SET_JOURNAL_APPLIED] = "UPDATE journal_state SET applied_seq = ?1 WHERE id = 1",
+    [STMT_IS_ADMIN] = "SELECT is_admin FROM users WHERE username = ?",
+    [STMT_COUNT_USERS] = "SELECT COUNT(*) FROM users;",
+    [STMT_SUM_BALANCE] = "SELECT SUM(balance) FROM users;",
+    // Archived rows still count; they are only stored elsewhere
+    [STMT_COUNT_TRANSACTIONS] = "SELECT (SELECT COUNT(*) FROM transactions) + "
+                                "(SELECT IFNULL(SUM(rows), 0) FROM archive_segments);",
+    [STMT_TOP_SENDERS] = "SELECT u.username, t.txn_count FROM "
+                         "(SELECT sender_id, SUM(n) as txn_count FROM ("
+                         "SELECT sender_id, COUNT(*) as n FROM transactions GROUP BY sender_id "
+                         "UNION ALL SELECT sender_id, transactions FROM archived_senders) "
+                         "GROUP BY sender_id ORDER BY txn_count DESC LIMIT ?1) t "
+                         "JOIN users u ON u.id = t.sender_id ORDER BY t.txn_count DESC;",
+    [STMT_READ_STATS] = "SELECT name, value FROM stats;",
+    [STMT_ADJUST_STAT] = "UPDATE stats SET value = value + ?2 WHERE name = ?1;",
+    // One pass over the username index with both history indexes joined in;
+    // each user's rows are sorted on their own, so memory stays flat however
+    // many users there are. The upper bound is the first username past the
+    // prefix (?2) or past the ?4th matching user, whichever comes first.
+    [STMT_ALL_USERS] = "SELECT u.id, u.username, u.password, u.balance, "
+                       "datetime(t.timestamp, 'unixepoch'), s.username, r.username, t.amount, "
+                       "t.timestamp, t.id, t.receiver_id "
+                       "FROM users u "
+                       "LEFT JOIN transactions t ON t.sender_id = u.id OR t.receiver_id = u.id "
+                       "LEFT JOIN users s ON s.id = t.sender_id "
+                       "LEFT JOIN users r ON r.id = t.receiver_id "
+                       "WHERE u.username >= ?1 AND u.balance >= ?3 AND u.username < IFNULL(("
+                       "SELECT username FROM users WHERE username >= ?1 AND username < IFNULL(?2, x'') "
+                       "AND balance >= ?3 ORDER BY username LIMIT (?4 > 0) OFFSET ?4), IFNULL(?2, x'')) "
+                       "ORDER BY u.username, t.timestamp DESC, t.id DESC",
+    // A transfer is stored with its sender, so these are a user's credits held in
+    // another shard; the sender is always local to it
+    [STMT_RECEIVED] = "SELECT datetime(t.timestamp, 'unixepoch'), s.username, t.amount, t.timestamp, t.id "
+                      "FROM transactions t JOIN users s ON s.id = t.sender_id "
+                      "WHERE t.receiver_id = ?1 ORDER BY t.timestamp DESC, t.id DESC",
+    // Each branch walks one index backwards from the cursor and stops after ?4 rows,
+    // so a page costs the same however long the user's history is
+    [STMT_HISTORY_PAGE] = "SELECT * FROM ("
+                          "SELECT id, timestamp, sender_id, receiver_id, amount FROM transactions "
+                          "WHERE sender_id = ?1 AND (timestamp, id) < (?2, ?3) "
+                          "ORDER BY timestamp DESC, id DESC LIMIT ?4) "
+                          "UNION ALL "
+                          "SELECT * FROM ("
+                          "SELECT id, timestamp, sender_id, receiver_id, amount FROM transactions "
+                          "WHERE receiver_id = ?1 AND sender_id <> receiver_id AND (timestamp, id) < (?2, ?3) "
+                          "ORDER BY timestamp DESC, id DESC LIMIT ?4) "
+                          "ORDER BY timestamp DESC, id DESC LIMIT ?4",
+    [STMT_ARCHIVE_CANDIDATES] = "SELECT id, timestamp, sender_id, receiver_id, amount FROM transactions "
+                                "WHERE timestamp < ?1 ORDER BY id LIMIT ?2",
+    [STMT_DELETE_TRANSACTION] = "DELETE FROM transactions WHERE id = ?1",
+    [STMT_ARCHIVE_SENDER] = "INSERT INTO archived_senders (sender_id, transactions) VALUES (?1, ?2) "
+                            "ON CONFLICT(sender_id) DO UPDATE SET transactions = transactions + excluded.transactions",
+    [STMT_ADD_SEGMENT] = "INSERT INTO archive_segments (id, rows, min_timestamp, max_timestamp) "
+                         "VALUES (?1, ?2, ?3, ?4)",
+    [STMT_LIST_SEGMENTS] = "SELECT id, rows FROM archive_segments ORDER BY id",
+    [STMT_BEGIN] = "BEGIN IMMEDIATE;",
+    [STMT_BEGIN_READ] = "BEGIN;",  // one snapshot for several reads
+    [STMT_COMMIT] = "COMMIT;",
+    [STMT_ROLLBACK] = "ROLLBACK;",
+};
+
+// One connection per worker thread, opened once and kept with its statements prepared
+struct db_conn {
+    sqlite3 *handle;
+    sqlite3_stmt *stmts[STMT_COUNT];
+    struct db_conn *next;
+};
+
+static __thread struct db_conn *thread_conns[DB_MAX_SHARDS];
+static __thread int thread_read_only = 0;
+
+// Every pooled connection, so close_db can finalize them all
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct db_conn *pool_head = NULL;
+
+// Checkpoint policy; checkpoint_pages stays 0 until the checkpoint thread runs
+static _Atomic int checkpoint_pages = 0;
+static int checkpoint_seconds = 0;
+static int checkpoint_due = 0;
+static pthread_mutex_t checkpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t checkpoint_cond = PTHREAD_COND_INITIALIZER;
+
+static const char *connection_pragmas =
+    "PRAGMA synchronous=FULL;"
+    "PRAGMA temp_store=MEMORY;"
+    "PRAGMA cache_size=-8192;"     // 8 MB page cache per connection
+    "PRAGMA mmap_size=268435456;";
+
+static const char *writer_pragmas =
+    "PRAGMA journal_size_limit=67108864;";  // cut the WAL file back to 64 MB once checkpointed
+
+// Writers wait out each other's transactions with a growing sleep, up to BUSY_TIMEOUT_MS
+static int busy_wait(void *unused, int attempt) {
+    (void)unused;
+    static const int backoff_ms[] = {1, 2, 5, 10, 20, 50};
+    int steps = sizeof(backoff_ms) / sizeof(backoff_ms[0]);
+
+    int waited = 0;
+    for (int i = 0; i < attempt; i++) waited += backoff_ms[i < steps ? i : steps - 1];
+    if (waited >= BUSY_TIMEOUT_MS) return 0;
+
+    if (attempt == 0) metrics_count(COUNTER_SQLITE_BUSY, 1);
+    usleep(backoff_ms[attempt < steps ? attempt : steps - 1] * 1000);
+    return 1;
+}
 
-#define SALT_SIZE 16
-#define HASH_SIZE 64
-#define ITERATIONS 100000
+// Called after each commit on a writer with the pages now in the WAL
+static int wal_committed(void *unused, sqlite3 *handle, const char *name, int pages) {
+    (void)unused;
+    int threshold = checkpoint_pages;
+    if (threshold == 0) {
+        // Recovery runs before the checkpoint thread; do what SQLite would by default
+        if (pages >= AUTOCHECKPOINT_PAGES)
+            sqlite3_wal_checkpoint_v2(handle, name, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+    } else if (pages >= threshold) {
+        pthread_mutex_lock(&checkpoint_lock);
+        checkpoint_due = 1;
+        pthread_cond_signal(&checkpoint_cond);
+        pthread_mutex_unlock(&checkpoint_lock);
+    }
+    return SQLITE_OK;
+}
 
-sqlite3 *db;
+static struct db_conn *open_thread_connection(int shard) {
+    struct db_conn *conn = calloc(1, sizeof(*conn));
+    if (!conn) return NULL;
+
+    // Each connection belongs to one thread, so SQLite's own mutexes are not needed.
+    // Readers see the last commit when each statement or BEGIN starts and never block writers.
+    int flags = SQLITE_OPEN_NOMUTEX;
+    flags |= thread_read_only ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    char path[256];
+    schema_shard_path(path, sizeof(path), DB_PATH, shard);
+    if (sqlite3_open_v2(path, &conn->handle, flags, NULL) != SQLITE_OK) {
+        log_error("Failed to open worker connection: %s", sqlite3_errmsg(conn->handle));
+        sqlite3_close(conn->handle);
+        free(conn);
+        return NULL;
+    }
 
-// Initialize the database and create tables if not exist
-int initialize_db() {
-    if (sqlite3_open("wallet.db", &db) != SQLITE_OK) {
-        printf("Failed to open database: %s\n", sqlite3_errmsg(db));
+    sqlite3_exec(conn->handle, connection_pragmas, NULL, NULL, NULL);
+    if (thread_read_only) {
+        sqlite3_busy_timeout(conn->handle, BUSY_TIMEOUT_MS);
+    } else {
+        sqlite3_busy_handler(conn->handle, busy_wait, NULL);
+        sqlite3_exec(conn->handle, writer_pragmas, NULL, NULL, NULL);
+        sqlite3_wal_hook(conn->handle, wal_committed, NULL);  // replaces SQLite's autocheckpoint
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    conn->next = pool_head;
+    pool_head = conn;
+    pthread_mutex_unlock(&pool_lock);
+    return conn;
+}
+
+void db_thread_read_only() {
+    thread_read_only = 1;
+}
+
+int db_shard_count() {
+    return shard_count;
+}
+
+int db_shard_of(const char *username) {
+    return schema_shard_of(username, shard_count);
+}
+
+sqlite3 *db_shard_bootstrap(int shard) {
+    return shard_db[shard];
+}
+
+// Handle of the calling thread's connection to a shard, opened on first use
+sqlite3 *db_shard_handle(int shard) {
+    if (!thread_conns[shard]) thread_conns[shard] = open_thread_connection(shard);
+    return thread_conns[shard] ? thread_conns[shard]->handle : NULL;
+}
+
+sqlite3 *db_thread_handle() {
+    return db_shard_handle(0);
+}
+
+// Cached statement on the calling thread's connection to a shard, reset and
+// ready to bind. Callers sqlite3_reset() it when done so no read snapshot is held open.
+sqlite3_stmt *db_shard_statement(int shard, enum db_statement id) {
+    if (!db_shard_handle(shard)) return NULL;
+
+    struct db_conn *conn = thread_conns[shard];
+    sqlite3_stmt *stmt = conn->stmts[id];
+    if (!stmt) {
+        if (sqlite3_prepare_v3(conn->handle, statement_sql[id], -1,
+                               SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK) {
+            log_error("SQLite prepare failed: %s", sqlite3_errmsg(conn->handle));
+            return NULL;
+        }
+        conn->stmts[id] = stmt;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return stmt;
+}
+
+// Run a statement that returns no rows
+static int db_exec_statement(int shard, enum db_statement id) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, id);
+    if (!stmt) return 0;
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Open one shard's file and bring its schema up to date. Every shard but the
+// first must already exist; tools/wallet_reshard creates them.
+static int open_shard(int shard, int *shards) {
+    char path[256];
+    schema_shard_path(path, sizeof(path), DB_PATH, shard);
+    int flags = SQLITE_OPEN_READWRITE | (shard == 0 ? SQLITE_OPEN_CREATE : 0);
+    if (sqlite3_open_v2(path, &shard_db[shard], flags, NULL) != SQLITE_OK) {
+        printf("Failed to open database %s: %s\n", path, sqlite3_errmsg(shard_db[shard]));
         return 0;
     }
 
     char *err_msg = NULL;
-    const char *sql_users =
-        "CREATE TABLE IF NOT EXISTS users ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "username TEXT UNIQUE,"
-        "password TEXT,"
-        "salt TEXT,"
-        "balance REAL DEFAULT 1000.0,"
-        "is_admin INTEGER DEFAULT 0);";
-
-    const char *sql_transactions =
-        "CREATE TABLE IF NOT EXISTS transactions ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "sender TEXT NOT NULL,"
-        "receiver TEXT NOT NULL,"
-        "amount REAL NOT NULL,"
-        "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);";
-
-    if (sqlite3_exec(db, sql_users, NULL, NULL, &err_msg) != SQLITE_OK ||
-        sqlite3_exec(db, sql_transactions, NULL, NULL, &err_msg) != SQLITE_OK) {
+
+    // WAL lets the worker connections read while one of them writes; the mode is persistent
+    if (sqlite3_exec(shard_db[shard], "PRAGMA journal_mode=WAL;", NULL, NULL, &err_msg) != SQLITE_OK) {
         printf("SQL error: %s\n", err_msg);
         sqlite3_free(err_msg);
-        sqlite3_close(db);
+    }
+
+    // Fresh databases get the current tables; older ones are converted in place
+    if (!migrate_schema(shard_db[shard], MIGRATE_BATCH_ROWS)) {
+        printf("Schema setup of %s failed!\n", path);
         return 0;
     }
 
+    int index, count;
+    if (!schema_shard_info(shard_db[shard], &index, &count) || index != shard || (shard > 0 && count != *shards)) {
+        printf("[ERROR] %s is not shard %d of %d; rerun tools/wallet_reshard\n", path, shard, *shards);
+        return 0;
+    }
+    *shards = count;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(shard_db[shard], "SELECT MAX(IFNULL((SELECT MAX(seq) FROM sqlite_sequence "
+                           "WHERE name = 'transactions'), 0), IFNULL((SELECT MAX(id) FROM transactions), 0));",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 0) > last_transaction_id)
+            last_transaction_id = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return 1;
+}
+
+// Initialize the database and create tables if not exist
+int initialize_db() {
+    int shards = 1;
+    for (int shard = 0; shard < shards; shard++) {
+        if (!open_shard(shard, &shards)) {
+            for (int i = 0; i <= shard; i++) sqlite3_close(shard_db[i]);
+            return 0;
+        }
+    }
+    db = shard_db[0];
+    shard_count = shards;
+    if (shards > 1) printf("[INFO] Accounts are split across %d database shards\n", shards);
+
+    // Balances are served from memory, rebuilt from the snapshot and journal
+    return store_open();
+}
+
+// Copy committed WAL pages back into the database file, off the request path.
+// A FULL checkpoint holds off the writers (in practice the journal applier) while
+// it copies, so it catches up with the end of the WAL and the next commit can
+// start the WAL over; a PASSIVE one racing the applier never would, and the WAL
+// would grow without bound. It gives up after CHECKPOINT_WAIT_MS waiting for a
+// writer or for a reader still on an older snapshot, and tries again later.
+static void *checkpoint_main(void *unused) {
+    (void)unused;
+    for (int shard = 0; shard < shard_count; shard++) {
+        if (!db_shard_handle(shard)) return NULL;
+        sqlite3_busy_timeout(db_shard_handle(shard), CHECKPOINT_WAIT_MS);
+    }
+
+    while (1) {
+        pthread_mutex_lock(&checkpoint_lock);
+        if (!checkpoint_due) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += checkpoint_seconds;
+            pthread_cond_timedwait(&checkpoint_cond, &checkpoint_lock, &deadline);
+        }
+        checkpoint_due = 0;
+        pthread_mutex_unlock(&checkpoint_lock);
+
+        int busy = 0;
+        for (int shard = 0; shard < shard_count; shard++) {
+            sqlite3 *handle = db_shard_handle(shard);
+            uint64_t start = metrics_now();
+            int wal_pages = 0, copied = 0;
+            int rc = sqlite3_wal_checkpoint_v2(handle, NULL, SQLITE_CHECKPOINT_FULL, &wal_pages, &copied);
+            if (rc != SQLITE_OK && rc != SQLITE_BUSY) {
+                log_error("Checkpoint of shard %d failed: %s", shard, sqlite3_errmsg(handle));
+                continue;
+            }
+            metrics_time(TIMER_CHECKPOINT, metrics_now() - start);
+
+            if (rc == SQLITE_BUSY) {
+                log_debug("Checkpoint of shard %d copied %d of %d WAL pages; a reader or writer holds the rest",
+                          shard, copied, wal_pages);
+                busy = 1;
+            }
+        }
+
+        // Every commit would call again while the reader lasts; give it a moment
+        if (busy) sleep(1);
+    }
+    return NULL;
+}
+
+int db_checkpoint_start(int seconds, int wal_pages) {
+    checkpoint_seconds = seconds > 0 ? seconds : 1;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, checkpoint_main, NULL) != 0) {
+        perror("Checkpoint thread creation failed");
+        return 0;
+    }
+    pthread_detach(thread);
+    checkpoint_pages = wal_pages > 0 ? wal_pages : AUTOCHECKPOINT_PAGES;
     return 1;
 }
 
 void close_db() {
-    sqlite3_close(db);
+    pthread_mutex_lock(&pool_lock);
+    while (pool_head) {
+        struct db_conn *conn = pool_head;
+        pool_head = conn->next;
+        for (int i = 0; i < STMT_COUNT; i++) sqlite3_finalize(conn->stmts[i]);
+        sqlite3_close(conn->handle);
+        free(conn);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    for (int shard = 0; shard < shard_count; shard++) sqlite3_close(shard_db[shard]);
 }
 
 // Hashing
@@ -71,140 +413,254 @@ int verify_password(const char *password, const char *stored_salt, const char *s
     return memcmp(computed_hash, stored_hash, HASH_SIZE) == 0;
 }
 
-// User registration
-int signup_user(const char *username, const char *password) {
-    char salt[SALT_SIZE];
-    char hashed_password[HASH_SIZE];
-
-    hash_password(password, salt, hashed_password);
+static void to_hex(char *hex, const unsigned char *bytes, int len) {
+    for (int i = 0; i < len; i++) snprintf(&hex[i * 2], 3, "%02x", bytes[i]);
+}
 
+// Store a new account whose password hash has already been derived. The row
+// goes in first, in the account's shard, so the username's UNIQUE constraint
+// settles races; the signup counts once its journal record is on disk.
+int create_user(const char *username, const unsigned char *salt, const unsigned char *hashed_password) {
     // Convert binary salt and hash to hex
     char salt_hex[SALT_SIZE * 2 + 1];
     char hash_hex[HASH_SIZE * 2 + 1];
-    for (int i = 0; i < SALT_SIZE; i++) snprintf(&salt_hex[i * 2], 3, "%02x", (unsigned char)salt[i]);
-    for (int i = 0; i < HASH_SIZE; i++) snprintf(&hash_hex[i * 2], 3, "%02x", (unsigned char)hashed_password[i]);
+    to_hex(salt_hex, salt, SALT_SIZE);
+    to_hex(hash_hex, hashed_password, HASH_SIZE);
 
-    const char *sql = "INSERT INTO users (username, password, salt, balance) VALUES (?, ?, ?, 1000.0)";
-    sqlite3_stmt *stmt;
+    int shard = db_shard_of(username);
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_INSERT_USER);
+    if (!stmt) return 0;
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        printf("[ERROR] SQLite prepare failed: %s\n", sqlite3_errmsg(db));
-        return 0;
-    }
-
-    sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, hash_hex, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, salt_hex, -1, SQLITE_STATIC);
+    // Ids are unique across the shards, so the store hands them out
+    store_signup_begin();
+    sqlite3_int64 id = store_next_user_id();
+    sqlite3_bind_int64(stmt, 1, id);
+    sqlite3_bind_text(stmt, 2, username, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, hash_hex, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, salt_hex, -1, SQLITE_STATIC);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        printf("[ERROR] Signup failed: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
+        log_error("Signup failed: %s", sqlite3_errmsg(db_shard_handle(shard)));
+        sqlite3_reset(stmt);
+        store_signup_end();
         return 0;
     }
+    sqlite3_reset(stmt);
 
-    sqlite3_finalize(stmt);
-    return 1;
+    int success = store_signup(id, username, salt, hashed_password, STARTING_BALANCE_PAISE);
+    if (!success && (stmt = db_shard_statement(shard, STMT_DELETE_USER))) {
+        sqlite3_bind_int64(stmt, 1, id);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    store_signup_end();
+    return success;
 }
 
-// Login
-int login_user(const char *username, const char *password) {
-    const char *sql = "SELECT password, salt FROM users WHERE username=?";
-    sqlite3_stmt *stmt;
+// User registration
+int signup_user(const char *username, const char *password) {
+    char salt[SALT_SIZE];
+    char hashed_password[HASH_SIZE];
+
+    hash_password(password, salt, hashed_password);
+    return create_user(username, (unsigned char *)salt, (unsigned char *)hashed_password);
+}
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) return 0;
+// Fetch the stored salt and hash; returns 0 for unknown users
+int get_credentials(const char *username, unsigned char *salt, unsigned char *hashed_password) {
+    sqlite3_stmt *stmt = db_shard_statement(db_shard_of(username), STMT_USER_CREDENTIALS);
+    if (!stmt) return 0;
 
     sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
 
-    int result = 0;
+    int found = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         const char *stored_hash_hex = (const char *)sqlite3_column_text(stmt, 0);
         const char *stored_salt_hex = (const char *)sqlite3_column_text(stmt, 1);
 
-        char stored_hash[HASH_SIZE];
-        char stored_salt[SALT_SIZE];
+        if (stored_hash_hex && stored_salt_hex &&
+            strlen(stored_hash_hex) == HASH_SIZE * 2 && strlen(stored_salt_hex) == SALT_SIZE * 2) {
+            for (int i = 0; i < HASH_SIZE; i++) sscanf(&stored_hash_hex[i * 2], "%2hhx", &hashed_password[i]);
+            for (int i = 0; i < SALT_SIZE; i++) sscanf(&stored_salt_hex[i * 2], "%2hhx", &salt[i]);
+            found = 1;
+        }
+    }
 
-        for (int i = 0; i < HASH_SIZE; i++) sscanf(&stored_hash_hex[i * 2], "%2hhx", &stored_hash[i]);
-        for (int i = 0; i < SALT_SIZE; i++) sscanf(&stored_salt_hex[i * 2], "%2hhx", &stored_salt[i]);
+    // Release the read snapshot before the slow hash
+    sqlite3_reset(stmt);
+    return found;
+}
 
-        result = verify_password(password, stored_salt, stored_hash);
-    }
+// Login
+int login_user(const char *username, const char *password) {
+    char stored_hash[HASH_SIZE];
+    char stored_salt[SALT_SIZE];
 
-    sqlite3_finalize(stmt);
-    return result;
+    if (!get_credentials(username, (unsigned char *)stored_salt, (unsigned char *)stored_hash)) return 0;
+    return verify_password(password, stored_salt, stored_hash);
 }
 
-// Get user balance
+// Get user balance from the in-memory ledger
 double get_balance(const char *username) {
-    sqlite3_stmt *stmt;
-    double balance = -1;
+    double balance;
+    uint64_t start = metrics_now();
+    int found = ledger_balance(username, &balance);
+    metrics_time(TIMER_BALANCE_LOOKUP, metrics_now() - start);
+    return found ? balance : -1;
+}
+
+// Bind amount and username to a balance UPDATE; fails if no account matched
+static int update_balance(int shard, enum db_statement id, sqlite3_int64 paise, const char *username) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, id);
+    if (!stmt) return 0;
+
+    sqlite3_bind_int64(stmt, 1, paise);
+    sqlite3_bind_text(stmt, 2, username, -1, SQLITE_STATIC);
+    int success = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(db_shard_handle(shard)) == 1;
+    sqlite3_reset(stmt);
+    return success;
+}
+
+// Transaction boundaries for the calling thread's connection to a shard
+int db_begin_batch(int shard) {
+    return db_exec_statement(shard, STMT_BEGIN);
+}
+
+int db_commit_batch(int shard) {
+    return db_exec_statement(shard, STMT_COMMIT);
+}
+
+void db_rollback_batch(int shard) {
+    db_exec_statement(shard, STMT_ROLLBACK);
+}
 
-    const char *sql = "SELECT balance FROM users WHERE username=?";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK) {
+static sqlite3_int64 user_id(int shard, const char *username) {
+    sqlite3_int64 id = -1;
+
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_USER_ID);
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            balance = sqlite3_column_double(stmt, 0);
-        }
+        if (sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int64(stmt, 0);
+        sqlite3_reset(stmt);
     }
+    return id;
+}
 
-    sqlite3_finalize(stmt);
-    return balance;
+// One line of a transfer, as far as this shard holds either side of it: the
+// receiver's shard credits it and the sender's records it. Either may be
+// applied before the other; the journal record commits both.
+static int apply_line(int shard, sqlite3_int64 sender_id, const char *receiver, sqlite3_int64 paise,
+                      sqlite3_int64 timestamp) {
+    int receiver_shard = db_shard_of(receiver);
+    sqlite3_int64 receiver_id = -1;
+
+    if (receiver_shard == shard) {
+        sqlite3_stmt *credit = db_shard_statement(shard, STMT_CREDIT_RETURNING_ID);
+        if (!credit) return 0;
+        sqlite3_bind_int64(credit, 1, paise);
+        sqlite3_bind_text(credit, 2, receiver, -1, SQLITE_STATIC);
+        int found = sqlite3_step(credit) == SQLITE_ROW;
+        if (found) receiver_id = sqlite3_column_int64(credit, 0);
+        if (found && sqlite3_step(credit) != SQLITE_DONE) found = 0;
+        sqlite3_reset(credit);
+        if (!found) return 0;
+    }
+    if (sender_id < 0) return 1;  // only the credit is ours
+
+    // A receiver elsewhere is looked up in its own shard, whose row was written at signup
+    if (receiver_id < 0 && (receiver_id = user_id(receiver_shard, receiver)) < 0) return 0;
+
+    sqlite3_stmt *insert = db_shard_statement(shard, STMT_INSERT_TRANSACTION_IDS);
+    if (!insert) return 0;
+    sqlite3_bind_int64(insert, 1, ++last_transaction_id);
+    sqlite3_bind_int64(insert, 2, sender_id);
+    sqlite3_bind_int64(insert, 3, receiver_id);
+    sqlite3_bind_int64(insert, 4, paise);
+    sqlite3_bind_int64(insert, 5, timestamp);
+    int success = sqlite3_step(insert) == SQLITE_DONE;
+    sqlite3_reset(insert);
+    return success;
 }
 
-// Money transfer
-int transfer_money(const char *sender, const char *receiver, double amount) {
-    double sender_balance = get_balance(sender);
-    if (sender_balance < amount) return 0;
+int db_apply_signup(int shard, const struct journal_signup *signup) {
+    if (db_shard_of(signup->username) != shard) return 1;
 
-    char *errmsg = NULL;
-    sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    char salt_hex[SALT_SIZE * 2 + 1];
+    char hash_hex[HASH_SIZE * 2 + 1];
+    to_hex(salt_hex, signup->salt, SALT_SIZE);
+    to_hex(hash_hex, signup->hash, HASH_SIZE);
+
+    // The row is normally there already, written by create_user()
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_APPLY_USER);
+    if (!stmt) return 0;
+    sqlite3_bind_int64(stmt, 1, signup->user_id);
+    sqlite3_bind_text(stmt, 2, signup->username, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, hash_hex, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, salt_hex, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, signup->balance);
+    int success = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_reset(stmt);
+    return success;
+}
 
-    sqlite3_stmt *stmt;
-    int success = 1;
+// A credit and a history row per line, then one debit for their total, each
+// on the shard that holds the account. There is no savepoint: with
+// temp_store=MEMORY, a savepoint spanning thousands of writes slows every
+// write by the size of its sub-journal.
+int db_apply_transfer(int shard, struct journal_transfer *transfer) {
+    int sends = db_shard_of(transfer->sender) == shard;
+    sqlite3_int64 sender_id = sends ? user_id(shard, transfer->sender) : -1;
+    if (sends && sender_id < 0) return 0;
+
+    char receiver[JOURNAL_NAME_SIZE];
+    int64_t paise, total = 0;
+    uint32_t lines = 0;
+    while (journal_next_line(transfer, receiver, &paise)) {
+        if (!apply_line(shard, sender_id, receiver, paise, transfer->timestamp)) return 0;
+        total += paise;
+        lines++;
+    }
+    return lines == transfer->count && (!sends || update_balance(shard, STMT_DEBIT, total, transfer->sender));
+}
 
-    const char *sql1 = "UPDATE users SET balance = balance - ? WHERE username = ?";
-    if (sqlite3_prepare_v2(db, sql1, -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_double(stmt, 1, amount);
-        sqlite3_bind_text(stmt, 2, sender, -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) != SQLITE_DONE) success = 0;
-        sqlite3_finalize(stmt);
-    } else success = 0;
+int db_apply_tier(int shard, const struct journal_tier *tier) {
+    if (db_shard_of(tier->username) != shard) return 1;
 
-    const char *sql2 = "UPDATE users SET balance = balance + ? WHERE username = ?";
-    if (success && sqlite3_prepare_v2(db, sql2, -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_double(stmt, 1, amount);
-        sqlite3_bind_text(stmt, 2, receiver, -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) != SQLITE_DONE) success = 0;
-        sqlite3_finalize(stmt);
-    } else success = 0;
-
-    const char *sql3 = "INSERT INTO transactions (sender, receiver, amount) VALUES (?, ?, ?)";
-    if (success && sqlite3_prepare_v2(db, sql3, -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, sender, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, receiver, -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 3, amount);
-        if (sqlite3_step(stmt) != SQLITE_DONE) success = 0;
-        sqlite3_finalize(stmt);
-    } else success = 0;
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_SET_TIER);
+    if (!stmt) return 0;
+    sqlite3_bind_int(stmt, 1, tier->tier);
+    sqlite3_bind_text(stmt, 2, tier->username, -1, SQLITE_STATIC);
+    int success = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(db_shard_handle(shard)) == 1;
+    sqlite3_reset(stmt);
+    return success;
+}
 
-    if (success)
-        sqlite3_exec(db, "COMMIT;", NULL, NULL, &errmsg);
-    else
-        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, &errmsg);
+sqlite3_int64 db_journal_applied(int shard) {
+    sqlite3_int64 seq = -1;
 
-    if (errmsg) {
-        printf("Transaction error: %s\n", errmsg);
-        sqlite3_free(errmsg);
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_JOURNAL_APPLIED);
+    if (stmt) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) seq = sqlite3_column_int64(stmt, 0);
+        sqlite3_reset(stmt);
     }
+    return seq;
+}
 
+int db_set_journal_applied(int shard, sqlite3_int64 seq) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_SET_JOURNAL_APPLIED);
+    if (!stmt) return 0;
+    sqlite3_bind_int64(stmt, 1, seq);
+    int success = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_reset(stmt);
     return success;
 }
 
 // Execute arbitrary SQL
 int execute_query(const char *query) {
     char *errMsg = 0;
-    int rc = sqlite3_exec(db, query, 0, 0, &errMsg);
+    int rc = sqlite3_exec(db_thread_handle(), query, 0, 0, &errMsg);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", errMsg);
+        log_error("SQL error: %s", errMsg);
         sqlite3_free(errMsg);
         return 0;
     }
@@ -213,130 +669,182 @@ int execute_query(const char *query) {
 
 // For Flask use
 sqlite3 *get_db_connection() {
-    return db;
+    return db_thread_handle();
 }
 
-// Show all users and their transaction history
-void show_all_users(char *result) {
-    sqlite3 *local_db;
-    sqlite3_stmt *stmt;
-    const char *sql_users = "SELECT username, password, balance FROM users;";
-    const char *sql_history = "SELECT sender, receiver, amount, timestamp FROM transactions WHERE sender = ? OR receiver = ? ORDER BY timestamp DESC;";
-
-    char temp[1024];
-    result[0] = '\0';
+// First string above every username that starts with prefix, or 0 if there is none
+static int prefix_end(const char *prefix, char *end, size_t size) {
+    size_t len = strlen(prefix);
+    if (len == 0 || len >= size) return 0;
 
-    if (sqlite3_open("wallet.db", &local_db) != SQLITE_OK) {
-        strcpy(result, "Error opening database.\n");
-        return;
-    }
+    memcpy(end, prefix, len + 1);
+    while (len > 0 && (unsigned char)end[len - 1] == 0xFF) end[--len] = '\0';
+    if (len == 0) return 0;
+    end[len - 1]++;
+    return 1;
+}
 
-    if (sqlite3_prepare_v2(local_db, sql_users, -1, &stmt, NULL) != SQLITE_OK) {
-        strcpy(result, "Error preparing user query.\n");
-        sqlite3_close(local_db);
-        return;
+int db_username(sqlite3_int64 id, char *name, size_t size) {
+    for (int shard = 0; shard < shard_count; shard++) {
+        sqlite3_stmt *stmt = db_shard_statement(shard, STMT_USERNAME);
+        if (!stmt) return 0;
+        sqlite3_bind_int64(stmt, 1, id);
+        int found = sqlite3_step(stmt) == SQLITE_ROW;
+        if (found) snprintf(name, size, "%s", (const char *)sqlite3_column_text(stmt, 0));
+        sqlite3_reset(stmt);
+        if (found) return 1;
     }
+    return 0;
+}
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *username = (const char *)sqlite3_column_text(stmt, 0);
-        const char *password = (const char *)sqlite3_column_text(stmt, 1);
-        double balance = sqlite3_column_double(stmt, 2);
+// Whether a transaction row (timestamp, id) is newer than another
+static int newer_row(sqlite3_stmt *a, int a_col, sqlite3_stmt *b, int b_col) {
+    sqlite3_int64 at = sqlite3_column_int64(a, a_col), bt = sqlite3_column_int64(b, b_col);
+    return at != bt ? at > bt : sqlite3_column_int64(a, a_col + 1) > sqlite3_column_int64(b, b_col + 1);
+}
 
-        sprintf(temp, "\nUser: %s\nPassword: %s\nBalance: ₹%.2f\nTransaction History:\n", username, password, balance);
-        strcat(result, temp);
+// Write one user's history: the rows from their own shard, which hold what
+// they sent, merged newest first with what other shards' users sent them.
+// Returns 0 on a database error; *writing drops to 0 if the writer stops.
+static int write_user_history(int shard, sqlite3_stmt *local, int *local_rc, const char *username,
+                              report_writer write, void *ctx, int *writing) {
+    sqlite3_stmt *received[DB_MAX_SHARDS] = {0};
+    int received_rc[DB_MAX_SHARDS] = {0};
+    sqlite3_int64 id = sqlite3_column_int64(local, 0);
+    int success = 1;
 
-        sqlite3_stmt *hist_stmt;
-        if (sqlite3_prepare_v2(local_db, sql_history, -1, &hist_stmt, NULL) == SQLITE_OK) {
-            sqlite3_bind_text(hist_stmt, 1, username, -1, SQLITE_STATIC);
-            sqlite3_bind_text(hist_stmt, 2, username, -1, SQLITE_STATIC);
+    for (int i = 0; i < shard_count; i++) {
+        if (i == shard) continue;
+        received[i] = db_shard_statement(i, STMT_RECEIVED);
+        if (!received[i]) return 0;
+        sqlite3_bind_int64(received[i], 1, id);
+        received_rc[i] = sqlite3_step(received[i]);
+    }
 
-            while (sqlite3_step(hist_stmt) == SQLITE_ROW) {
-                const char *sender = (const char *)sqlite3_column_text(hist_stmt, 0);
-                const char *receiver = (const char *)sqlite3_column_text(hist_stmt, 1);
-                double amount = sqlite3_column_double(hist_stmt, 2);
-                const char *timestamp = (const char *)sqlite3_column_text(hist_stmt, 3);
+    // A user without transactions comes back once, with NULLs on the right
+    if (sqlite3_column_type(local, 7) == SQLITE_NULL) *local_rc = sqlite3_step(local);
 
-                sprintf(temp, "  From: %s | To: %s | ₹%.2f | %s\n", sender, receiver, amount, timestamp);
-                strcat(result, temp);
+    char temp[1024];
+    char receiver[64];
+    while (*writing) {
+        int has_local = *local_rc == SQLITE_ROW && sqlite3_column_int64(local, 0) == id;
+        int next = -1;
+        for (int i = 0; i < shard_count; i++) {
+            if (received_rc[i] != SQLITE_ROW) continue;
+            if (next < 0 || newer_row(received[i], 3, received[next], 3)) next = i;
+        }
+        if (has_local && (next < 0 || newer_row(local, 8, received[next], 3))) next = shard;
+        if (next < 0) break;
+
+        int n;
+        if (next == shard) {
+            const char *to = (const char *)sqlite3_column_text(local, 6);
+            if (!to) {
+                // Sent to a user in another shard
+                snprintf(receiver, sizeof(receiver), "?");
+                db_username(sqlite3_column_int64(local, 10), receiver, sizeof(receiver));
+                to = receiver;
             }
-
-            sqlite3_finalize(hist_stmt);
+            n = snprintf(temp, sizeof(temp), "  From: %s | To: %s | ₹%.2f | %s\n",
+                         (const char *)sqlite3_column_text(local, 5), to,
+                         sqlite3_column_int64(local, 7) / 100.0,
+                         (const char *)sqlite3_column_text(local, 4));
+            if (n >= (int)sizeof(temp)) n = sizeof(temp) - 1;
+            *writing = write(ctx, temp, n);
+            *local_rc = sqlite3_step(local);
         } else {
-            strcat(result, "  Error fetching transaction history.\n");
+            n = snprintf(temp, sizeof(temp), "  From: %s | To: %s | ₹%.2f | %s\n",
+                         (const char *)sqlite3_column_text(received[next], 1), username,
+                         sqlite3_column_int64(received[next], 2) / 100.0,
+                         (const char *)sqlite3_column_text(received[next], 0));
+            if (n >= (int)sizeof(temp)) n = sizeof(temp) - 1;
+            *writing = write(ctx, temp, n);
+            received_rc[next] = sqlite3_step(received[next]);
         }
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(local_db);
+    for (int i = 0; i < shard_count; i++) {
+        if (!received[i]) continue;
+        if (*writing && received_rc[i] != SQLITE_DONE) success = 0;
+        sqlite3_reset(received[i]);
+    }
+    return success;
 }
 
-// Check if user is admin
-int is_admin(const char *username) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT is_admin FROM users WHERE username = ?";
-    int admin = 1;
-
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            admin = sqlite3_column_int(stmt, 0);
+// Show users and their transaction history, streamed row by row to the writer.
+// Each shard lists its own users in username order and the lists are merged.
+int show_all_users(const struct user_filter *filter, report_writer write, void *ctx) {
+    const char *prefix = filter->prefix ? filter->prefix : "";
+    char end[128];
+    char temp[1024];
+    int has_end = prefix_end(prefix, end, sizeof(end));
+
+    sqlite3_stmt *stmts[DB_MAX_SHARDS];
+    int rcs[DB_MAX_SHARDS];
+    for (int shard = 0; shard < shard_count; shard++) {
+        stmts[shard] = db_shard_statement(shard, STMT_ALL_USERS);
+        if (!stmts[shard]) {
+            while (shard-- > 0) sqlite3_reset(stmts[shard]);
+            return 0;
         }
     }
-    sqlite3_finalize(stmt);
-    return admin;
-}
 
-void get_admin_stats(char *response) {
-    sqlite3_stmt *stmt;
-    char temp[512];
-    response[0] = '\0';
+    // Reading every segment for every user would make this report far slower
+    if (archive_segments() > 0) {
+        const char *note = "Note: archived transactions are listed by HISTORY only.\n";
+        if (!write(ctx, note, strlen(note))) return 1;
+    }
 
-    // Total users
-    const char *sql_users = "SELECT COUNT(*) FROM users;";
-    if (sqlite3_prepare_v2(db, sql_users, -1, &stmt, NULL) == SQLITE_OK) {
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            int user_count = sqlite3_column_int(stmt, 0);
-            sprintf(temp, "Total Users: %d\n", user_count);
-            strcat(response, temp);
-        }
-        sqlite3_finalize(stmt);
+    for (int shard = 0; shard < shard_count; shard++) {
+        sqlite3_stmt *stmt = stmts[shard];
+        sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC);
+        if (has_end) sqlite3_bind_text(stmt, 2, end, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 3, filter->min_balance);
+        sqlite3_bind_int(stmt, 4, filter->limit > 0 ? filter->limit : 0);
+        rcs[shard] = sqlite3_step(stmt);
     }
 
-    // Total balance
-    const char *sql_balance = "SELECT SUM(balance) FROM users;";
-    if (sqlite3_prepare_v2(db, sql_balance, -1, &stmt, NULL) == SQLITE_OK) {
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            double total_balance = sqlite3_column_double(stmt, 0);
-            sprintf(temp, "Total Balance in System: ₹%.2f\n", total_balance);
-            strcat(response, temp);
+    int listed = 0, writing = 1, success = 1;
+    while (success && writing) {
+        int next = -1;
+        for (int shard = 0; shard < shard_count; shard++) {
+            if (rcs[shard] != SQLITE_ROW) continue;
+            if (next < 0 || strcmp((const char *)sqlite3_column_text(stmts[shard], 1),
+                                   (const char *)sqlite3_column_text(stmts[next], 1)) < 0)
+                next = shard;
         }
-        sqlite3_finalize(stmt);
+        // Each shard stops at the limit on its own; the merge keeps the first of them all
+        if (next < 0 || (filter->limit > 0 && listed++ >= filter->limit)) break;
+
+        sqlite3_stmt *stmt = stmts[next];
+        char username[64];
+        snprintf(username, sizeof(username), "%s", (const char *)sqlite3_column_text(stmt, 1));
+        int n = snprintf(temp, sizeof(temp), "\nUser: %s\nPassword: %s\nBalance: ₹%.2f\nTransaction History:\n",
+                         username, (const char *)sqlite3_column_text(stmt, 2),
+                         sqlite3_column_int64(stmt, 3) / 100.0);
+        if (n >= (int)sizeof(temp)) n = sizeof(temp) - 1;
+        writing = write(ctx, temp, n);
+        if (writing) success = write_user_history(next, stmt, &rcs[next], username, write, ctx, &writing);
     }
 
-    // Total transactions
-    const char *sql_txn = "SELECT COUNT(*) FROM transactions;";
-    if (sqlite3_prepare_v2(db, sql_txn, -1, &stmt, NULL) == SQLITE_OK) {
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            int txn_count = sqlite3_column_int(stmt, 0);
-            sprintf(temp, "Total Transactions: %d\n", txn_count);
-            strcat(response, temp);
-        }
-        sqlite3_finalize(stmt);
+    for (int shard = 0; shard < shard_count; shard++) {
+        if (writing && rcs[shard] != SQLITE_DONE && rcs[shard] != SQLITE_ROW) success = 0;
+        sqlite3_reset(stmts[shard]);
     }
+    return success;
+}
 
-    // Top 3 senders
-    const char *sql_top_senders =
-        "SELECT sender, COUNT(*) as txn_count FROM transactions "
-        "GROUP BY sender ORDER BY txn_count DESC LIMIT 3;";
-    strcat(response, "\nTop 3 Most Active Senders:\n");
+// Check if user is admin
+int is_admin(const char *username) {
+    int admin = 0;  // anonymous and unknown users are never admins
 
-    if (sqlite3_prepare_v2(db, sql_top_senders, -1, &stmt, NULL) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *sender = (const char *)sqlite3_column_text(stmt, 0);
-            int count = sqlite3_column_int(stmt, 1);
-            sprintf(temp, "  %s - %d transactions\n", sender, count);
-            strcat(response, temp);
+    sqlite3_stmt *stmt = db_shard_statement(db_shard_of(username), STMT_IS_ADMIN);
+    if (stmt) {
+        sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            admin = sqlite3_column_int(stmt, 0);
         }
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
     }
+    return admin;
 }
@@ -1,21 +1,109 @@
 #ifndef DB_H
 #define DB_H
 
+#include <stddef.h>
 #include <sqlite3.h>
+#include "schema.h"
 
-// Global database variable
+#define SALT_SIZE 16
+#define HASH_SIZE 64
+#define ITERATIONS 100000
+#define STARTING_BALANCE_PAISE 100000  // ₹1000.00 for every new account
+#define DB_MAX_SHARDS SCHEMA_MAX_SHARDS
+
+// Global database variable (schema setup of the first shard; workers use per-thread connections)
 extern sqlite3 *db;
 
+// Statements kept prepared on every worker connection
+enum db_statement {
+    STMT_INSERT_USER,              // id, username, password, salt
+    STMT_USER_CREDENTIALS,
+    STMT_APPLY_USER,               // id, username, password, salt, balance; ignored if present
+    STMT_DELETE_USER,
+    STMT_SET_TIER,                 // tier ?1 for username ?2
+    STMT_DEBIT,
+    STMT_CREDIT,
+    STMT_USER_ID,
+    STMT_USERNAME,                 // username of id ?1
+    STMT_CREDIT_RETURNING_ID,      // credit ?1 to username ?2, giving its id
+    STMT_INSERT_TRANSACTION_IDS,   // id, sender_id, receiver_id, amount, timestamp
+    STMT_JOURNAL_APPLIED,
+    STMT_SET_JOURNAL_APPLIED,
+    STMT_IS_ADMIN,
+    STMT_COUNT_USERS,
+    STMT_SUM_BALANCE,
+    STMT_COUNT_TRANSACTIONS,
+    STMT_TOP_SENDERS,  // username, count of the ?1 busiest senders
+    STMT_READ_STATS,
+    STMT_ADJUST_STAT,
+    STMT_ALL_USERS,  // users in [?1, ?2) with balance >= ?3, the first ?4 of them, with their history
+    STMT_RECEIVED,   // datetime, sender, amount, timestamp, id of transfers to user id ?1, newest first
+    STMT_HISTORY_PAGE,  // id, timestamp, sender_id, receiver_id, amount of user id ?1 before (?2, ?3), ?4 rows
+    STMT_ARCHIVE_CANDIDATES,   // id, timestamp, sender_id, receiver_id, amount older than ?1, the first ?2 by id
+    STMT_DELETE_TRANSACTION,
+    STMT_ARCHIVE_SENDER,       // add ?2 to sender ?1's archived count
+    STMT_ADD_SEGMENT,          // id, rows, min_timestamp, max_timestamp
+    STMT_LIST_SEGMENTS,        // id, rows
+    STMT_BEGIN,
+    STMT_BEGIN_READ,
+    STMT_COMMIT,
+    STMT_ROLLBACK,
+    STMT_COUNT
+};
+
+// SHOW_ALL_USERS filters; zero values filter nothing
+struct user_filter {
+    const char *prefix;           // usernames starting with this
+    sqlite3_int64 min_balance;    // paise
+    int limit;                    // users listed
+};
+
+// Receives a report piece by piece; returns 0 to stop it early
+typedef int (*report_writer)(void *ctx, const char *data, size_t len);
+
 // Function declarations
 int initialize_db();
 int signup_user(const char *username, const char *password);
 int login_user(const char *username, const char *password);
+int create_user(const char *username, const unsigned char *salt, const unsigned char *hashed_password);
+int get_credentials(const char *username, unsigned char *salt, unsigned char *hashed_password);
 double get_balance(const char *username);
-int transfer_money(const char *sender, const char *receiver, double amount);
+int db_begin_batch(int shard);
+int db_commit_batch(int shard);
+void db_rollback_batch(int shard);
+
+// Write the part of journal records that a shard holds into its tables, inside
+// an open batch; the journal has already committed them, so nothing is checked
+// but that the accounts exist
+struct journal_signup;
+struct journal_transfer;
+struct journal_tier;
+int db_apply_signup(int shard, const struct journal_signup *signup);
+int db_apply_transfer(int shard, struct journal_transfer *transfer);
+int db_apply_tier(int shard, const struct journal_tier *tier);
+// Last journal record a shard holds
+sqlite3_int64 db_journal_applied(int shard);
+int db_set_journal_applied(int shard, sqlite3_int64 seq);
 int execute_query(const char *query);
 sqlite3 *get_db_connection();
-void show_all_users(char *result);
+// Give the calling thread a read-only connection; call before its first query
+void db_thread_read_only();
+// Accounts live in one of db_shard_count() files, picked by a hash of the username
+int db_shard_count();
+int db_shard_of(const char *username);
+sqlite3 *db_shard_bootstrap(int shard);
+// The calling thread's connection to a shard, and its cached statements
+sqlite3 *db_shard_handle(int shard);
+sqlite3_stmt *db_shard_statement(int shard, enum db_statement id);
+// Connection to the first shard
+sqlite3 *db_thread_handle();
+// Username of an account in any shard; 0 if there is none
+int db_username(sqlite3_int64 id, char *name, size_t size);
+// Checkpoint the WAL on a background thread every `seconds`, or sooner once a
+// commit leaves `wal_pages` in it, instead of in whichever writer crosses the line
+int db_checkpoint_start(int seconds, int wal_pages);
+void close_db();
+int show_all_users(const struct user_filter *filter, report_writer write, void *ctx);
 int is_admin(const char *username);
-void get_admin_stats(char *response);
 
 #endif
\ No newline at end of file
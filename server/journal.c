@@ -0,0 +1,658 @@
+#include "journal.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#define HAVE_X86_CRC32 1
+#endif
+
+#define JOURNAL_MAGIC "WJNL"
+#define PATH_SIZE 512
+
+struct segment {
+    uint64_t first_seq;
+    uint64_t last_seq;  // 0 while empty
+    unsigned char *map;
+    size_t size;
+    size_t end;         // offset just past the last record
+    char path[PATH_SIZE];
+    struct segment *next;
+};
+
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t synced_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t settled_cond = PTHREAD_COND_INITIALIZER;
+
+static char journal_dir[PATH_SIZE - 32];  // room for the segment names
+static int read_only = 0;
+static struct segment *head = NULL, *tail = NULL;
+static uint64_t next_seq = 1;
+static _Atomic uint64_t synced_seq = 0;
+static size_t synced_end = 0;   // bytes of the tail segment known to be on disk
+static int unsettled = 0;
+static int holding = 0;         // journal_quiesce() is waiting
+static __thread int thread_unsettled = 0;
+
+// Where recent scans stopped, so the next one does not walk the segment again.
+// Each shard's applier scans on its own, so there is a hint per scanner to come.
+#define SCAN_HINTS 16
+
+struct scan_hint {
+    struct segment *seg;
+    size_t off;
+    uint64_t seq;
+};
+
+static struct scan_hint scan_hints[SCAN_HINTS];
+
+// Little-endian helpers
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// CRC32C (Castagnoli), with the SSE4.2 instruction where the CPU has it
+
+static uint32_t crc_table[256];
+static int crc_hardware = 0;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        crc_table[i] = crc;
+    }
+#ifdef HAVE_X86_CRC32
+    __builtin_cpu_init();
+    crc_hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#ifdef HAVE_X86_CRC32
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hardware(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t c = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = __builtin_ia32_crc32di(c, word);
+    }
+    crc = (uint32_t)c;
+    for (; len; p++, len--) crc = __builtin_ia32_crc32qi(crc, *p);
+    return crc;
+}
+#endif
+
+uint32_t journal_crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    const unsigned char *p = data;
+    crc = ~crc;
+#ifdef HAVE_X86_CRC32
+    if (crc_hardware) return ~crc32c_hardware(crc, p, len);
+#endif
+    for (; len; p++, len--) crc = crc_table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Payload encoding
+
+static void put_raw(struct journal_buffer *b, const void *data, size_t len) {
+    if (b->failed) return;
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + len) cap *= 2;
+        unsigned char *grown = realloc(b->data, cap);
+        if (!grown) {
+            b->failed = 1;
+            return;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+void journal_put_u8(struct journal_buffer *b, uint8_t value) {
+    put_raw(b, &value, 1);
+}
+
+void journal_put_u32(struct journal_buffer *b, uint32_t value) {
+    unsigned char bytes[4];
+    put_u32(bytes, value);
+    put_raw(b, bytes, 4);
+}
+
+void journal_put_i64(struct journal_buffer *b, int64_t value) {
+    unsigned char bytes[8];
+    put_u64(bytes, (uint64_t)value);
+    put_raw(b, bytes, 8);
+}
+
+void journal_put_bytes(struct journal_buffer *b, const void *data, size_t len) {
+    put_raw(b, data, len);
+}
+
+void journal_put_name(struct journal_buffer *b, const char *name) {
+    size_t len = strlen(name);
+    if (len >= JOURNAL_NAME_SIZE) {
+        b->failed = 1;
+        return;
+    }
+    journal_put_u8(b, (uint8_t)len);
+    put_raw(b, name, len);
+}
+
+// Payload decoding; each takes bytes from *p and fails rather than read past end
+
+static int take_name(const unsigned char **p, const unsigned char *end, char *name) {
+    if (*p >= end || **p >= JOURNAL_NAME_SIZE || end - *p < 1 + **p) return 0;
+    size_t len = **p;
+    memcpy(name, *p + 1, len);
+    name[len] = '\0';
+    *p += 1 + len;
+    return 1;
+}
+
+static int take_i64(const unsigned char **p, const unsigned char *end, int64_t *value) {
+    if (end - *p < 8) return 0;
+    *value = (int64_t)get_u64(*p);
+    *p += 8;
+    return 1;
+}
+
+int journal_decode_signup(const struct journal_record *rec, struct journal_signup *out) {
+    const unsigned char *p = rec->payload, *end = rec->payload + rec->size;
+    if (!take_i64(&p, end, &out->user_id) || !take_i64(&p, end, &out->balance) ||
+        !take_name(&p, end, out->username) || end - p != 16 + 64)
+        return 0;
+    out->salt = p;
+    out->hash = p + 16;
+    return 1;
+}
+
+int journal_decode_transfer(const struct journal_record *rec, struct journal_transfer *out) {
+    const unsigned char *p = rec->payload, *end = rec->payload + rec->size;
+    if (!take_i64(&p, end, &out->timestamp) || !take_name(&p, end, out->sender) || end - p < 4) return 0;
+    out->count = get_u32(p);
+    out->next = p + 4;
+    out->end = end;
+    return 1;
+}
+
+int journal_decode_tier(const struct journal_record *rec, struct journal_tier *out) {
+    const unsigned char *p = rec->payload, *end = rec->payload + rec->size;
+    if (!take_name(&p, end, out->username) || end - p != 1) return 0;
+    out->tier = p[0];
+    return 1;
+}
+
+int journal_next_line(struct journal_transfer *t, char *receiver, int64_t *paise) {
+    return t->next < t->end && take_name(&t->next, t->end, receiver) && take_i64(&t->next, t->end, paise);
+}
+
+// Segments
+
+static void write_header(unsigned char *p, uint64_t first_seq) {
+    memset(p, 0, JOURNAL_HEADER_SIZE);
+    memcpy(p, JOURNAL_MAGIC, 4);
+    put_u32(p + 4, JOURNAL_VERSION);
+    put_u64(p + 8, first_seq);
+    put_u32(p + 16, journal_crc32c(0, p, 16));
+}
+
+// The good record at off with the expected seq; returns its size on disk, or 0
+static size_t record_at(const struct segment *seg, size_t off, uint64_t seq, struct journal_record *rec) {
+    if (off + JOURNAL_RECORD_HEADER > seg->size) return 0;
+    const unsigned char *p = seg->map + off;
+    uint32_t length = get_u32(p);
+    if (length < JOURNAL_RECORD_HEADER - 8 || length > seg->size - off - 8) return 0;
+    if (get_u64(p + 8) != seq || journal_crc32c(0, p + 8, length) != get_u32(p + 4)) return 0;
+
+    rec->seq = seq;
+    rec->type = p[16];
+    rec->payload = p + JOURNAL_RECORD_HEADER;
+    rec->size = length - (JOURNAL_RECORD_HEADER - 8);
+    return align8(8 + (size_t)length);
+}
+
+static void sync_range(struct segment *seg, size_t from, size_t to) {
+    if (to <= from) return;
+    long page = sysconf(_SC_PAGESIZE);
+    size_t start = from - from % (size_t)page;
+    if (msync(seg->map + start, to - start, MS_SYNC) != 0) {
+        // The kernel may have dropped the dirty pages; carrying on could
+        // acknowledge transfers that are not on disk
+        log_error("Journal sync failed on %s: %s", seg->path, strerror(errno));
+        log_flush();
+        exit(1);
+    }
+}
+
+static int sync_dir() {
+    int fd = open(journal_dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+static struct segment *map_segment(const char *path, int create, uint64_t first_seq) {
+    int flags = read_only ? O_RDONLY : O_RDWR;
+    if (create) flags |= O_CREAT | O_EXCL;
+    int fd = open(path, flags, 0600);
+    if (fd < 0) {
+        printf("[ERROR] Cannot open journal segment %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    int err = create ? posix_fallocate(fd, 0, JOURNAL_SEGMENT_SIZE) : 0;
+    if (err || fstat(fd, &st) != 0 || st.st_size < JOURNAL_HEADER_SIZE) {
+        printf("[ERROR] Journal segment %s: %s\n", path, err ? strerror(err) : "too short");
+        close(fd);
+        if (create) unlink(path);
+        return NULL;
+    }
+
+    struct segment *seg = calloc(1, sizeof(*seg));
+    seg->size = (size_t)st.st_size;
+    seg->map = mmap(NULL, seg->size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg->map == MAP_FAILED) {
+        printf("[ERROR] Cannot map journal segment %s: %s\n", path, strerror(errno));
+        free(seg);
+        if (create) unlink(path);
+        return NULL;
+    }
+    snprintf(seg->path, sizeof(seg->path), "%s", path);
+    seg->end = JOURNAL_HEADER_SIZE;
+
+    if (create) {
+        write_header(seg->map, first_seq);
+        sync_range(seg, 0, JOURNAL_HEADER_SIZE);
+        sync_dir();
+    }
+
+    const unsigned char *h = seg->map;
+    if (memcmp(h, JOURNAL_MAGIC, 4) != 0 || get_u32(h + 4) != JOURNAL_VERSION ||
+        get_u32(h + 16) != journal_crc32c(0, h, 16)) {
+        printf("[ERROR] %s is not a version %d journal segment\n", path, JOURNAL_VERSION);
+        munmap(seg->map, seg->size);
+        free(seg);
+        return NULL;
+    }
+    seg->first_seq = get_u64(h + 8);
+    return seg;
+}
+
+static void segment_path(char *path, uint64_t first_seq) {
+    snprintf(path, PATH_SIZE, "%s/%016llx.wjl", journal_dir, (unsigned long long)first_seq);
+}
+
+// Find the end of the good records, checking the seqs carry on from the last segment
+static int recover_segment(struct segment *seg, int is_last) {
+    struct journal_record rec;
+    uint64_t seq = seg->first_seq;
+    size_t off = JOURNAL_HEADER_SIZE, len;
+
+    while ((len = record_at(seg, off, seq, &rec))) {
+        off += len;
+        seq++;
+    }
+    seg->end = off;
+    seg->last_seq = seq > seg->first_seq ? seq - 1 : 0;
+
+    int clean = off + 4 > seg->size || get_u32(seg->map + off) == 0;
+    if (clean) return 1;
+    if (!is_last) {
+        printf("[ERROR] Journal segment %s is damaged at offset %zu (seq %llu)\n",
+               seg->path, off, (unsigned long long)seq);
+        return 0;
+    }
+
+    // A write cut short by a crash: it was never acknowledged, so wipe it
+    printf("[INFO] Journal ends with a partial record at seq %llu; discarding it\n", (unsigned long long)seq);
+    if (!read_only) {
+        memset(seg->map + off, 0, seg->size - off);
+        sync_range(seg, off, seg->size);
+    }
+    return 1;
+}
+
+static int compare_seq(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int open_journal(const char *dir, uint64_t first_seq) {
+    snprintf(journal_dir, sizeof(journal_dir), "%s", dir);
+    if (!read_only && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        printf("[ERROR] Cannot create %s: %s\n", dir, strerror(errno));
+        return 0;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        printf("[ERROR] Cannot open %s: %s\n", dir, strerror(errno));
+        return 0;
+    }
+    uint64_t *seqs = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d))) {
+        unsigned long long seq;
+        char tail_name[8];
+        if (strlen(entry->d_name) != 20 || sscanf(entry->d_name, "%16llx%7s", &seq, tail_name) != 2 ||
+            strcmp(tail_name, ".wjl") != 0)
+            continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            uint64_t *grown = realloc(seqs, cap * sizeof(*seqs));
+            if (!grown) break;
+            seqs = grown;
+        }
+        seqs[count++] = seq;
+    }
+    closedir(d);
+    qsort(seqs, count, sizeof(*seqs), compare_seq);
+
+    char path[PATH_SIZE];
+    int ok = 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        segment_path(path, seqs[i]);
+        struct segment *seg = map_segment(path, 0, 0);
+        if (!seg) {
+            ok = 0;
+            break;
+        }
+        if (seg->first_seq != seqs[i] || (tail && seg->first_seq != next_seq)) {
+            printf("[ERROR] Journal segment %s does not follow seq %llu\n", path,
+                   (unsigned long long)(next_seq - 1));
+            munmap(seg->map, seg->size);
+            free(seg);
+            ok = 0;
+            break;
+        }
+        if (tail) tail->next = seg;
+        else head = seg;
+        tail = seg;
+        ok = recover_segment(seg, i == count - 1);
+        next_seq = seg->last_seq ? seg->last_seq + 1 : seg->first_seq;
+    }
+    free(seqs);
+    if (!ok) return 0;
+
+    if (!tail) {
+        if (read_only) return 1;
+        next_seq = first_seq > 0 ? first_seq : 1;
+        segment_path(path, next_seq);
+        if (!(head = tail = map_segment(path, 1, next_seq))) return 0;
+    }
+
+    synced_seq = next_seq - 1;
+    synced_end = tail->end;
+    return 1;
+}
+
+int journal_open(const char *dir, uint64_t first_seq) {
+    read_only = 0;
+    return open_journal(dir, first_seq);
+}
+
+int journal_open_read_only(const char *dir) {
+    read_only = 1;
+    return open_journal(dir, 0);
+}
+
+void journal_close() {
+    pthread_mutex_lock(&journal_lock);
+    while (head) {
+        struct segment *seg = head;
+        head = seg->next;
+        munmap(seg->map, seg->size);
+        free(seg);
+    }
+    tail = NULL;
+    memset(scan_hints, 0, sizeof(scan_hints));
+    next_seq = 1;
+    synced_seq = 0;
+    pthread_mutex_unlock(&journal_lock);
+}
+
+uint64_t journal_first_seq() {
+    pthread_mutex_lock(&journal_lock);
+    uint64_t seq = head ? head->first_seq : next_seq;
+    pthread_mutex_unlock(&journal_lock);
+    return seq;
+}
+
+uint64_t journal_last_seq() {
+    pthread_mutex_lock(&journal_lock);
+    uint64_t seq = next_seq - 1;
+    pthread_mutex_unlock(&journal_lock);
+    return seq;
+}
+
+// Sync what is left of the tail and start a new segment after it (journal_lock held)
+static int roll_segment() {
+    char path[PATH_SIZE];
+    segment_path(path, next_seq);
+    sync_range(tail, synced_end, tail->end);
+
+    struct segment *seg = map_segment(path, 1, next_seq);
+    if (!seg) return 0;
+    tail->next = seg;
+    tail = seg;
+    synced_end = seg->end;
+    return 1;
+}
+
+uint64_t journal_append(int type, const void *payload, size_t size) {
+    size_t total = align8(JOURNAL_RECORD_HEADER + size);
+    if (read_only || total > JOURNAL_SEGMENT_SIZE - JOURNAL_HEADER_SIZE) return 0;
+
+    pthread_mutex_lock(&journal_lock);
+    // A thread midway through its own group must finish it, or the quiesce never would
+    while (holding && thread_unsettled == 0) pthread_cond_wait(&settled_cond, &journal_lock);
+
+    if (tail->end + total > tail->size && !roll_segment()) {
+        pthread_mutex_unlock(&journal_lock);
+        return 0;
+    }
+
+    uint64_t seq = next_seq++;
+    unsigned char *p = tail->map + tail->end;
+    uint32_t length = (uint32_t)(JOURNAL_RECORD_HEADER - 8 + size);
+    put_u64(p + 8, seq);
+    p[16] = (unsigned char)type;
+    memcpy(p + JOURNAL_RECORD_HEADER, payload, size);
+    memset(p + JOURNAL_RECORD_HEADER + size, 0, total - JOURNAL_RECORD_HEADER - size);
+    put_u32(p + 4, journal_crc32c(0, p + 8, length));
+    put_u32(p, length);
+
+    tail->end += total;
+    tail->last_seq = seq;
+    unsettled++;
+    thread_unsettled++;
+    pthread_mutex_unlock(&journal_lock);
+    return seq;
+}
+
+void journal_sync() {
+    pthread_mutex_lock(&journal_lock);
+    struct segment *seg = tail;
+    size_t from = synced_end, to = seg->end;
+    uint64_t target = next_seq - 1;
+    pthread_mutex_unlock(&journal_lock);
+
+    if (target <= synced_seq) return;
+    sync_range(seg, from, to);  // a roll meanwhile synced the rest of seg itself
+
+    pthread_mutex_lock(&journal_lock);
+    if (target > synced_seq) {
+        synced_seq = target;
+        pthread_cond_broadcast(&synced_cond);
+    }
+    if (seg == tail && to > synced_end) synced_end = to;
+    pthread_mutex_unlock(&journal_lock);
+}
+
+uint64_t journal_synced_seq() {
+    return synced_seq;
+}
+
+void journal_settled(int count) {
+    pthread_mutex_lock(&journal_lock);
+    unsettled -= count;
+    thread_unsettled -= count;
+    if (unsettled == 0) pthread_cond_broadcast(&settled_cond);
+    pthread_mutex_unlock(&journal_lock);
+}
+
+uint64_t journal_quiesce() {
+    pthread_mutex_lock(&journal_lock);
+    holding++;
+    while (unsettled > 0) pthread_cond_wait(&settled_cond, &journal_lock);
+    uint64_t seq = next_seq - 1;
+    holding--;
+    pthread_cond_broadcast(&settled_cond);
+    pthread_mutex_unlock(&journal_lock);
+    return seq;
+}
+
+uint64_t journal_wait(uint64_t seq, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&journal_lock);
+    while (synced_seq <= seq) {
+        if (pthread_cond_timedwait(&synced_cond, &journal_lock, &deadline) == ETIMEDOUT) break;
+    }
+    uint64_t synced = synced_seq;
+    pthread_mutex_unlock(&journal_lock);
+    return synced;
+}
+
+int journal_scan(uint64_t after, journal_visitor visit, void *ctx) {
+    uint64_t limit = read_only ? UINT64_MAX : synced_seq;
+    struct journal_record rec;
+
+    pthread_mutex_lock(&journal_lock);
+    struct segment *seg = head;
+    size_t off = JOURNAL_HEADER_SIZE;
+    uint64_t seq = seg ? seg->first_seq : next_seq;
+
+    // The closest hint at or before the starting point
+    struct scan_hint *hint = NULL;
+    for (int i = 0; i < SCAN_HINTS; i++) {
+        struct scan_hint *h = &scan_hints[i];
+        if (h->seg && h->seq <= after + 1 && h->seg->first_seq <= after + 1 && (!hint || h->seq > hint->seq))
+            hint = h;
+    }
+    if (hint) {
+        seg = hint->seg;
+        off = hint->off;
+        seq = hint->seq;
+    } else {
+        // Skip whole segments that end before the starting point
+        while (seg && seg->next && seg->next->first_seq <= after + 1) seg = seg->next;
+        if (seg) seq = seg->first_seq;
+    }
+    pthread_mutex_unlock(&journal_lock);
+
+    if (seq > after + 1) return 0;  // already trimmed
+    uint64_t started = seq;
+    while (seg && seq <= limit) {
+        size_t len = record_at(seg, off, seq, &rec);
+        if (!len) {
+            pthread_mutex_lock(&journal_lock);
+            struct segment *next = seg->next;
+            pthread_mutex_unlock(&journal_lock);
+            if (!next || next->first_seq != seq) break;
+            seg = next;
+            off = JOURNAL_HEADER_SIZE;
+            continue;
+        }
+
+        int keep_going = 1;
+        if (seq > after) keep_going = visit(ctx, &rec);
+        off += len;
+        seq++;
+        if (!keep_going) break;
+    }
+
+    // Leave a hint where this scan stopped, in place of the one it started
+    // from or else the one furthest behind
+    if (seg && seq > started) {
+        pthread_mutex_lock(&journal_lock);
+        struct scan_hint *slot = hint;
+        for (int i = 0; !slot && i < SCAN_HINTS; i++)
+            if (!scan_hints[i].seg) slot = &scan_hints[i];
+        if (!slot) {
+            slot = &scan_hints[0];
+            for (int i = 1; i < SCAN_HINTS; i++)
+                if (scan_hints[i].seq < slot->seq) slot = &scan_hints[i];
+        }
+        // Trimming stops short of records a scan has yet to pass, so seg is still there
+        *slot = (struct scan_hint){seg, off, seq};
+        pthread_mutex_unlock(&journal_lock);
+    }
+    return 1;
+}
+
+void journal_trim(uint64_t seq) {
+    while (1) {
+        pthread_mutex_lock(&journal_lock);
+        struct segment *seg = head;
+        if (!seg || seg == tail || seg->last_seq == 0 || seg->last_seq > seq) {
+            pthread_mutex_unlock(&journal_lock);
+            return;
+        }
+        head = seg->next;
+        for (int i = 0; i < SCAN_HINTS; i++)
+            if (scan_hints[i].seg == seg) scan_hints[i].seg = NULL;
+        pthread_mutex_unlock(&journal_lock);
+
+        munmap(seg->map, seg->size);
+        if (unlink(seg->path) != 0) log_error("Cannot remove journal segment %s: %s", seg->path, strerror(errno));
+        free(seg);
+    }
+}
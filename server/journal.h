@@ -0,0 +1,149 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only record of every committed change: a transfer is durable once
+// its record is synced here, and the ledger is rebuilt from a snapshot plus
+// the records after it. SQLite is a view that store.c keeps up from the
+// journal in the background.
+//
+// Format, version 1. All integers are little-endian.
+//
+//   journal/<first seq as 16 hex digits>.wjl   segments of JOURNAL_SEGMENT_SIZE bytes
+//
+//   segment header (64 bytes):
+//     "WJNL" | u32 version | u64 first_seq | u32 crc32c of the 20 bytes before it | zeros
+//
+//   record, starting on an 8-byte boundary and zero-padded to the next one:
+//     u32 length          bytes from seq to the end of the payload
+//     u32 crc32c          of those bytes
+//     u64 seq | u8 type | payload
+//
+//   Seqs start at 1 and go up by one with no gaps across segments. A length of
+//   0 ends the segment (it was preallocated with zeros); so does a record whose
+//   crc or seq does not match, which is where a crash cut the last write short.
+//
+//   JOURNAL_SIGNUP payload:
+//     i64 user_id | i64 balance (paise) | u8 name length | name | salt[16] | hash[64]
+//   JOURNAL_TRANSFER payload (one record per TRANSFER or per TRANSFER_BATCH):
+//     i64 timestamp | u8 sender length | sender | u32 count |
+//     count x (u8 receiver length | receiver | i64 amount in paise)
+//   JOURNAL_TIER payload (SET_TIER):
+//     u8 name length | name | u8 tier
+//
+// New record types may be added within a version; readers skip types they do
+// not know. Anything else changes JOURNAL_VERSION.
+
+#define JOURNAL_DIR "journal"
+#define JOURNAL_VERSION 1
+#define JOURNAL_SEGMENT_SIZE (64u << 20)
+#define JOURNAL_HEADER_SIZE 64
+#define JOURNAL_RECORD_HEADER 17  // length, crc, seq and type
+#define JOURNAL_NAME_SIZE 64      // longest name a record carries, plus its NUL
+
+enum journal_record_type {
+    JOURNAL_SIGNUP = 1,
+    JOURNAL_TRANSFER = 2,
+    JOURNAL_TIER = 3
+};
+
+struct journal_record {
+    uint64_t seq;
+    int type;
+    const unsigned char *payload;
+    size_t size;
+};
+
+struct journal_signup {
+    int64_t user_id;
+    int64_t balance;
+    char username[JOURNAL_NAME_SIZE];
+    const unsigned char *salt;  // point into the record
+    const unsigned char *hash;
+};
+
+struct journal_tier {
+    char username[JOURNAL_NAME_SIZE];
+    int tier;
+};
+
+// A transfer record being read line by line with journal_next_line()
+struct journal_transfer {
+    int64_t timestamp;
+    char sender[JOURNAL_NAME_SIZE];
+    uint32_t count;
+    const unsigned char *next, *end;
+};
+
+// Payload under construction
+struct journal_buffer {
+    unsigned char *data;
+    size_t len, cap;
+    int failed;  // out of memory; the payload is incomplete
+};
+
+void journal_put_u8(struct journal_buffer *b, uint8_t value);
+void journal_put_u32(struct journal_buffer *b, uint32_t value);
+void journal_put_i64(struct journal_buffer *b, int64_t value);
+void journal_put_bytes(struct journal_buffer *b, const void *data, size_t len);
+void journal_put_name(struct journal_buffer *b, const char *name);
+
+// These return 0 for a malformed payload
+int journal_decode_signup(const struct journal_record *rec, struct journal_signup *out);
+int journal_decode_transfer(const struct journal_record *rec, struct journal_transfer *out);
+int journal_decode_tier(const struct journal_record *rec, struct journal_tier *out);
+
+// The next receiver and amount; returns 0 after the last line
+int journal_next_line(struct journal_transfer *t, char *receiver, int64_t *paise);
+
+uint32_t journal_crc32c(uint32_t crc, const void *data, size_t len);
+
+// Open the journal in dir, creating it if needed, and find the end of the last
+// good record. A new journal starts at first_seq, so its seqs carry on from
+// whatever the database has already applied.
+int journal_open(const char *dir, uint64_t first_seq);
+
+// Open an existing journal for reading only, e.g. from a tool while the server runs
+int journal_open_read_only(const char *dir);
+void journal_close();
+
+// First seq still on disk and the last one written
+uint64_t journal_first_seq();
+uint64_t journal_last_seq();
+
+// Add a record; returns its seq, or 0 if it could not be written. It is not
+// durable until journal_sync(), and counts as unsettled until journal_settled().
+uint64_t journal_append(int type, const void *payload, size_t size);
+
+// Make every record appended so far durable. If the kernel reports a write
+// error the pages may or may not have reached the disk, so the process exits
+// rather than guess.
+void journal_sync();
+
+// Last seq known to be on disk
+uint64_t journal_synced_seq();
+
+// The caller has applied count of its appended records to the ledger
+void journal_settled(int count);
+
+// Hold new appends until every record is settled, then return the last seq.
+// At that moment every change up to the seq is in the ledger and none after
+// it, which makes it the starting point of a snapshot.
+uint64_t journal_quiesce();
+
+// Block until a record after seq is durable or timeout_ms passes; returns the last durable seq
+uint64_t journal_wait(uint64_t seq, int timeout_ms);
+
+// Call visit for every good record after seq, in order; stops early if it returns 0.
+// Only reads records that are durable. Returns 0 if records after seq were
+// already trimmed. Scans may run side by side; journal_trim() alongside one
+// must leave the records after its starting point.
+typedef int (*journal_visitor)(void *ctx, const struct journal_record *rec);
+int journal_scan(uint64_t after, journal_visitor visit, void *ctx);
+
+// Delete segments whose records are all at or before seq
+void journal_trim(uint64_t seq);
+
+#endif
@@ -0,0 +1,328 @@
+#include "ledger.h"
+#include "db.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#define MIN_BUCKETS 65536
+#define NAME_SIZE 64
+#define VISIT_SLICE 4096  // buckets visited per hold of a stripe lock
+
+// Balances are kept in paise so concurrent updates are exact integer adds
+struct account {
+    _Atomic int64_t balance;  // available to spend
+    int64_t pending;          // reserved by transfers not yet settled
+    uint64_t last_seq;        // last journal record applied to this account
+    int tier;                 // velocity limits, see velocity.h
+    struct velocity *velocity;  // recent sends; allocated on the first one under a limited tier
+    struct account *_Atomic next;
+    char username[NAME_SIZE];
+} __attribute__((aligned(64)));  // one cache line per hot balance
+
+// A bucket's low bits equal its stripe index, so each chain has exactly one writer lock
+struct stripe {
+    pthread_mutex_t lock;
+} __attribute__((aligned(64)));
+
+static struct stripe stripes[LEDGER_STRIPES];
+static struct account *_Atomic *buckets = NULL;
+static size_t bucket_mask = 0;
+static _Atomic size_t account_count = 0;
+
+// Accounts known at startup come from one allocation instead of millions
+static struct account *slab = NULL;
+static size_t slab_used = 0, slab_size = 0;
+
+// Checked against by tiers that track nothing
+static const struct velocity no_sends;
+
+static uint64_t hash_username(const char *username) {
+    uint64_t h = 1469598103934665603ULL;  // FNV-1a
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int64_t to_paise(double amount) {
+    return (int64_t)llround(amount * 100.0);
+}
+
+static struct stripe *stripe_for(uint64_t hash) {
+    return &stripes[hash & (LEDGER_STRIPES - 1)];
+}
+
+// Lock-free: accounts are only ever prepended and never removed
+static struct account *find_account(const char *username, uint64_t hash) {
+    struct account *a = atomic_load_explicit(&buckets[hash & bucket_mask], memory_order_acquire);
+    while (a) {
+        if (strcmp(a->username, username) == 0) return a;
+        a = atomic_load_explicit(&a->next, memory_order_acquire);
+    }
+    return NULL;
+}
+
+// Takes the stripe lock
+static int insert_account(const char *username, int64_t paise, uint64_t seq, int tier) {
+    if (strlen(username) >= NAME_SIZE) return 0;
+
+    uint64_t hash = hash_username(username);
+    struct stripe *s = stripe_for(hash);
+
+    pthread_mutex_lock(&s->lock);
+    if (find_account(username, hash)) {
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+
+    struct account *a = slab_used < slab_size ? &slab[slab_used++] : aligned_alloc(64, sizeof(*a));
+    if (!a) {
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+    memset(a, 0, sizeof(*a));
+    strcpy(a->username, username);
+    atomic_init(&a->balance, paise);
+    a->last_seq = seq;
+    a->tier = tier;
+
+    struct account *_Atomic *head = &buckets[hash & bucket_mask];
+    atomic_init(&a->next, atomic_load_explicit(head, memory_order_relaxed));
+    atomic_store_explicit(head, a, memory_order_release);  // publish after it is fully built
+    pthread_mutex_unlock(&s->lock);
+    account_count++;
+    return 1;
+}
+
+int ledger_init(size_t accounts) {
+    // Size the table once for a load factor of at most 1/2 at startup
+    size_t nbuckets = MIN_BUCKETS;
+    while (nbuckets < accounts * 2) nbuckets *= 2;
+    buckets = calloc(nbuckets, sizeof(*buckets));
+    if (!buckets) return 0;
+    bucket_mask = nbuckets - 1;
+
+    for (int i = 0; i < LEDGER_STRIPES; i++)
+        pthread_mutex_init(&stripes[i].lock, NULL);
+
+    // Untouched pages cost nothing, so a generous guess is fine
+    if (accounts > 0 && (slab = aligned_alloc(64, accounts * sizeof(*slab)))) slab_size = accounts;
+    return 1;
+}
+
+int ledger_load(sqlite3 *handle, int64_t after_id, uint64_t seq) {
+    sqlite3_stmt *stmt;
+    size_t users = 0;
+
+    if (sqlite3_prepare_v2(handle, "SELECT username, balance, tier FROM users WHERE id > ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        printf("[ERROR] Ledger load failed: %s\n", sqlite3_errmsg(handle));
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, after_id);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *username = (const char *)sqlite3_column_text(stmt, 0);
+        if (username) users += insert_account(username, sqlite3_column_int64(stmt, 1), seq, sqlite3_column_int(stmt, 2));
+    }
+    sqlite3_finalize(stmt);
+
+    printf("[INFO] Ledger loaded %zu accounts from the database\n", users);
+    return 1;
+}
+
+int ledger_add(const char *username, int64_t paise, uint64_t seq, int tier) {
+    return insert_account(username, paise, seq, tier);
+}
+
+int ledger_set_tier(const char *username, int tier) {
+    uint64_t hash = hash_username(username);
+    struct account *a = find_account(username, hash);
+    if (!a) return 0;
+
+    struct stripe *s = stripe_for(hash);
+    pthread_mutex_lock(&s->lock);
+    a->tier = tier;
+    pthread_mutex_unlock(&s->lock);
+    return 1;
+}
+
+size_t ledger_count() {
+    return account_count;
+}
+
+int ledger_balance(const char *username, double *balance) {
+    struct account *a = find_account(username, hash_username(username));
+    if (!a) return 0;
+    *balance = atomic_load_explicit(&a->balance, memory_order_acquire) / 100.0;
+    return 1;
+}
+
+// Under the sender's stripe lock: count the request against the sender's tier,
+// then take each amount in order while the limits and the funds allow
+static int reserve_locked(struct account *from, const char *const *receivers, const int64_t *paise, int count,
+                          int all_or_nothing, unsigned char *reserved, enum velocity_verdict *verdicts) {
+    const struct velocity_limits *limits = velocity_tier(from->tier);
+    uint32_t now = (uint32_t)time(NULL);
+    int tracked = velocity_tracked(limits);
+    const struct velocity *sends = &no_sends;
+    struct velocity trial;
+
+    if (tracked) {
+        if (!from->velocity && !(from->velocity = calloc(1, sizeof(*from->velocity)))) return 0;
+        trial = *from->velocity;
+        sends = &trial;
+
+        enum velocity_verdict verdict = velocity_check_request(sends, limits, now);
+        if (verdict != VELOCITY_OK) {
+            for (int i = 0; i < count; i++)
+                if (paise[i] > 0) verdicts[i] = verdict;
+            return 0;
+        }
+        velocity_record_request(&trial, now);
+    }
+
+    int64_t balance = atomic_load_explicit(&from->balance, memory_order_relaxed);
+    int64_t left = balance;
+    int taken = 0;
+    for (int i = 0; i < count; i++) {
+        if (paise[i] <= 0) continue;
+        verdicts[i] = velocity_check_payment(sends, limits, now, receivers[i], paise[i]);
+        if (verdicts[i] != VELOCITY_OK || paise[i] > left) {
+            if (all_or_nothing) {
+                taken = 0;
+                break;
+            }
+            continue;
+        }
+        if (tracked) velocity_record_payment(&trial, limits, now, receivers[i], paise[i]);
+        left -= paise[i];
+        reserved[i] = 1;
+        taken++;
+    }
+
+    if (!taken) {
+        memset(reserved, 0, count);
+        return 0;
+    }
+    atomic_store_explicit(&from->balance, left, memory_order_release);
+    from->pending += balance - left;
+    if (tracked) *from->velocity = trial;
+    return taken;
+}
+
+int ledger_reserve(const char *sender, const char *receiver, double amount, enum velocity_verdict *verdict) {
+    int64_t paise = to_paise(amount);
+    *verdict = VELOCITY_OK;
+    if (paise <= 0) return 0;
+
+    uint64_t hash = hash_username(sender);
+    struct account *from = find_account(sender, hash);
+    if (!from || !find_account(receiver, hash_username(receiver))) return 0;
+
+    unsigned char reserved = 0;
+    struct stripe *s = stripe_for(hash);
+    pthread_mutex_lock(&s->lock);
+    int ok = reserve_locked(from, &receiver, &paise, 1, 1, &reserved, verdict);
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+int ledger_reserve_many(const char *sender, const char *const *receivers, const double *amounts, int count,
+                        int all_or_nothing, unsigned char *reserved, enum velocity_verdict *verdicts) {
+    if (count <= 0) return 0;
+    uint64_t hash = hash_username(sender);
+    struct account *from = find_account(sender, hash);
+    int64_t *paise = malloc(sizeof(*paise) * count);
+    memset(reserved, 0, count);
+    for (int i = 0; i < count; i++) verdicts[i] = VELOCITY_OK;
+    if (!from || !paise) {
+        free(paise);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) paise[i] = to_paise(amounts[i]);
+
+    struct stripe *s = stripe_for(hash);
+    pthread_mutex_lock(&s->lock);
+    int taken = reserve_locked(from, receivers, paise, count, all_or_nothing, reserved, verdicts);
+    pthread_mutex_unlock(&s->lock);
+    free(paise);
+    return taken;
+}
+
+void ledger_note_sent(const char *sender, const char *receiver, int64_t paise, uint32_t when, int new_request) {
+    uint64_t hash = hash_username(sender);
+    struct account *from = find_account(sender, hash);
+    if (!from) return;
+
+    struct stripe *s = stripe_for(hash);
+    pthread_mutex_lock(&s->lock);
+    const struct velocity_limits *limits = velocity_tier(from->tier);
+    if (velocity_tracked(limits) && (from->velocity || (from->velocity = calloc(1, sizeof(*from->velocity))))) {
+        if (new_request) velocity_record_request(from->velocity, when);
+        velocity_record_payment(from->velocity, limits, when, receiver, paise);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void ledger_settle(const char *sender, const char *receiver, double amount, uint64_t seq) {
+    int64_t paise = to_paise(amount);
+    uint64_t hash = hash_username(sender);
+    struct account *from = find_account(sender, hash);
+    if (!from) return;
+
+    struct stripe *s = stripe_for(hash);
+    pthread_mutex_lock(&s->lock);
+    from->pending -= paise;
+    if (seq) from->last_seq = seq;
+    else atomic_fetch_add_explicit(&from->balance, paise, memory_order_release);
+    pthread_mutex_unlock(&s->lock);
+    if (!seq) return;
+
+    hash = hash_username(receiver);
+    struct account *to = find_account(receiver, hash);
+    if (!to) return;
+
+    s = stripe_for(hash);
+    pthread_mutex_lock(&s->lock);
+    atomic_fetch_add_explicit(&to->balance, paise, memory_order_release);
+    to->last_seq = seq;
+    pthread_mutex_unlock(&s->lock);
+}
+
+int ledger_replay(const char *username, int64_t delta, uint64_t seq) {
+    uint64_t hash = hash_username(username);
+    struct account *a = find_account(username, hash);
+    if (!a) return 0;
+
+    // last_seq is left alone, so a record touching the account twice counts twice
+    struct stripe *s = stripe_for(hash);
+    pthread_mutex_lock(&s->lock);
+    if (seq > a->last_seq) atomic_fetch_add_explicit(&a->balance, delta, memory_order_release);
+    pthread_mutex_unlock(&s->lock);
+    return 1;
+}
+
+void ledger_visit(ledger_visitor visit, void *ctx) {
+    size_t nbuckets = bucket_mask + 1;
+    for (size_t stripe = 0; stripe < LEDGER_STRIPES; stripe++) {
+        struct stripe *s = &stripes[stripe];
+        for (size_t first = stripe; first < nbuckets; first += (size_t)VISIT_SLICE * LEDGER_STRIPES) {
+            size_t last = first + (size_t)VISIT_SLICE * LEDGER_STRIPES;
+            if (last > nbuckets) last = nbuckets;
+
+            pthread_mutex_lock(&s->lock);
+            for (size_t b = first; b < last; b += LEDGER_STRIPES) {
+                struct account *a = atomic_load_explicit(&buckets[b], memory_order_acquire);
+                for (; a; a = atomic_load_explicit(&a->next, memory_order_acquire))
+                    visit(ctx, a->username, atomic_load_explicit(&a->balance, memory_order_relaxed) + a->pending,
+                          a->last_seq, a->tier);
+            }
+            pthread_mutex_unlock(&s->lock);
+        }
+    }
+}
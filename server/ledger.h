@@ -0,0 +1,72 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <stdint.h>
+
+// In-memory copy of every account balance, sharded by username hash.
+// Reads are lock-free; each stripe's lock serializes the writers of its accounts.
+// The journal is the durable copy: transfers reserve funds here first, and the
+// receiver is only credited once the transfer's journal record is on disk.
+// Each account remembers the seq of the last journal record that changed it,
+// so a snapshot can be read while transfers carry on, and its tier's velocity
+// counters, which are checked and updated together with each reservation.
+
+#include <stddef.h>
+#include <sqlite3.h>
+#include "velocity.h"
+
+#define LEDGER_STRIPES 64
+
+// Size the table for about this many accounts (called once, before any other)
+int ledger_init(size_t accounts);
+
+// Load the accounts with users.id above after_id from one shard's users table,
+// whose rows are as of journal record seq. ledger_init() must have been called.
+int ledger_load(sqlite3 *handle, int64_t after_id, uint64_t seq);
+
+// Track an account created by journal record seq; an account already known is left alone
+int ledger_add(const char *username, int64_t paise, uint64_t seq, int tier);
+
+// Move an account to another velocity tier; returns 0 if it is unknown
+int ledger_set_tier(const char *username, int tier);
+
+// Current balance; returns 0 if the account is unknown
+int ledger_balance(const char *username, double *balance);
+
+// Check the sender's velocity limits and funds and debit it under its stripe
+// lock. Returns 0 (and changes nothing) if either account is unknown, a limit
+// is reached, which *verdict then names, or the funds are insufficient.
+int ledger_reserve(const char *sender, const char *receiver, double amount, enum velocity_verdict *verdict);
+
+// Debit several amounts from one account under a single stripe lock, for a
+// batch of transfers; the batch counts as one request against the rate limit.
+// With all_or_nothing either every amount is reserved or none is; otherwise
+// each is taken in order while the limits and funds last. Amounts of 0 or less
+// are skipped. Sets reserved[i] for each amount taken, verdicts[i] for each
+// one a limit refused, and returns how many were taken. Receivers are not
+// checked; the caller has done that.
+int ledger_reserve_many(const char *sender, const char *const *receivers, const double *amounts, int count,
+                        int all_or_nothing, unsigned char *reserved, enum velocity_verdict *verdicts);
+
+// Startup: count a payment sent at when towards the sender's limits, in any
+// order. new_request is 0 for the later payments of one batch.
+void ledger_note_sent(const char *sender, const char *receiver, int64_t paise, uint32_t when, int new_request);
+
+// Finish a reserved transfer: credit the receiver if journal record seq holds
+// it, or refund the sender when seq is 0
+void ledger_settle(const char *sender, const char *receiver, double amount, uint64_t seq);
+
+// Startup replay: add delta to an account unless it already reflects record
+// seq, having come from a snapshot read after that record was settled.
+// Returns 0 if the account is unknown.
+int ledger_replay(const char *username, int64_t delta, uint64_t seq);
+
+// Each account's committed balance (reserved funds count as still there), the
+// seq of the last record that changed it and its tier. Holds each stripe's lock for a
+// slice of the table at a time, so transfers keep going meanwhile.
+typedef void (*ledger_visitor)(void *ctx, const char *username, int64_t paise, uint64_t seq, int tier);
+void ledger_visit(ledger_visitor visit, void *ctx);
+
+size_t ledger_count();
+
+#endif
@@ -0,0 +1,417 @@
+#include "logger.h"
+#include "metrics.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+
+#define LOG_LINE_MAX 1024
+#define LOG_IDLE_NS 1000000  // writer sleep when every ring is empty
+#define LOG_FLUSH_TRIES 100  // 1 ms apart, in case the writer is mid-drain
+
+// struct log_site.state
+enum {
+    SITE_NEW,
+    SITE_PARSING,
+    SITE_CAPTURE,     // arguments are copied and formatted by the writer
+    SITE_FORMAT_NOW   // the format needs something capture cannot do
+};
+
+// How an argument is read off the va_list and handed back to snprintf
+enum arg_kind {
+    ARG_INT,
+    ARG_UINT,
+    ARG_LONG,
+    ARG_ULONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_INTMAX,
+    ARG_PTRDIFF,
+    ARG_DOUBLE,
+    ARG_POINTER,
+    ARG_STRING
+};
+
+#define NULL_STRING 0xFFFF  // string length marking a NULL %s
+
+struct log_record {
+    const struct log_site *site;
+    uint16_t len;
+    uint8_t formatted;  // data holds the finished message rather than arguments
+    uint8_t data[LOG_RECORD_SIZE - sizeof(void *) - 4];
+};
+
+// One thread's records. The thread advances head, the writer advances tail.
+struct log_ring {
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t dropped;
+    uint64_t tail __attribute__((aligned(64)));
+    struct log_ring *next;
+    struct log_record slots[LOG_RING_SLOTS];
+};
+
+enum log_level log_threshold = LOG_INFO;
+
+static const char *level_names[LOG_LEVEL_COUNT] = {"debug", "info", "error"};
+static const char *level_prefixes[LOG_LEVEL_COUNT] = {"[DEBUG] ", "[INFO] ", "[ERROR] "};
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct log_ring *rings = NULL;
+static __thread struct log_ring *local = NULL;
+static __thread int no_ring = 0;
+
+// Held by whoever is draining the rings: the writer thread, or log_flush()
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t reported_drops = 0;
+
+static struct log_ring *ring() {
+    if (local || no_ring) return local;
+
+    struct log_ring *r = calloc(1, sizeof(*r));
+    if (!r) {
+        no_ring = 1;  // this thread's messages are all dropped
+        return NULL;
+    }
+    pthread_mutex_lock(&rings_lock);
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock(&rings_lock);
+    local = r;
+    return r;
+}
+
+// Work out once per call site what each conversion needs
+static int parse_site(struct log_site *site) {
+    const char *f = site->format;
+    int nargs = 0;
+
+    for (size_t i = 0; f[i]; i++) {
+        if (f[i] != '%') continue;
+        size_t start = i++;
+        if (f[i] == '%') continue;
+
+        while (f[i] && strchr("-+ #0'", f[i])) i++;
+        while (f[i] >= '0' && f[i] <= '9') i++;
+        if (f[i] == '.') {
+            i++;
+            while (f[i] >= '0' && f[i] <= '9') i++;
+        }
+        if (f[i] == '*') return SITE_FORMAT_NOW;
+
+        int longs = 0, halves = 0;
+        char size = 0;
+        while (f[i] == 'l') longs++, i++;
+        while (f[i] == 'h') halves++, i++;
+        if (f[i] == 'z' || f[i] == 'j' || f[i] == 't' || f[i] == 'L') size = f[i++];
+
+        enum arg_kind kind;
+        switch (f[i]) {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+                int is_signed = f[i] == 'd' || f[i] == 'i';
+                if (size == 'z') kind = ARG_SIZE;
+                else if (size == 'j') kind = ARG_INTMAX;
+                else if (size == 't') kind = ARG_PTRDIFF;
+                else if (size == 'L') return SITE_FORMAT_NOW;
+                else if (longs >= 2) kind = ARG_LLONG;
+                else if (longs == 1) kind = is_signed ? ARG_LONG : ARG_ULONG;
+                else kind = is_signed ? ARG_INT : ARG_UINT;  // h and hh are promoted to int
+                break;
+            }
+            case 'c':
+                if (longs || size) return SITE_FORMAT_NOW;
+                kind = ARG_INT;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                if (size == 'L') return SITE_FORMAT_NOW;
+                kind = ARG_DOUBLE;
+                break;
+            case 's':
+                if (longs || halves || size) return SITE_FORMAT_NOW;
+                kind = ARG_STRING;
+                break;
+            case 'p':
+                kind = ARG_POINTER;
+                break;
+            default:
+                return SITE_FORMAT_NOW;
+        }
+
+        size_t len = i + 1 - start;
+        if (nargs == LOG_MAX_ARGS || len >= sizeof(site->specs[0])) return SITE_FORMAT_NOW;
+        site->kinds[nargs] = kind;
+        site->spec_start[nargs] = start;
+        site->spec_end[nargs] = i + 1;
+        memcpy(site->specs[nargs], f + start, len);
+        site->specs[nargs][len] = '\0';
+        nargs++;
+    }
+    site->nargs = nargs;
+    return SITE_CAPTURE;
+}
+
+static int site_state(struct log_site *site) {
+    int state = __atomic_load_n(&site->state, __ATOMIC_ACQUIRE);
+    if (state != SITE_NEW) return state == SITE_PARSING ? SITE_FORMAT_NOW : state;
+
+    int expected = SITE_NEW;
+    if (!__atomic_compare_exchange_n(&site->state, &expected, SITE_PARSING, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        return SITE_FORMAT_NOW;  // another thread is parsing it right now
+    state = parse_site(site);
+    __atomic_store_n(&site->state, state, __ATOMIC_RELEASE);
+    return state;
+}
+
+static void capture(const struct log_site *site, struct log_record *rec, va_list args) {
+    uint8_t *out = rec->data;
+    size_t used = 0;
+
+    // Strings share what the fixed-size arguments leave over
+    size_t reserved = 0;
+    for (int i = 0; i < site->nargs; i++) reserved += site->kinds[i] == ARG_STRING ? sizeof(uint16_t) : sizeof(uint64_t);
+
+    for (int i = 0; i < site->nargs; i++) {
+        uint64_t value;
+        switch (site->kinds[i]) {
+            case ARG_INT: value = (uint64_t)(int64_t)va_arg(args, int); break;
+            case ARG_UINT: value = va_arg(args, unsigned int); break;
+            case ARG_LONG: value = (uint64_t)(int64_t)va_arg(args, long); break;
+            case ARG_ULONG: value = va_arg(args, unsigned long); break;
+            case ARG_LLONG: value = va_arg(args, unsigned long long); break;
+            case ARG_SIZE: value = va_arg(args, size_t); break;
+            case ARG_INTMAX: value = (uint64_t)va_arg(args, intmax_t); break;
+            case ARG_PTRDIFF: value = (uint64_t)va_arg(args, ptrdiff_t); break;
+            case ARG_POINTER: value = (uintptr_t)va_arg(args, void *); break;
+            case ARG_DOUBLE: {
+                double d = va_arg(args, double);
+                memcpy(&value, &d, sizeof(value));
+                break;
+            }
+            case ARG_STRING: {
+                const char *s = va_arg(args, const char *);
+                reserved -= sizeof(uint16_t);
+                size_t room = sizeof(rec->data) - used - sizeof(uint16_t) - reserved;
+                uint16_t len = s ? strnlen(s, room) : NULL_STRING;
+                memcpy(out + used, &len, sizeof(len));
+                used += sizeof(len);
+                if (s) {
+                    memcpy(out + used, s, len);
+                    used += len;
+                }
+                continue;
+            }
+            default:
+                return;
+        }
+        reserved -= sizeof(uint64_t);
+        memcpy(out + used, &value, sizeof(value));
+        used += sizeof(value);
+    }
+    rec->len = used;
+    rec->formatted = 0;
+}
+
+void log_write(struct log_site *site, ...) {
+    struct log_ring *r = ring();
+    if (!r) return;
+
+    uint64_t head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        metrics_count(COUNTER_LOG_DROPPED, 1);
+        return;
+    }
+
+    struct log_record *rec = &r->slots[head % LOG_RING_SLOTS];
+    va_list args;
+    va_start(args, site);
+    if (site_state(site) == SITE_CAPTURE) {
+        capture(site, rec, args);
+    } else {
+        int n = vsnprintf((char *)rec->data, sizeof(rec->data), site->format, args);
+        rec->len = n < 0 ? 0 : (size_t)n < sizeof(rec->data) ? (size_t)n : sizeof(rec->data) - 1;
+        rec->formatted = 1;
+    }
+    va_end(args);
+    rec->site = site;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Append printf output to a line, truncating at the end of the buffer
+static size_t append(char *line, size_t used, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+static size_t append(char *line, size_t used, const char *format, ...) {
+    if (used >= LOG_LINE_MAX - 1) return used;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line + used, LOG_LINE_MAX - 1 - used, format, args);
+    va_end(args);
+    if (n < 0) return used;
+    used += n;
+    return used < LOG_LINE_MAX - 1 ? used : LOG_LINE_MAX - 2;
+}
+
+static size_t append_text(char *line, size_t used, const char *text, size_t len) {
+    if (len > LOG_LINE_MAX - 2 - used) len = LOG_LINE_MAX - 2 - used;
+    memcpy(line + used, text, len);
+    return used + len;
+}
+
+// Run one captured argument back through its own conversion spec
+static size_t format_arg(char *line, size_t used, const char *spec, enum arg_kind kind,
+                         const uint8_t *data, size_t *offset) {
+    uint64_t value;
+    if (kind == ARG_STRING) {
+        uint16_t len;
+        memcpy(&len, data + *offset, sizeof(len));
+        *offset += sizeof(len);
+        if (len == NULL_STRING) return append(line, used, spec, (char *)NULL);
+
+        char text[LOG_RECORD_SIZE];
+        memcpy(text, data + *offset, len);
+        text[len] = '\0';
+        *offset += len;
+        return append(line, used, spec, text);
+    }
+
+    memcpy(&value, data + *offset, sizeof(value));
+    *offset += sizeof(value);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+    switch (kind) {
+        case ARG_INT: return append(line, used, spec, (int)value);
+        case ARG_UINT: return append(line, used, spec, (unsigned int)value);
+        case ARG_LONG: return append(line, used, spec, (long)value);
+        case ARG_ULONG: return append(line, used, spec, (unsigned long)value);
+        case ARG_LLONG: return append(line, used, spec, (long long)value);
+        case ARG_SIZE: return append(line, used, spec, (size_t)value);
+        case ARG_INTMAX: return append(line, used, spec, (intmax_t)value);
+        case ARG_PTRDIFF: return append(line, used, spec, (ptrdiff_t)value);
+        case ARG_POINTER: return append(line, used, spec, (void *)(uintptr_t)value);
+        case ARG_DOUBLE: {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            return append(line, used, spec, d);
+        }
+        default: return used;
+    }
+#pragma GCC diagnostic pop
+}
+
+static void write_record(const struct log_record *rec) {
+    const struct log_site *site = rec->site;
+    char line[LOG_LINE_MAX];
+    size_t used = append_text(line, 0, level_prefixes[site->level], strlen(level_prefixes[site->level]));
+
+    if (rec->formatted) {
+        used = append_text(line, used, (const char *)rec->data, rec->len);
+    } else {
+        const char *f = site->format;
+        size_t offset = 0, from = 0;
+        for (int i = 0; i <= site->nargs; i++) {
+            size_t to = i < site->nargs ? site->spec_start[i] : strlen(f);
+            // Literal text up to the next conversion, with %% collapsed
+            for (size_t j = from; j < to; j++) {
+                if (f[j] == '%' && f[j + 1] == '%') j++;
+                used = append_text(line, used, f + j, 1);
+            }
+            if (i == site->nargs) break;
+            used = format_arg(line, used, site->specs[i], site->kinds[i], rec->data, &offset);
+            from = site->spec_end[i];
+        }
+    }
+    line[used++] = '\n';
+    fwrite(line, 1, used, stdout);
+}
+
+// Write out every waiting record; caller holds drain_lock
+static int drain() {
+    pthread_mutex_lock(&rings_lock);
+    struct log_ring *first = rings;
+    pthread_mutex_unlock(&rings_lock);
+
+    int written = 0;
+    uint64_t dropped = 0;
+    for (struct log_ring *r = first; r; r = r->next) {
+        uint64_t tail = r->tail;
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (; tail != head; tail++, written++) write_record(&r->slots[tail % LOG_RING_SLOTS]);
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+        dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    }
+
+    if (dropped > reported_drops) {
+        printf("[ERROR] Logger dropped %llu messages; the writer fell behind\n",
+               (unsigned long long)(dropped - reported_drops));
+        reported_drops = dropped;
+        written++;
+    }
+    if (written) fflush(stdout);
+    return written;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    struct timespec idle = {0, LOG_IDLE_NS};
+    while (1) {
+        pthread_mutex_lock(&drain_lock);
+        int written = drain();
+        pthread_mutex_unlock(&drain_lock);
+        if (!written) nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+void log_flush() {
+    struct timespec wait = {0, LOG_IDLE_NS};
+    for (int i = 0; i < LOG_FLUSH_TRIES; i++) {
+        if (pthread_mutex_trylock(&drain_lock) == 0) {
+            drain();
+            pthread_mutex_unlock(&drain_lock);
+            return;
+        }
+        nanosleep(&wait, NULL);
+    }
+}
+
+int log_parse_level(const char *name, enum log_level *level) {
+    for (int i = 0; i < LOG_LEVEL_COUNT; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) {
+            *level = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char *log_level_name(enum log_level level) {
+    return level >= 0 && level < LOG_LEVEL_COUNT ? level_names[level] : "unknown";
+}
+
+void log_set_level(enum log_level level) {
+    __atomic_store_n(&log_threshold, level, __ATOMIC_RELAXED);
+}
+
+int log_start() {
+    const char *name = getenv("WALLET_LOG_LEVEL");
+    enum log_level level;
+    if (name && *name) {
+        if (log_parse_level(name, &level)) log_set_level(level);
+        else printf("[ERROR] Unknown WALLET_LOG_LEVEL '%s'; using %s\n", name, log_level_name(log_threshold));
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_main, NULL) != 0) {
+        perror("Log writer creation failed");
+        return 0;
+    }
+    pthread_detach(thread);
+    printf("[INFO] Logging at %s level\n", log_level_name(log_threshold));
+    return 1;
+}
@@ -0,0 +1,69 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+
+// Logging off the hot path. A log call copies its arguments into a ring owned
+// by the calling thread and returns; a writer thread formats the records and
+// writes them to stdout with the usual "[INFO] " style prefix. Nothing on the
+// calling side takes a lock or touches stdio. When a ring is full the record is
+// dropped and counted. Lines from one thread keep their order; lines from
+// different threads may interleave slightly out of order.
+//
+// Formats use printf conversions. Integer, floating point, %c, %s and %p
+// arguments are captured raw and formatted later; a format with anything the
+// capture does not understand (such as '*' widths) is formatted on the calling
+// thread instead. Strings are copied, so they may be freed after the call.
+// Messages get a newline added; leave it off the format.
+
+#define LOG_RING_SLOTS 1024  // records each thread can have waiting
+#define LOG_RECORD_SIZE 256  // bytes per record; longer strings are cut short
+#define LOG_MAX_ARGS 12
+
+enum log_level {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_ERROR,
+    LOG_LEVEL_COUNT
+};
+
+// One per log call site, parsed on first use
+struct log_site {
+    const char *format;
+    enum log_level level;
+    int state;  // enum in logger.c
+    int nargs;
+    unsigned char kinds[LOG_MAX_ARGS];
+    unsigned short spec_start[LOG_MAX_ARGS], spec_end[LOG_MAX_ARGS];
+    char specs[LOG_MAX_ARGS][16];  // each conversion rewritten for the captured type
+};
+
+extern enum log_level log_threshold;
+
+void log_write(struct log_site *site, ...);
+
+// The printf() never runs; it only lets the compiler check the arguments
+#define LOG_AT(lvl, fmt, ...) do { \
+    static struct log_site log_site_ = {.format = fmt, .level = lvl}; \
+    if ((lvl) >= __atomic_load_n(&log_threshold, __ATOMIC_RELAXED)) log_write(&log_site_, ##__VA_ARGS__); \
+    if (0) printf(fmt, ##__VA_ARGS__); \
+} while (0)
+
+#define log_debug(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#define log_error(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+
+// Start the writer thread. The initial level comes from WALLET_LOG_LEVEL
+// (debug, info or error), defaulting to info.
+int log_start();
+
+void log_set_level(enum log_level level);
+const char *log_level_name(enum log_level level);
+
+// "debug", "info" or "error", any case; returns 0 for anything else
+int log_parse_level(const char *name, enum log_level *level);
+
+// Write out everything logged so far, e.g. before exiting
+void log_flush();
+
+#endif
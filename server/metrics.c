@@ -0,0 +1,281 @@
+#include "metrics.h"
+#include "protocol.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define RENDER_BUFFER 4096
+#define HTTP_REQUEST_MAX 1024
+
+struct histogram {
+    uint64_t buckets[METRICS_BUCKETS + 1];  // the last is +Inf
+    uint64_t sum_ns;
+};
+
+// One thread's numbers; only that thread writes them
+struct metrics_shard {
+    uint64_t counters[COUNTER_COUNT];
+    struct histogram timers[TIMER_COUNT];
+    struct histogram commands[METRIC_COMMAND_COUNT];
+    uint64_t command_errors[METRIC_COMMAND_COUNT];
+    struct metrics_shard *next;
+};
+
+static const char *command_names[METRIC_COMMAND_COUNT] = {
+    "INVALID", "SIGNUP", "LOGIN", "LOGOUT", "RESUME", "BALANCE", "TRANSFER", "HISTORY",
+    "SHOW_ALL_USERS", "ADMIN_STATS", "QUEUE_STATS", "METRICS", "LOG_LEVEL",
+    "TRANSFER_BATCH", "SET_TIER"
+};
+
+static const char *timer_names[TIMER_COUNT] = {
+    "lane_wait_auth", "lane_wait_write", "lane_wait_read", "lane_wait_report", "pbkdf2_wait",
+    "pbkdf2_batch", "commit_wait", "journal_append", "journal_sync", "sqlite_begin", "sqlite_transfer", "sqlite_commit",
+    "snapshot", "checkpoint", "balance_lookup", "history_page"
+};
+
+static const char *counter_names[COUNTER_COUNT] = {
+    "wallet_connections_opened_total", "wallet_connections_closed_total",
+    "wallet_connections_rejected_total", "wallet_connections_timed_out_total",
+    "wallet_pbkdf2_derivations_total", "wallet_transfer_batches_total",
+    "wallet_transfers_committed_total", "wallet_transfers_failed_total",
+    "wallet_transfers_limited_total", "wallet_sqlite_busy_waits_total",
+    "wallet_log_dropped_total"
+};
+
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct metrics_shard *shards = NULL;
+static __thread struct metrics_shard *local = NULL;
+
+// Threads that cannot get a shard share this one and may lose an update now and then
+static struct metrics_shard fallback;
+
+static struct metrics_shard *shard() {
+    if (local) return local;
+
+    struct metrics_shard *s = calloc(1, sizeof(*s));
+    if (!s) return &fallback;
+    pthread_mutex_lock(&shards_lock);
+    s->next = shards;
+    shards = s;
+    pthread_mutex_unlock(&shards_lock);
+    local = s;
+    return s;
+}
+
+// Single writer: a plain add, stored whole so a concurrent scrape never sees a torn value
+static inline void bump(uint64_t *value, uint64_t n) {
+    __atomic_store_n(value, *value + n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t load(const uint64_t *value) {
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void observe(struct histogram *h, uint64_t nanoseconds) {
+    // Bucket i holds values up to 1024 << i ns
+    uint64_t units = nanoseconds ? (nanoseconds - 1) >> 10 : 0;
+    int bucket = units ? 64 - __builtin_clzll(units) : 0;
+    if (bucket > METRICS_BUCKETS) bucket = METRICS_BUCKETS;
+
+    bump(&h->buckets[bucket], 1);
+    bump(&h->sum_ns, nanoseconds);
+}
+
+void metrics_count(enum metric_counter counter, uint64_t n) {
+    bump(&shard()->counters[counter], n);
+}
+
+void metrics_time(enum metric_timer timer, uint64_t nanoseconds) {
+    observe(&shard()->timers[timer], nanoseconds);
+}
+
+void metrics_command(enum metric_command command, int status, uint64_t nanoseconds) {
+    struct metrics_shard *s = shard();
+    observe(&s->commands[command], nanoseconds);
+    if (status != WIRE_OK && status != WIRE_MORE) bump(&s->command_errors[command], 1);
+}
+
+static void add_histogram(struct histogram *into, const struct histogram *from) {
+    for (int i = 0; i <= METRICS_BUCKETS; i++) into->buckets[i] += load(&from->buckets[i]);
+    into->sum_ns += load(&from->sum_ns);
+}
+
+// Sum every thread's shard into one
+static void collect(struct metrics_shard *total) {
+    memset(total, 0, sizeof(*total));
+
+    pthread_mutex_lock(&shards_lock);
+    for (struct metrics_shard *s = shards; ; s = s->next) {
+        if (!s) s = &fallback;
+        for (int i = 0; i < COUNTER_COUNT; i++) total->counters[i] += load(&s->counters[i]);
+        for (int i = 0; i < TIMER_COUNT; i++) add_histogram(&total->timers[i], &s->timers[i]);
+        for (int i = 0; i < METRIC_COMMAND_COUNT; i++) {
+            add_histogram(&total->commands[i], &s->commands[i]);
+            total->command_errors[i] += load(&s->command_errors[i]);
+        }
+        if (s == &fallback) break;
+    }
+    pthread_mutex_unlock(&shards_lock);
+}
+
+// Batches the many short lines of a render into fewer writes
+struct render {
+    metrics_writer write;
+    void *ctx;
+    size_t len;
+    char buffer[RENDER_BUFFER];
+};
+
+static void emit(struct render *out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit(struct render *out, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(line)) n = sizeof(line) - 1;
+
+    if (out->len + n > sizeof(out->buffer)) {
+        out->write(out->ctx, out->buffer, out->len);
+        out->len = 0;
+    }
+    memcpy(out->buffer + out->len, line, n);
+    out->len += n;
+}
+
+static void emit_histogram(struct render *out, const char *name, const char *label, const char *value,
+                           const struct histogram *h) {
+    uint64_t cumulative = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        cumulative += h->buckets[i];
+        emit(out, "%s_bucket{%s=\"%s\",le=\"%.9g\"} %llu\n", name, label, value,
+             (1024ULL << i) / 1e9, (unsigned long long)cumulative);
+    }
+    cumulative += h->buckets[METRICS_BUCKETS];
+    emit(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value, (unsigned long long)cumulative);
+    emit(out, "%s_sum{%s=\"%s\"} %.9f\n", name, label, value, h->sum_ns / 1e9);
+    emit(out, "%s_count{%s=\"%s\"} %llu\n", name, label, value, (unsigned long long)cumulative);
+}
+
+void metrics_render(metrics_writer write, void *ctx) {
+    struct metrics_shard *total = malloc(sizeof(*total));
+    struct render *out = malloc(sizeof(*out));
+    if (!total || !out) {
+        free(total);
+        free(out);
+        return;
+    }
+    collect(total);
+    out->write = write;
+    out->ctx = ctx;
+    out->len = 0;
+
+    emit(out, "# HELP wallet_command_duration_seconds Time from receiving a command to queueing its reply.\n");
+    emit(out, "# TYPE wallet_command_duration_seconds histogram\n");
+    for (int i = 0; i < METRIC_COMMAND_COUNT; i++)
+        emit_histogram(out, "wallet_command_duration_seconds", "command", command_names[i], &total->commands[i]);
+
+    emit(out, "# HELP wallet_command_errors_total Commands answered with a failed, busy or bad-request status.\n");
+    emit(out, "# TYPE wallet_command_errors_total counter\n");
+    for (int i = 0; i < METRIC_COMMAND_COUNT; i++)
+        emit(out, "wallet_command_errors_total{command=\"%s\"} %llu\n", command_names[i],
+             (unsigned long long)total->command_errors[i]);
+
+    emit(out, "# HELP wallet_stage_duration_seconds Time spent in each stage of the hot paths.\n");
+    emit(out, "# TYPE wallet_stage_duration_seconds histogram\n");
+    for (int i = 0; i < TIMER_COUNT; i++)
+        emit_histogram(out, "wallet_stage_duration_seconds", "stage", timer_names[i], &total->timers[i]);
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        emit(out, "# TYPE %s counter\n", counter_names[i]);
+        emit(out, "%s %llu\n", counter_names[i], (unsigned long long)total->counters[i]);
+    }
+
+    if (out->len > 0) write(ctx, out->buffer, out->len);
+    free(out);
+    free(total);
+}
+
+static void write_socket(void *ctx, const char *data, size_t len) {
+    int fd = *(int *)ctx;
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+// One short-lived connection per scrape: read the request line, answer, close
+static void *http_main(void *arg) {
+    int listen_fd = (int)(intptr_t)arg;
+    char request[HTTP_REQUEST_MAX];
+
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+
+        struct timeval timeout = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ssize_t n = recv(fd, request, sizeof(request) - 1, 0);
+        request[n > 0 ? n : 0] = '\0';
+
+        if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+            const char *header = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n";
+            write_socket(&fd, header, strlen(header));
+            metrics_render(write_socket, &fd);
+        } else {
+            const char *reply = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n\r\nTry /metrics\n";
+            write_socket(&fd, reply, strlen(reply));
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+int metrics_serve(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Metrics socket creation failed");
+        return 0;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    // Loopback only: the numbers reveal traffic patterns, so scrapers must run on this host
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        perror("Metrics listener failed");
+        close(fd);
+        return 0;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, http_main, (void *)(intptr_t)fd) != 0) {
+        perror("Metrics thread creation failed");
+        close(fd);
+        return 0;
+    }
+    pthread_detach(thread);
+    printf("[INFO] Metrics on http://127.0.0.1:%d/metrics\n", port);
+    return 1;
+}
@@ -0,0 +1,89 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Counters and latency histograms for the hot paths, rendered in the Prometheus
+// text format by the admin METRICS command and by a plain HTTP listener on the
+// loopback interface. Every thread records into its own shard with ordinary
+// stores, so measuring costs no locks or atomic read-modify-writes; a scrape
+// sums the shards and may be a few events behind the threads it reads.
+
+#define METRICS_PORT 9100  // 127.0.0.1 only; GET /metrics
+#define METRICS_BUCKETS 26 // histogram bounds 1.024 us * 2^i, then +Inf
+
+// Commands as the event loop classifies them
+enum metric_command {
+    METRIC_INVALID,  // unknown commands; also the default
+    METRIC_SIGNUP,
+    METRIC_LOGIN,
+    METRIC_LOGOUT,
+    METRIC_RESUME,
+    METRIC_BALANCE,
+    METRIC_TRANSFER,
+    METRIC_HISTORY,
+    METRIC_SHOW_ALL_USERS,
+    METRIC_ADMIN_STATS,
+    METRIC_QUEUE_STATS,
+    METRIC_METRICS,
+    METRIC_LOG_LEVEL,
+    METRIC_TRANSFER_BATCH,
+    METRIC_SET_TIER,
+    METRIC_COMMAND_COUNT
+};
+
+// Stages inside a command
+enum metric_timer {
+    TIMER_LANE_WAIT_AUTH,   // worker lane queues, in enum lane order
+    TIMER_LANE_WAIT_WRITE,
+    TIMER_LANE_WAIT_READ,
+    TIMER_LANE_WAIT_REPORT,
+    TIMER_PBKDF2_WAIT,      // queued for an auth engine thread
+    TIMER_PBKDF2,           // one SIMD batch of derivations
+    TIMER_COMMIT_WAIT,      // queued for the transfer committer
+    TIMER_JOURNAL_APPEND,   // one committer batch into the journal
+    TIMER_JOURNAL_SYNC,
+    TIMER_SQLITE_BEGIN,     // the journal applier's transactions
+    TIMER_SQLITE_TRANSFER,  // debits, credits and inserts for one journaled transfer
+    TIMER_SQLITE_COMMIT,
+    TIMER_SNAPSHOT,
+    TIMER_CHECKPOINT,       // one passive WAL checkpoint
+    TIMER_BALANCE_LOOKUP,
+    TIMER_HISTORY_PAGE,
+    TIMER_COUNT
+};
+
+enum metric_counter {
+    COUNTER_CONNECTIONS_OPENED,
+    COUNTER_CONNECTIONS_CLOSED,
+    COUNTER_CONNECTIONS_REJECTED,  // over the global or per-IP cap
+    COUNTER_CONNECTIONS_TIMED_OUT,
+    COUNTER_PBKDF2_DERIVATIONS,
+    COUNTER_TRANSFER_BATCHES,
+    COUNTER_TRANSFERS_COMMITTED,
+    COUNTER_TRANSFERS_FAILED,
+    COUNTER_TRANSFERS_LIMITED,   // refused by the sender's velocity limits
+    COUNTER_SQLITE_BUSY,      // writer statements that waited for another writer
+    COUNTER_LOG_DROPPED,      // ring full; see logger.h
+    COUNTER_COUNT
+};
+
+// Receives the rendered text piece by piece
+typedef void (*metrics_writer)(void *ctx, const char *data, size_t len);
+
+// Monotonic nanoseconds
+uint64_t metrics_now();
+
+void metrics_count(enum metric_counter counter, uint64_t n);
+void metrics_time(enum metric_timer timer, uint64_t nanoseconds);
+
+// A reply went out; status is its enum wire_status
+void metrics_command(enum metric_command command, int status, uint64_t nanoseconds);
+
+void metrics_render(metrics_writer write, void *ctx);
+
+// Serve the same text over HTTP on 127.0.0.1:port from a thread of its own
+int metrics_serve(int port);
+
+#endif
@@ -0,0 +1,295 @@
+#include "pbkdf2_mb.h"
+#include <string.h>
+#include <stdint.h>
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Block length of an HMAC iteration: 64-byte pad block plus a 32-byte digest
+#define ITERATION_BITS ((64 + 32) * 8)
+
+static int simd_enabled = -1;  // -1 until the CPU has been probed
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t load_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static void sha256_compress(uint32_t state[8], const uint32_t block[16]) {
+    uint32_t w[64];
+    memcpy(w, block, 16 * sizeof(uint32_t));
+    for (int t = 16; t < 64; t++) {
+        uint32_t s0 = ROTR32(w[t - 15], 7) ^ ROTR32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+        uint32_t s1 = ROTR32(w[t - 2], 17) ^ ROTR32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+        w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; t++) {
+        uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+        uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// Finish a SHA-256 whose first `prefix` bytes (a multiple of 64) are already in `state`
+static void sha256_finish(uint32_t state[8], size_t prefix, const unsigned char *msg, size_t len,
+                          unsigned char digest[32]) {
+    uint32_t block[16];
+    unsigned char tail[128];
+    uint64_t bits = (uint64_t)(prefix + len) * 8;
+
+    while (len >= 64) {
+        for (int i = 0; i < 16; i++) block[i] = load_be32(msg + i * 4);
+        sha256_compress(state, block);
+        msg += 64;
+        len -= 64;
+    }
+
+    size_t tail_len = len < 56 ? 64 : 128;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, msg, len);
+    tail[len] = 0x80;
+    for (int i = 0; i < 8; i++) tail[tail_len - 1 - i] = (unsigned char)(bits >> (8 * i));
+
+    for (size_t off = 0; off < tail_len; off += 64) {
+        for (int i = 0; i < 16; i++) block[i] = load_be32(tail + off + i * 4);
+        sha256_compress(state, block);
+    }
+    for (int i = 0; i < 8; i++) store_be32(digest + i * 4, state[i]);
+}
+
+// Midstates after absorbing key^ipad and key^opad
+static void hmac_pads(const char *password, size_t len, uint32_t ipad[8], uint32_t opad[8]) {
+    unsigned char key[64];
+    memset(key, 0, sizeof(key));
+    if (len > 64) {
+        uint32_t st[8];
+        memcpy(st, IV, sizeof(st));
+        sha256_finish(st, 0, (const unsigned char *)password, len, key);
+    } else {
+        memcpy(key, password, len);
+    }
+
+    uint32_t iblock[16], oblock[16];
+    for (int i = 0; i < 16; i++) {
+        uint32_t word = load_be32(key + i * 4);
+        iblock[i] = word ^ 0x36363636;
+        oblock[i] = word ^ 0x5c5c5c5c;
+    }
+    memcpy(ipad, IV, 8 * sizeof(uint32_t));
+    memcpy(opad, IV, 8 * sizeof(uint32_t));
+    sha256_compress(ipad, iblock);
+    sha256_compress(opad, oblock);
+}
+
+// One output block's HMAC chain: U1 is computed here, U2..Uc by a kernel
+struct chain {
+    uint32_t ipad[8], opad[8];
+    uint32_t u[8];     // current U
+    uint32_t t[8];     // running XOR of all U
+    unsigned char *out;
+    size_t out_len;
+};
+
+static void chain_start(struct chain *ch, const struct pbkdf2_job *job, uint32_t block_index,
+                        const uint32_t ipad[8], const uint32_t opad[8]) {
+    unsigned char msg[256];
+    unsigned char inner[32], outer[32];
+    size_t salt_len = job->salt_len > sizeof(msg) - 4 ? sizeof(msg) - 4 : job->salt_len;
+
+    memcpy(ch->ipad, ipad, sizeof(ch->ipad));
+    memcpy(ch->opad, opad, sizeof(ch->opad));
+
+    memcpy(msg, job->salt, salt_len);
+    store_be32(msg + salt_len, block_index);
+
+    uint32_t st[8];
+    memcpy(st, ipad, sizeof(st));
+    sha256_finish(st, 64, msg, salt_len + 4, inner);
+    memcpy(st, opad, sizeof(st));
+    sha256_finish(st, 64, inner, 32, outer);
+
+    for (int i = 0; i < 8; i++) ch->u[i] = ch->t[i] = load_be32(outer + i * 4);
+}
+
+static void chain_store(const struct chain *ch) {
+    unsigned char digest[32];
+    for (int i = 0; i < 8; i++) store_be32(digest + i * 4, ch->t[i]);
+    memcpy(ch->out, digest, ch->out_len);
+}
+
+#ifdef HAVE_X86_SIMD
+
+#define V_ADD(a, b) _mm256_add_epi32(a, b)
+#define V_XOR(a, b) _mm256_xor_si256(a, b)
+#define V_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// Eight independent SHA-256 compressions, one per 32-bit lane
+__attribute__((target("avx2")))
+static void sha256_compress_x8(__m256i s[8], __m256i w[16]) {
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+    __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int t = 0; t < 64; t++) {
+        if (t >= 16) {
+            __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+            __m256i s0 = V_XOR(V_XOR(V_ROTR(w15, 7), V_ROTR(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = V_XOR(V_XOR(V_ROTR(w2, 17), V_ROTR(w2, 19)), _mm256_srli_epi32(w2, 10));
+            w[t & 15] = V_ADD(V_ADD(w[t & 15], s0), V_ADD(w[(t - 7) & 15], s1));
+        }
+
+        __m256i sig1 = V_XOR(V_XOR(V_ROTR(e, 6), V_ROTR(e, 11)), V_ROTR(e, 25));
+        __m256i ch = V_XOR(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = V_ADD(V_ADD(h, sig1), V_ADD(V_ADD(ch, _mm256_set1_epi32((int)K[t])), w[t & 15]));
+        __m256i sig0 = V_XOR(V_XOR(V_ROTR(a, 2), V_ROTR(a, 13)), V_ROTR(a, 22));
+        __m256i maj = V_XOR(V_XOR(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        __m256i t2 = V_ADD(sig0, maj);
+
+        h = g; g = f; f = e; e = V_ADD(d, t1);
+        d = c; c = b; b = a; a = V_ADD(t1, t2);
+    }
+
+    s[0] = V_ADD(s[0], a); s[1] = V_ADD(s[1], b); s[2] = V_ADD(s[2], c); s[3] = V_ADD(s[3], d);
+    s[4] = V_ADD(s[4], e); s[5] = V_ADD(s[5], f); s[6] = V_ADD(s[6], g); s[7] = V_ADD(s[7], h);
+}
+
+// Run up to eight chains together. Unused lanes repeat lane 0 and are discarded.
+__attribute__((target("avx2")))
+static void run_avx2(struct chain **lanes, int n, int iterations) {
+    uint32_t tmp[PBKDF2_MAX_LANES];
+    __m256i ipad[8], opad[8], u[8], t[8];
+
+    for (int i = 0; i < 8; i++) {
+        for (int l = 0; l < PBKDF2_MAX_LANES; l++) tmp[l] = lanes[l < n ? l : 0]->ipad[i];
+        ipad[i] = _mm256_loadu_si256((const __m256i *)tmp);
+        for (int l = 0; l < PBKDF2_MAX_LANES; l++) tmp[l] = lanes[l < n ? l : 0]->opad[i];
+        opad[i] = _mm256_loadu_si256((const __m256i *)tmp);
+        for (int l = 0; l < PBKDF2_MAX_LANES; l++) tmp[l] = lanes[l < n ? l : 0]->u[i];
+        u[i] = _mm256_loadu_si256((const __m256i *)tmp);
+        t[i] = u[i];
+    }
+
+    const __m256i pad_word = _mm256_set1_epi32((int)0x80000000);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i length = _mm256_set1_epi32(ITERATION_BITS);
+
+    for (int it = 1; it < iterations; it++) {
+        __m256i st[8], w[16];
+
+        for (int i = 0; i < 8; i++) { w[i] = u[i]; st[i] = ipad[i]; }
+        w[8] = pad_word;
+        for (int i = 9; i < 15; i++) w[i] = zero;
+        w[15] = length;
+        sha256_compress_x8(st, w);
+
+        for (int i = 0; i < 8; i++) { w[i] = st[i]; u[i] = opad[i]; }
+        w[8] = pad_word;
+        for (int i = 9; i < 15; i++) w[i] = zero;
+        w[15] = length;
+        sha256_compress_x8(u, w);
+
+        for (int i = 0; i < 8; i++) t[i] = V_XOR(t[i], u[i]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i *)tmp, t[i]);
+        for (int l = 0; l < n; l++) lanes[l]->t[i] = tmp[l];
+    }
+}
+
+#endif
+
+static int probe_simd() {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+int pbkdf2_use_simd(int enable) {
+    simd_enabled = enable ? probe_simd() : 0;
+    return simd_enabled;
+}
+
+const char *pbkdf2_kernel_name() {
+    if (simd_enabled < 0) simd_enabled = probe_simd();
+    return simd_enabled ? "avx2-x8" : "scalar";
+}
+
+// Without SIMD lanes to fill, OpenSSL's tuned single-buffer code is the fastest scalar path
+static void derive_scalar(struct pbkdf2_job *jobs, int count, int iterations) {
+    for (int j = 0; j < count; j++) {
+        PKCS5_PBKDF2_HMAC(jobs[j].password, (int)jobs[j].password_len, jobs[j].salt, (int)jobs[j].salt_len,
+                          iterations, EVP_sha256(), (int)jobs[j].out_len, jobs[j].out);
+    }
+}
+
+void pbkdf2_sha256_many(struct pbkdf2_job *jobs, int count, int iterations) {
+    if (simd_enabled < 0) simd_enabled = probe_simd();
+    if (!simd_enabled) {
+        derive_scalar(jobs, count, iterations);
+        return;
+    }
+
+    struct chain group[PBKDF2_MAX_LANES];
+    struct chain *lanes[PBKDF2_MAX_LANES];
+    int filled = 0;
+
+    for (int j = 0; j < count; j++) {
+        uint32_t ipad[8], opad[8];
+        hmac_pads(jobs[j].password, jobs[j].password_len, ipad, opad);
+
+        size_t blocks = (jobs[j].out_len + 31) / 32;
+        for (size_t b = 0; b < blocks; b++) {
+            struct chain *ch = &group[filled];
+            chain_start(ch, &jobs[j], (uint32_t)(b + 1), ipad, opad);
+            ch->out = jobs[j].out + b * 32;
+            ch->out_len = jobs[j].out_len - b * 32 < 32 ? jobs[j].out_len - b * 32 : 32;
+            lanes[filled++] = ch;
+
+            int last = (j == count - 1) && (b == blocks - 1);
+            if (filled < PBKDF2_MAX_LANES && !last) continue;
+
+#ifdef HAVE_X86_SIMD
+            run_avx2(lanes, filled, iterations);
+#endif
+
+            for (int l = 0; l < filled; l++) chain_store(lanes[l]);
+            filled = 0;
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef PBKDF2_MB_H
+#define PBKDF2_MB_H
+
+#include <stddef.h>
+
+// PBKDF2-HMAC-SHA256 for several passwords at once. Every 32-byte output
+// block of every job is an independent HMAC chain, so the chains are packed
+// into the lanes of an 8-wide AVX2 SHA-256 kernel when the CPU has it; otherwise
+// each job goes through OpenSSL one at a time. Output matches PKCS5_PBKDF2_HMAC(..., EVP_sha256(), ...).
+
+#define PBKDF2_MAX_LANES 8
+
+struct pbkdf2_job {
+    const char *password;
+    size_t password_len;
+    const unsigned char *salt;
+    size_t salt_len;         // at most 252 bytes
+    unsigned char *out;
+    size_t out_len;
+};
+
+// Derive every job's output. All jobs in one call share the iteration count.
+void pbkdf2_sha256_many(struct pbkdf2_job *jobs, int count, int iterations);
+
+// Turn the SIMD kernel off (or back on where supported); returns whether it is active
+int pbkdf2_use_simd(int enable);
+
+// Name of the kernel in use, for logs and the benchmark
+const char *pbkdf2_kernel_name();
+
+#endif
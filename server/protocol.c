@@ -0,0 +1,26 @@
+#include "protocol.h"
+#include <string.h>
+
+uint32_t wire_get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void wire_put_u32(unsigned char *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+int64_t wire_get_i64(const unsigned char *p) {
+    uint64_t value = ((uint64_t)wire_get_u32(p) << 32) | wire_get_u32(p + 4);
+    return (int64_t)value;
+}
+
+int wire_get_string(char *dst, const unsigned char *field, size_t width) {
+    const unsigned char *end = memchr(field, '\0', width);
+    if (!end || end == field) return 0;
+
+    memcpy(dst, field, end - field + 1);
+    return 1;
+}
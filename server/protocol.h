@@ -0,0 +1,87 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary framing, chosen per connection. A client that opens with the four
+// bytes of WIRE_MAGIC gets them echoed back and speaks frames from then on;
+// any other first byte means the newline-terminated text commands.
+//
+// All integers are big-endian. `length` counts the bytes after itself.
+//   request:  u32 length | u32 request_id | u8 opcode | fields
+//   reply:    u32 length | u32 request_id | u8 status | reply text
+//
+// Requests on one connection run concurrently, so replies can come back in
+// any order; match them up by request_id. Wait for the LOGIN (or RESUME)
+// reply before sending commands that need the session.
+//
+// Clients that open with WIRE_SECURE_MAGIC and a 32-byte X25519 public key
+// get the magic and the server's own ephemeral public key back, and from then
+// on both directions are a stream of AES-256-GCM records (see wire_crypto.h):
+//   record:   u32 length | ciphertext | tag[16]
+// `length` counts the ciphertext and tag and is authenticated with them. The
+// plaintext of the records, joined up, is the same stream of frames as above,
+// and a record may hold several frames or part of one; pack all the frames
+// that are ready into one record. The server seals everything it has queued
+// when it writes to the socket, so a record from it can be as long as the
+// replies it carries. Each direction has its own key and 12-byte IV from
+// HKDF-SHA256 (salt client key | server key, info WIRE_SECURE_INFO; out c2s
+// key, c2s IV, s2c key, s2c IV), and the nonce of the nth record sent that way
+// is the IV with n, as a big-endian u64, XORed into its last 8 bytes.
+
+#define WIRE_MAGIC "\0WB1"
+#define WIRE_SECURE_MAGIC "\0WE1"
+#define WIRE_MAGIC_SIZE 4
+#define WIRE_KEY_SIZE 32        // X25519 public key
+#define WIRE_SECURE_INFO "wallet wire v1"
+#define WIRE_RECORD_HEADER 4
+#define WIRE_TAG_SIZE 16
+#define WIRE_MAX_RECORD 65536   // largest record length a client may send
+#define WIRE_HEADER_SIZE 9   // length, request_id, opcode or status
+#define WIRE_MAX_FRAME 4096  // largest request length accepted, except OP_TRANSFER_BATCH
+
+// Request fields are fixed width; strings are NUL-padded
+#define WIRE_NAME_SIZE 50    // 49 characters, the same limit as the text commands
+#define WIRE_TOKEN_SIZE 32   // hex session token, no terminator
+#define WIRE_AMOUNT_SIZE 8   // signed 64-bit amount in paise
+#define WIRE_LIMIT_SIZE 4    // u32 row count, 0 for the default
+#define WIRE_CURSOR_SIZE 64  // continuation cursor from a previous page, or empty
+#define WIRE_BATCH_MAX_LINES 16384  // payments in one OP_TRANSFER_BATCH
+#define WIRE_BATCH_LINE_SIZE (WIRE_NAME_SIZE + WIRE_AMOUNT_SIZE)
+#define WIRE_MAX_BATCH_FRAME (9 + 1 + WIRE_LIMIT_SIZE + WIRE_BATCH_MAX_LINES * WIRE_BATCH_LINE_SIZE)
+
+enum wire_opcode {
+    OP_SIGNUP = 1,          // username[50] password[50]
+    OP_LOGIN = 2,           // username[50] password[50]
+    OP_LOGOUT = 3,
+    OP_RESUME = 4,          // token[32]
+    OP_BALANCE = 5,
+    OP_TRANSFER = 6,        // receiver[50] amount
+    OP_HISTORY = 7,         // nothing for the newest page, or limit cursor[64]
+    OP_SHOW_ALL_USERS = 8,  // nothing for everyone, or limit min_balance prefix[50]
+    OP_ADMIN_STATS = 9,     // nothing for the top 3 senders, or u32 k
+    OP_QUEUE_STATS = 10,
+    OP_METRICS = 11,
+    OP_LOG_LEVEL = 12,      // nothing to read the level, or level[50] to set it
+    OP_TRANSFER_BATCH = 13, // u8 best_effort, u32 count, then count x (receiver[50] amount)
+    OP_SET_TIER = 14        // username[50] u8 tier
+};
+
+enum wire_status {
+    WIRE_OK = 0,
+    WIRE_FAILED = 1,        // the command was refused; the reply text says why
+    WIRE_BUSY = 2,          // not run, retry later
+    WIRE_BAD_REQUEST = 3,   // unknown opcode or malformed fields
+    WIRE_MORE = 4           // part of a long reply; more frames with this request_id follow
+};
+
+uint32_t wire_get_u32(const unsigned char *p);
+void wire_put_u32(unsigned char *p, uint32_t value);
+int64_t wire_get_i64(const unsigned char *p);
+
+// Copy a NUL-padded string field into dst (width bytes). Returns 0 if the
+// field is empty or has no terminator.
+int wire_get_string(char *dst, const unsigned char *field, size_t width);
+
+#endif
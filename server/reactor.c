@@ -0,0 +1,1090 @@
+#define _GNU_SOURCE
+#include "reactor.h"
+#include "protocol.h"
+#include "wire_crypto.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MAX_EVENTS 256
+#define READ_CHUNK 4096
+#define OUT_CHUNK_SIZE 4096       // reply bytes per pooled chunk
+#define OUT_POOL_MAX 256          // idle chunks each loop keeps for reuse
+#define FLUSH_IOVECS 64           // chunks handed to one sendmsg()
+#define MAX_PENDING_INPUT 65536   // stop reading a client until its requests drain
+#define MAX_PIPELINE 256          // binary requests in flight per connection
+#define OUTPUT_HIGH_WATER 262144  // unsent reply bytes before a connection stops dispatching
+#define OUTPUT_LOW_WATER 65536    // unsent reply bytes below which a streaming worker resumes
+#define TICK_MS 100               // timeout resolution
+#define IP_BUCKETS 4096           // per-IP connection counts, shared by the loops
+#define IP_STRIPES 64
+
+struct event_loop {
+    int id;
+    int epfd;
+    int listen_fd;
+    int wake_fd;     // eventfd poked by workers when a request completes
+    pthread_t thread;
+
+    pthread_mutex_t done_lock;
+    struct request *done_head;
+    pthread_cond_t flush_cond;  // workers in request_flush() wait here
+
+    // Closed connections, freed after the current epoll batch since a later
+    // event in the same batch may still point at them
+    struct connection *graveyard;
+
+    // Reply chunks: workers take them for their connection's loop, the loop
+    // returns them once the socket has taken the bytes
+    pthread_mutex_t pool_lock;
+    struct out_chunk *pool;
+    int pooled;
+
+    uint64_t tick;  // TICK_MS periods, read once per epoll wakeup
+    struct timer_wheel wheel;
+};
+
+struct out_chunk {
+    struct out_chunk *next;
+    size_t len;
+    int record_start;  // opens a sealed reply with room for the record header
+    char data[OUT_CHUNK_SIZE];
+};
+
+static struct event_loop *loops = NULL;
+static int loop_count = 0;
+static request_handler handler = NULL;
+static request_router router = NULL;
+static struct reactor_limits limits;
+static _Atomic int open_connections = 0;
+
+// Clients connect to whichever loop the kernel picks, so the per-IP counts are shared
+struct ip_count {
+    uint32_t addr;
+    int count;
+    struct ip_count *next;
+};
+
+static struct ip_count *ip_buckets[IP_BUCKETS];
+static pthread_mutex_t ip_locks[IP_STRIPES];
+
+static uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t current_tick() {
+    return monotonic_ms() / TICK_MS;
+}
+
+static uint64_t seconds_to_ticks(int seconds) {
+    return (uint64_t)seconds * 1000 / TICK_MS;
+}
+
+// Loopback clients (local tools, a proxy on the same host) only count toward the global cap
+static int ip_limited(uint32_t addr) {
+    return limits.max_per_ip > 0 && (ntohl(addr) >> 24) != 127;
+}
+
+static uint32_t ip_bucket(uint32_t addr) {
+    return (addr * 2654435761u) >> 20;  // Fibonacci hash to 12 bits
+}
+
+// Count one more connection from addr; returns 0 if it already has max_per_ip
+static int take_ip(uint32_t addr) {
+    if (!ip_limited(addr)) return 1;
+
+    uint32_t b = ip_bucket(addr);
+    pthread_mutex_t *lock = &ip_locks[b % IP_STRIPES];
+    pthread_mutex_lock(lock);
+    struct ip_count *e = ip_buckets[b];
+    while (e && e->addr != addr) e = e->next;
+    if (!e && (e = calloc(1, sizeof(*e)))) {
+        e->addr = addr;
+        e->next = ip_buckets[b];
+        ip_buckets[b] = e;
+    }
+    int ok = e && e->count < limits.max_per_ip;
+    if (ok) e->count++;
+    pthread_mutex_unlock(lock);
+    return ok;
+}
+
+static void release_ip(uint32_t addr) {
+    if (!ip_limited(addr)) return;
+
+    uint32_t b = ip_bucket(addr);
+    pthread_mutex_t *lock = &ip_locks[b % IP_STRIPES];
+    pthread_mutex_lock(lock);
+    for (struct ip_count **link = &ip_buckets[b]; *link; link = &(*link)->next) {
+        struct ip_count *e = *link;
+        if (e->addr != addr) continue;
+        if (--e->count == 0) {
+            *link = e->next;
+            free(e);
+        }
+        break;
+    }
+    pthread_mutex_unlock(lock);
+}
+
+static int create_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = INADDR_ANY;
+    server.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+
+    listen(fd, limits.backlog > 0 ? limits.backlog : SOMAXCONN);
+    return fd;
+}
+
+static struct out_chunk *alloc_chunk(struct event_loop *loop) {
+    pthread_mutex_lock(&loop->pool_lock);
+    struct out_chunk *chunk = loop->pool;
+    if (chunk) {
+        loop->pool = chunk->next;
+        loop->pooled--;
+    }
+    pthread_mutex_unlock(&loop->pool_lock);
+
+    if (!chunk) chunk = malloc(sizeof(*chunk));
+    if (chunk) {
+        chunk->next = NULL;
+        chunk->len = 0;
+        chunk->record_start = 0;
+    }
+    return chunk;
+}
+
+// Return a chain of chunks to the pool, freeing whatever does not fit
+static void release_chunks(struct event_loop *loop, struct out_chunk *chunk) {
+    if (!chunk) return;
+
+    pthread_mutex_lock(&loop->pool_lock);
+    while (chunk && loop->pooled < OUT_POOL_MAX) {
+        struct out_chunk *next = chunk->next;
+        chunk->next = loop->pool;
+        loop->pool = chunk;
+        loop->pooled++;
+        chunk = next;
+    }
+    pthread_mutex_unlock(&loop->pool_lock);
+
+    while (chunk) {
+        struct out_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+// Append bytes to a chunk chain, taking new chunks as the tail fills. Returns
+// how many bytes fit, which is short of len only when memory runs out.
+static size_t append_chunks(struct event_loop *loop, struct out_chunk **head, struct out_chunk **tail,
+                            const char *data, size_t len) {
+    size_t appended = 0;
+    while (appended < len) {
+        struct out_chunk *last = *tail;
+        if (!last || last->len == OUT_CHUNK_SIZE) {
+            struct out_chunk *chunk = alloc_chunk(loop);
+            if (!chunk) break;
+            if (last) last->next = chunk;
+            else *head = chunk;
+            *tail = last = chunk;
+        }
+
+        size_t n = OUT_CHUNK_SIZE - last->len;
+        if (n > len - appended) n = len - appended;
+        memcpy(last->data + last->len, data + appended, n);
+        last->len += n;
+        appended += n;
+    }
+    return appended;
+}
+
+static void free_connection(struct connection *c) {
+    c->next_free = c->loop->graveyard;
+    c->loop->graveyard = c;
+}
+
+static void bury_connections(struct event_loop *loop) {
+    while (loop->graveyard) {
+        struct connection *c = loop->graveyard;
+        loop->graveyard = c->next_free;
+        release_chunks(loop, c->out_head);
+        wire_channel_free(c->channel);
+        free(c->in);
+        free(c);
+    }
+}
+
+static void release_stalled(struct connection *c, int aborted);
+
+// Drop the socket now; the struct lives on until the in-flight requests finish
+static void close_connection(struct connection *c) {
+    release_stalled(c, 1);
+    if (c->fd >= 0) {
+        close(c->fd);  // also removes it from the epoll set
+        c->fd = -1;
+        timer_cancel(&c->loop->wheel, &c->timer);
+        release_ip(c->peer_addr);
+        open_connections--;
+        metrics_count(COUNTER_CONNECTIONS_CLOSED, 1);
+    }
+    if (c->in_flight)
+        c->dead = 1;
+    else
+        free_connection(c);
+}
+
+static int grow_buffer(char **buf, size_t *cap, size_t needed, size_t first) {
+    if (needed <= *cap) return 1;
+
+    size_t size = *cap ? *cap : first;
+    while (size < needed) size *= 2;
+    char *grown = realloc(*buf, size);
+    if (!grown) return 0;
+    *buf = grown;
+    *cap = size;
+    return 1;
+}
+
+static void consume_input(struct connection *c, size_t len) {
+    c->in_start += len;
+    c->in_len -= len;
+    if (c->protocol == PROTO_SECURE) c->in_open -= len;
+    if (c->in_len == 0) {
+        free(c->in);
+        c->in = NULL;
+        c->in_start = c->in_cap = 0;
+    }
+}
+
+// Make room for one read at the tail of the input window
+static int reserve_input(struct connection *c) {
+    if (c->in_cap - c->in_start - c->in_len >= READ_CHUNK) return 1;
+
+    if (c->in_start > 0) {
+        memmove(c->in, c->in + c->in_start, c->in_len);
+        c->in_start = 0;
+    }
+    return grow_buffer(&c->in, &c->in_cap, c->in_len + READ_CHUNK, READ_CHUNK);
+}
+
+// Input buffered before reading pauses: MAX_PENDING_INPUT, or all of a larger
+// frame at the head of the window so that it can complete. Encrypted clients
+// also get room for the record that may hold the rest of that frame.
+static size_t input_limit(struct connection *c) {
+    int secure = c->protocol == PROTO_SECURE;
+    size_t record = secure ? WIRE_RECORD_HEADER + WIRE_MAX_RECORD : 0;
+    size_t ready = secure ? c->in_open : c->in_len;
+    if (c->protocol == PROTO_TEXT || ready < 4) return MAX_PENDING_INPUT + record;
+
+    size_t frame = 4 + (size_t)wire_get_u32((const unsigned char *)c->in + c->in_start);
+    if (frame > 4 + (size_t)WIRE_MAX_BATCH_FRAME) frame = 4 + WIRE_MAX_BATCH_FRAME;
+    return (frame > MAX_PENDING_INPUT ? frame : MAX_PENDING_INPUT) + record;
+}
+
+// Drain the socket (edge-triggered) straight into the input window. Stops early
+// once input_limit() is buffered; make_progress() picks up from there.
+// Returns 0 if the connection must be dropped.
+static int read_input(struct connection *c) {
+    c->read_paused = 0;
+
+    while (1) {
+        if (c->in_len >= input_limit(c)) {
+            c->read_paused = 1;
+            break;
+        }
+        if (!reserve_input(c)) return 0;
+
+        char *tail = c->in + c->in_start + c->in_len;
+        ssize_t n = recv(c->fd, tail, c->in_cap - c->in_start - c->in_len, 0);
+        if (n > 0) {
+            c->in_len += (size_t)n;
+            c->active_tick = c->loop->tick;
+            continue;
+        }
+        if (n == 0) {
+            c->peer_closed = 1;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return 0;
+    }
+
+    if (c->in_len == 0) consume_input(c, 0);
+    return 1;
+}
+
+static void queue_output(struct connection *c, const void *data, size_t len) {
+    c->out_len += append_chunks(c->loop, &c->out_head, &c->out_tail, data, len);
+}
+
+// Encrypt the replies delivered since the last flush where they sit. Each run
+// from one record_start chunk to the next is a record: its length goes in the
+// room kept at the front, and the tag after its last byte, in a chunk of its
+// own if that one is full. Small pipelined replies were copied into the run
+// before them, so a busy connection seals many replies as one record.
+static int seal_output(struct connection *c) {
+    struct out_chunk *first = c->out_unsealed;
+    c->out_unsealed = NULL;
+
+    while (first) {
+        struct out_chunk *last = first;
+        size_t length = first->len - WIRE_RECORD_HEADER;
+        while (last->next && !last->next->record_start) {
+            last = last->next;
+            length += last->len;
+        }
+
+        unsigned char *header = (unsigned char *)first->data;
+        wire_put_u32(header, (uint32_t)(length + WIRE_TAG_SIZE));
+        if (!wire_seal_begin(c->channel, header)) return 0;
+        for (struct out_chunk *chunk = first;; chunk = chunk->next) {
+            size_t skip = chunk == first ? WIRE_RECORD_HEADER : 0;
+            if (!wire_seal_update(c->channel, (unsigned char *)chunk->data + skip, chunk->len - skip)) return 0;
+            if (chunk == last) break;
+        }
+
+        if (OUT_CHUNK_SIZE - last->len < WIRE_TAG_SIZE) {
+            struct out_chunk *tag = alloc_chunk(c->loop);
+            if (!tag) return 0;
+            tag->next = last->next;
+            last->next = tag;
+            if (c->out_tail == last) c->out_tail = tag;
+            last = tag;
+        }
+        if (!wire_seal_end(c->channel, (unsigned char *)last->data + last->len)) return 0;
+        last->len += WIRE_TAG_SIZE;
+        c->out_len += WIRE_TAG_SIZE;
+        first = last->next;
+    }
+    return 1;
+}
+
+// Hand the queued chunks to the socket, up to FLUSH_IOVECS at a time, and
+// recycle the ones it took. Returns 0 on a socket error; leftover bytes wait
+// for EPOLLOUT.
+static int flush_output(struct connection *c) {
+    if (c->out_unsealed && !seal_output(c)) return 0;
+
+    while (c->out_head) {
+        struct iovec iov[FLUSH_IOVECS];
+        int count = 0;
+        for (struct out_chunk *chunk = c->out_head; chunk && count < FLUSH_IOVECS; chunk = chunk->next) {
+            size_t skip = count == 0 ? c->out_sent : 0;
+            iov[count].iov_base = chunk->data + skip;
+            iov[count].iov_len = chunk->len - skip;
+            count++;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+        if (n <= 0) return 0;
+        c->write_tick = c->loop->tick;
+
+        // Unlink the chunks that went out completely and recycle them in one go
+        c->out_len -= (size_t)n;
+        size_t sent = (size_t)n + c->out_sent;
+        struct out_chunk *done = c->out_head, *last_done = NULL;
+        while (c->out_head && sent >= c->out_head->len) {
+            sent -= c->out_head->len;
+            last_done = c->out_head;
+            c->out_head = c->out_head->next;
+        }
+        c->out_sent = sent;
+        if (last_done) {
+            last_done->next = NULL;
+            release_chunks(c->loop, done);
+        }
+    }
+
+    c->out_tail = NULL;
+    c->out_sent = 0;
+    c->write_tick = c->loop->tick;
+    return 1;
+}
+
+static struct request *new_request(struct connection *c, const char *command, size_t len) {
+    struct request *r = malloc(sizeof(*r) + len + 1);
+    if (!r) return NULL;
+
+    memset(r, 0, sizeof(*r));
+    r->conn = c;
+    r->binary = c->protocol != PROTO_TEXT;
+    r->sealed = c->protocol == PROTO_SECURE;
+    r->status = WIRE_OK;
+    strcpy(r->username, c->username);
+    strcpy(r->token, c->token);
+    r->len = len;
+    memcpy(r->command, command, len);
+    r->command[len] = '\0';
+    r->received = metrics_now();
+    return r;
+}
+
+static void run_request(void *arg) {
+    struct request *r = arg;
+
+    if (handler(r)) request_complete(r);
+}
+
+// Put a request on its loop's done list and wake the loop
+static void post_request(struct request *r) {
+    struct event_loop *loop = r->conn->loop;
+
+    pthread_mutex_lock(&loop->done_lock);
+    r->next_done = loop->done_head;
+    loop->done_head = r;
+    pthread_mutex_unlock(&loop->done_lock);
+
+    uint64_t one = 1;
+    if (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        log_error("Event loop wakeup failed: %s", strerror(errno));
+}
+
+void request_complete(struct request *r) {
+    post_request(r);
+}
+
+// Room kept at the front of a reply: the frame header, and the record header
+// in front of that on an encrypted connection
+static size_t reply_header(const struct request *r) {
+    return (r->binary ? WIRE_HEADER_SIZE : 0) + (r->sealed ? WIRE_RECORD_HEADER : 0);
+}
+
+int request_flush(struct request *r) {
+    if (r->aborted) return 0;
+    if (r->out_len <= reply_header(r)) return 1;
+
+    struct event_loop *loop = r->conn->loop;
+    r->flushing = 1;
+    post_request(r);
+
+    pthread_mutex_lock(&loop->done_lock);
+    while (r->flushing)
+        pthread_cond_wait(&loop->flush_cond, &loop->done_lock);
+    pthread_mutex_unlock(&loop->done_lock);
+    return !r->aborted;
+}
+
+// Runs on the loop: let a worker parked in request_flush() carry on
+static void release_flush(struct request *r, int aborted) {
+    struct event_loop *loop = r->conn->loop;
+
+    pthread_mutex_lock(&loop->done_lock);
+    r->aborted = aborted;
+    r->flushing = 0;
+    pthread_cond_broadcast(&loop->flush_cond);
+    pthread_mutex_unlock(&loop->done_lock);
+}
+
+// Let every worker waiting on this connection's output go on. A released
+// request can be finished and freed at once, so its link is read first.
+static void release_stalled(struct connection *c, int aborted) {
+    struct request *r = c->stalled;
+    c->stalled = NULL;
+    while (r) {
+        struct request *next = r->next_stalled;
+        release_flush(r, aborted);
+        r = next;
+    }
+}
+
+// Move the reply to the socket's output. Small replies are copied into the
+// last queued chunk so pipelined replies share one; larger ones are linked in
+// whole. Binary replies get their frame header here. A sealed reply is only
+// copied into a chunk that has not been encrypted yet, leaving its record
+// header room behind; linked in whole, it starts a record of its own.
+static void deliver_reply(struct connection *c, struct request *r, int status) {
+    size_t room = r->sealed ? WIRE_RECORD_HEADER : 0;
+    if (r->binary) {
+        request_send(r, NULL, 0);  // a reply with no text still needs its header
+        if (r->out_head) {
+            unsigned char *header = (unsigned char *)r->out_head->data + room;
+            wire_put_u32(header, (uint32_t)(r->out_len - room - 4));
+            wire_put_u32(header + 4, r->id);
+            header[8] = (unsigned char)status;
+        }
+    }
+    if (r->out_len == 0) {
+        release_chunks(c->loop, r->out_head);
+        r->out_head = r->out_tail = NULL;
+        return;
+    }
+
+    size_t len = r->out_len - room;
+    if (c->out_tail && r->out_head == r->out_tail && (!r->sealed || c->out_unsealed) &&
+        len <= OUT_CHUNK_SIZE - c->out_tail->len) {
+        memcpy(c->out_tail->data + c->out_tail->len, r->out_head->data + room, len);
+        c->out_tail->len += len;
+        c->out_len += len;
+        release_chunks(c->loop, r->out_head);
+    } else {
+        if (c->out_tail) c->out_tail->next = r->out_head;
+        else c->out_head = r->out_head;
+        c->out_tail = r->out_tail;
+        c->out_len += r->out_len;
+        if (r->sealed && !c->out_unsealed) c->out_unsealed = r->out_head;
+    }
+    r->out_head = r->out_tail = NULL;
+    r->out_len = 0;
+}
+
+// Runs on the loop: copy the session back and send the reply
+static void finish_request(struct request *r) {
+    struct connection *c = r->conn;
+    c->in_flight--;
+    metrics_command(r->metric, r->status, metrics_now() - r->received);
+
+    if (!c->dead) {
+        c->active_tick = c->loop->tick;
+        if (r->session_changed) {
+            strcpy(c->username, r->username);
+            strcpy(c->token, r->token);
+        }
+        deliver_reply(c, r, r->status);
+    }
+
+    release_chunks(c->loop, r->out_head);
+    free(r);
+}
+
+// Runs on the loop: send the part of a reply that a worker flushed, and keep the
+// worker waiting until the socket has taken most of the backlog
+static void take_partial_reply(struct request *r) {
+    struct connection *c = r->conn;
+
+    if (c->dead) {
+        release_flush(r, 1);
+        return;
+    }
+    deliver_reply(c, r, WIRE_MORE);
+    r->next_stalled = c->stalled;
+    c->stalled = r;
+}
+
+// Hand a parsed command to its worker lane. If the lane is full the client gets
+// BUSY_REPLY straight away and the command is dropped.
+static void submit_request(struct connection *c, struct request *r) {
+    c->in_flight++;
+    if (worker_pool_submit(router(r), run_request, r)) return;
+
+    r->status = WIRE_BUSY;
+    request_send_text(r, BUSY_REPLY);
+    finish_request(r);
+}
+
+// Answer WIRE_SECURE_MAGIC and the client's public key with ours; the reply
+// goes out in the clear, and everything after it is sealed
+static int start_secure(struct connection *c) {
+    unsigned char public_key[WIRE_KEY_SIZE];
+    const unsigned char *peer = (const unsigned char *)c->in + c->in_start + WIRE_MAGIC_SIZE;
+
+    c->channel = wire_channel_new(public_key);
+    if (!c->channel || !wire_channel_accept(c->channel, peer, 1)) {
+        log_info("Refused the key exchange on socket %d", c->fd);
+        return -1;
+    }
+    consume_input(c, WIRE_MAGIC_SIZE + WIRE_KEY_SIZE);
+    c->protocol = PROTO_SECURE;
+    queue_output(c, WIRE_SECURE_MAGIC, WIRE_MAGIC_SIZE);
+    queue_output(c, public_key, WIRE_KEY_SIZE);
+    return 1;
+}
+
+// The first byte decides the protocol: WIRE_MAGIC switches to frames,
+// WIRE_SECURE_MAGIC to encrypted frames, anything else is text. Returns 0
+// while the opening is still arriving, -1 if it is wrong or not allowed.
+static int negotiate(struct connection *c) {
+    const char *start = c->in + c->in_start;
+
+    if (start[0] != WIRE_MAGIC[0]) {
+        if (limits.secure_only) return -1;
+        c->protocol = PROTO_TEXT;
+        return 1;
+    }
+    if (c->in_len < WIRE_MAGIC_SIZE) return 0;
+    if (memcmp(start, WIRE_SECURE_MAGIC, WIRE_MAGIC_SIZE) == 0) {
+        if (c->in_len < WIRE_MAGIC_SIZE + WIRE_KEY_SIZE) return 0;
+        return start_secure(c);
+    }
+    if (memcmp(start, WIRE_MAGIC, WIRE_MAGIC_SIZE) != 0 || limits.secure_only) return -1;
+
+    consume_input(c, WIRE_MAGIC_SIZE);
+    c->protocol = PROTO_BINARY;
+    queue_output(c, WIRE_MAGIC, WIRE_MAGIC_SIZE);
+    return 1;
+}
+
+// Decrypt every complete record in the input window where it sits and pack
+// the plaintext down behind the frames already open, so dispatch_frames() sees
+// one run of frames. Returns -1 on a record that is too long or fails to
+// authenticate; the client gets no reply to a tampered stream.
+static int open_records(struct connection *c) {
+    unsigned char *window = (unsigned char *)c->in + c->in_start;
+    size_t read = c->in_open, write = c->in_open;
+
+    while (c->in_len - read >= WIRE_RECORD_HEADER) {
+        uint32_t length = wire_get_u32(window + read);
+        if (length < WIRE_TAG_SIZE || length > WIRE_MAX_RECORD) return -1;
+        if (c->in_len - read < WIRE_RECORD_HEADER + (size_t)length) break;
+
+        unsigned char *body = window + read + WIRE_RECORD_HEADER;
+        size_t plain = length - WIRE_TAG_SIZE;
+        if (!wire_open(c->channel, window + read, body, plain, body + plain)) {
+            log_info("Record failed authentication on socket %d", c->fd);
+            return -1;
+        }
+        memmove(window + write, body, plain);
+        write += plain;
+        read += WIRE_RECORD_HEADER + length;
+    }
+    if (read == write) return 0;
+
+    memmove(window + write, window + read, c->in_len - read);
+    c->in_len -= read - write;
+    c->in_open = write;
+    if (c->in_len == 0) consume_input(c, 0);
+    return 1;
+}
+
+// Text clients get one command at a time, and the next is not read until the
+// last reply has gone out. A command ends at '\n', or at the end of what has
+// arrived so far for clients that send one bare command per write.
+static int dispatch_text(struct connection *c) {
+    if (c->in_flight || c->out_len > 0) return 0;
+
+    int progress = 0;
+    while (c->in_len > 0) {
+        char *line = c->in + c->in_start;
+        char *nl = memchr(line, '\n', c->in_len);
+        size_t len = nl ? (size_t)(nl - line) : c->in_len;
+        size_t consumed = nl ? len + 1 : len;
+        if (len > 0 && line[len - 1] == '\r') len--;
+
+        struct request *r = len > 0 ? new_request(c, line, len) : NULL;
+        consume_input(c, consumed);
+        progress = 1;
+
+        if (r) {
+            submit_request(c, r);
+            break;
+        }
+    }
+    return progress;
+}
+
+// Frames are decoded where they sit in the input window; only the body is
+// copied into the request. Stops at a partial frame, MAX_PIPELINE requests in
+// flight, or OUTPUT_HIGH_WATER unsent bytes. Returns -1 on a malformed frame.
+static int dispatch_frames(struct connection *c) {
+    int progress = 0;
+
+    while (c->in_flight < MAX_PIPELINE && c->out_len < OUTPUT_HIGH_WATER) {
+        size_t ready = c->protocol == PROTO_SECURE ? c->in_open : c->in_len;
+        if (ready < 4) break;
+
+        const unsigned char *frame = (const unsigned char *)c->in + c->in_start;
+        uint32_t length = wire_get_u32(frame);
+        if (length < WIRE_HEADER_SIZE - 4 || length > WIRE_MAX_BATCH_FRAME) return -1;
+        if (length > WIRE_MAX_FRAME) {
+            // Only a TRANSFER_BATCH may be longer; wait for its opcode to tell
+            if (ready < WIRE_HEADER_SIZE) break;
+            if (frame[8] != OP_TRANSFER_BATCH) return -1;
+        }
+        if (ready < 4 + (size_t)length) break;
+
+        struct request *r = new_request(c, (const char *)frame + 8, length - 4);
+        if (r) r->id = wire_get_u32(frame + 4);
+        consume_input(c, 4 + (size_t)length);
+        progress = 1;
+
+        if (r) submit_request(c, r);
+    }
+    return progress;
+}
+
+// Returns 1 if any input was consumed, 0 if nothing could be, -1 on a protocol error
+static int dispatch(struct connection *c) {
+    if (c->in_len == 0) return 0;
+
+    if (c->protocol == PROTO_UNKNOWN) {
+        int negotiated = negotiate(c);
+        if (negotiated <= 0) return negotiated;
+        if (c->in_len == 0) return 1;
+    }
+    if (c->protocol == PROTO_TEXT) return dispatch_text(c);
+    if (c->protocol == PROTO_BINARY) return dispatch_frames(c);
+
+    int opened = open_records(c);
+    if (opened < 0) return -1;
+    int dispatched = dispatch_frames(c);
+    return dispatched < 0 ? -1 : opened || dispatched;
+}
+
+// Flush, dispatch, and close a half-closed peer once it has nothing left to say
+static void make_progress(struct connection *c) {
+    while (1) {
+        if (!flush_output(c)) {
+            close_connection(c);
+            return;
+        }
+        if (c->stalled && c->out_len < OUTPUT_LOW_WATER) release_stalled(c, 0);
+        if (c->read_paused && c->in_len < input_limit(c) && !read_input(c)) {
+            close_connection(c);
+            return;
+        }
+
+        int progress = dispatch(c);
+        if (progress < 0) {
+            close_connection(c);
+            return;
+        }
+        if (progress == 0) break;
+    }
+
+    // The read timeout runs while the client owes us the rest of a command
+    if (c->in_len == 0 || c->in_flight) c->partial_tick = 0;
+    else if (!c->partial_tick) c->partial_tick = c->loop->tick;
+
+    // Leftover bytes of a partial frame or magic can never complete once the peer is gone
+    if (c->peer_closed && !c->in_flight && c->out_len == 0 &&
+        (c->in_len == 0 || c->protocol != PROTO_TEXT)) {
+        log_info("Client disconnected from socket %d", c->fd);
+        close_connection(c);
+    }
+}
+
+// The tick at which c runs out of time in its current state, or 0 if no
+// timeout applies to it right now
+static uint64_t connection_deadline(const struct connection *c) {
+    if (c->out_len > 0 && limits.write_seconds > 0) return c->write_tick + seconds_to_ticks(limits.write_seconds);
+    if (c->in_flight) return 0;  // our move, not the client's
+    if (c->partial_tick && limits.read_seconds > 0) return c->partial_tick + seconds_to_ticks(limits.read_seconds);
+    if (c->in_len == 0 && limits.idle_seconds > 0) return c->active_tick + seconds_to_ticks(limits.idle_seconds);
+    return 0;
+}
+
+// The shortest timeout, for checking back on a connection none applies to yet
+static uint64_t recheck_ticks() {
+    int seconds = 0;
+    int all[] = {limits.idle_seconds, limits.read_seconds, limits.write_seconds};
+    for (int i = 0; i < 3; i++)
+        if (all[i] > 0 && (seconds == 0 || all[i] < seconds)) seconds = all[i];
+    return seconds_to_ticks(seconds);
+}
+
+static void connection_expired(struct timer *t, void *ctx) {
+    struct event_loop *loop = ctx;
+    struct connection *c = (struct connection *)((char *)t - offsetof(struct connection, timer));
+
+    uint64_t deadline = connection_deadline(c);
+    if (deadline == 0) {
+        timer_arm(&loop->wheel, t, loop->tick + recheck_ticks());
+        return;
+    }
+    if (deadline > loop->tick) {
+        timer_arm(&loop->wheel, t, deadline);
+        return;
+    }
+
+    const char *reason = c->out_len > 0 ? "replies unread" : c->partial_tick ? "command incomplete" : "idle";
+    log_info("Closing socket %d: %s for too long", c->fd, reason);
+    metrics_count(COUNTER_CONNECTIONS_TIMED_OUT, 1);
+    close_connection(c);
+}
+
+// Refuse a client over the global or per-IP cap
+static int admit(uint32_t addr) {
+    int open = ++open_connections;
+    if ((limits.max_connections > 0 && open > limits.max_connections) || !take_ip(addr)) {
+        open_connections--;
+        return 0;
+    }
+    return 1;
+}
+
+static void accept_clients(struct event_loop *loop) {
+    while (1) {
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int fd = accept4(loop->listen_fd, (struct sockaddr *)&peer, &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) log_error("Accept failed: %s", strerror(errno));
+            return;
+        }
+
+        if (!admit(peer.sin_addr.s_addr)) {
+            close(fd);
+            metrics_count(COUNTER_CONNECTIONS_REJECTED, 1);
+            continue;
+        }
+
+        struct connection *c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            release_ip(peer.sin_addr.s_addr);
+            open_connections--;
+            continue;
+        }
+        c->fd = fd;
+        c->loop = loop;
+        c->peer_addr = peer.sin_addr.s_addr;
+        c->active_tick = c->write_tick = loop->tick;
+
+        // Replies go out as soon as they are ready; with Nagle on, a reply
+        // behind an unacknowledged one waited for the client's delayed ACK
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = c;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            log_error("epoll_ctl failed: %s", strerror(errno));
+            close(fd);
+            release_ip(c->peer_addr);
+            open_connections--;
+            free(c);
+            continue;
+        }
+        metrics_count(COUNTER_CONNECTIONS_OPENED, 1);
+        if (recheck_ticks() > 0) timer_arm(&loop->wheel, &c->timer, loop->tick + recheck_ticks());
+    }
+}
+
+static void drain_completions(struct event_loop *loop) {
+    uint64_t count;
+    while (read(loop->wake_fd, &count, sizeof(count)) > 0)
+        ;
+
+    pthread_mutex_lock(&loop->done_lock);
+    struct request *r = loop->done_head;
+    loop->done_head = NULL;
+    pthread_mutex_unlock(&loop->done_lock);
+
+    // Deliver every reply first and flush each connection once, so replies
+    // finished together share a sendmsg() and, when encrypted, a record
+    struct connection *ready = NULL;
+    while (r) {
+        struct request *next = r->next_done;
+        struct connection *c = r->conn;
+
+        // A streaming worker waits on its part going out; take it at once so
+        // the worker can go on as soon as the socket drains
+        if (r->flushing) {
+            take_partial_reply(r);
+            if (!c->dead) make_progress(c);
+            r = next;
+            continue;
+        }
+
+        finish_request(r);
+        if (c->dead) {
+            if (!c->in_flight) free_connection(c);
+        } else if (!c->ready) {
+            c->ready = 1;
+            c->next_ready = ready;
+            ready = c;
+        }
+        r = next;
+    }
+
+    while (ready) {
+        struct connection *c = ready;
+        ready = c->next_ready;
+        c->ready = 0;
+        if (!c->dead && c->fd >= 0) make_progress(c);
+    }
+}
+
+static void handle_event(struct connection *c, uint32_t events) {
+    if (c->fd < 0) return;  // closed earlier in this batch
+    if (events & EPOLLERR) {
+        close_connection(c);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+        if (!read_input(c)) {
+            close_connection(c);
+            return;
+        }
+    }
+    make_progress(c);
+}
+
+static void *loop_main(void *arg) {
+    struct event_loop *loop = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        // Wake for the next tick only while some connection has a timer
+        int timeout = -1;
+        if (loop->wheel.armed > 0) timeout = TICK_MS - (int)(monotonic_ms() % TICK_MS);
+
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+        loop->tick = current_tick();
+
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &loop->listen_fd)
+                accept_clients(loop);
+            else if (ptr == &loop->wake_fd)
+                drain_completions(loop);
+            else
+                handle_event(ptr, events[i].events);
+        }
+        timer_wheel_advance(&loop->wheel, loop->tick, connection_expired, loop);
+        bury_connections(loop);
+    }
+    return NULL;
+}
+
+static int init_loop(struct event_loop *loop, int id, int port) {
+    loop->id = id;
+    loop->done_head = NULL;
+    loop->graveyard = NULL;
+    pthread_mutex_init(&loop->done_lock, NULL);
+    pthread_cond_init(&loop->flush_cond, NULL);
+    pthread_mutex_init(&loop->pool_lock, NULL);
+    loop->pool = NULL;
+    loop->pooled = 0;
+    loop->tick = current_tick();
+    timer_wheel_init(&loop->wheel, loop->tick);
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->epfd < 0 || loop->wake_fd < 0) {
+        perror("Event loop setup failed");
+        return 0;
+    }
+
+    loop->listen_fd = create_listener(port);
+    if (loop->listen_fd < 0) return 0;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &loop->listen_fd;
+    epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->listen_fd, &ev);
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &loop->wake_fd;
+    epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wake_fd, &ev);
+    return 1;
+}
+
+int reactor_start(int port, int nloops, const struct reactor_limits *caps, request_handler on_request,
+                  request_router on_route) {
+    handler = on_request;
+    router = on_route;
+    limits = *caps;
+    for (int i = 0; i < IP_STRIPES; i++) pthread_mutex_init(&ip_locks[i], NULL);
+    loop_count = nloops > 0 ? nloops : 1;
+    loops = calloc(loop_count, sizeof(*loops));
+    if (!loops) return 0;
+
+    for (int i = 0; i < loop_count; i++) {
+        if (!init_loop(&loops[i], i, port)) return 0;
+    }
+    for (int i = 0; i < loop_count; i++) {
+        if (pthread_create(&loops[i].thread, NULL, loop_main, &loops[i]) != 0) {
+            perror("Event loop thread creation failed");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void request_send(struct request *r, const void *data, size_t len) {
+    struct event_loop *loop = r->conn->loop;
+
+    if (!r->out_head) {
+        size_t header = reply_header(r);
+        struct out_chunk *chunk = alloc_chunk(loop);
+        if (!chunk) return;
+        chunk->len = header;
+        chunk->record_start = r->sealed;
+        r->out_head = r->out_tail = chunk;
+        r->out_len = header;
+    }
+    r->out_len += append_chunks(loop, &r->out_head, &r->out_tail, data, len);
+}
+
+void request_send_text(struct request *r, const char *text) {
+    request_send(r, text, strlen(text));
+}
+
+void request_printf(struct request *r, const char *format, ...) {
+    request_send(r, NULL, 0);
+    if (!r->out_tail) return;
+
+    // Most replies fit in the space left in the last chunk
+    struct out_chunk *last = r->out_tail;
+    size_t room = OUT_CHUNK_SIZE - last->len;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(last->data + last->len, room, format, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n < room) {
+        last->len += (size_t)n;
+        r->out_len += (size_t)n;
+        return;
+    }
+
+    char *text = malloc((size_t)n + 1);
+    if (!text) return;
+    va_start(args, format);
+    vsnprintf(text, (size_t)n + 1, format, args);
+    va_end(args);
+    request_send(r, text, (size_t)n);
+    free(text);
+}
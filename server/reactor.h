@@ -0,0 +1,143 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "worker_pool.h"
+#include "session.h"
+#include "metrics.h"
+#include "timer_wheel.h"
+
+#define CONN_USERNAME_SIZE 100
+
+struct event_loop;
+struct out_chunk;
+struct wire_channel;
+
+// Decided by the first bytes a client sends; see protocol.h
+enum conn_protocol {
+    PROTO_UNKNOWN,
+    PROTO_TEXT,    // newline-terminated commands, one in flight at a time
+    PROTO_BINARY,  // length-prefixed frames, pipelined
+    PROTO_SECURE   // the same frames inside AES-GCM records
+};
+
+// One client socket, owned by its event loop. Workers never touch it; they
+// write into their own request and the loop copies the result back.
+struct connection {
+    int fd;
+    struct event_loop *loop;
+    enum conn_protocol protocol;
+    char username[CONN_USERNAME_SIZE];  // logged-in user for this socket
+    char token[SESSION_TOKEN_SIZE];     // session this socket is using, if any
+
+    // Unparsed bytes live in in[in_start, in_start + in_len). Parsing advances
+    // in_start; the bytes slide back to the front only when a read needs room.
+    // Freed when empty so idle sockets stay small.
+    char *in;
+    size_t in_start, in_len, in_cap;
+
+    // Reply bytes waiting for the socket: out_len bytes in a chain of chunks,
+    // the first out_sent bytes of the head already gone
+    struct out_chunk *out_head, *out_tail;
+    size_t out_len, out_sent;
+
+    // PROTO_SECURE only: the first in_open bytes of the input window are
+    // decrypted frames and the rest sealed records still arriving; replies
+    // from out_unsealed on are encrypted when the output is next flushed
+    struct wire_channel *channel;
+    size_t in_open;
+    struct out_chunk *out_unsealed;
+
+    int in_flight;   // requests with the workers
+    int read_paused; // input buffer full; read again once requests drain
+    int peer_closed; // EOF seen; close once buffered commands are answered
+    int dead;        // socket gone; free when the in-flight requests complete
+    struct request *stalled;  // waiting in request_flush() for the output to drain, by next_stalled
+    struct connection *next_free;
+    struct connection *next_ready;  // replies delivered this wakeup, flushed together
+    int ready;
+
+    // Timeouts, in loop ticks. The timer is armed once and, when it fires,
+    // checks these and moves itself on unless the client has run out of time.
+    struct timer timer;
+    uint64_t active_tick;   // last bytes read or reply finished
+    uint64_t partial_tick;  // first byte of a command that has not fully arrived, or 0
+    uint64_t write_tick;    // output last empty or last taken by the socket
+    uint32_t peer_addr;     // IPv4, network order, for the per-IP count
+};
+
+// Caps on connections and how long a client may keep one; 0 turns any of them off
+struct reactor_limits {
+    int backlog;           // listen() backlog of each loop's listener
+    int max_connections;   // client sockets open across all loops
+    int max_per_ip;
+    int idle_seconds;      // with nothing buffered and no command running
+    int read_seconds;      // to finish sending a command once it has started
+    int write_seconds;     // without reading any of the replies waiting for it
+    int secure_only;       // refuse clients that do not open with WIRE_SECURE_MAGIC
+};
+
+// One command on its way through a worker. The handler reads the session from
+// username/token and may change it; the loop copies it back to the connection.
+struct request {
+    struct connection *conn;
+    int binary;          // command holds a frame body: opcode then fields
+    int sealed;          // the reply goes out in an AES-GCM record (PROTO_SECURE)
+    uint32_t id;         // binary request_id, echoed on the reply
+    int status;          // binary reply status, enum wire_status
+    char username[CONN_USERNAME_SIZE];
+    char token[SESSION_TOKEN_SIZE];
+    int session_changed;
+
+    // Reply bytes in pooled chunks; binary replies keep room for the frame
+    // header at the front of the first, sealed ones for the record header too
+    struct out_chunk *out_head, *out_tail;
+    size_t out_len;
+    int flushing;        // part of the reply is with the loop; the worker waits
+    int aborted;         // the client went away mid-reply
+
+    enum metric_command metric;  // set by the router
+    uint64_t received;           // metrics_now() when the command was parsed
+
+    struct request *next_done;
+    struct request *next_stalled;  // more requests stalled on the same connection
+    size_t len;          // bytes in command, not counting the added NUL
+    char command[];
+};
+
+// Called on a worker thread with one complete command (NUL-terminated text, or a
+// frame body). Returns 1 when the reply is complete, or 0 if it will be finished
+// later from another thread with request_complete().
+typedef int (*request_handler)(struct request *r);
+
+// Called on the event loop to pick the worker lane for a command; also sets
+// r->metric so the reply is counted under the right command
+typedef enum lane (*request_router)(struct request *r);
+
+// Sent instead of queueing when the command's lane is full
+#define BUSY_REPLY "Server busy, retry later.\n"
+
+// Start one event loop per CPU, each with its own SO_REUSEPORT listener
+int reactor_start(int port, int nloops, const struct reactor_limits *limits, request_handler handler,
+                  request_router router);
+
+// Append reply bytes to a request
+void request_send(struct request *r, const void *data, size_t len);
+
+// Append a NUL-terminated reply
+void request_send_text(struct request *r, const char *text);
+
+// Append formatted reply text, written straight into the reply's chunks
+void request_printf(struct request *r, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Hand the reply written so far to the connection and wait until the client has
+// read most of it, so a long reply streams in bounded memory. Binary clients get
+// it as a WIRE_MORE frame. Returns 0 once the client is gone; stop writing then.
+int request_flush(struct request *r);
+
+// Hand the request back to its event loop once a deferred reply is written
+void request_complete(struct request *r);
+
+#endif
@@ -0,0 +1,344 @@
+#include "schema.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SQL_USERS(name) \
+    "CREATE TABLE IF NOT EXISTS " name " (" \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "username TEXT UNIQUE," \
+    "password TEXT," \
+    "salt TEXT," \
+    "balance INTEGER NOT NULL DEFAULT 100000," /* paise */ \
+    "is_admin INTEGER DEFAULT 0," \
+    "tier INTEGER NOT NULL DEFAULT 0);" /* velocity limits, see velocity.h */
+
+#define SQL_TRANSACTIONS(name) \
+    "CREATE TABLE IF NOT EXISTS " name " (" \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "sender_id INTEGER NOT NULL REFERENCES users(id)," \
+    "receiver_id INTEGER NOT NULL REFERENCES users(id)," \
+    "amount INTEGER NOT NULL," /* paise */ \
+    "timestamp INTEGER NOT NULL DEFAULT (CAST(strftime('%s', 'now') AS INTEGER)));"
+
+// HISTORY pages read these newest-first for one side of the transfer. The names
+// stay fixed so a migrated table ends up with the same indexes as a fresh one.
+#define SQL_TRANSACTION_INDEXES(table) \
+    "CREATE INDEX IF NOT EXISTS idx_transactions_sender_id ON " table " (sender_id, timestamp, id);" \
+    "CREATE INDEX IF NOT EXISTS idx_transactions_receiver_id ON " table " (receiver_id, timestamp, id);"
+
+// Running totals for ADMIN_STATS, kept current by triggers so every write that
+// changes them updates them in the same transaction
+#define SQL_STATS \
+    "CREATE TABLE IF NOT EXISTS stats (name TEXT PRIMARY KEY, value INTEGER NOT NULL) WITHOUT ROWID;" \
+    "CREATE TRIGGER IF NOT EXISTS stats_user_insert AFTER INSERT ON users BEGIN " \
+    "UPDATE stats SET value = value + 1 WHERE name = 'users';" \
+    "UPDATE stats SET value = value + NEW.balance WHERE name = 'balance'; END;" \
+    "CREATE TRIGGER IF NOT EXISTS stats_user_delete AFTER DELETE ON users BEGIN " \
+    "UPDATE stats SET value = value - 1 WHERE name = 'users';" \
+    "UPDATE stats SET value = value - OLD.balance WHERE name = 'balance'; END;" \
+    "CREATE TRIGGER IF NOT EXISTS stats_user_balance AFTER UPDATE OF balance ON users " \
+    "WHEN NEW.balance <> OLD.balance BEGIN " \
+    "UPDATE stats SET value = value + NEW.balance - OLD.balance WHERE name = 'balance'; END;" \
+    "CREATE TRIGGER IF NOT EXISTS stats_transaction_insert AFTER INSERT ON transactions BEGIN " \
+    "UPDATE stats SET value = value + 1 WHERE name = 'transactions'; END;" \
+    "CREATE TRIGGER IF NOT EXISTS stats_transaction_delete AFTER DELETE ON transactions BEGIN " \
+    "UPDATE stats SET value = value - 1 WHERE name = 'transactions'; END;"
+
+// Seed the totals from the tables; run in the transaction that creates the triggers
+#define SQL_SEED_STATS \
+    "INSERT OR REPLACE INTO stats (name, value) VALUES " \
+    "('users', (SELECT COUNT(*) FROM users))," \
+    "('balance', (SELECT COALESCE(SUM(balance), 0) FROM users))," \
+    "('transactions', (SELECT COUNT(*) FROM transactions));"
+
+// How far the tables have caught up with the journal; written in the same
+// transaction as the records it counts
+#define SQL_JOURNAL_STATE \
+    "CREATE TABLE IF NOT EXISTS journal_state (" \
+    "id INTEGER PRIMARY KEY CHECK (id = 1)," \
+    "applied_seq INTEGER NOT NULL);" \
+    "INSERT OR IGNORE INTO journal_state (id, applied_seq) VALUES (1, 0);"
+
+// Transactions moved out to archive segments (see archive.h), and how many
+// each sender had, so the totals still count them
+#define SQL_ARCHIVE \
+    "CREATE TABLE IF NOT EXISTS archive_segments (" \
+    "id INTEGER PRIMARY KEY," /* archive/<id as 16 hex digits>.wseg */ \
+    "rows INTEGER NOT NULL," \
+    "min_timestamp INTEGER NOT NULL," \
+    "max_timestamp INTEGER NOT NULL);" \
+    "CREATE TABLE IF NOT EXISTS archived_senders (" \
+    "sender_id INTEGER PRIMARY KEY," \
+    "transactions INTEGER NOT NULL);"
+
+// Which of the shard files this is; a fresh or migrated database is the only one
+#define SQL_SHARD_INFO \
+    "CREATE TABLE IF NOT EXISTS shard_info (" \
+    "id INTEGER PRIMARY KEY CHECK (id = 1)," \
+    "shard INTEGER NOT NULL," \
+    "shards INTEGER NOT NULL);" \
+    "INSERT OR IGNORE INTO shard_info (id, shard, shards) VALUES (1, 0, 1);"
+
+// Version 1 rows whose ids fall in (?1, ?2], converted to the version 2 layout
+static const char *copy_transactions_sql =
+    "INSERT INTO transactions_v2 (id, sender_id, receiver_id, amount, timestamp) "
+    "SELECT t.id, s.id, r.id, CAST(round(t.amount * 100) AS INTEGER), "
+    "COALESCE(CAST(strftime('%s', t.timestamp) AS INTEGER), 0) "
+    "FROM transactions t "
+    "JOIN users s ON s.username = t.sender "
+    "JOIN users r ON r.username = t.receiver "
+    "WHERE t.id > ?1 AND t.id <= ?2 ORDER BY t.id";
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int exec_sql(sqlite3 *handle, const char *sql) {
+    char *err_msg = NULL;
+    if (sqlite3_exec(handle, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        printf("[ERROR] Schema update failed: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return 0;
+    }
+    return 1;
+}
+
+static sqlite3_int64 query_int(sqlite3 *handle, const char *sql) {
+    sqlite3_stmt *stmt;
+    sqlite3_int64 value = 0;
+
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return value;
+}
+
+int schema_version(sqlite3 *handle) {
+    int version = (int)query_int(handle, "PRAGMA user_version;");
+    if (version > 0) return version;
+
+    if (query_int(handle, "SELECT COUNT(*) FROM pragma_table_info('transactions') WHERE name = 'sender';"))
+        return 1;
+    if (query_int(handle, "SELECT COUNT(*) FROM sqlite_master WHERE name IN ('users', 'transactions');"))
+        return 2;  // created by version 2 before user_version was stamped
+    return 0;
+}
+
+int create_schema(sqlite3 *handle) {
+    char version[64];
+    snprintf(version, sizeof(version), "PRAGMA user_version=%d;", SCHEMA_VERSION);
+
+    return exec_sql(handle, SQL_USERS("users")) &&
+           exec_sql(handle, SQL_TRANSACTIONS("transactions")) &&
+           exec_sql(handle, SQL_TRANSACTION_INDEXES("transactions")) &&
+           exec_sql(handle, SQL_STATS) &&
+           exec_sql(handle, SQL_SEED_STATS) &&
+           exec_sql(handle, SQL_JOURNAL_STATE) &&
+           exec_sql(handle, SQL_ARCHIVE) &&
+           exec_sql(handle, SQL_SHARD_INFO) &&
+           exec_sql(handle, version);
+}
+
+// Copy version 1 rows with ids in (from, to]
+static int copy_transactions(sqlite3 *handle, sqlite3_stmt *copy, sqlite3_int64 from, sqlite3_int64 to) {
+    sqlite3_bind_int64(copy, 1, from);
+    sqlite3_bind_int64(copy, 2, to);
+    int rc = sqlite3_step(copy);
+    sqlite3_reset(copy);
+    if (rc != SQLITE_DONE) {
+        printf("[ERROR] Copying transactions failed: %s\n", sqlite3_errmsg(handle));
+        return 0;
+    }
+    return 1;
+}
+
+// Version 1 to 2: rows are copied in short transactions, then the tables are swapped
+static int migrate_to_v2(sqlite3 *handle, int batch_rows) {
+
+    // The new table carries its indexes from the start; building them at the
+    // end would hold the write lock for the whole index build
+    if (!exec_sql(handle, SQL_TRANSACTIONS("transactions_v2")) ||
+        !exec_sql(handle, SQL_TRANSACTION_INDEXES("transactions_v2")))
+        return 0;
+
+    sqlite3_stmt *copy;
+    if (sqlite3_prepare_v2(handle, copy_transactions_sql, -1, &copy, NULL) != SQLITE_OK) {
+        printf("[ERROR] Schema update failed: %s\n", sqlite3_errmsg(handle));
+        return 0;
+    }
+
+    // Resume after whatever an interrupted run already copied
+    sqlite3_int64 copied = query_int(handle, "SELECT COALESCE(MAX(id), 0) FROM transactions_v2;");
+    sqlite3_int64 last = query_int(handle, "SELECT COALESCE(MAX(id), 0) FROM transactions;");
+    sqlite3_int64 reported = copied;
+
+    while (copied < last) {
+        sqlite3_int64 to = copied + batch_rows;
+        double started = now_seconds();
+        if (!exec_sql(handle, "BEGIN IMMEDIATE;")) break;
+        if (!copy_transactions(handle, copy, copied, to)) {
+            exec_sql(handle, "ROLLBACK;");
+            break;
+        }
+        if (!exec_sql(handle, "COMMIT;")) break;
+        copied = to;
+
+        // Give the server's writers a turn: stay off the write lock for as long as we held it
+        usleep((useconds_t)((now_seconds() - started) * 1e6));
+
+        if (copied - reported >= 1000000 || copied >= last) {
+            printf("[INFO] Copied transactions up to id %lld of %lld\n", (long long)copied, (long long)last);
+            reported = copied;
+        }
+    }
+    if (copied < last) {
+        sqlite3_finalize(copy);
+        return 0;
+    }
+
+    // Swap: rows written since the bulk copy, the users table, then the names.
+    // legacy_alter_table keeps the REFERENCES users(id) clauses pointing at the new table.
+    int success = exec_sql(handle, "PRAGMA legacy_alter_table=ON;") &&
+                  exec_sql(handle, "BEGIN IMMEDIATE;") &&
+                  copy_transactions(handle, copy, copied, INT64_MAX) &&
+                  exec_sql(handle, SQL_USERS("users_v2")) &&
+                  exec_sql(handle, "INSERT INTO users_v2 (id, username, password, salt, balance, is_admin) "
+                                   "SELECT id, username, password, salt, "
+                                   "CAST(round(balance * 100) AS INTEGER), is_admin FROM users;") &&
+                  exec_sql(handle, "ALTER TABLE transactions RENAME TO transactions_v1;"
+                                   "ALTER TABLE users RENAME TO users_v1;"
+                                   "ALTER TABLE users_v2 RENAME TO users;"
+                                   "ALTER TABLE transactions_v2 RENAME TO transactions;") &&
+                  exec_sql(handle, "PRAGMA user_version=2;") &&
+                  exec_sql(handle, "COMMIT;");
+    sqlite3_finalize(copy);
+
+    if (!success) {
+        sqlite3_exec(handle, "ROLLBACK;", NULL, NULL, NULL);
+        exec_sql(handle, "PRAGMA legacy_alter_table=OFF;");
+        return 0;
+    }
+    exec_sql(handle, "PRAGMA legacy_alter_table=OFF;");
+
+    // Dropping the old tables is its own write; on a large database it holds the
+    // write lock again for a while, but the new tables are already in use
+    exec_sql(handle, "DROP TABLE IF EXISTS transactions_v1;");
+    exec_sql(handle, "DROP TABLE IF EXISTS users_v1;");
+    return 1;
+}
+
+// Version 2 to 3: the stats table, its triggers and its first totals in one
+// transaction, so no write can slip between the seed and the triggers
+static int migrate_to_v3(sqlite3 *handle) {
+    int success = exec_sql(handle, "BEGIN IMMEDIATE;") &&
+                  exec_sql(handle, SQL_STATS) &&
+                  exec_sql(handle, SQL_SEED_STATS) &&
+                  exec_sql(handle, "PRAGMA user_version=3;") &&
+                  exec_sql(handle, "COMMIT;");
+    if (!success) sqlite3_exec(handle, "ROLLBACK;", NULL, NULL, NULL);
+    return success;
+}
+
+// Version 3 to 4: journal_state starts at seq 0, so the rows already there are
+// the base the journal builds on
+static int migrate_to_v4(sqlite3 *handle) {
+    int success = exec_sql(handle, "BEGIN IMMEDIATE;") &&
+                  exec_sql(handle, SQL_JOURNAL_STATE) &&
+                  exec_sql(handle, "PRAGMA user_version=4;") &&
+                  exec_sql(handle, "COMMIT;");
+    if (!success) sqlite3_exec(handle, "ROLLBACK;", NULL, NULL, NULL);
+    return success;
+}
+
+// Version 4 to 5: every account starts in tier 0. A database that came through
+// migrate_to_v2() in this run already has the column.
+static int migrate_to_v5(sqlite3 *handle) {
+    int has_tier = query_int(handle, "SELECT COUNT(*) FROM pragma_table_info('users') WHERE name = 'tier';") > 0;
+    int success = exec_sql(handle, "BEGIN IMMEDIATE;") &&
+                  (has_tier || exec_sql(handle, "ALTER TABLE users ADD COLUMN tier INTEGER NOT NULL DEFAULT 0;")) &&
+                  exec_sql(handle, "PRAGMA user_version=5;") &&
+                  exec_sql(handle, "COMMIT;");
+    if (!success) sqlite3_exec(handle, "ROLLBACK;", NULL, NULL, NULL);
+    return success;
+}
+
+// Version 5 to 6: the archive starts empty
+static int migrate_to_v6(sqlite3 *handle) {
+    int success = exec_sql(handle, "BEGIN IMMEDIATE;") &&
+                  exec_sql(handle, SQL_ARCHIVE) &&
+                  exec_sql(handle, "PRAGMA user_version=6;") &&
+                  exec_sql(handle, "COMMIT;");
+    if (!success) sqlite3_exec(handle, "ROLLBACK;", NULL, NULL, NULL);
+    return success;
+}
+
+// Version 6 to 7: an existing database is shard 0 of 1
+static int migrate_to_v7(sqlite3 *handle) {
+    int success = exec_sql(handle, "BEGIN IMMEDIATE;") &&
+                  exec_sql(handle, SQL_SHARD_INFO) &&
+                  exec_sql(handle, "PRAGMA user_version=7;") &&
+                  exec_sql(handle, "COMMIT;");
+    if (!success) sqlite3_exec(handle, "ROLLBACK;", NULL, NULL, NULL);
+    return success;
+}
+
+int migrate_schema(sqlite3 *handle, int batch_rows) {
+    int version = schema_version(handle);
+    if (version >= SCHEMA_VERSION) return 1;
+    if (version == 0) return create_schema(handle);
+    if (batch_rows < 1) batch_rows = MIGRATE_BATCH_ROWS;
+
+    printf("[INFO] Migrating schema from version %d to %d\n", version, SCHEMA_VERSION);
+
+    if (version < 2 && !migrate_to_v2(handle, batch_rows)) return 0;
+    if (version < 3 && !migrate_to_v3(handle)) return 0;
+    if (version < 4 && !migrate_to_v4(handle)) return 0;
+    if (version < 5 && !migrate_to_v5(handle)) return 0;
+    if (version < 6 && !migrate_to_v6(handle)) return 0;
+    if (version < 7 && !migrate_to_v7(handle)) return 0;
+
+    printf("[INFO] Schema is at version %d\n", SCHEMA_VERSION);
+    return 1;
+}
+
+int schema_shard_info(sqlite3 *handle, int *shard, int *shards) {
+    sqlite3_stmt *stmt;
+    int found = 0;
+    if (sqlite3_prepare_v2(handle, "SELECT shard, shards FROM shard_info WHERE id = 1;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            *shard = sqlite3_column_int(stmt, 0);
+            *shards = sqlite3_column_int(stmt, 1);
+            found = *shards >= 1 && *shards <= SCHEMA_MAX_SHARDS && *shard >= 0 && *shard < *shards;
+        }
+        sqlite3_finalize(stmt);
+    }
+    return found;
+}
+
+int schema_set_shard_info(sqlite3 *handle, int shard, int shards) {
+    char sql[128];
+    snprintf(sql, sizeof(sql), "UPDATE shard_info SET shard = %d, shards = %d WHERE id = 1;", shard, shards);
+    return exec_sql(handle, sql);
+}
+
+int schema_shard_of(const char *username, int shards) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return shards > 1 ? (int)(h % (uint32_t)shards) : 0;
+}
+
+void schema_shard_path(char *path, size_t size, const char *first, int shard) {
+    const char *dot = strrchr(first, '.');
+    if (shard == 0) snprintf(path, size, "%s", first);
+    else if (dot && !strchr(dot, '/')) snprintf(path, size, "%.*s.%d%s", (int)(dot - first), first, shard, dot);
+    else snprintf(path, size, "%s.%d", first, shard);
+}
@@ -0,0 +1,41 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stddef.h>
+#include <sqlite3.h>
+
+// Version 1 is the original layout: transactions name both parties by username
+// and money is REAL rupees. Version 2 references users.id, stores every amount
+// and balance as integer paise, and keeps timestamps as Unix seconds. Version 3
+// adds the stats table of running totals that triggers keep up to date.
+// Version 4 adds journal_state, the last journal record applied to the tables.
+// Version 5 adds users.tier, which picks the account's velocity limits.
+// Version 6 adds archive_segments and archived_senders for archived transactions.
+// Version 7 adds shard_info, which of the database files this one is.
+#define SCHEMA_VERSION 7
+#define MIGRATE_BATCH_ROWS 50000  // rows copied per write transaction
+#define SCHEMA_MAX_SHARDS 16
+
+// SCHEMA_VERSION or 1 for an existing database, 0 for an empty one
+int schema_version(sqlite3 *handle);
+
+// Create the current tables and indexes in an empty database
+int create_schema(sqlite3 *handle);
+
+// Bring an older database up to SCHEMA_VERSION. Version 1 rows are copied in
+// short transactions so a running server keeps going; only the final swap of
+// the tables holds the write lock. Safe to rerun after an interruption.
+int migrate_schema(sqlite3 *handle, int batch_rows);
+
+// Accounts can be split by username hash across several database files, each
+// with the full schema: wallet.db is shard 0, wallet.1.db shard 1 and so on.
+// A shard holds its accounts, the transactions they sent and its share of the
+// stats totals. tools/wallet_reshard changes the number of shards.
+int schema_shard_info(sqlite3 *handle, int *shard, int *shards);
+int schema_set_shard_info(sqlite3 *handle, int shard, int shards);
+int schema_shard_of(const char *username, int shards);
+
+// File of shard given that of shard 0, e.g. wallet.db and 2 give wallet.2.db
+void schema_shard_path(char *path, size_t size, const char *first, int shard);
+
+#endif
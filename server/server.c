@@ -1,242 +1,949 @@
 #include <stdio.h>        // for printf, etc.
 #include <stdlib.h>       // for exit, etc.
 #include <string.h>       // for string functions
+#include <math.h>         // for llround
 #include <pthread.h>      // for multithreading
 #include <unistd.h>       // for close(), etc.
 #include <signal.h>       // for signal handling
+#include <errno.h>        // for EINTR
+#include <sys/eventfd.h>  // wakes the main thread on Ctrl+C
 #include <arpa/inet.h>    // for socket functions
+#include <sys/resource.h> // for the open-file limit
 #include <sqlite3.h>      // for database functions
 #include "db.h"           // your own file for DB functions
-#include "auth.h"         // your own file for authentication functions
 #include "transactions.h" // your own file for transactions
+#include "reactor.h"      // epoll event loops that own the client sockets
+#include "worker_pool.h"  // threads that run the commands
+#include "transfer_engine.h" // group commit for TRANSFER
+#include "ledger.h"       // in-memory balances
+#include "session.h"      // login tokens that survive reconnects
+#include "auth_engine.h"  // batched SIMD PBKDF2 for LOGIN/SIGNUP
+#include "protocol.h"     // binary framing for pipelined clients
+#include "stats.h"        // running totals and top senders for ADMIN_STATS
+#include "metrics.h"      // latency histograms and counters
+#include "logger.h"       // log lines written off the request threads
+#include "store.h"        // journal recovery, snapshots and the SQLite applier
+#include "velocity.h"     // per-tier transfer limits
+#include "archive.h"      // old transactions in compact segment files
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
 
 
 #define PORT 8080
 #define BUFFER_SIZE 4096
-
-int server_fd; // Global for graceful shutdown
-
+#define AUTH_QUEUE_DEPTH 256    // queued LOGIN/SIGNUP before clients are told to retry
+#define AUTH_ENGINE_DEPTH 1024  // derivations waiting for a PBKDF2 thread
+#define WRITE_QUEUE_DEPTH 1024  // queued TRANSFERs
+#define READ_QUEUE_DEPTH 1024   // queued BALANCE/HISTORY and other short reads
+#define REPORT_QUEUE_DEPTH 64   // queued SHOW_ALL_USERS/ADMIN_STATS
+#define REPORT_WORKERS 2        // long reports get their own threads so BALANCE never waits behind one
+#define WRITE_WORKERS 2         // writes serialize on SQLite anyway
+#define TRANSFER_BATCH_MAX 256      // transfers sharing one commit
+#define TRANSFER_BATCH_WAIT_US 300  // how long the committer waits to fill a batch
+#define TRANSFER_QUEUE_DEPTH 8192
+#define STREAM_FLUSH_BYTES 65536    // long reports go out in parts of about this size
+#define TOP_SENDERS_TRACKED 256     // senders each top-K sketch counts exactly
+#define STATS_RECONCILE_SECONDS 300 // how often the stored totals are checked against the tables
+#define SNAPSHOT_SECONDS 600        // ledger snapshots at least this often while transfers arrive
+#define SNAPSHOT_RECORDS 1000000    // or after this many journal records
+#define REPORT_CATCH_UP_MS 200      // reports wait this long for SQLite to reach the journal
+#define CHECKPOINT_SECONDS 5        // WAL checkpoints at least this often
+#define CHECKPOINT_WAL_PAGES 4096   // or once the WAL holds this many pages (16 MB)
+#define ARCHIVE_HOT_DAYS 90         // transactions stay in the table this long
+#define ARCHIVE_SEGMENT_ROWS 65536  // then move out this many at a time
+#define ARCHIVE_CHECK_SECONDS 3600
+#define LISTEN_BACKLOG 4096         // per loop; the kernel caps it at net.core.somaxconn
+#define MAX_CONNECTIONS 100000      // lowered to fit the fd limit
+#define MAX_CONNECTIONS_PER_IP 1024
+#define IDLE_TIMEOUT_SECONDS 300    // no command at all
+#define READ_TIMEOUT_SECONDS 30     // a command started but not finished
+#define WRITE_TIMEOUT_SECONDS 30    // replies the client stopped reading
+#define SECURE_ONLY 0               // default for WALLET_SECURE_ONLY; 1 refuses text and plain binary clients
+
+// ADMIN_STATS lists the busiest senders over all time and over each of these windows
+static const int top_sender_windows[] = {60, 3600, 86400};
+
+static int shutdown_fd = -1;  // eventfd the SIGINT handler pokes
+
+// Runs on whichever thread took the signal, so it only wakes the main thread;
+// that one flushes the log and exits
 void handle_shutdown(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    uint64_t one = 1;
+    if (write(shutdown_fd, &one, sizeof(one)) < 0) {
+        // Nothing safe to report from here; the counter cannot overflow
+    }
+    errno = saved_errno;
+}
+
+// Block until Ctrl+C, then shut down from the main thread
+static void wait_for_shutdown(void) {
+    uint64_t count;
+    while (read(shutdown_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+    log_flush();
     printf("\n[INFO] Shutting down server gracefully...\n");
-    close(server_fd);
-    exit(0);
+    exit(0);  // closes the listeners and client sockets with the process
+}
+
+// WALLET_SECURE_ONLY=1 accepts only encrypted binary clients, 0 every protocol
+static int secure_only_setting() {
+    const char *value = getenv("WALLET_SECURE_ONLY");
+    if (!value || !*value) return SECURE_ONLY;
+    if (strcmp(value, "0") == 0 || strcmp(value, "1") == 0) return value[0] == '1';
+    printf("[ERROR] Ignoring WALLET_SECURE_ONLY='%s'; use 0 or 1\n", value);
+    return SECURE_ONLY;
 }
 
 void print_supported_commands() {
     printf("\n> Supported Commands:\n");
     printf("  SIGNUP <username> <password>\n");
     printf("  LOGIN <username> <password>\n");
+    printf("  LOGOUT\n");
+    printf("  TOKEN <token> <command>   (resume a session on any connection)\n");
     printf("  BALANCE\n");
     printf("  TRANSFER <recipient> <amount>\n");
-    printf("  HISTORY\n");
-    printf("  SHOW_ALL_USERS\n");
-    printf("  ADMIN_STATS\n\n");
+    printf("  TRANSFER_BATCH [BEST_EFFORT] <count> <recipient> <amount> ...\n");
+    printf("  HISTORY [limit] [cursor]\n");
+    printf("  SHOW_ALL_USERS [limit] [min_balance] [prefix]\n");
+    printf("  ADMIN_STATS [k]\n");
+    printf("  QUEUE_STATS\n");
+    printf("  METRICS                   (also http://127.0.0.1:%d/metrics)\n", METRICS_PORT);
+    printf("  LOG_LEVEL [debug|info|error]\n");
+    printf("  SET_TIER <username> <tier>   (velocity limits: 0 standard .. 3 unlimited)\n");
+    printf("  (binary clients: open with the protocol.h magic, then send frames)\n\n");
+}
+
+// Refuse a command; binary clients also see WIRE_FAILED in the status byte
+static int refuse(struct request *r, const char *reply) {
+    r->status = WIRE_FAILED;
+    request_send_text(r, reply);
+    return 1;
+}
+
+static int busy(struct request *r) {
+    r->status = WIRE_BUSY;
+    request_send_text(r, BUSY_REPLY);
+    return 1;
+}
+
+static void write_request(void *ctx, const char *data, size_t len) {
+    request_send(ctx, data, len);
+}
+
+// Long reports hand each full part to the connection and wait for the client to read it
+static int stream_request(void *ctx, const char *data, size_t len) {
+    struct request *r = ctx;
+    request_send(r, data, len);
+    return r->out_len < STREAM_FLUSH_BYTES || request_flush(r);
+}
+
+// This version sends one page of transaction history to the client connection
+int get_transaction_history_socket(const char *username, int limit, const char *cursor, struct request *r) {
+    return get_history_page(username, limit, cursor, write_request, r);
+}
+
+// Runs on the transfer committer thread once the transfer's batch is settled
+static void transfer_finished(struct transfer_request *req, int success, double new_balance) {
+    struct request *r = req->ctx;
+
+    if (success) {
+        request_printf(r, "Transfer successful! New balance: ₹%.2f\n", new_balance);
+        log_info("%s sent ₹%.2f to %s. New Balance: ₹%.2f", req->sender, req->amount, req->receiver, new_balance);
+    } else {
+        refuse(r, "Transfer failed! Check balance or recipient.\n");
+    }
+
+    free(req);
+    request_complete(r);
 }
 
-// This version sends the transaction history to client socket
-void get_transaction_history_socket(const char *username, int sock) {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    char *sql = "SELECT timestamp, sender, receiver, amount FROM transactions WHERE sender=? OR receiver=? ORDER BY timestamp DESC";
+// Runs on an auth engine thread once the password hash for SIGNUP is derived
+static void signup_finished(struct auth_job *job) {
+    struct request *r = job->ctx;
 
-    if (sqlite3_open("wallet.db", &db) != SQLITE_OK) {
-        send(sock, "Database error.\n", 16, 0);
-        return;
+    if (create_user(job->username, job->salt, job->derived)) {
+        request_send_text(r, "Signup successful!\n");
+    } else {
+        refuse(r, "Signup failed! Username might be taken.\n");
     }
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        send(sock, "Failed to fetch history.\n", 25, 0);
-        sqlite3_close(db);
-        return;
+    OPENSSL_cleanse(job->password, sizeof(job->password));
+    free(job);
+    request_complete(r);
+}
+
+// Runs on an auth engine thread once the LOGIN password has been hashed
+static void login_finished(struct auth_job *job) {
+    struct request *r = job->ctx;
+
+    if (CRYPTO_memcmp(job->derived, job->expected, HASH_SIZE) == 0) {
+        strcpy(r->username, job->username);
+        r->session_changed = 1;
+        if (session_create(job->username, r->token)) {
+            request_printf(r, "Login successful\nToken: %s\n", r->token);
+        } else {
+            r->token[0] = '\0';
+            request_send_text(r, "Login successful\n");
+        }
+    } else {
+        refuse(r, "Login failed\n");
     }
 
-    sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, username, -1, SQLITE_STATIC);
+    OPENSSL_cleanse(job->password, sizeof(job->password));
+    free(job);
+    request_complete(r);
+}
 
-    char row[256];
-    send(sock, "Transaction History:\n", 22, 0);
+// Hand a derivation to the auth engine; its callback finishes the reply
+static int submit_auth(struct request *r, struct auth_job *job) {
+    if (auth_engine_submit(job)) return 0;
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *timestamp = (const char *)sqlite3_column_text(stmt, 0);
-        const char *sender = (const char *)sqlite3_column_text(stmt, 1);
-        const char *receiver = (const char *)sqlite3_column_text(stmt, 2);
-        double amount = sqlite3_column_double(stmt, 3);
+    OPENSSL_cleanse(job->password, sizeof(job->password));
+    free(job);
+    return busy(r);
+}
 
-        snprintf(row, sizeof(row), "%s | From: %s | To: %s | ₹%.2f\n", timestamp, sender, receiver, amount);
-        send(sock, row, strlen(row), 0);
+static int signup(struct request *r, const char *username, const char *password) {
+    struct auth_job *job = calloc(1, sizeof(*job));
+    if (!job || RAND_bytes(job->salt, SALT_SIZE) != 1) {
+        free(job);
+        return refuse(r, "Signup failed! Username might be taken.\n");
     }
+    strcpy(job->username, username);
+    strcpy(job->password, password);
+    job->done = signup_finished;
+    job->ctx = r;
+    return submit_auth(r, job);
+}
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+static int login(struct request *r, const char *username, const char *password) {
+    struct auth_job *job = calloc(1, sizeof(*job));
+    if (!job || !get_credentials(username, job->salt, job->expected)) {
+        free(job);
+        return refuse(r, "Login failed\n");
+    }
+    strcpy(job->username, username);
+    strcpy(job->password, password);
+    job->done = login_finished;
+    job->ctx = r;
+    return submit_auth(r, job);
 }
 
-void *handle_client(void *socket_desc) {
-    int sock = *(int *)socket_desc;
-    free(socket_desc);
-    char buffer[BUFFER_SIZE];
-    char current_username[100] = "";
+// Adopt an existing session; returns 0 if the token is unknown or expired
+static int resume(struct request *r, const char *token) {
+    if (!session_resume(token, r->username, sizeof(r->username))) return 0;
 
-    while (1) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int read_size = recv(sock, buffer, BUFFER_SIZE, 0);
-        if (read_size <= 0) {
-            printf("[INFO] Client disconnected from socket %d\n", sock);
-            break;
-        }
+    strcpy(r->token, token);
+    r->session_changed = 1;
+    return 1;
+}
 
-        char command[20], arg1[50], arg2[50];
-        double amount;
+static int logout(struct request *r) {
+    session_revoke(r->token);
+    r->token[0] = '\0';
+    r->username[0] = '\0';
+    r->session_changed = 1;
+    request_send_text(r, "Logged out\n");
+    return 1;
+}
 
-        if (sscanf(buffer, "SIGNUP %s %s", arg1, arg2) == 2) {
-            if (signup_user(arg1, arg2)) {
-                send(sock, "Signup successful!\n", 19, 0);
-            } else {
-                send(sock, "Signup failed! Username might be taken.\n", 40, 0);
-            }
-        }
+static int balance(struct request *r) {
+    if (strlen(r->username) == 0) return refuse(r, "Please login first.\n");
 
-        else if (sscanf(buffer, "LOGIN %s %s", arg1, arg2) == 2) {
-            if (login_user(arg1, arg2)) {
-                strcpy(current_username, arg1);
-                send(sock, "Login successful\n", 17, 0);
-            } else {
-                send(sock, "Login failed\n", 13, 0);
-            }
-        }
+    double balance = get_balance(r->username);
+    request_printf(r, "Balance: ₹%.2f\n", balance);
+    return 1;
+}
 
-        else if (strncmp(buffer, "BALANCE", 7) == 0) {
-            if (strlen(current_username) == 0) {
-                send(sock, "Please login first.\n", 21, 0);
-                continue;
-            }
+// A transfer the sender's velocity tier does not allow
+static int refuse_limit(struct request *r, enum velocity_verdict verdict) {
+    metrics_count(COUNTER_TRANSFERS_LIMITED, 1);
+    r->status = WIRE_FAILED;
+    request_printf(r, "Transaction limit exceeded: %s.\n", velocity_verdict_text(verdict));
+    return 1;
+}
 
-            double balance = get_balance(current_username);
-            char response[50];
-            sprintf(response, "Balance: ₹%.2f\n", balance);
-            send(sock, response, strlen(response), 0);
+static int transfer(struct request *r, const char *receiver, double amount) {
+    const char *current_username = r->username;
+
+    if (strlen(current_username) == 0) return refuse(r, "Please login first.\n");
+
+    // Check the limits and hold the funds in memory; the committer journals it
+    enum velocity_verdict verdict;
+    if (!ledger_reserve(current_username, receiver, amount, &verdict)) {
+        if (verdict != VELOCITY_OK) return refuse_limit(r, verdict);
+        return refuse(r, "Transfer failed! Check balance or recipient.\n");
+    }
+
+    struct transfer_request *req = calloc(1, sizeof(*req));
+    if (!req) {
+        ledger_settle(current_username, receiver, amount, 0);
+        return busy(r);
+    }
+    strcpy(req->sender, current_username);
+    strcpy(req->receiver, receiver);
+    req->amount = amount;
+    req->done = transfer_finished;
+    req->ctx = r;
+
+    // The committer replies once the batch holding this transfer commits
+    if (transfer_engine_submit(req)) return 0;
+
+    ledger_settle(current_username, receiver, amount, 0);
+    free(req);
+    return busy(r);
+}
+
+static const char *line_status_text[] = {
+    [LINE_PENDING] = "PENDING",
+    [LINE_OK] = "OK",
+    [LINE_UNKNOWN_RECIPIENT] = "FAILED unknown recipient",
+    [LINE_OVER_LIMIT] = "FAILED over the per-transfer limit",
+    [LINE_OVER_HOURLY] = "FAILED over the hourly limit",
+    [LINE_OVER_RATE] = "FAILED too many transfers in the last minute",
+    [LINE_TOO_MANY_RECIPIENTS] = "FAILED too many new recipients today",
+    [LINE_BAD_AMOUNT] = "FAILED invalid amount",
+    [LINE_NO_FUNDS] = "FAILED insufficient funds",
+    [LINE_NOT_SENT] = "NOT SENT",
+    [LINE_FAILED] = "FAILED could not commit",
+};
+
+static const enum transfer_line_status verdict_status[] = {
+    [VELOCITY_OVER_AMOUNT] = LINE_OVER_LIMIT,
+    [VELOCITY_OVER_HOURLY] = LINE_OVER_HOURLY,
+    [VELOCITY_OVER_RATE] = LINE_OVER_RATE,
+    [VELOCITY_OVER_RECIPIENTS] = LINE_TOO_MANY_RECIPIENTS,
+};
+
+// A summary, then one numbered result per payment in the order they were sent
+static void send_batch_report(struct request *r, const struct transfer_line *lines, int count) {
+    for (int i = 0; i < count; i++)
+        request_printf(r, "%d %s ₹%.2f %s\n", i + 1, lines[i].receiver, lines[i].amount,
+                       line_status_text[lines[i].status]);
+}
+
+// Runs on the transfer committer thread once the batch's commit is settled
+static void transfer_batch_finished(struct transfer_request *req, int success, double new_balance) {
+    struct request *r = req->ctx;
+
+    int sent = 0;
+    for (int i = 0; i < req->line_count; i++) sent += req->lines[i].status == LINE_OK;
+    if (success) {
+        request_printf(r, "Batch sent: %d of %d transfers, ₹%.2f in total. New balance: ₹%.2f\n",
+                       sent, req->line_count, req->amount, new_balance);
+        log_info("%s sent a batch of %d transfers totalling ₹%.2f. New Balance: ₹%.2f",
+                 req->sender, sent, req->amount, new_balance);
+    } else {
+        r->status = WIRE_FAILED;
+        request_send_text(r, "Batch failed: nothing was sent.\n");
+    }
+    send_batch_report(r, req->lines, req->line_count);
+
+    free(req->lines);
+    free(req);
+    request_complete(r);
+}
+
+static int refuse_batch(struct request *r, const char *summary, struct transfer_line *lines, int count) {
+    r->status = WIRE_FAILED;
+    request_send_text(r, summary);
+    send_batch_report(r, lines, count);
+    free(lines);
+    return 1;
+}
+
+// Check every line, reserve the funds for the whole batch at once, and hand it
+// to the committer as one transfer. Without best_effort any bad line, a line
+// over the sender's limits or a total over the balance refuses the lot. Takes
+// ownership of lines.
+static int transfer_batch(struct request *r, struct transfer_line *lines, int count, int best_effort) {
+    if (strlen(r->username) == 0) {
+        free(lines);
+        return refuse(r, "Please login first.\n");
+    }
+
+    double *amounts = calloc(count, sizeof(*amounts));
+    const char **receivers = malloc(sizeof(*receivers) * count);
+    enum velocity_verdict *verdicts = malloc(sizeof(*verdicts) * count);
+    unsigned char *reserved = calloc(count, 1);
+    if (!amounts || !receivers || !verdicts || !reserved) {
+        free(amounts);
+        free(receivers);
+        free(verdicts);
+        free(reserved);
+        free(lines);
+        return busy(r);
+    }
+
+    int invalid = 0;
+    for (int i = 0; i < count; i++) {
+        struct transfer_line *line = &lines[i];
+        double known;
+        if (!(line->amount > 0) || llround(line->amount * 100.0) <= 0) line->status = LINE_BAD_AMOUNT;
+        else if (!ledger_balance(line->receiver, &known)) line->status = LINE_UNKNOWN_RECIPIENT;
+        else line->status = LINE_PENDING;
+
+        amounts[i] = line->status == LINE_PENDING ? line->amount : 0;
+        receivers[i] = line->receiver;
+        verdicts[i] = VELOCITY_OK;
+        invalid += line->status != LINE_PENDING;
+    }
+
+    // An all-or-nothing batch with a bad line reserves nothing; its good lines
+    // are reported as not sent
+    int taken = 0;
+    if (best_effort || !invalid)
+        taken = ledger_reserve_many(r->username, receivers, amounts, count, !best_effort, reserved, verdicts);
+    else
+        for (int i = 0; i < count; i++)
+            if (lines[i].status == LINE_PENDING) lines[i].status = LINE_NOT_SENT;
+    free(amounts);
+    free(receivers);
+
+    double total = 0;
+    int limited = 0;
+    for (int i = 0; i < count; i++) {
+        if (lines[i].status != LINE_PENDING) continue;
+        if (reserved[i]) total += lines[i].amount;
+        else if (verdicts[i] != VELOCITY_OK) lines[i].status = verdict_status[verdicts[i]];
+        else lines[i].status = best_effort ? LINE_NO_FUNDS : LINE_NOT_SENT;
+        limited += verdicts[i] != VELOCITY_OK;
+    }
+    free(verdicts);
+    free(reserved);
+    if (limited) metrics_count(COUNTER_TRANSFERS_LIMITED, limited);
+
+    if (!taken) {
+        if (best_effort) return refuse_batch(r, "Batch failed: no transfer could be sent.\n", lines, count);
+        if (invalid) return refuse_batch(r, "Batch refused: nothing was sent. Fix the failed lines.\n", lines, count);
+        if (limited)
+            return refuse_batch(r, "Batch refused: nothing was sent. A payment is over your transfer limits.\n",
+                                lines, count);
+        return refuse_batch(r, "Batch refused: nothing was sent. The total is more than your balance.\n",
+                            lines, count);
+    }
+
+    struct transfer_request *req = calloc(1, sizeof(*req));
+    if (req) {
+        strcpy(req->sender, r->username);
+        req->amount = total;
+        req->lines = lines;
+        req->line_count = count;
+        req->done = transfer_batch_finished;
+        req->ctx = r;
+
+        // The committer replies once the batch commits
+        if (transfer_engine_submit(req)) return 0;
+    }
+
+    for (int i = 0; i < count; i++)
+        if (lines[i].status == LINE_PENDING) ledger_settle(r->username, lines[i].receiver, lines[i].amount, 0);
+    free(req);
+    free(lines);
+    return busy(r);
+}
+
+// "[BEST_EFFORT] <count> <recipient> <amount> ...", all on one line. The count
+// catches a line that arrived cut short.
+static int transfer_batch_text(struct request *r, char *args) {
+    const char *usage = "Invalid TRANSFER_BATCH format. "
+                        "Use: TRANSFER_BATCH [BEST_EFFORT] <count> <recipient> <amount> ...\n";
+    char *save = NULL;
+    char *word = strtok_r(args, " \t", &save);
+    int best_effort = word && strcmp(word, "BEST_EFFORT") == 0;
+    if (best_effort) word = strtok_r(NULL, " \t", &save);
+
+    char *end;
+    long count = word ? strtol(word, &end, 10) : 0;
+    if (!word || *end != '\0' || count < 1 || count > WIRE_BATCH_MAX_LINES) return refuse(r, usage);
+
+    struct transfer_line *lines = calloc(count, sizeof(*lines));
+    if (!lines) return busy(r);
+    for (long i = 0; i < count; i++) {
+        char *receiver = strtok_r(NULL, " \t", &save);
+        char *amount = strtok_r(NULL, " \t", &save);
+        if (!amount || strlen(receiver) >= WIRE_NAME_SIZE) {
+            free(lines);
+            return refuse(r, usage);
         }
+        strcpy(lines[i].receiver, receiver);
+        lines[i].amount = strtod(amount, &end);
+        if (*end != '\0') lines[i].amount = NAN;  // reported as an invalid amount
+    }
+    if (strtok_r(NULL, " \t", &save)) {
+        free(lines);
+        return refuse(r, usage);
+    }
+    return transfer_batch(r, lines, count, best_effort);
+}
 
-        else if (strncmp(buffer, "TRANSFER", 8) == 0) {
-            char receiver[100];
-            double amount;
-            printf("[DEBUG] Received buffer: '%s'\n", buffer);
-        
-            if (sscanf(buffer, "TRANSFER %s %lf", receiver, &amount) == 2) {
-                if (strlen(current_username) == 0) {
-                    send(sock, "Please login first.\n", 21, 0);
-                    return NULL;
-                }
-        
-                if (amount > 1000.0) {
-                    send(sock, "Transaction limit exceeded! Max ₹1000.\n", 40, 0);
-                    return NULL;
-                }
-        
-                if (transfer_money(current_username, receiver, amount)) {
-                    double new_balance = get_balance(current_username);
-                    char response[BUFFER_SIZE];
-                    sprintf(response, "Transfer successful! New balance: ₹%.2f\n", new_balance);
-                    send(sock, response, strlen(response), 0);
-                    printf("[INFO] %s sent ₹%.2f to %s. New Balance: ₹%.2f\n", current_username, amount, receiver, new_balance);
-                } else {
-                    send(sock, "Transfer failed! Check balance or recipient.\n", 45, 0);
-                }
-            } else {
-                send(sock, "Invalid TRANSFER format. Use: TRANSFER <recipient> <amount>\n", 60, 0);
-            }
+// u8 best_effort | u32 count | count x (receiver[50] amount). Returns 0 if the
+// fields are malformed; *lines is NULL if they could not be allocated.
+static int decode_transfer_batch(const unsigned char *fields, size_t size, struct transfer_line **lines,
+                                 int *count) {
+    if (size < 1 + WIRE_LIMIT_SIZE) return 0;
+    uint32_t n = wire_get_u32(fields + 1);
+    if (fields[0] > 1 || n < 1 || n > WIRE_BATCH_MAX_LINES ||
+        size != 1 + WIRE_LIMIT_SIZE + (size_t)n * WIRE_BATCH_LINE_SIZE)
+        return 0;
+
+    *count = n;
+    *lines = calloc(n, sizeof(**lines));
+    if (!*lines) return 1;
+    const unsigned char *line = fields + 1 + WIRE_LIMIT_SIZE;
+    for (uint32_t i = 0; i < n; i++, line += WIRE_BATCH_LINE_SIZE) {
+        if (!wire_get_string((*lines)[i].receiver, line, WIRE_NAME_SIZE)) {
+            free(*lines);
+            return 0;
         }
+        (*lines)[i].amount = wire_get_i64(line + WIRE_NAME_SIZE) / 100.0;
+    }
+    return 1;
+}
 
-        else if (strncmp(buffer, "HISTORY", 7) == 0) {
-            if (strlen(current_username) == 0) {
-                send(sock, "Please login first.\n", 21, 0);
-                continue;
-            }
+static int history(struct request *r, int limit, const char *cursor) {
+    if (strlen(r->username) == 0) return refuse(r, "Please login first.\n");
 
-            get_transaction_history_socket(current_username, sock);
-        }
+    store_catch_up(REPORT_CATCH_UP_MS);
+    uint64_t start = metrics_now();
+    int found = get_transaction_history_socket(r->username, limit, cursor, r);
+    metrics_time(TIMER_HISTORY_PAGE, metrics_now() - start);
+    if (!found) return refuse(r, "Failed to fetch history.\n");
+    return 1;
+}
 
-        else if (strncmp(buffer, "SHOW_ALL_USERS", 15) == 0) {
-            if (!is_admin(current_username)) {
-                send(sock, "Unauthorized. Admin access only.\n", 34, 0);
-                continue;
-            }
+static int show_users(struct request *r, const struct user_filter *filter) {
+    if (!is_admin(r->username)) return refuse(r, "Unauthorized. Admin access only.\n");
 
-            char result[65536];  // bump it up for testing!
-            show_all_users(result);
-            send(sock, result, strlen(result), 0);
-        }
+    store_catch_up(REPORT_CATCH_UP_MS);
+    if (!show_all_users(filter, stream_request, r))
+        return refuse(r, "Error fetching users.\n");
+    return 1;
+}
+
+static int admin_stats(struct request *r, int k) {
+    if (!is_admin(r->username)) return refuse(r, "Unauthorized. Admin access only.\n");
+
+    char result[16384];
+    store_catch_up(REPORT_CATCH_UP_MS);
+    get_admin_stats(result, sizeof(result), k);  // Implemented in stats.c
+    request_send_text(r, result);
+    return 1;
+}
+
+static int queue_stats(struct request *r) {
+    if (strlen(r->username) == 0) return refuse(r, "Please login first.\n");
+    if (!is_admin(r->username)) return refuse(r, "Unauthorized. Admin access only.\n");
+
+    char result[1024];
+    worker_pool_report(result, sizeof(result));
+    request_send_text(r, result);
+    return 1;
+}
+
+// Prometheus text; the same as the local HTTP endpoint
+static int metrics(struct request *r) {
+    if (strlen(r->username) == 0) return refuse(r, "Please login first.\n");
+    if (!is_admin(r->username)) return refuse(r, "Unauthorized. Admin access only.\n");
+
+    metrics_render(write_request, r);
+    return 1;
+}
+
+// Show the log level, or change it when a name is given
+static int log_level(struct request *r, const char *name) {
+    if (strlen(r->username) == 0) return refuse(r, "Please login first.\n");
+    if (!is_admin(r->username)) return refuse(r, "Unauthorized. Admin access only.\n");
+
+    if (name && *name) {
+        enum log_level level;
+        if (!log_parse_level(name, &level)) return refuse(r, "Unknown log level. Use debug, info or error.\n");
+        log_set_level(level);
+        log_info("Log level set to %s by %s", log_level_name(level), r->username);
+    }
+    request_printf(r, "Log level: %s\n", log_level_name(log_threshold));
+    return 1;
+}
+
+// Move an account to another velocity tier
+static int set_tier(struct request *r, const char *username, int tier) {
+    if (strlen(r->username) == 0) return refuse(r, "Please login first.\n");
+    if (!is_admin(r->username)) return refuse(r, "Unauthorized. Admin access only.\n");
+
+    if (tier < 0 || tier >= VELOCITY_TIERS) return refuse(r, "Unknown tier. Use 0 to 3.\n");
+    if (!store_set_tier(username, tier)) return refuse(r, "Tier change failed! Check the username.\n");
+    log_info("%s moved %s to velocity tier %d", r->username, username, tier);
+    request_printf(r, "%s is now in velocity tier %d\n", username, tier);
+    return 1;
+}
+
+// Decode one binary frame body (opcode, then its fixed-width fields)
+static int handle_frame(struct request *r) {
+    const unsigned char *fields = (const unsigned char *)r->command + 1;
+    size_t size = r->len - 1;
+    char name[WIRE_NAME_SIZE], password[WIRE_NAME_SIZE];
+    char token[WIRE_TOKEN_SIZE + 1];
+    char cursor[WIRE_CURSOR_SIZE] = "";
+
+    switch ((unsigned char)r->command[0]) {
+    case OP_SIGNUP:
+    case OP_LOGIN:
+        if (size != 2 * WIRE_NAME_SIZE ||
+            !wire_get_string(name, fields, WIRE_NAME_SIZE) ||
+            !wire_get_string(password, fields + WIRE_NAME_SIZE, WIRE_NAME_SIZE))
+            break;
+        if (r->command[0] == OP_SIGNUP) return signup(r, name, password);
+        return login(r, name, password);
+
+    case OP_RESUME:
+        if (size != WIRE_TOKEN_SIZE) break;
+        memcpy(token, fields, WIRE_TOKEN_SIZE);
+        token[WIRE_TOKEN_SIZE] = '\0';
+        if (!resume(r, token)) return refuse(r, "Session expired or invalid. Please login again.\n");
+        request_send_text(r, "Session resumed\n");
+        return 1;
+
+    case OP_TRANSFER: {
+        if (size != WIRE_NAME_SIZE + WIRE_AMOUNT_SIZE || !wire_get_string(name, fields, WIRE_NAME_SIZE))
+            break;
+        int64_t paise = wire_get_i64(fields + WIRE_NAME_SIZE);
+        return transfer(r, name, paise / 100.0);
+    }
 
-        else if (strncmp(buffer, "ADMIN_STATS", 11) == 0) {
-            if (!is_admin(current_username)) {
-                send(sock, "Unauthorized. Admin access only.\n", 34, 0);
-                continue;
-            }
+    case OP_LOGOUT:         if (size == 0) return logout(r); break;
+    case OP_BALANCE:        if (size == 0) return balance(r); break;
+    case OP_HISTORY:
+        if (size == 0) return history(r, HISTORY_DEFAULT_LIMIT, NULL);
+        if (size != WIRE_LIMIT_SIZE + WIRE_CURSOR_SIZE) break;
+        if (fields[WIRE_LIMIT_SIZE] && !wire_get_string(cursor, fields + WIRE_LIMIT_SIZE, WIRE_CURSOR_SIZE))
+            break;
+        return history(r, (int)wire_get_u32(fields), cursor);
+
+    case OP_SHOW_ALL_USERS: {
+        struct user_filter filter = {NULL, 0, 0};
+        if (size == 0) return show_users(r, &filter);
+        if (size != WIRE_LIMIT_SIZE + WIRE_AMOUNT_SIZE + WIRE_NAME_SIZE) break;
+        const unsigned char *prefix = fields + WIRE_LIMIT_SIZE + WIRE_AMOUNT_SIZE;
+        if (prefix[0] && !wire_get_string(name, prefix, WIRE_NAME_SIZE)) break;
+        filter.prefix = prefix[0] ? name : NULL;
+        filter.min_balance = wire_get_i64(fields + WIRE_LIMIT_SIZE);
+        filter.limit = (int)wire_get_u32(fields);
+        return show_users(r, &filter);
+    }
+
+    case OP_ADMIN_STATS:
+        if (size == 0) return admin_stats(r, STATS_DEFAULT_TOP);
+        if (size == WIRE_LIMIT_SIZE) return admin_stats(r, (int)wire_get_u32(fields));
+        break;
+    case OP_QUEUE_STATS:    if (size == 0) return queue_stats(r); break;
+    case OP_METRICS:        if (size == 0) return metrics(r); break;
+    case OP_TRANSFER_BATCH: {
+        struct transfer_line *lines;
+        int count;
+        if (!decode_transfer_batch(fields, size, &lines, &count)) break;
+        if (!lines) return busy(r);
+        return transfer_batch(r, lines, count, fields[0]);
+    }
+    case OP_LOG_LEVEL:
+        if (size == 0) return log_level(r, NULL);
+        if (size == WIRE_NAME_SIZE && wire_get_string(name, fields, WIRE_NAME_SIZE)) return log_level(r, name);
+        break;
+    case OP_SET_TIER:
+        if (size != WIRE_NAME_SIZE + 1 || !wire_get_string(name, fields, WIRE_NAME_SIZE)) break;
+        return set_tier(r, name, fields[WIRE_NAME_SIZE]);
+    }
 
-            char result[65536];  // bump it up for testing!
-            get_admin_stats(result);  // Implemented in db.c
-            send(sock, result, strlen(result), 0);
+    r->status = WIRE_BAD_REQUEST;
+    request_send_text(r, "Invalid command!\n");
+    return 1;
+}
+
+// Runs on a worker thread with one complete command from the event loop
+int handle_request(struct request *r) {
+    if (r->binary) return handle_frame(r);
+
+    char *buffer = r->command;
+    char arg1[50], arg2[50];
+
+    // "TOKEN <token> <command>" resumes a session without repeating LOGIN
+    if (strncmp(buffer, "TOKEN ", 6) == 0) {
+        char token[65];
+        int used = 0;
+        if (sscanf(buffer, "TOKEN %64s %n", token, &used) != 1 || used == 0 || !resume(r, token))
+            return refuse(r, "Session expired or invalid. Please login again.\n");
+        buffer += used;
+        if (*buffer == '\0') {
+            request_send_text(r, "Session resumed\n");
+            return 1;
         }
+    }
+
+    if (sscanf(buffer, "SIGNUP %49s %49s", arg1, arg2) == 2) {
+        return signup(r, arg1, arg2);
+    }
+
+    else if (sscanf(buffer, "LOGIN %49s %49s", arg1, arg2) == 2) {
+        return login(r, arg1, arg2);
+    }
+
+    else if (strncmp(buffer, "LOGOUT", 6) == 0) {
+        return logout(r);
+    }
 
-        else {
-            send(sock, "Invalid command!\n", 17, 0);
+    else if (strncmp(buffer, "BALANCE", 7) == 0) {
+        return balance(r);
+    }
+
+    // Before TRANSFER, which is a prefix of it
+    else if (strncmp(buffer, "TRANSFER_BATCH", 14) == 0) {
+        return transfer_batch_text(r, buffer + 14);
+    }
+
+    else if (strncmp(buffer, "TRANSFER", 8) == 0) {
+        char receiver[100];
+        double amount;
+        log_debug("Received buffer: '%s'", buffer);
+
+        if (sscanf(buffer, "TRANSFER %99s %lf", receiver, &amount) == 2) {
+            return transfer(r, receiver, amount);
         }
+        return refuse(r, "Invalid TRANSFER format. Use: TRANSFER <recipient> <amount>\n");
+    }
+
+    else if (strncmp(buffer, "HISTORY", 7) == 0) {
+        // "HISTORY [limit] [cursor]"; older clients send "HISTORY <username>",
+        // which fails the number and gets the first page
+        int limit = HISTORY_DEFAULT_LIMIT;
+        char cursor[HISTORY_CURSOR_SIZE] = "";
+        sscanf(buffer + 7, "%d %63s", &limit, cursor);
+        return history(r, limit, cursor);
     }
 
-    close(sock);
-    return NULL;
+    else if (strncmp(buffer, "SHOW_ALL_USERS", 14) == 0) {
+        // "SHOW_ALL_USERS [limit] [min_balance] [prefix]"; 0 leaves a filter off
+        struct user_filter filter = {NULL, 0, 0};
+        double min_balance = 0;
+        if (sscanf(buffer + 14, "%d %lf %49s", &filter.limit, &min_balance, arg1) == 3) filter.prefix = arg1;
+        filter.min_balance = llround(min_balance * 100);
+        return show_users(r, &filter);
+    }
+
+    else if (strncmp(buffer, "ADMIN_STATS", 11) == 0) {
+        int k = STATS_DEFAULT_TOP;
+        sscanf(buffer + 11, "%d", &k);
+        return admin_stats(r, k);
+    }
+
+    else if (strncmp(buffer, "QUEUE_STATS", 11) == 0) {
+        return queue_stats(r);
+    }
+
+    else if (strncmp(buffer, "METRICS", 7) == 0) {
+        return metrics(r);
+    }
+
+    else if (strncmp(buffer, "LOG_LEVEL", 9) == 0) {
+        arg1[0] = '\0';
+        sscanf(buffer + 9, "%49s", arg1);
+        return log_level(r, arg1);
+    }
+
+    else if (strncmp(buffer, "SET_TIER", 8) == 0) {
+        int tier;
+        if (sscanf(buffer + 8, "%49s %d", arg1, &tier) == 2) return set_tier(r, arg1, tier);
+        return refuse(r, "Invalid SET_TIER format. Use: SET_TIER <username> <tier>\n");
+    }
+
+    return refuse(r, "Invalid command!\n");
+}
+
+// Binary opcodes as metrics commands; gaps are METRIC_INVALID
+static const enum metric_command opcode_metrics[] = {
+    [OP_SIGNUP] = METRIC_SIGNUP,
+    [OP_LOGIN] = METRIC_LOGIN,
+    [OP_LOGOUT] = METRIC_LOGOUT,
+    [OP_RESUME] = METRIC_RESUME,
+    [OP_BALANCE] = METRIC_BALANCE,
+    [OP_TRANSFER] = METRIC_TRANSFER,
+    [OP_HISTORY] = METRIC_HISTORY,
+    [OP_SHOW_ALL_USERS] = METRIC_SHOW_ALL_USERS,
+    [OP_ADMIN_STATS] = METRIC_ADMIN_STATS,
+    [OP_QUEUE_STATS] = METRIC_QUEUE_STATS,
+    [OP_METRICS] = METRIC_METRICS,
+    [OP_LOG_LEVEL] = METRIC_LOG_LEVEL,
+    [OP_TRANSFER_BATCH] = METRIC_TRANSFER_BATCH,
+    [OP_SET_TIER] = METRIC_SET_TIER
+};
+
+// Text commands by their leading word, matched as handle_request() does
+static const struct {
+    const char *word;
+    enum metric_command metric;
+} text_metrics[] = {
+    {"SIGNUP", METRIC_SIGNUP}, {"LOGIN", METRIC_LOGIN}, {"LOGOUT", METRIC_LOGOUT},
+    {"BALANCE", METRIC_BALANCE}, {"TRANSFER_BATCH", METRIC_TRANSFER_BATCH},
+    {"TRANSFER", METRIC_TRANSFER}, {"HISTORY", METRIC_HISTORY},
+    {"SHOW_ALL_USERS", METRIC_SHOW_ALL_USERS}, {"ADMIN_STATS", METRIC_ADMIN_STATS},
+    {"QUEUE_STATS", METRIC_QUEUE_STATS}, {"METRICS", METRIC_METRICS},
+    {"LOG_LEVEL", METRIC_LOG_LEVEL}, {"SET_TIER", METRIC_SET_TIER}
+};
+
+static enum metric_command classify(const struct request *r) {
+    if (r->binary) {
+        unsigned char opcode = r->command[0];
+        if (opcode < sizeof(opcode_metrics) / sizeof(opcode_metrics[0])) return opcode_metrics[opcode];
+        return METRIC_INVALID;
+    }
+
+    // Classify the command behind a "TOKEN <token> " prefix
+    const char *buffer = r->command;
+    if (strncmp(buffer, "TOKEN ", 6) == 0) {
+        const char *rest = strchr(buffer + 6, ' ');
+        if (!rest || rest[1] == '\0') return METRIC_RESUME;
+        buffer = rest + 1;
+    }
+
+    for (size_t i = 0; i < sizeof(text_metrics) / sizeof(text_metrics[0]); i++) {
+        if (strncmp(buffer, text_metrics[i].word, strlen(text_metrics[i].word)) == 0) return text_metrics[i].metric;
+    }
+    return METRIC_INVALID;
+}
+
+// Runs on the event loop: auth, writes, reads and long reports each get their own lane
+enum lane route_request(struct request *r) {
+    r->metric = classify(r);
+    switch (r->metric) {
+    case METRIC_SIGNUP:
+    case METRIC_LOGIN:
+        return LANE_AUTH;
+    case METRIC_TRANSFER:
+    case METRIC_TRANSFER_BATCH:
+    case METRIC_SET_TIER:
+        return LANE_WRITE;
+    case METRIC_SHOW_ALL_USERS:
+    case METRIC_ADMIN_STATS:
+        return LANE_REPORT;
+    default:
+        return LANE_READ;
+    }
+}
+
+// Let one process hold tens of thousands of idle client sockets; returns the new limit
+static long raise_fd_limit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return -1;
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur == RLIM_INFINITY ? -1 : (long)limit.rlim_cur;
 }
 
 int main() {
+    shutdown_fd = eventfd(0, EFD_CLOEXEC);
+    if (shutdown_fd < 0) {
+        printf("Shutdown eventfd setup failed!\n");
+        return 1;
+    }
     signal(SIGINT, handle_shutdown); // Graceful Ctrl+C shutdown
+    signal(SIGPIPE, SIG_IGN);        // a vanished client must not kill the server
+
+    if (!log_start()) {
+        printf("Logger startup failed!\n");
+        return 1;
+    }
+
+    velocity_configure();
 
     if (!initialize_db()) {
         printf("Database initialization failed!\n");
         return 1;
     }
 
-    struct sockaddr_in server, client;
-    socklen_t client_size = sizeof(client);
-    int client_sock;
+    if (!archive_open()) {
+        printf("Archive startup failed!\n");
+        return 1;
+    }
 
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1) {
-        perror("Socket creation failed");
+    long fd_limit = raise_fd_limit();
+    session_init();
+
+    int window_count = sizeof(top_sender_windows) / sizeof(top_sender_windows[0]);
+    if (!stats_start(top_sender_windows, window_count, TOP_SENDERS_TRACKED, STATS_RECONCILE_SECONDS)) {
+        printf("Stats startup failed!\n");
         return 1;
     }
 
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(PORT);
+    if (!db_checkpoint_start(CHECKPOINT_SECONDS, CHECKPOINT_WAL_PAGES)) {
+        printf("Checkpoint thread startup failed!\n");
+        return 1;
+    }
 
-    if (bind(server_fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
-        perror("Bind failed");
+    if (!store_start(SNAPSHOT_SECONDS, SNAPSHOT_RECORDS)) {
+        printf("Journal applier startup failed!\n");
         return 1;
     }
 
-    listen(server_fd, 5);
+    if (!archive_start(ARCHIVE_HOT_DAYS, ARCHIVE_SEGMENT_ROWS, ARCHIVE_CHECK_SECONDS)) {
+        printf("Archiver startup failed!\n");
+        return 1;
+    }
 
-    printf("Server listening on port %d...\n", PORT);
-    print_supported_commands();
+    // Scrapes go to their own loopback port; the server runs on without them
+    metrics_serve(METRICS_PORT);
 
-    while (1) {
-        client_sock = accept(server_fd, (struct sockaddr *)&client, &client_size);
-        if (client_sock < 0) {
-            perror("Accept failed");
-            continue;
-        }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
 
-        pthread_t thread;
-        int *new_sock = malloc(sizeof(int));
-        *new_sock = client_sock;
+    if (!transfer_engine_start(TRANSFER_BATCH_MAX, TRANSFER_BATCH_WAIT_US, TRANSFER_QUEUE_DEPTH)) {
+        printf("Transfer engine startup failed!\n");
+        return 1;
+    }
 
-        if (pthread_create(&thread, NULL, handle_client, (void *)new_sock) < 0) {
-            perror("Thread creation failed");
-            continue;
-        }
+    // One PBKDF2 thread per core; each hashes several passwords per SIMD pass
+    if (!auth_engine_start(cpus, AUTH_ENGINE_DEPTH)) {
+        printf("Auth engine startup failed!\n");
+        return 1;
+    }
+
+    // Reads get read-only connections, so a long report never holds up the applier
+    struct lane_config lanes[LANE_COUNT] = {{0}};
+    lanes[LANE_AUTH].threads = cpus;
+    lanes[LANE_AUTH].depth = AUTH_QUEUE_DEPTH;
+    lanes[LANE_WRITE].threads = WRITE_WORKERS;
+    lanes[LANE_WRITE].depth = WRITE_QUEUE_DEPTH;
+    lanes[LANE_READ].threads = cpus;
+    lanes[LANE_READ].depth = READ_QUEUE_DEPTH;
+    lanes[LANE_READ].thread_start = db_thread_read_only;
+    lanes[LANE_REPORT].threads = REPORT_WORKERS;
+    lanes[LANE_REPORT].depth = REPORT_QUEUE_DEPTH;
+    lanes[LANE_REPORT].thread_start = db_thread_read_only;
+
+    if (!worker_pool_start(lanes)) {
+        printf("Worker pool startup failed!\n");
+        return 1;
+    }
 
-        pthread_detach(thread);
+    // Leave descriptors for the database, journal, listeners and epoll sets
+    struct reactor_limits limits = {LISTEN_BACKLOG, MAX_CONNECTIONS, MAX_CONNECTIONS_PER_IP,
+                                    IDLE_TIMEOUT_SECONDS, READ_TIMEOUT_SECONDS, WRITE_TIMEOUT_SECONDS,
+                                    secure_only_setting()};
+    if (fd_limit > 0 && limits.max_connections > fd_limit - 64 - 2 * cpus)
+        limits.max_connections = fd_limit > 64 + 2 * cpus + 1 ? (int)(fd_limit - 64 - 2 * cpus) : 1;
+    printf("[INFO] Accepting up to %d connections, %d per IP\n", limits.max_connections, limits.max_per_ip);
+    if (limits.secure_only) printf("[INFO] Only encrypted binary clients are accepted\n");
+
+    // One edge-triggered epoll loop per core, each with its own SO_REUSEPORT listener
+    if (!reactor_start(PORT, cpus, &limits, handle_request, route_request)) {
+        return 1;
     }
 
-    close(server_fd);
+    printf("Server listening on port %d...\n", PORT);
+    print_supported_commands();
+
+    wait_for_shutdown();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,132 @@
+#include "session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <openssl/rand.h>
+
+#define SESSION_BUCKETS 65536
+#define SESSION_STRIPES 64
+#define NAME_SIZE 100
+
+struct session {
+    char token[SESSION_TOKEN_SIZE];
+    char username[NAME_SIZE];
+    time_t expires;
+    struct session *next;
+};
+
+// A bucket's low bits equal its stripe index, so one lock covers each chain
+static pthread_mutex_t stripes[SESSION_STRIPES];
+static struct session *buckets[SESSION_BUCKETS];
+
+// Tokens are uniformly random, so their leading bytes already make a good hash
+static uint32_t hash_token(const char *token) {
+    uint32_t h = 0;
+    for (int i = 0; i < 8 && token[i]; i++) {
+        char ch = token[i];
+        h = (h << 4) | (uint32_t)(ch <= '9' ? ch - '0' : ch - 'a' + 10);
+    }
+    return h;
+}
+
+static int valid_token(const char *token) {
+    size_t len = strlen(token);
+    if (len != SESSION_TOKEN_SIZE - 1) return 0;
+    for (size_t i = 0; i < len; i++) {
+        char ch = token[i];
+        if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f'))) return 0;
+    }
+    return 1;
+}
+
+int session_init() {
+    for (int i = 0; i < SESSION_STRIPES; i++)
+        pthread_mutex_init(&stripes[i], NULL);
+    return 1;
+}
+
+int session_create(const char *username, char *token_out) {
+    unsigned char raw[SESSION_TOKEN_BYTES];
+    if (RAND_bytes(raw, sizeof(raw)) != 1) return 0;
+    for (int i = 0; i < SESSION_TOKEN_BYTES; i++) snprintf(&token_out[i * 2], 3, "%02x", raw[i]);
+
+    struct session *s = malloc(sizeof(*s));
+    if (!s) return 0;
+    strcpy(s->token, token_out);
+    snprintf(s->username, sizeof(s->username), "%s", username);
+
+    time_t now = time(NULL);
+    s->expires = now + SESSION_TTL_SECONDS;
+
+    uint32_t h = hash_token(token_out);
+    struct session **bucket = &buckets[h % SESSION_BUCKETS];
+    pthread_mutex_t *lock = &stripes[h % SESSION_STRIPES];
+
+    pthread_mutex_lock(lock);
+    // Sweep expired sessions from this chain while we hold it
+    for (struct session **p = bucket; *p;) {
+        if ((*p)->expires <= now) {
+            struct session *old = *p;
+            *p = old->next;
+            free(old);
+        } else {
+            p = &(*p)->next;
+        }
+    }
+    s->next = *bucket;
+    *bucket = s;
+    pthread_mutex_unlock(lock);
+    return 1;
+}
+
+int session_resume(const char *token, char *username_out, size_t username_size) {
+    if (!valid_token(token)) return 0;
+
+    uint32_t h = hash_token(token);
+    struct session **p = &buckets[h % SESSION_BUCKETS];
+    pthread_mutex_t *lock = &stripes[h % SESSION_STRIPES];
+    time_t now = time(NULL);
+    int found = 0;
+
+    pthread_mutex_lock(lock);
+    while (*p) {
+        struct session *s = *p;
+        if (strcmp(s->token, token) == 0) {
+            if (s->expires > now) {
+                s->expires = now + SESSION_TTL_SECONDS;
+                snprintf(username_out, username_size, "%s", s->username);
+                found = 1;
+            } else {
+                *p = s->next;
+                free(s);
+            }
+            break;
+        }
+        p = &s->next;
+    }
+    pthread_mutex_unlock(lock);
+    return found;
+}
+
+void session_revoke(const char *token) {
+    if (!valid_token(token)) return;
+
+    uint32_t h = hash_token(token);
+    struct session **p = &buckets[h % SESSION_BUCKETS];
+    pthread_mutex_t *lock = &stripes[h % SESSION_STRIPES];
+
+    pthread_mutex_lock(lock);
+    while (*p) {
+        struct session *s = *p;
+        if (strcmp(s->token, token) == 0) {
+            *p = s->next;
+            free(s);
+            break;
+        }
+        p = &s->next;
+    }
+    pthread_mutex_unlock(lock);
+}
@@ -0,0 +1,23 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>
+
+#define SESSION_TOKEN_BYTES 16
+#define SESSION_TOKEN_SIZE (SESSION_TOKEN_BYTES * 2 + 1)  // hex plus NUL
+#define SESSION_TTL_SECONDS (30 * 60)                     // idle lifetime, renewed on use
+
+// Size the in-memory session table (no SQLite involved)
+int session_init();
+
+// Issue a random token for a freshly authenticated user
+int session_create(const char *username, char *token_out);
+
+// Look a token up in O(1). Copies the owner into username_out and renews the
+// expiry; returns 0 if the token is unknown, expired or revoked.
+int session_resume(const char *token, char *username_out, size_t username_size);
+
+// Invalidate a token immediately (LOGOUT)
+void session_revoke(const char *token);
+
+#endif
@@ -0,0 +1,182 @@
+#include "snapshot.h"
+#include "journal.h"
+#include "ledger.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC "WSNP"
+#define SNAPSHOT_HEADER_SIZE 40
+#define ENTRY_FIXED 18  // an entry's bytes besides the name
+#define WRITE_BUFFER (1 << 20)
+#define PATH_SIZE 512
+
+struct snapshot_writer {
+    FILE *file;
+    unsigned char *buffer;
+    size_t len;
+    uint32_t crc;
+    uint64_t accounts;
+    int failed;
+};
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static void flush_entries(struct snapshot_writer *w) {
+    w->crc = journal_crc32c(w->crc, w->buffer, w->len);
+    if (fwrite(w->buffer, 1, w->len, w->file) != w->len) w->failed = 1;
+    w->len = 0;
+}
+
+// Runs under a ledger stripe lock; the buffer keeps file writes to one per megabyte
+static void write_entry(void *ctx, const char *username, int64_t paise, uint64_t seq, int tier) {
+    struct snapshot_writer *w = ctx;
+    size_t len = strlen(username);
+    if (w->len + ENTRY_FIXED + len > WRITE_BUFFER) flush_entries(w);
+
+    unsigned char *p = w->buffer + w->len;
+    p[0] = (unsigned char)len;
+    memcpy(p + 1, username, len);
+    put_u64(p + 1 + len, (uint64_t)paise);
+    put_u64(p + 9 + len, seq);
+    p[17 + len] = (unsigned char)tier;
+    w->len += ENTRY_FIXED + len;
+    w->accounts++;
+}
+
+static void write_header(unsigned char *h, uint64_t seq, uint64_t accounts, uint64_t max_user_id, uint32_t crc) {
+    memcpy(h, SNAPSHOT_MAGIC, 4);
+    put_u32(h + 4, SNAPSHOT_VERSION);
+    put_u64(h + 8, seq);
+    put_u64(h + 16, accounts);
+    put_u64(h + 24, max_user_id);
+    put_u32(h + 32, crc);
+    put_u32(h + 36, journal_crc32c(0, h, 36));
+}
+
+// fsync the directory holding path, so a rename in it is durable
+static int sync_parent(const char *path) {
+    char dir[PATH_SIZE] = ".";
+    const char *slash = strrchr(path, '/');
+    if (slash) snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+int snapshot_write(const char *path, uint64_t seq, uint64_t max_user_id) {
+    char tmp_path[PATH_SIZE];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    struct snapshot_writer w = {0};
+    w.file = fopen(tmp_path, "wb");
+    w.buffer = malloc(WRITE_BUFFER);
+    if (!w.file || !w.buffer) {
+        log_error("Cannot write snapshot %s: %s", tmp_path, strerror(errno));
+        if (w.file) fclose(w.file);
+        free(w.buffer);
+        return 0;
+    }
+
+    // The header is filled in once the entries are counted
+    unsigned char header[SNAPSHOT_HEADER_SIZE] = {0};
+    if (fwrite(header, 1, sizeof(header), w.file) != sizeof(header)) w.failed = 1;
+    ledger_visit(write_entry, &w);
+    flush_entries(&w);
+    free(w.buffer);
+
+    write_header(header, seq, w.accounts, max_user_id, w.crc);
+    if (fseek(w.file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), w.file) != sizeof(header))
+        w.failed = 1;
+    if (fflush(w.file) != 0 || fsync(fileno(w.file)) != 0) w.failed = 1;
+    if (fclose(w.file) != 0) w.failed = 1;
+
+    if (w.failed || rename(tmp_path, path) != 0 || !sync_parent(path)) {
+        log_error("Cannot write snapshot %s: %s", path, strerror(errno));
+        unlink(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+int snapshot_load(const char *path, uint64_t *seq, uint64_t *max_user_id) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SNAPSHOT_HEADER_SIZE) {
+        close(fd);
+        printf("[ERROR] Snapshot %s is too short\n", path);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const unsigned char *p = map + SNAPSHOT_HEADER_SIZE, *end = map + size;
+    int valid = memcmp(map, SNAPSHOT_MAGIC, 4) == 0 && get_u32(map + 4) == SNAPSHOT_VERSION &&
+                get_u32(map + 36) == journal_crc32c(0, map, 36) &&
+                get_u32(map + 32) == journal_crc32c(0, p, (size_t)(end - p));
+    if (!valid) {
+        printf("[ERROR] Snapshot %s is damaged or from another version\n", path);
+        munmap(map, size);
+        return 0;
+    }
+
+    uint64_t accounts = get_u64(map + 16);
+    if (!ledger_init(accounts)) {
+        munmap(map, size);
+        return 0;
+    }
+
+    char username[256];
+    uint64_t loaded = 0;
+    while (end - p >= ENTRY_FIXED && end - p >= ENTRY_FIXED + p[0]) {
+        size_t len = p[0];
+        memcpy(username, p + 1, len);
+        username[len] = '\0';
+        loaded += ledger_add(username, (int64_t)get_u64(p + 1 + len), get_u64(p + 9 + len), p[17 + len]);
+        p += ENTRY_FIXED + len;
+    }
+    *seq = get_u64(map + 8);
+    *max_user_id = get_u64(map + 24);
+    munmap(map, size);
+
+    if (loaded != accounts) {
+        printf("[ERROR] Snapshot %s held %llu accounts, expected %llu\n", path,
+               (unsigned long long)loaded, (unsigned long long)accounts);
+        return 0;
+    }
+    printf("[INFO] Ledger loaded %llu accounts from the snapshot at seq %llu\n",
+           (unsigned long long)loaded, (unsigned long long)*seq);
+    return 1;
+}
@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+// Copy of the ledger as of a journal seq, so startup only replays the records
+// after it. The copy is read while transfers carry on: every record up to seq
+// is in it, and an account whose last seq is higher also has those later ones.
+//
+// Format, version 2. All integers are little-endian.
+//
+//   header (40 bytes):
+//     "WSNP" | u32 version | u64 seq | u64 accounts | u64 max_user_id |
+//     u32 crc32c of the entries | u32 crc32c of the 36 bytes before it
+//   accounts x (u8 name length | name | i64 balance in paise | u64 last seq | u8 tier)
+//
+// Version 1 had no tier; such a file is ignored and the users table used instead.
+
+#define SNAPSHOT_PATH "wallet.snapshot"
+#define SNAPSHOT_VERSION 2
+
+// Write the live ledger to path, replacing any older snapshot only once the
+// new one is on disk. max_user_id is the highest users.id the ledger holds.
+int snapshot_write(const char *path, uint64_t seq, uint64_t max_user_id);
+
+// Fill an empty ledger from path. Returns 0 if the file is missing or damaged;
+// the ledger is only touched once the checksums have passed.
+int snapshot_load(const char *path, uint64_t *seq, uint64_t *max_user_id);
+
+#endif
@@ -0,0 +1,267 @@
+#include "stats.h"
+#include "topk.h"
+#include "db.h"
+#include "archive.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+enum total {
+    TOTAL_USERS,
+    TOTAL_BALANCE,  // paise
+    TOTAL_TRANSACTIONS,
+    TOTAL_COUNT
+};
+
+// Row names in the stats table and the full-table queries that must agree with them
+static const char *total_names[TOTAL_COUNT] = {"users", "balance", "transactions"};
+static const enum db_statement total_recount[TOTAL_COUNT] = {
+    STMT_COUNT_USERS, STMT_SUM_BALANCE, STMT_COUNT_TRANSACTIONS
+};
+
+static struct topk *all_time = NULL;
+static struct topk *windows[STATS_MAX_WINDOWS];
+static int window_count = 0;
+static int reconcile_interval = 0;
+
+// Run a statement that returns no rows
+static int run_statement(int shard, enum db_statement id) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, id);
+    if (!stmt) return 0;
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// One shard's stored totals; fails unless all of them are present
+static int read_totals(int shard, sqlite3_int64 *values) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_READ_STATS);
+    if (!stmt) return 0;
+
+    int found = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        for (int i = 0; name && i < TOTAL_COUNT; i++) {
+            if (strcmp(name, total_names[i]) == 0) {
+                values[i] = sqlite3_column_int64(stmt, 1);
+                found++;
+            }
+        }
+    }
+    sqlite3_reset(stmt);
+    return found == TOTAL_COUNT;
+}
+
+static int recount_total(int shard, enum total total, sqlite3_int64 *value) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, total_recount[total]);
+    if (!stmt) return 0;
+
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) *value = sqlite3_column_int64(stmt, 0);
+    sqlite3_reset(stmt);
+    return found;
+}
+
+// Compare the stored totals with the tables in one snapshot and add the
+// difference to any that drifted. Triggers apply the same deltas to both sides
+// of the comparison, so a difference seen in the snapshot is still the right fix
+// after later writes. Each shard keeps totals of its own tables.
+static void reconcile(int shard) {
+    sqlite3_int64 stored[TOTAL_COUNT], actual[TOTAL_COUNT];
+
+    if (!run_statement(shard, STMT_BEGIN_READ)) return;
+    int success = read_totals(shard, stored);
+    for (int i = 0; success && i < TOTAL_COUNT; i++)
+        success = recount_total(shard, i, &actual[i]);
+    run_statement(shard, STMT_COMMIT);
+
+    if (!success) {
+        log_error("Stats reconciliation could not read the totals of shard %d", shard);
+        return;
+    }
+
+    int drifted = 0;
+    for (int i = 0; i < TOTAL_COUNT; i++) {
+        if (stored[i] == actual[i]) continue;
+        log_error("Stored %s total of shard %d is %lld but the tables say %lld; repairing",
+                  total_names[i], shard, (long long)stored[i], (long long)actual[i]);
+        drifted = 1;
+    }
+    if (!drifted) return;
+
+    if (!run_statement(shard, STMT_BEGIN)) return;
+    for (int i = 0; success && i < TOTAL_COUNT; i++) {
+        if (stored[i] == actual[i]) continue;
+        sqlite3_stmt *stmt = db_shard_statement(shard, STMT_ADJUST_STAT);
+        if (!stmt) {
+            success = 0;
+            break;
+        }
+        sqlite3_bind_text(stmt, 1, total_names[i], -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, actual[i] - stored[i]);
+        success = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    }
+    if (!success || !run_statement(shard, STMT_COMMIT)) {
+        log_error("Stats repair failed: %s", sqlite3_errmsg(db_shard_handle(shard)));
+        run_statement(shard, STMT_ROLLBACK);
+    }
+}
+
+static void *reconciler_main(void *unused) {
+    (void)unused;
+    while (1) {
+        sleep(reconcile_interval);
+        for (int shard = 0; shard < db_shard_count(); shard++) reconcile(shard);
+    }
+    return NULL;
+}
+
+struct seed_sender {
+    char name[64];
+    long long count;
+};
+
+static int compare_seed(const void *a, const void *b) {
+    long long x = ((const struct seed_sender *)a)->count, y = ((const struct seed_sender *)b)->count;
+    return (x < y) - (x > y);
+}
+
+// Start the all-time counts from the transactions already on disk. A sender's
+// transactions are all in its own shard, so the busiest overall are among each
+// shard's busiest; only those go into the sketch, which would otherwise
+// overcount once it is full.
+static int seed_all_time(int capacity) {
+    int shards = db_shard_count();
+    struct seed_sender *seeds = malloc((size_t)capacity * shards * sizeof(*seeds));
+    if (!seeds) return 0;
+
+    int count = 0;
+    for (int shard = 0; shard < shards; shard++) {
+        sqlite3_stmt *stmt = db_shard_statement(shard, STMT_TOP_SENDERS);
+        if (!stmt) {
+            free(seeds);
+            return 0;
+        }
+
+        sqlite3_bind_int(stmt, 1, capacity);
+        while (sqlite3_step(stmt) == SQLITE_ROW && count < capacity * shards) {
+            const char *sender = (const char *)sqlite3_column_text(stmt, 0);
+            if (!sender) continue;
+            snprintf(seeds[count].name, sizeof(seeds[count].name), "%s", sender);
+            seeds[count++].count = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_reset(stmt);
+    }
+
+    qsort(seeds, (size_t)count, sizeof(*seeds), compare_seed);
+    time_t now = time(NULL);
+    for (int i = 0; i < count && i < capacity; i++) topk_add(all_time, seeds[i].name, seeds[i].count, now);
+    free(seeds);
+    return 1;
+}
+
+int stats_start(const int *window_seconds, int count, int capacity, int reconcile_seconds) {
+    if (count > STATS_MAX_WINDOWS) count = STATS_MAX_WINDOWS;
+
+    all_time = topk_create(capacity, 0, 1);
+    if (!all_time) return 0;
+    for (int i = 0; i < count; i++) {
+        windows[i] = topk_create(capacity, window_seconds[i], STATS_SLICES);
+        if (!windows[i]) return 0;
+    }
+    window_count = count;
+
+    if (!seed_all_time(capacity)) return 0;
+
+    reconcile_interval = reconcile_seconds;
+    if (reconcile_interval > 0) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, reconciler_main, NULL) != 0) {
+            perror("Stats reconciler creation failed");
+            return 0;
+        }
+        pthread_detach(thread);
+    }
+    return 1;
+}
+
+void stats_record_transfer(const char *sender, int transfers) {
+    if (!all_time) return;
+
+    time_t now = time(NULL);
+    topk_add(all_time, sender, transfers, now);
+    for (int i = 0; i < window_count; i++)
+        topk_add(windows[i], sender, transfers, now);
+}
+
+// "90s", "15m", "24h"
+static void format_window(char *out, size_t size, int seconds) {
+    if (seconds % 3600 == 0) snprintf(out, size, "%dh", seconds / 3600);
+    else if (seconds % 60 == 0) snprintf(out, size, "%dm", seconds / 60);
+    else snprintf(out, size, "%ds", seconds);
+}
+
+static size_t append_senders(char *response, size_t size, size_t len, struct topk *t, int k, time_t now) {
+    struct topk_entry top[STATS_MAX_TOP];
+    int n = topk_query(t, k, now, top);
+
+    for (int i = 0; i < n && len < size; i++) {
+        if (top[i].error > 0) {
+            len += snprintf(response + len, size - len, "  %s - %lld transactions (at least %lld)\n",
+                            top[i].key, top[i].count, top[i].count - top[i].error);
+        } else {
+            len += snprintf(response + len, size - len, "  %s - %lld transactions\n", top[i].key, top[i].count);
+        }
+    }
+    if (n == 0 && len < size) len += snprintf(response + len, size - len, "  (none)\n");
+    return len;
+}
+
+// Constant time: three stored rows per shard and a merge of bounded sketches
+void get_admin_stats(char *response, size_t size, int k) {
+    sqlite3_int64 totals[TOTAL_COUNT] = {0};
+    time_t now = time(NULL);
+    size_t len = 0;
+    response[0] = '\0';
+
+    if (k < 1) k = STATS_DEFAULT_TOP;
+    if (k > STATS_MAX_TOP) k = STATS_MAX_TOP;
+
+    for (int shard = 0; shard < db_shard_count(); shard++) {
+        sqlite3_int64 shard_totals[TOTAL_COUNT];
+        if (!read_totals(shard, shard_totals)) {
+            snprintf(response, size, "Error reading stats.\n");
+            return;
+        }
+        for (int i = 0; i < TOTAL_COUNT; i++) totals[i] += shard_totals[i];
+    }
+
+    // Exact: summed as integer paise
+    len += snprintf(response + len, size - len,
+                    "Total Users: %lld\n"
+                    "Total Balance in System: ₹%lld.%02lld\n"
+                    "Total Transactions: %lld\n",
+                    (long long)totals[TOTAL_USERS],
+                    (long long)(totals[TOTAL_BALANCE] / 100), (long long)(totals[TOTAL_BALANCE] % 100),
+                    (long long)totals[TOTAL_TRANSACTIONS]);
+
+    int segments = archive_segments();
+    if (segments > 0 && len < size)
+        len += snprintf(response + len, size - len, "Archived Transactions: %lld in %d segments\n",
+                        (long long)archive_rows(), segments);
+
+    if (len < size) len += snprintf(response + len, size - len, "\nTop %d Most Active Senders:\n", k);
+    if (len < size) len = append_senders(response, size, len, all_time, k, now);
+
+    for (int i = 0; i < window_count && len < size; i++) {
+        char label[16];
+        format_window(label, sizeof(label), topk_window(windows[i]));
+        len += snprintf(response + len, size - len, "\nTop %d Senders, last %s:\n", k, label);
+        if (len < size) len = append_senders(response, size, len, windows[i], k, now);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+
+// ADMIN_STATS without full-table aggregates. User, balance and transaction
+// totals come from the stats table (schema version 3), whose triggers update it
+// in the same commit as every signup and transfer. The busiest senders come from
+// in-memory top-K sketches: one all-time, seeded from the table at startup, and
+// one per configured window, which start empty. A background thread recounts the
+// tables now and then and repairs any drift in the stored totals.
+
+#define STATS_DEFAULT_TOP 3  // senders listed when ADMIN_STATS names no k
+#define STATS_MAX_TOP 50
+#define STATS_MAX_WINDOWS 4
+#define STATS_SLICES 12      // a window expires in steps of 1/12 of its length
+
+// windows are lengths in seconds; capacity is how many senders each sketch
+// tracks exactly; reconcile_seconds 0 disables the reconciler
+int stats_start(const int *windows, int window_count, int capacity, int reconcile_seconds);
+
+// Count committed transfers towards the top senders
+void stats_record_transfer(const char *sender, int transfers);
+
+void get_admin_stats(char *response, size_t size, int k);
+
+#endif
@@ -0,0 +1,449 @@
+#define _GNU_SOURCE  // pthread_rwlockattr_setkind_np
+#include "store.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "ledger.h"
+#include "db.h"
+#include "metrics.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+
+static pthread_rwlock_t signup_lock;
+static _Atomic int64_t max_user_id = 0;
+static _Atomic int64_t last_user_id = 0;  // handed out by store_next_user_id()
+
+// Progress of the SQLite tables through the journal: each shard's, and the
+// least of them, which every shard has reached
+static pthread_mutex_t applied_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t applied_cond = PTHREAD_COND_INITIALIZER;
+static _Atomic uint64_t applied_seq = 0;
+static uint64_t shard_applied[DB_MAX_SHARDS];
+
+static _Atomic uint64_t snapshot_seq = 0;
+static _Atomic int have_snapshot = 0;
+static int snapshot_interval = 0;
+static uint64_t snapshot_every = 0;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void raise_max_user_id(int64_t id) {
+    int64_t seen = max_user_id;
+    while (id > seen && !__atomic_compare_exchange_n(&max_user_id, &seen, id, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static int64_t query_int(sqlite3 *handle, const char *sql) {
+    sqlite3_stmt *stmt;
+    int64_t value = 0;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return value;
+}
+
+// Ids are unique across the shards
+static int64_t query_max_user_id() {
+    int64_t id = 0;
+    for (int shard = 0; shard < db_shard_count(); shard++) {
+        int64_t shard_max = query_int(db_shard_bootstrap(shard), "SELECT MAX(id) FROM users;");
+        if (shard_max > id) id = shard_max;
+    }
+    return id;
+}
+
+// Startup: apply one journal record to the ledger
+static int replay_record(void *ctx, const struct journal_record *rec) {
+    uint64_t *records = ctx;
+    (*records)++;
+
+    if (rec->type == JOURNAL_SIGNUP) {
+        struct journal_signup signup;
+        if (!journal_decode_signup(rec, &signup)) {
+            printf("[ERROR] Journal record %llu is malformed\n", (unsigned long long)rec->seq);
+            return 1;
+        }
+        ledger_add(signup.username, signup.balance, rec->seq, 0);
+        raise_max_user_id(signup.user_id);
+    } else if (rec->type == JOURNAL_TRANSFER) {
+        struct journal_transfer transfer;
+        if (!journal_decode_transfer(rec, &transfer)) {
+            printf("[ERROR] Journal record %llu is malformed\n", (unsigned long long)rec->seq);
+            return 1;
+        }
+        char receiver[JOURNAL_NAME_SIZE];
+        int64_t paise, total = 0;
+        while (journal_next_line(&transfer, receiver, &paise)) {
+            ledger_replay(receiver, paise, rec->seq);
+            total += paise;
+        }
+        ledger_replay(transfer.sender, -total, rec->seq);
+    } else if (rec->type == JOURNAL_TIER) {
+        struct journal_tier tier;
+        if (journal_decode_tier(rec, &tier)) ledger_set_tier(tier.username, tier.tier);
+        else printf("[ERROR] Journal record %llu is malformed\n", (unsigned long long)rec->seq);
+    }
+    return 1;
+}
+
+// Startup: count a transfer the tables do not hold yet towards its sender's
+// limits. The sender's shard holds the rows of its transfers.
+static int note_record(void *ctx, const struct journal_record *rec) {
+    uint64_t *sends = ctx;
+    struct journal_transfer transfer;
+    if (rec->type != JOURNAL_TRANSFER || !journal_decode_transfer(rec, &transfer)) return 1;
+    if (rec->seq <= shard_applied[db_shard_of(transfer.sender)]) return 1;
+
+    char receiver[JOURNAL_NAME_SIZE];
+    int64_t paise;
+    int first = 1;
+    while (journal_next_line(&transfer, receiver, &paise)) {
+        ledger_note_sent(transfer.sender, receiver, paise, (uint32_t)transfer.timestamp, first);
+        first = 0;
+        (*sends)++;
+    }
+    return 1;
+}
+
+// Startup: count one shard's transfers of the last day, newest first
+static int note_shard_rows(int shard, uint32_t now, uint64_t *sends) {
+    sqlite3 *handle = db_shard_bootstrap(shard);
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(handle, "SELECT s.username, r.username, t.amount, t.timestamp, t.receiver_id "
+                                   "FROM transactions t JOIN users s ON s.id = t.sender_id "
+                                   "LEFT JOIN users r ON r.id = t.receiver_id "
+                                   "ORDER BY t.id DESC;", -1, &stmt, NULL) != SQLITE_OK) {
+        printf("[ERROR] Cannot read recent transfers: %s\n", sqlite3_errmsg(handle));
+        return 0;
+    }
+    char last_sender[JOURNAL_NAME_SIZE] = "";
+    char other[JOURNAL_NAME_SIZE];
+    sqlite3_int64 last_time = -1;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *sender = (const char *)sqlite3_column_text(stmt, 0);
+        const char *receiver = (const char *)sqlite3_column_text(stmt, 1);
+        sqlite3_int64 timestamp = sqlite3_column_int64(stmt, 3);
+        if (timestamp + VELOCITY_RECIPIENT_SECONDS <= now) break;
+        // A receiver in another shard
+        if (!receiver && db_username(sqlite3_column_int64(stmt, 4), other, sizeof(other))) receiver = other;
+        if (!sender || !receiver) continue;
+
+        int new_request = timestamp != last_time || strcmp(sender, last_sender) != 0;
+        ledger_note_sent(sender, receiver, sqlite3_column_int64(stmt, 2), (uint32_t)timestamp, new_request);
+        snprintf(last_sender, sizeof(last_sender), "%s", sender);
+        last_time = timestamp;
+        (*sends)++;
+    }
+    sqlite3_finalize(stmt);
+    return 1;
+}
+
+// Startup: rebuild the velocity counters from the last day of transfers, the
+// ones in the tables newest first and then those only in the journal. Rows
+// of one sender with the same timestamp count as one request, as a batch did.
+static int rebuild_velocity(uint64_t applied) {
+    double started = now_seconds();
+    uint32_t now = (uint32_t)time(NULL);
+    uint64_t sends = 0;
+
+    for (int shard = 0; shard < db_shard_count(); shard++)
+        if (!note_shard_rows(shard, now, &sends)) return 0;
+
+    journal_scan(applied, note_record, &sends);
+    printf("[INFO] Velocity counters rebuilt from %llu transfers of the last day in %.2f s\n",
+           (unsigned long long)sends, now_seconds() - started);
+    return 1;
+}
+
+int store_open() {
+    // Writer preference, so a stream of signups cannot hold a snapshot off
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&signup_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    double started = now_seconds();
+
+    // Each shard has applied the journal up to its own point; the journal is
+    // needed from the least of them
+    int shards = db_shard_count();
+    uint64_t applied = UINT64_MAX, applied_max = 0;
+    for (int shard = 0; shard < shards; shard++) {
+        sqlite3_int64 seq = db_journal_applied(shard);
+        if (seq < 0) {
+            printf("[ERROR] Cannot read journal_state of shard %d: %s\n", shard,
+                   sqlite3_errmsg(db_shard_handle(shard)));
+            return 0;
+        }
+        shard_applied[shard] = (uint64_t)seq;
+        if ((uint64_t)seq < applied) applied = (uint64_t)seq;
+        if ((uint64_t)seq > applied_max) applied_max = (uint64_t)seq;
+    }
+    if (!journal_open(JOURNAL_DIR, applied + 1)) return 0;
+    if (journal_last_seq() < applied_max) {
+        printf("[ERROR] The journal ends at seq %llu but the database has applied up to %llu\n",
+               (unsigned long long)journal_last_seq(), (unsigned long long)applied_max);
+        return 0;
+    }
+
+    uint64_t start_seq, snapshot_max_id;
+    if (snapshot_load(SNAPSHOT_PATH, &start_seq, &snapshot_max_id)) {
+        snapshot_seq = start_seq;
+        have_snapshot = 1;
+        // Accounts created after the snapshot, as of the records the tables hold
+        for (int shard = 0; shard < shards; shard++)
+            if (!ledger_load(db_shard_bootstrap(shard), (int64_t)snapshot_max_id, shard_applied[shard])) return 0;
+    } else if (ledger_count() == 0) {
+        start_seq = applied;
+        int64_t users = 0;
+        for (int shard = 0; shard < shards; shard++)
+            users += query_int(db_shard_bootstrap(shard), "SELECT COUNT(*) FROM users;");
+        if (!ledger_init((size_t)users)) return 0;
+        for (int shard = 0; shard < shards; shard++)
+            if (!ledger_load(db_shard_bootstrap(shard), 0, shard_applied[shard])) return 0;
+    } else {
+        return 0;
+    }
+
+    if (journal_first_seq() > start_seq + 1) {
+        printf("[ERROR] Recovery needs the journal from seq %llu but it starts at %llu\n",
+               (unsigned long long)start_seq + 1, (unsigned long long)journal_first_seq());
+        return 0;
+    }
+
+    uint64_t records = 0;
+    journal_scan(start_seq, replay_record, &records);
+    applied_seq = applied;
+    raise_max_user_id(query_max_user_id());
+    last_user_id = max_user_id;
+    if (!rebuild_velocity(applied)) return 0;
+
+    printf("[INFO] Recovered %zu accounts, replaying %llu journal records after seq %llu, in %.2f s\n",
+           ledger_count(), (unsigned long long)records, (unsigned long long)start_seq,
+           now_seconds() - started);
+    return 1;
+}
+
+struct apply_batch {
+    int shard;
+    uint64_t last;
+    int records;
+    int failed;
+};
+
+// Applier: write one journal record into the open SQLite transaction
+static int apply_record(void *ctx, const struct journal_record *rec) {
+    struct apply_batch *batch = ctx;
+    uint64_t start = metrics_now();
+    int success = 1;
+
+    if (rec->type == JOURNAL_SIGNUP) {
+        struct journal_signup signup;
+        success = journal_decode_signup(rec, &signup) && db_apply_signup(batch->shard, &signup);
+    } else if (rec->type == JOURNAL_TRANSFER) {
+        struct journal_transfer transfer;
+        success = journal_decode_transfer(rec, &transfer) && db_apply_transfer(batch->shard, &transfer);
+        metrics_time(TIMER_SQLITE_TRANSFER, metrics_now() - start);
+    } else if (rec->type == JOURNAL_TIER) {
+        struct journal_tier tier;
+        success = journal_decode_tier(rec, &tier) && db_apply_tier(batch->shard, &tier);
+    }
+
+    if (!success) {
+        log_error("Journal record %llu could not be applied to shard %d: %s", (unsigned long long)rec->seq,
+                  batch->shard, sqlite3_errmsg(db_shard_handle(batch->shard)));
+        batch->failed = 1;
+        return 0;
+    }
+    batch->last = rec->seq;
+    return ++batch->records < STORE_APPLY_BATCH;
+}
+
+// One applier per shard. A record is committed once it is in the journal, so
+// each shard writes its own part of it whenever it gets there; a transfer
+// between two shards is in both once both appliers have passed it.
+static void *applier_main(void *arg) {
+    int shard = (int)(intptr_t)arg;
+    uint64_t applied = shard_applied[shard];
+
+    while (1) {
+        if (journal_wait(applied, 1000) <= applied) continue;
+
+        struct apply_batch batch = {.shard = shard, .last = applied};
+        uint64_t start = metrics_now();
+        int success = db_begin_batch(shard);
+        uint64_t now = metrics_now();
+        metrics_time(TIMER_SQLITE_BEGIN, now - start);
+
+        if (success && !journal_scan(applied, apply_record, &batch)) {
+            log_error("Journal records after seq %llu are gone; shard %d cannot catch up",
+                      (unsigned long long)applied, shard);
+            success = 0;
+        }
+        success = success && !batch.failed && db_set_journal_applied(shard, (sqlite3_int64)batch.last);
+
+        now = metrics_now();
+        if (!success || !db_commit_batch(shard)) {
+            db_rollback_batch(shard);
+            sleep(1);  // try the same records again
+            continue;
+        }
+        metrics_time(TIMER_SQLITE_COMMIT, metrics_now() - now);
+
+        applied = batch.last;
+        pthread_mutex_lock(&applied_lock);
+        shard_applied[shard] = applied;
+        uint64_t all = applied;
+        for (int i = 0; i < db_shard_count(); i++)
+            if (shard_applied[i] < all) all = shard_applied[i];
+        applied_seq = all;
+        pthread_cond_broadcast(&applied_cond);
+        pthread_mutex_unlock(&applied_lock);
+
+        // Recovery starts from the snapshot or, failing that, from the tables
+        uint64_t keep_after = all;
+        if (have_snapshot && snapshot_seq < keep_after) keep_after = snapshot_seq;
+        journal_trim(keep_after);
+    }
+    return NULL;
+}
+
+static void take_snapshot() {
+    uint64_t start = metrics_now();
+
+    // Settled signups are in the ledger; none is between its row and its record
+    pthread_rwlock_wrlock(&signup_lock);
+    uint64_t seq = journal_quiesce();
+    int64_t max_id = max_user_id;
+    pthread_rwlock_unlock(&signup_lock);
+
+    if (!snapshot_write(SNAPSHOT_PATH, seq, (uint64_t)max_id)) return;
+    snapshot_seq = seq;
+    have_snapshot = 1;
+
+    uint64_t elapsed = metrics_now() - start;
+    metrics_time(TIMER_SNAPSHOT, elapsed);
+    log_info("Snapshot of %zu accounts at seq %llu took %.1f ms", ledger_count(),
+             (unsigned long long)seq, elapsed / 1e6);
+}
+
+static void *snapshot_main(void *unused) {
+    (void)unused;
+    time_t last = time(NULL);
+
+    while (1) {
+        sleep(1);
+        uint64_t written = journal_last_seq() - snapshot_seq;
+        if (written == 0) continue;
+        if (written < snapshot_every && time(NULL) - last < snapshot_interval) continue;
+
+        take_snapshot();
+        last = time(NULL);
+    }
+    return NULL;
+}
+
+int store_start(int snapshot_seconds, uint64_t snapshot_records) {
+    snapshot_interval = snapshot_seconds;
+    snapshot_every = snapshot_records;
+
+    pthread_t thread;
+    for (int shard = 0; shard < db_shard_count(); shard++) {
+        if (pthread_create(&thread, NULL, applier_main, (void *)(intptr_t)shard) != 0) {
+            perror("Journal applier creation failed");
+            return 0;
+        }
+        pthread_detach(thread);
+    }
+
+    if (pthread_create(&thread, NULL, snapshot_main, NULL) != 0) {
+        perror("Snapshot thread creation failed");
+        return 0;
+    }
+    pthread_detach(thread);
+    return 1;
+}
+
+void store_signup_begin() {
+    pthread_rwlock_rdlock(&signup_lock);
+}
+
+void store_signup_end() {
+    pthread_rwlock_unlock(&signup_lock);
+}
+
+int64_t store_next_user_id() {
+    return ++last_user_id;
+}
+
+int store_signup(int64_t user_id, const char *username, const unsigned char *salt,
+                 const unsigned char *hash, int64_t balance) {
+    struct journal_buffer payload = {0};
+    journal_put_i64(&payload, user_id);
+    journal_put_i64(&payload, balance);
+    journal_put_name(&payload, username);
+    journal_put_bytes(&payload, salt, SALT_SIZE);
+    journal_put_bytes(&payload, hash, HASH_SIZE);
+
+    uint64_t seq = payload.failed ? 0 : journal_append(JOURNAL_SIGNUP, payload.data, payload.len);
+    free(payload.data);
+    if (!seq) {
+        log_error("Signup of %s could not be journaled", username);
+        return 0;
+    }
+
+    journal_sync();
+    ledger_add(username, balance, seq, 0);
+    raise_max_user_id(user_id);
+    journal_settled(1);
+    return 1;
+}
+
+int store_set_tier(const char *username, int tier) {
+    double known;
+    if (tier < 0 || tier >= VELOCITY_TIERS || !ledger_balance(username, &known)) return 0;
+
+    struct journal_buffer payload = {0};
+    journal_put_name(&payload, username);
+    journal_put_u8(&payload, (uint8_t)tier);
+
+    uint64_t seq = payload.failed ? 0 : journal_append(JOURNAL_TIER, payload.data, payload.len);
+    free(payload.data);
+    if (!seq) {
+        log_error("Tier change for %s could not be journaled", username);
+        return 0;
+    }
+
+    journal_sync();
+    ledger_set_tier(username, tier);
+    journal_settled(1);
+    return 1;
+}
+
+void store_catch_up(int timeout_ms) {
+    uint64_t target = journal_synced_seq();
+    if (applied_seq >= target) return;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&applied_lock);
+    while (applied_seq < target) {
+        if (pthread_cond_timedwait(&applied_cond, &applied_lock, &deadline) == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&applied_lock);
+}
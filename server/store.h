@@ -0,0 +1,43 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+
+// Ties the ledger, the journal and SQLite together. At startup the ledger is
+// rebuilt from the newest snapshot (or the users table) plus the journal
+// records after it. While running, a background thread applies the journal to
+// the SQLite tables in large transactions, and another writes a fresh snapshot
+// now and then so the journal can be trimmed. Each database shard has its own
+// applier and its own point in the journal.
+
+#define STORE_APPLY_BATCH 20000  // journal records per SQLite transaction
+
+// Recover the ledger; called by initialize_db() once the schema is current
+int store_open();
+
+// Start the applier, and a snapshot every snapshot_seconds or whenever
+// snapshot_records records have been written since the last one
+int store_start(int snapshot_seconds, uint64_t snapshot_records);
+
+// create_user() holds this from inserting the row through store_signup(), so
+// a snapshot never falls between the two
+void store_signup_begin();
+void store_signup_end();
+
+// Id for a new account, unique across the database shards; call between
+// store_signup_begin() and store_signup_end()
+int64_t store_next_user_id();
+
+// Journal a new account and add it to the ledger; returns 0 if it could not be journaled
+int store_signup(int64_t user_id, const char *username, const unsigned char *salt,
+                 const unsigned char *hash, int64_t balance);
+
+// Journal a move of an existing account to another velocity tier and apply it;
+// returns 0 if the account or tier is unknown or it could not be journaled
+int store_set_tier(const char *username, int tier);
+
+// Wait up to timeout_ms for the SQLite tables to hold every durable record,
+// so a report read afterwards includes the caller's own transfers
+void store_catch_up(int timeout_ms);
+
+#endif
@@ -0,0 +1,89 @@
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_SPAN ((uint64_t)TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS)
+
+static void list_init(struct timer *head) {
+    head->next = head->prev = head;
+}
+
+static void list_add(struct timer *head, struct timer *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void list_unlink(struct timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+// Move a slot's timers onto a private list, so callbacks can arm into the slot again
+static void list_take(struct timer *head, struct timer *into) {
+    list_init(into);
+    if (head->next == head) return;
+    into->next = head->next;
+    into->prev = head->prev;
+    into->next->prev = into;
+    into->prev->next = into;
+    list_init(head);
+}
+
+static void place(struct timer_wheel *w, struct timer *t) {
+    uint64_t delta = t->expires - w->now;
+    if (delta < TIMER_WHEEL_SLOTS) list_add(&w->slots[0][t->expires & SLOT_MASK], t);
+    else list_add(&w->slots[1][(t->expires >> TIMER_WHEEL_BITS) & SLOT_MASK], t);
+}
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now) {
+    w->now = now;
+    w->armed = 0;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) list_init(&w->slots[level][slot]);
+}
+
+void timer_arm(struct timer_wheel *w, struct timer *t, uint64_t expires) {
+    if (t->next) list_unlink(t);
+    else w->armed++;
+
+    if (expires <= w->now) expires = w->now + 1;
+    if (expires - w->now >= WHEEL_SPAN) expires = w->now + WHEEL_SPAN - 1;
+    t->expires = expires;
+    place(w, t);
+}
+
+void timer_cancel(struct timer_wheel *w, struct timer *t) {
+    if (!t->next) return;
+    list_unlink(t);
+    w->armed--;
+}
+
+void timer_wheel_advance(struct timer_wheel *w, uint64_t now, timer_expired expire, void *ctx) {
+    // Nothing can fall due on the way
+    if (w->armed == 0 && now > w->now) w->now = now;
+
+    struct timer due;
+    while (w->now < now) {
+        w->now++;
+
+        // A new lap of the first level: bring the second level's next slot down
+        if ((w->now & SLOT_MASK) == 0) {
+            list_take(&w->slots[1][(w->now >> TIMER_WHEEL_BITS) & SLOT_MASK], &due);
+            while (due.next != &due) {
+                struct timer *t = due.next;
+                list_unlink(t);
+                place(w, t);
+            }
+        }
+
+        list_take(&w->slots[0][w->now & SLOT_MASK], &due);
+        while (due.next != &due) {
+            struct timer *t = due.next;
+            list_unlink(t);
+            w->armed--;
+            expire(t, ctx);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Two-level hashed timer wheel counting in ticks. Arming, cancelling and
+// firing a timer are O(1) however many are armed: the first level has a slot
+// per tick for the next TIMER_WHEEL_SLOTS ticks, the second a slot per
+// TIMER_WHEEL_SLOTS ticks, emptied into the first as its turn comes. Timers
+// further out than the second level reaches fire at its end. Not thread-safe;
+// each event loop owns one.
+
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 2
+
+// Embedded in whatever it times; unarmed when zeroed
+struct timer {
+    struct timer *next, *prev;
+    uint64_t expires;
+};
+
+struct timer_wheel {
+    uint64_t now;   // last tick advanced to
+    size_t armed;
+    struct timer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  // list heads
+};
+
+typedef void (*timer_expired)(struct timer *t, void *ctx);
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now);
+
+// Fire t at tick expires, or on the next tick if that has passed; re-arming moves it
+void timer_arm(struct timer_wheel *w, struct timer *t, uint64_t expires);
+void timer_cancel(struct timer_wheel *w, struct timer *t);
+
+// Move to tick now, calling expire for each timer that falls due on the way.
+// The callback may re-arm the timer.
+void timer_wheel_advance(struct timer_wheel *w, uint64_t now, timer_expired expire, void *ctx);
+
+#endif
@@ -0,0 +1,66 @@
+// Upgrade a wallet database to the current schema (see schema.h).
+//
+// Build from the server folder:
+//   cc -O2 -I. tools/wallet_migrate.c schema.c -o wallet_migrate -lsqlite3
+//   ./wallet_migrate [--vacuum] [database] [batch-rows]
+//
+// Safe to run while an older server is still serving: rows are copied in
+// short transactions and only the final table swap blocks writers. Restart
+// the server on the new build as soon as it reports the new version, since
+// the old build cannot use the new tables. The server also runs this
+// migration itself at startup, with no other writers around. With several
+// database shards, run it on each wallet.N.db as well.
+//
+// --vacuum rebuilds the file afterwards so the space of the old tables is
+// returned to the filesystem. That needs the server stopped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+#include "../schema.h"
+
+static long long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "wallet.db";
+    int batch_rows = MIGRATE_BATCH_ROWS;
+    int vacuum = 0;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vacuum") == 0) vacuum = 1;
+        else if (positional++ == 0) path = argv[i];
+        else batch_rows = atoi(argv[i]);
+    }
+
+    sqlite3 *handle;
+    if (sqlite3_open_v2(path, &handle, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+        printf("[ERROR] Cannot open %s: %s\n", path, sqlite3_errmsg(handle));
+        return 1;
+    }
+    sqlite3_busy_timeout(handle, 5000);
+    sqlite3_exec(handle, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
+
+    printf("[INFO] %s is at schema version %d (%lld bytes)\n", path, schema_version(handle), file_size(path));
+
+    if (!migrate_schema(handle, batch_rows)) {
+        printf("[ERROR] Migration stopped; rerun to continue where it left off\n");
+        sqlite3_close(handle);
+        return 1;
+    }
+
+    if (vacuum) {
+        printf("[INFO] Vacuuming...\n");
+        sqlite3_exec(handle, "VACUUM;", NULL, NULL, NULL);
+        sqlite3_exec(handle, "PRAGMA wal_checkpoint(TRUNCATE);", NULL, NULL, NULL);
+    }
+
+    printf("[INFO] %s is at schema version %d (%lld bytes)\n", path, schema_version(handle), file_size(path));
+    sqlite3_close(handle);
+    return 0;
+}
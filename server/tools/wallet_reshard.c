@@ -0,0 +1,223 @@
+// Split a wallet database into a number of shards, or merge shards back (see schema.h).
+//
+// Build from the server folder:
+//   cc -O2 -I. tools/wallet_reshard.c schema.c -o wallet_reshard -lsqlite3
+//   ./wallet_reshard SHARDS [database]
+//
+// Stop the server first. Every account moves to the shard its username hashes
+// to, together with the transactions it sent and its archived counts; the
+// archive_segments list goes to shard 0, since the segment files themselves
+// stay where they are. The new files are built next to the old ones and only
+// swapped in once all of them are complete; the old files are kept as *.old.
+//
+// The shards must all have applied the journal up to the same record, which
+// they have once a server has been left idle for a moment before stopping.
+// The journal and wallet.snapshot are not touched: they name accounts by
+// username, so they do not care where an account is stored.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "../schema.h"
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int exec_sql(sqlite3 *handle, const char *sql) {
+    char *err_msg = NULL;
+    if (sqlite3_exec(handle, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        printf("[ERROR] %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return 0;
+    }
+    return 1;
+}
+
+static sqlite3_int64 query_int(sqlite3 *handle, const char *sql) {
+    sqlite3_stmt *stmt;
+    sqlite3_int64 value = -1;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return value;
+}
+
+// SQL function shard_of(username), for the new number of shards
+static void shard_of_sql(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const char *username = (const char *)sqlite3_value_text(argv[0]);
+    int shards = *(int *)sqlite3_user_data(ctx);
+    sqlite3_result_int(ctx, username ? schema_shard_of(username, shards) : -1);
+}
+
+// Copy what belongs to shard `shard` out of one old file, attached as src. A
+// file cannot be detached inside a transaction, so each gets its own.
+static int copy_from(sqlite3 *handle, const char *old_path, int shard) {
+    char sql[1024];
+    char *quoted = sqlite3_mprintf("ATTACH %Q AS src;", old_path);
+    int success = quoted && exec_sql(handle, quoted);
+    sqlite3_free(quoted);
+    if (!success) return 0;
+
+    // The triggers bring the stats totals along
+    snprintf(sql, sizeof(sql),
+             "INSERT INTO users (id, username, password, salt, balance, is_admin, tier) "
+             "SELECT id, username, password, salt, balance, is_admin, tier FROM src.users "
+             "WHERE shard_of(username) = %d;"
+             "INSERT INTO transactions (id, sender_id, receiver_id, amount, timestamp) "
+             "SELECT t.id, t.sender_id, t.receiver_id, t.amount, t.timestamp FROM src.transactions t "
+             "JOIN src.users u ON u.id = t.sender_id WHERE shard_of(u.username) = %d;"
+             "INSERT INTO archived_senders (sender_id, transactions) "
+             "SELECT a.sender_id, a.transactions FROM src.archived_senders a "
+             "JOIN src.users u ON u.id = a.sender_id WHERE shard_of(u.username) = %d;",
+             shard, shard, shard);
+    success = exec_sql(handle, "BEGIN;") && exec_sql(handle, sql);
+    if (success && shard == 0) {
+        success = exec_sql(handle, "INSERT INTO archive_segments SELECT * FROM src.archive_segments;");
+    }
+    success = success && exec_sql(handle, "COMMIT;");
+    if (!success) sqlite3_exec(handle, "ROLLBACK;", NULL, NULL, NULL);
+    return exec_sql(handle, "DETACH src;") && success;
+}
+
+// Build the new shard `shard` of `shards` at path from the old files
+static int build_shard(const char *path, int shard, int shards, char (*old_paths)[256], int old_shards,
+                       sqlite3_int64 applied, sqlite3_int64 last_user, sqlite3_int64 last_transaction) {
+    remove(path);
+    sqlite3 *handle;
+    if (sqlite3_open(path, &handle) != SQLITE_OK) {
+        printf("[ERROR] Cannot create %s: %s\n", path, sqlite3_errmsg(handle));
+        sqlite3_close(handle);
+        return 0;
+    }
+    sqlite3_create_function(handle, "shard_of", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, &shards, shard_of_sql,
+                            NULL, NULL);
+
+    char sql[1024];
+    int success = exec_sql(handle, "PRAGMA synchronous=OFF; PRAGMA cache_size=-262144;") &&
+                  create_schema(handle) &&
+                  schema_set_shard_info(handle, shard, shards);
+    for (int i = 0; success && i < old_shards; i++) success = copy_from(handle, old_paths[i], shard);
+
+    // Archived rows still count, in the shard that lists their segments; ids
+    // carry on from the highest of any shard
+    snprintf(sql, sizeof(sql),
+             "BEGIN;"
+             "UPDATE stats SET value = value + (SELECT IFNULL(SUM(rows), 0) FROM archive_segments) "
+             "WHERE name = 'transactions';"
+             "UPDATE journal_state SET applied_seq = %lld WHERE id = 1;"
+             "DELETE FROM sqlite_sequence WHERE name IN ('users', 'transactions');"
+             "INSERT INTO sqlite_sequence (name, seq) VALUES ('users', %lld), ('transactions', %lld);"
+             "COMMIT;",
+             applied, last_user, last_transaction);
+    success = success && exec_sql(handle, sql);
+    if (success) {
+        printf("[INFO] %s: shard %d of %d, %lld users, %lld transactions\n", path, shard, shards,
+               query_int(handle, "SELECT COUNT(*) FROM users;"),
+               query_int(handle, "SELECT COUNT(*) FROM transactions;"));
+    }
+    sqlite3_close(handle);
+    return success;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 2 ? argv[2] : "wallet.db";
+    int shards = argc > 1 ? atoi(argv[1]) : 0;
+    if (shards < 1 || shards > SCHEMA_MAX_SHARDS) {
+        printf("Usage: %s SHARDS [database], with 1 to %d shards\n", argv[0], SCHEMA_MAX_SHARDS);
+        return 1;
+    }
+
+    // The old layout, and the point in the journal every shard has reached
+    char old_paths[SCHEMA_MAX_SHARDS][256];
+    int old_shards = 1;
+    sqlite3_int64 applied = -1, last_user = 0, last_transaction = 0;
+    for (int i = 0; i < old_shards; i++) {
+        schema_shard_path(old_paths[i], sizeof(old_paths[i]), path, i);
+        sqlite3 *handle;
+        if (sqlite3_open_v2(old_paths[i], &handle, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+            printf("[ERROR] Cannot open %s: %s\n", old_paths[i], sqlite3_errmsg(handle));
+            sqlite3_close(handle);
+            return 1;
+        }
+
+        int shard, count;
+        if (schema_version(handle) != SCHEMA_VERSION) {
+            printf("[ERROR] %s is at schema version %d; run tools/wallet_migrate on it first\n",
+                   old_paths[i], schema_version(handle));
+            sqlite3_close(handle);
+            return 1;
+        }
+        if (!schema_shard_info(handle, &shard, &count) || shard != i || (i > 0 && count != old_shards)) {
+            printf("[ERROR] %s is not shard %d of %d\n", old_paths[i], i, old_shards);
+            sqlite3_close(handle);
+            return 1;
+        }
+        old_shards = count;
+
+        sqlite3_int64 seq = query_int(handle, "SELECT applied_seq FROM journal_state WHERE id = 1;");
+        if (i > 0 && seq != applied) {
+            printf("[ERROR] %s has applied the journal up to seq %lld but %s up to %lld; "
+                   "start the server, let it idle for a moment and stop it again\n",
+                   old_paths[i], seq, old_paths[0], applied);
+            sqlite3_close(handle);
+            return 1;
+        }
+        applied = seq;
+
+        sqlite3_int64 id = query_int(handle, "SELECT IFNULL(MAX(seq), 0) FROM sqlite_sequence WHERE name = 'users';");
+        if (id > last_user) last_user = id;
+        id = query_int(handle, "SELECT IFNULL(MAX(seq), 0) FROM sqlite_sequence WHERE name = 'transactions';");
+        if (id > last_transaction) last_transaction = id;
+
+        // Leave no WAL behind, so the file alone is the database
+        exec_sql(handle, "PRAGMA wal_checkpoint(TRUNCATE);");
+        sqlite3_close(handle);
+    }
+    if (applied < 0) {
+        printf("[ERROR] Cannot read journal_state of %s\n", path);
+        return 1;
+    }
+
+    printf("[INFO] Moving %d shard(s) to %d, as of journal seq %lld...\n", old_shards, shards, applied);
+    double start = now_seconds();
+
+    char new_paths[SCHEMA_MAX_SHARDS][256];
+    char temp_paths[SCHEMA_MAX_SHARDS][272];
+    int success = 1;
+    for (int i = 0; success && i < shards; i++) {
+        schema_shard_path(new_paths[i], sizeof(new_paths[i]), path, i);
+        snprintf(temp_paths[i], sizeof(temp_paths[i]), "%s.reshard", new_paths[i]);
+        success = build_shard(temp_paths[i], i, shards, old_paths, old_shards, applied, last_user, last_transaction);
+    }
+    if (!success) {
+        printf("[ERROR] Resharding failed; the old files are unchanged\n");
+        for (int i = 0; i < shards; i++) remove(temp_paths[i]);
+        return 1;
+    }
+
+    // Swap: old files aside first, so a new file never lands on an old one
+    char moved[272];
+    for (int i = 0; i < old_shards; i++) {
+        snprintf(moved, sizeof(moved), "%s.old", old_paths[i]);
+        if (rename(old_paths[i], moved) != 0) {
+            perror(old_paths[i]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < shards; i++) {
+        if (rename(temp_paths[i], new_paths[i]) != 0) {
+            perror(temp_paths[i]);
+            return 1;
+        }
+    }
+
+    printf("[INFO] Done in %.1f s; the old files are kept as *.old\n", now_seconds() - start);
+    return 0;
+}
@@ -0,0 +1,196 @@
+// Generate a wallet database for benchmarks (see bench/wallet_bench.c).
+//
+// Build from the server folder:
+//   cc -O2 -I. tools/wallet_seed.c schema.c -o wallet_seed -lsqlite3 -lcrypto
+//   ./wallet_seed [options] [database]
+//
+//   --users N         accounts named <prefix>0 .. <prefix>N-1 (default 10000)
+//   --transactions M  transfers between them (default 1000000)
+//   --prefix NAME     username prefix (default "bench")
+//   --password PW     password of every account (default "pw")
+//   --heavy PCT       share of transfers sent by <prefix>0 (default 0)
+//   --seed S          the same seed gives the same database (default 1)
+//
+// Replaces the database file, and the same options always produce the same
+// bytes. Every account shares one salt and hash, derived from the seed, so that
+// a million users do not cost a million PBKDF2 derivations; LOGIN still does
+// the full derivation. Balances are what the accounts would hold had each been
+// topped up by exactly what it sends, so none is negative and the stats totals
+// match the tables. Timestamps start at a fixed time, 20 transfers a second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sqlite3.h>
+#include <openssl/evp.h>
+#include "../db.h"
+#include "../schema.h"
+
+#define FIRST_TIMESTAMP 1700000000
+#define TRANSFERS_PER_SECOND 20
+#define MAX_AMOUNT_PAISE 100000  // transfers are 1 paisa to ₹1000.00
+#define COMMIT_ROWS 100000       // rows per write transaction
+#define NAME_LIMIT 49            // longest username the server accepts
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift64*: fast and reproducible for a given seed
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+struct transfer {
+    int sender, receiver;
+    sqlite3_int64 amount;
+};
+
+static void pick_transfer(uint64_t *state, int users, int heavy_percent, struct transfer *t) {
+    if (heavy_percent > 0 && (int)(next_random(state) % 100) < heavy_percent) t->sender = 0;
+    else t->sender = next_random(state) % users;
+
+    t->receiver = next_random(state) % (users - 1);
+    if (t->receiver >= t->sender) t->receiver++;
+    t->amount = 1 + next_random(state) % MAX_AMOUNT_PAISE;
+}
+
+static int exec_sql(sqlite3 *handle, const char *sql) {
+    char *err_msg = NULL;
+    if (sqlite3_exec(handle, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        printf("[ERROR] %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return 0;
+    }
+    return 1;
+}
+
+// Step a bound insert; commits and reopens the transaction every COMMIT_ROWS rows
+static int insert_row(sqlite3 *handle, sqlite3_stmt *stmt, long long row) {
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        printf("[ERROR] Insert failed: %s\n", sqlite3_errmsg(handle));
+        return 0;
+    }
+    if ((row + 1) % COMMIT_ROWS == 0) return exec_sql(handle, "COMMIT; BEGIN;");
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "wallet.db";
+    const char *prefix = "bench";
+    const char *password = "pw";
+    int users = 10000;
+    long long transactions = 1000000;
+    int heavy_percent = 0;
+    uint64_t seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--users") == 0 && has_value) users = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--transactions") == 0 && has_value) transactions = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--prefix") == 0 && has_value) prefix = argv[++i];
+        else if (strcmp(argv[i], "--password") == 0 && has_value) password = argv[++i];
+        else if (strcmp(argv[i], "--heavy") == 0 && has_value) heavy_percent = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && has_value) seed = strtoull(argv[++i], NULL, 10);
+        else if (argv[i][0] != '-') path = argv[i];
+        else {
+            printf("Usage: %s [--users N] [--transactions M] [--prefix NAME] [--password PW] "
+                   "[--heavy PCT] [--seed S] [database]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (users < 2 || transactions < 0 || strlen(prefix) + 11 > NAME_LIMIT) {
+        printf("[ERROR] Need at least 2 users and a prefix under %d characters\n", NAME_LIMIT - 10);
+        return 1;
+    }
+    if (seed == 0) seed = 1;  // xorshift never leaves zero
+
+    // Balances come from a first pass over the same random sequence
+    sqlite3_int64 *received = calloc(users, sizeof(*received));
+    if (!received) {
+        printf("[ERROR] Out of memory for %d users\n", users);
+        return 1;
+    }
+    uint64_t state = seed;
+    struct transfer t;
+    for (long long i = 0; i < transactions; i++) {
+        pick_transfer(&state, users, heavy_percent, &t);
+        received[t.receiver] += t.amount;
+    }
+
+    unsigned char salt[SALT_SIZE], hash[HASH_SIZE];
+    char salt_hex[SALT_SIZE * 2 + 1], hash_hex[HASH_SIZE * 2 + 1];
+    state = seed;
+    for (int i = 0; i < SALT_SIZE; i++) salt[i] = next_random(&state) >> 56;
+    PKCS5_PBKDF2_HMAC(password, strlen(password), salt, SALT_SIZE, ITERATIONS, EVP_sha256(), HASH_SIZE, hash);
+    for (int i = 0; i < SALT_SIZE; i++) snprintf(&salt_hex[i * 2], 3, "%02x", salt[i]);
+    for (int i = 0; i < HASH_SIZE; i++) snprintf(&hash_hex[i * 2], 3, "%02x", hash[i]);
+
+    remove(path);
+    sqlite3 *handle;
+    if (sqlite3_open(path, &handle) != SQLITE_OK) {
+        printf("[ERROR] Cannot open %s: %s\n", path, sqlite3_errmsg(handle));
+        return 1;
+    }
+    if (!exec_sql(handle, "PRAGMA journal_mode=WAL; PRAGMA synchronous=OFF; PRAGMA cache_size=-262144;") ||
+        !create_schema(handle)) {
+        sqlite3_close(handle);
+        return 1;
+    }
+
+    printf("[INFO] Generating %d users and %lld transactions in %s...\n", users, transactions, path);
+    double start = now_seconds();
+
+    sqlite3_stmt *insert_user, *insert_transaction;
+    if (sqlite3_prepare_v2(handle, "INSERT INTO users (id, username, password, salt, balance) VALUES (?, ?, ?, ?, ?)",
+                           -1, &insert_user, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(handle, "INSERT INTO transactions (sender_id, receiver_id, amount, timestamp) VALUES (?, ?, ?, ?)",
+                           -1, &insert_transaction, NULL) != SQLITE_OK) {
+        printf("[ERROR] %s\n", sqlite3_errmsg(handle));
+        return 1;
+    }
+
+    int success = exec_sql(handle, "BEGIN;");
+    char username[NAME_LIMIT + 1];
+    for (int i = 0; success && i < users; i++) {
+        snprintf(username, sizeof(username), "%s%d", prefix, i);
+        sqlite3_bind_int(insert_user, 1, i + 1);
+        sqlite3_bind_text(insert_user, 2, username, -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert_user, 3, hash_hex, -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert_user, 4, salt_hex, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(insert_user, 5, STARTING_BALANCE_PAISE + received[i]);
+        success = insert_row(handle, insert_user, i);
+    }
+
+    state = seed;
+    for (long long i = 0; success && i < transactions; i++) {
+        pick_transfer(&state, users, heavy_percent, &t);
+        sqlite3_bind_int(insert_transaction, 1, t.sender + 1);
+        sqlite3_bind_int(insert_transaction, 2, t.receiver + 1);
+        sqlite3_bind_int64(insert_transaction, 3, t.amount);
+        sqlite3_bind_int64(insert_transaction, 4, FIRST_TIMESTAMP + i / TRANSFERS_PER_SECOND);
+        success = insert_row(handle, insert_transaction, i);
+    }
+    if (success) success = exec_sql(handle, "COMMIT;");
+
+    sqlite3_finalize(insert_user);
+    sqlite3_finalize(insert_transaction);
+    free(received);
+
+    if (success) {
+        exec_sql(handle, "PRAGMA wal_checkpoint(TRUNCATE);");
+        printf("[INFO] Done in %.1f s; log in as %s0 .. %s%d with password \"%s\"\n",
+               now_seconds() - start, prefix, prefix, users - 1, password);
+    }
+    sqlite3_close(handle);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include "topk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+struct counter {
+    uint64_t hash;
+    long long count;
+    long long error;
+    char key[TOPK_KEY_SIZE];
+};
+
+// One space-saving sketch covering `width` seconds
+struct slice {
+    long long epoch;  // now / width when the slice was last reset
+    int used;
+    struct counter *counters;
+};
+
+struct topk {
+    pthread_mutex_t lock;
+    int capacity;
+    int window;
+    int width;        // seconds per slice; 0 for an all-time sketch
+    int nslices;
+    struct slice *slices;
+    struct counter *merged;  // query scratch, nslices * capacity
+};
+
+static uint64_t hash_key(const char *key) {
+    uint64_t h = 1469598103934665603ULL;  // FNV-1a
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+struct topk *topk_create(int capacity, int window_seconds, int slices) {
+    struct topk *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+
+    t->capacity = capacity > 0 ? capacity : 1;
+    t->window = window_seconds > 0 ? window_seconds : 0;
+    t->nslices = t->window && slices > 0 ? slices : 1;
+    t->width = t->window ? (t->window + t->nslices - 1) / t->nslices : 0;
+    pthread_mutex_init(&t->lock, NULL);
+
+    t->slices = calloc(t->nslices, sizeof(*t->slices));
+    t->merged = calloc((size_t)t->nslices * t->capacity, sizeof(*t->merged));
+    int success = t->slices && t->merged;
+    for (int i = 0; success && i < t->nslices; i++) {
+        t->slices[i].epoch = -1;
+        t->slices[i].counters = calloc(t->capacity, sizeof(struct counter));
+        success = t->slices[i].counters != NULL;
+    }
+    if (!success) {
+        for (int i = 0; t->slices && i < t->nslices; i++) free(t->slices[i].counters);
+        free(t->slices);
+        free(t->merged);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static long long epoch_of(const struct topk *t, time_t now) {
+    return t->width ? (long long)now / t->width : 0;
+}
+
+void topk_add(struct topk *t, const char *key, long long count, time_t now) {
+    uint64_t hash = hash_key(key);
+    long long epoch = epoch_of(t, now);
+
+    pthread_mutex_lock(&t->lock);
+    struct slice *s = &t->slices[epoch % t->nslices];
+    if (s->epoch != epoch) {
+        s->epoch = epoch;
+        s->used = 0;
+    }
+
+    // One pass finds the key or, failing that, the smallest counter to replace
+    int min = 0;
+    for (int i = 0; i < s->used; i++) {
+        struct counter *c = &s->counters[i];
+        if (c->hash == hash && strcmp(c->key, key) == 0) {
+            c->count += count;
+            pthread_mutex_unlock(&t->lock);
+            return;
+        }
+        if (c->count < s->counters[min].count) min = i;
+    }
+
+    struct counter *c;
+    if (s->used < t->capacity) {
+        c = &s->counters[s->used++];
+        c->count = count;
+        c->error = 0;
+    } else {
+        c = &s->counters[min];
+        c->error = c->count;
+        c->count += count;
+    }
+    c->hash = hash;
+    snprintf(c->key, sizeof(c->key), "%s", key);
+    pthread_mutex_unlock(&t->lock);
+}
+
+static int by_key(const void *a, const void *b) {
+    const struct counter *x = a, *y = b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return strcmp(x->key, y->key);
+}
+
+static int by_count(const void *a, const void *b) {
+    const struct counter *x = a, *y = b;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return strcmp(x->key, y->key);
+}
+
+int topk_query(struct topk *t, int k, time_t now, struct topk_entry *out) {
+    long long epoch = epoch_of(t, now);
+
+    pthread_mutex_lock(&t->lock);
+
+    // Gather every live slice, then sum the counters of each key
+    int n = 0;
+    for (int i = 0; i < t->nslices; i++) {
+        struct slice *s = &t->slices[i];
+        if (s->epoch < 0 || s->epoch <= epoch - t->nslices || s->epoch > epoch) continue;
+        memcpy(&t->merged[n], s->counters, s->used * sizeof(struct counter));
+        n += s->used;
+    }
+
+    qsort(t->merged, n, sizeof(struct counter), by_key);
+    int unique = 0;
+    for (int i = 0; i < n; i++) {
+        if (unique > 0 && by_key(&t->merged[unique - 1], &t->merged[i]) == 0) {
+            t->merged[unique - 1].count += t->merged[i].count;
+            t->merged[unique - 1].error += t->merged[i].error;
+        } else {
+            t->merged[unique++] = t->merged[i];
+        }
+    }
+    qsort(t->merged, unique, sizeof(struct counter), by_count);
+
+    if (k > unique) k = unique;
+    for (int i = 0; i < k; i++) {
+        memcpy(out[i].key, t->merged[i].key, sizeof(out[i].key));
+        out[i].count = t->merged[i].count;
+        out[i].error = t->merged[i].error;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return k;
+}
+
+int topk_window(const struct topk *t) {
+    return t->window;
+}
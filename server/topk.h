@@ -0,0 +1,32 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <time.h>
+
+// Heavy hitters over a sliding time window, using space-saving sketches:
+// each slice of the window tracks at most `capacity` keys, and a new key
+// replaces the smallest counter, inheriting its count as the error bound.
+// Counts are exact while a slice has seen no more than `capacity` distinct keys.
+
+#define TOPK_KEY_SIZE 64
+
+struct topk;
+
+struct topk_entry {
+    char key[TOPK_KEY_SIZE];
+    long long count;  // upper bound on the true count
+    long long error;  // count - error is a lower bound
+};
+
+// window_seconds 0 keeps counts forever in a single slice
+struct topk *topk_create(int capacity, int window_seconds, int slices);
+
+void topk_add(struct topk *t, const char *key, long long count, time_t now);
+
+// Fill out with the k largest counts in the window ending at now, largest
+// first. Returns how many entries were written.
+int topk_query(struct topk *t, int k, time_t now, struct topk_entry *out);
+
+int topk_window(const struct topk *t);
+
+#endif
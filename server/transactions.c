@@ -1,45 +1,198 @@
 #include "transactions.h"
 #include "db.h"
+#include "archive.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 #include <sqlite3.h>
 #include <unistd.h> // for send()
 #include <sys/socket.h>
 #include <string.h>
 
-#define BUFFER_SIZE 1024
+#define CURSOR_DIGITS 16  // hex digits per cursor field
+#define NAME_CACHE_SIZE 16
 
+// Cursors are the (timestamp, id) of the last row sent, as two 16-digit hex
+// numbers. Clients only pass them back.
+static void encode_cursor(char *cursor, sqlite3_int64 timestamp, sqlite3_int64 id) {
+    sprintf(cursor, "%016llx%016llx", (unsigned long long)timestamp, (unsigned long long)id);
+}
 
-void get_transaction_history(const char *username, int client_socket) {
-    sqlite3_stmt *stmt;
-    char query[300];
+static int decode_field(const char *hex, sqlite3_int64 *value) {
+    unsigned long long v = 0;
+    for (int i = 0; i < CURSOR_DIGITS; i++) {
+        char c = hex[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (digit < 0) return 0;
+        v = (v << 4) | (unsigned long long)digit;
+    }
+    if (v > INT64_MAX) return 0;
+    *value = (sqlite3_int64)v;
+    return 1;
+}
 
-    sprintf(query,
-        "SELECT sender, receiver, amount, timestamp FROM transactions "
-        "WHERE sender = ? OR receiver = ? ORDER BY timestamp DESC");
+static int decode_cursor(const char *cursor, sqlite3_int64 *timestamp, sqlite3_int64 *id) {
+    return strlen(cursor) == 2 * CURSOR_DIGITS &&
+           decode_field(cursor, timestamp) &&
+           decode_field(cursor + CURSOR_DIGITS, id);
+}
 
-    if (sqlite3_prepare_v2(get_db_connection(), query, -1, &stmt, 0) != SQLITE_OK) {
-        send(client_socket, "Failed to prepare transaction query.\n", 37, 0);
-        return;
+// Counterparties seen on this page; a page usually names only a few
+struct name_cache {
+    int count;
+    sqlite3_int64 ids[NAME_CACHE_SIZE];
+    char names[NAME_CACHE_SIZE][64];
+};
+
+static const char *username_of(struct name_cache *cache, sqlite3_int64 id) {
+    for (int i = 0; i < cache->count && i < NAME_CACHE_SIZE; i++)
+        if (cache->ids[i] == id) return cache->names[i];
+
+    int slot = cache->count++ % NAME_CACHE_SIZE;
+    cache->ids[slot] = id;
+    if (!db_username(id, cache->names[slot], sizeof(cache->names[slot])))
+        snprintf(cache->names[slot], sizeof(cache->names[slot]), "?");
+    return cache->names[slot];
+}
+
+// Hot rows from one shard's table, newest first, up to max. 0 on a database error.
+static int read_shard_rows(int shard, sqlite3_int64 user_id, sqlite3_int64 after_timestamp, sqlite3_int64 after_id,
+                           struct archive_row *rows, int *count, int max) {
+    sqlite3_stmt *stmt = db_shard_statement(shard, STMT_HISTORY_PAGE);
+    if (!stmt) return 0;
+
+    sqlite3_bind_int64(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, after_timestamp);
+    sqlite3_bind_int64(stmt, 3, after_id);
+    sqlite3_bind_int(stmt, 4, max);
+
+    int rc;
+    while (*count < max && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        struct archive_row *r = &rows[(*count)++];
+        r->id = sqlite3_column_int64(stmt, 0);
+        r->timestamp = sqlite3_column_int64(stmt, 1);
+        r->sender_id = sqlite3_column_int64(stmt, 2);
+        r->receiver_id = sqlite3_column_int64(stmt, 3);
+        r->amount = sqlite3_column_int64(stmt, 4);
+    }
+    sqlite3_reset(stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE;
+}
+
+// Hot rows from every shard: the user's own holds what they sent and what
+// its users sent them, the others only what theirs sent them
+static int read_hot_rows(sqlite3_int64 user_id, sqlite3_int64 after_timestamp, sqlite3_int64 after_id,
+                         struct archive_row *rows, int *count, int max) {
+    if (!read_shard_rows(0, user_id, after_timestamp, after_id, rows, count, max)) return 0;
+
+    struct archive_row more[HISTORY_MAX_LIMIT + 1];
+    struct archive_row merged[HISTORY_MAX_LIMIT + 1];
+    for (int shard = 1; shard < db_shard_count(); shard++) {
+        int extra = 0;
+        if (!read_shard_rows(shard, user_id, after_timestamp, after_id, more, &extra, max)) return 0;
+
+        // Both lists are newest first, and no row is in two shards
+        int i = 0, j = 0, n = 0;
+        while (n < max && (i < *count || j < extra)) {
+            int take_more = i == *count || (j < extra && (more[j].timestamp != rows[i].timestamp
+                                                          ? more[j].timestamp > rows[i].timestamp
+                                                          : more[j].id > rows[i].id));
+            merged[n++] = take_more ? more[j++] : rows[i++];
+        }
+        memcpy(rows, merged, n * sizeof(*rows));
+        *count = n;
     }
+    return 1;
+}
+
+int get_history_page(const char *username, int limit, const char *cursor,
+                     history_writer write, void *ctx) {
+    // Without a cursor, start above every real (timestamp, id)
+    sqlite3_int64 after_timestamp = INT64_MAX;
+    sqlite3_int64 after_id = INT64_MAX;
 
+    if (cursor && cursor[0] && !decode_cursor(cursor, &after_timestamp, &after_id))
+        return 0;
+    if (limit < 1) limit = HISTORY_DEFAULT_LIMIT;
+    if (limit > HISTORY_MAX_LIMIT) limit = HISTORY_MAX_LIMIT;
+
+    sqlite3_stmt *stmt = db_shard_statement(db_shard_of(username), STMT_USER_ID);
+    if (!stmt) return 0;
     sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, username, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_int64 user_id = rc == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) return 0;
+
+    // One extra row tells us whether to hand out a cursor. The table holds the
+    // recent rows and the archive the old ones; a row being moved can be in
+    // both for a moment, and the merge keeps one.
+    struct archive_row rows[HISTORY_MAX_LIMIT + 1];
+    int count = 0;
+    if (user_id && (!read_hot_rows(user_id, after_timestamp, after_id, rows, &count, limit + 1) ||
+                    !archive_history(user_id, after_timestamp, after_id, rows, &count, limit + 1)))
+        return 0;
 
-    char response[BUFFER_SIZE];
-    strcpy(response, "Transaction History:\n");
+    const char *header = "Transaction History:\n";
+    write(ctx, header, strlen(header));
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const unsigned char *sender = sqlite3_column_text(stmt, 0);
-        const unsigned char *receiver = sqlite3_column_text(stmt, 1);
-        double amount = sqlite3_column_double(stmt, 2);
-        const unsigned char *timestamp = sqlite3_column_text(stmt, 3);
+    struct name_cache names = {0};
+    char line[256];
+    for (int i = 0; i < count && i < limit; i++) {
+        const struct archive_row *r = &rows[i];
 
-        char line[200];
-        sprintf(line, "%s -> %s : $%.2f at %s\n", sender, receiver, amount, timestamp);
-        strcat(response, line);
+        // Same form as SQLite's datetime(timestamp, 'unixepoch')
+        char when[32];
+        time_t seconds = (time_t)r->timestamp;
+        struct tm tm;
+        gmtime_r(&seconds, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+
+        const char *sender = r->sender_id == user_id ? username : username_of(&names, r->sender_id);
+        const char *receiver = r->receiver_id == user_id ? username : username_of(&names, r->receiver_id);
+        int n = snprintf(line, sizeof(line), "%s | From: %s | To: %s | ₹%.2f\n", when, sender, receiver,
+                         r->amount / 100.0);
+        if (n >= (int)sizeof(line)) n = sizeof(line) - 1;
+        write(ctx, line, n);
     }
 
-    sqlite3_finalize(stmt);
-    send(client_socket, response, strlen(response), 0);
-}
\ No newline at end of file
+    if (count > limit) {
+        char next[HISTORY_CURSOR_SIZE];
+        encode_cursor(next, rows[limit - 1].timestamp, rows[limit - 1].id);
+        int n = snprintf(line, sizeof(line), "Next: %s\n", next);
+        write(ctx, line, n);
+    }
+    return 1;
+}
+
+// Rows are gathered and sent together instead of one send() per row
+struct socket_writer {
+    int fd;
+    size_t len;
+    char buf[8192];
+};
+
+static void write_socket(void *ctx, const char *data, size_t len) {
+    struct socket_writer *w = ctx;
+
+    if (w->len + len > sizeof(w->buf)) {
+        send(w->fd, w->buf, w->len, 0);
+        w->len = 0;
+    }
+    if (len > sizeof(w->buf)) {
+        send(w->fd, data, len, 0);
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+void get_transaction_history(const char *username, int client_socket) {
+    struct socket_writer w = {.fd = client_socket, .len = 0};
+    const char *error = "Failed to prepare transaction query.\n";
+
+    if (!get_history_page(username, HISTORY_DEFAULT_LIMIT, NULL, write_socket, &w))
+        write_socket(&w, error, strlen(error));
+    if (w.len > 0) send(client_socket, w.buf, w.len, 0);
+}
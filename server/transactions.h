@@ -1,6 +1,21 @@
 #ifndef TRANSACTIONS_H
 #define TRANSACTIONS_H
 
+#include <stddef.h>
+
+#define HISTORY_DEFAULT_LIMIT 20
+#define HISTORY_MAX_LIMIT 500
+#define HISTORY_CURSOR_SIZE 64  // room for a continuation cursor and its NUL
+
+// Receives the reply text piece by piece
+typedef void (*history_writer)(void *ctx, const char *data, size_t len);
+
+// Write up to `limit` of the user's transactions, newest first, starting after
+// `cursor` (NULL or "" for the newest). When more rows remain the page ends with
+// "Next: <cursor>". Returns 0 for a malformed cursor or a failed query.
+int get_history_page(const char *username, int limit, const char *cursor,
+                     history_writer write, void *ctx);
+
 void get_transaction_history(const char *username, int client_socket);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,181 @@
+#include "transfer_engine.h"
+#include "journal.h"
+#include "ledger.h"
+#include "stats.h"
+#include "metrics.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static struct transfer_request *queue_head = NULL;
+static struct transfer_request *queue_tail = NULL;
+static int queued = 0;
+
+static int batch_limit = 1;
+static int wait_limit_us = 0;
+static int depth_limit = 1;
+
+// Hold the queue lock for up to wait_limit_us so more transfers can share the commit
+static void wait_for_batch() {
+    if (wait_limit_us <= 0) return;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)wait_limit_us * 1000;
+    while (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (queued < batch_limit) {
+        if (pthread_cond_timedwait(&queue_cond, &queue_lock, &deadline) == ETIMEDOUT) break;
+    }
+}
+
+static int64_t to_paise(double amount) {
+    return (int64_t)llround(amount * 100.0);
+}
+
+// The journal record for one request: a TRANSFER_BATCH is a single record of
+// its pending lines, so it is applied whole or not at all
+static int encode(struct journal_buffer *payload, struct transfer_request *req, int64_t timestamp) {
+    payload->len = 0;
+    payload->failed = 0;
+    journal_put_i64(payload, timestamp);
+    journal_put_name(payload, req->sender);
+
+    if (!req->lines) {
+        journal_put_u32(payload, 1);
+        journal_put_name(payload, req->receiver);
+        journal_put_i64(payload, to_paise(req->amount));
+        return !payload->failed;
+    }
+
+    uint32_t pending = 0;
+    for (int i = 0; i < req->line_count; i++) pending += req->lines[i].status == LINE_PENDING;
+    journal_put_u32(payload, pending);
+    for (int i = 0; i < req->line_count; i++) {
+        if (req->lines[i].status != LINE_PENDING) continue;
+        journal_put_name(payload, req->lines[i].receiver);
+        journal_put_i64(payload, to_paise(req->lines[i].amount));
+    }
+    return !payload->failed;
+}
+
+// Credit or refund every reserved line of a TRANSFER_BATCH
+static void settle_lines(struct transfer_request *req, uint64_t seq) {
+    int settled = 0;
+    for (int i = 0; i < req->line_count; i++) {
+        struct transfer_line *line = &req->lines[i];
+        if (line->status != LINE_PENDING) continue;
+        ledger_settle(req->sender, line->receiver, line->amount, seq);
+        line->status = seq ? LINE_OK : LINE_FAILED;
+        settled++;
+    }
+    metrics_count(seq ? COUNTER_TRANSFERS_COMMITTED : COUNTER_TRANSFERS_FAILED, settled);
+    if (seq) stats_record_transfer(req->sender, settled);
+}
+
+static void *committer_main(void *unused) {
+    (void)unused;
+    struct transfer_request **batch = malloc(sizeof(*batch) * batch_limit);
+    uint64_t *seqs = malloc(sizeof(*seqs) * batch_limit);
+    struct journal_buffer payload = {0};
+    if (!batch || !seqs) {
+        log_error("Transfer committer out of memory");
+        return NULL;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_head == NULL)
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        wait_for_batch();
+
+        int n = 0;
+        while (queue_head && n < batch_limit) {
+            batch[n++] = queue_head;
+            queue_head = queue_head->next;
+            queued--;
+        }
+        if (queue_head == NULL) queue_tail = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        uint64_t start = metrics_now();
+        for (int i = 0; i < n; i++) metrics_time(TIMER_COMMIT_WAIT, start - batch[i]->queued_at);
+
+        // One journal record per transfer and one sync for the whole batch
+        int64_t timestamp = (int64_t)time(NULL);
+        int appended = 0;
+        for (int i = 0; i < n; i++) {
+            seqs[i] = 0;
+            if (encode(&payload, batch[i], timestamp))
+                seqs[i] = journal_append(JOURNAL_TRANSFER, payload.data, payload.len);
+            if (seqs[i]) appended++;
+            else log_error("Transfer from %s could not be journaled", batch[i]->sender);
+        }
+        uint64_t now = metrics_now();
+        metrics_time(TIMER_JOURNAL_APPEND, now - start);
+        if (appended) journal_sync();
+        metrics_time(TIMER_JOURNAL_SYNC, metrics_now() - now);
+        metrics_count(COUNTER_TRANSFER_BATCHES, 1);
+
+        // Funds were reserved in the ledger at submit time; credit or refund them now
+        for (int i = 0; i < n; i++) {
+            struct transfer_request *req = batch[i];
+            if (req->lines) {
+                settle_lines(req, seqs[i]);
+            } else {
+                ledger_settle(req->sender, req->receiver, req->amount, seqs[i]);
+                metrics_count(seqs[i] ? COUNTER_TRANSFERS_COMMITTED : COUNTER_TRANSFERS_FAILED, 1);
+                if (seqs[i]) stats_record_transfer(req->sender, 1);
+            }
+        }
+        if (appended) journal_settled(appended);
+
+        for (int i = 0; i < n; i++) {
+            double new_balance = 0;
+            ledger_balance(batch[i]->sender, &new_balance);
+            batch[i]->done(batch[i], seqs[i] != 0, new_balance);
+        }
+    }
+    return NULL;
+}
+
+int transfer_engine_start(int max_batch, int max_wait_us, int queue_depth) {
+    batch_limit = max_batch > 0 ? max_batch : 1;
+    wait_limit_us = max_wait_us;
+    depth_limit = queue_depth > 0 ? queue_depth : 1;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, committer_main, NULL) != 0) {
+        perror("Transfer committer creation failed");
+        return 0;
+    }
+    pthread_detach(thread);
+    return 1;
+}
+
+int transfer_engine_submit(struct transfer_request *req) {
+    req->next = NULL;
+    req->queued_at = metrics_now();
+
+    pthread_mutex_lock(&queue_lock);
+    if (queued >= depth_limit) {
+        pthread_mutex_unlock(&queue_lock);
+        return 0;
+    }
+    if (queue_tail) queue_tail->next = req;
+    else queue_head = req;
+    queue_tail = req;
+    queued++;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef TRANSFER_ENGINE_H
+#define TRANSFER_ENGINE_H
+
+#include <stdint.h>
+
+#define TRANSFER_NAME_SIZE 100
+
+struct transfer_request;
+
+// How one payment of a TRANSFER_BATCH fared
+enum transfer_line_status {
+    LINE_PENDING,           // funds reserved, waiting for the committer
+    LINE_OK,
+    LINE_UNKNOWN_RECIPIENT,
+    LINE_OVER_LIMIT,        // over the sender's per-transfer limit
+    LINE_OVER_HOURLY,       // the other velocity limits of the sender's tier
+    LINE_OVER_RATE,
+    LINE_TOO_MANY_RECIPIENTS,
+    LINE_BAD_AMOUNT,
+    LINE_NO_FUNDS,
+    LINE_NOT_SENT,          // fine on its own, but the all-or-nothing batch was refused
+    LINE_FAILED             // it could not be journaled
+};
+
+struct transfer_line {
+    char receiver[TRANSFER_NAME_SIZE];
+    double amount;
+    enum transfer_line_status status;
+};
+
+// Called on the committer thread once the request's journal record is durable
+// (or could not be written). new_balance is the sender's in-memory balance after settling.
+typedef void (*transfer_done_fn)(struct transfer_request *req, int success, double new_balance);
+
+struct transfer_request {
+    char sender[TRANSFER_NAME_SIZE];
+    char receiver[TRANSFER_NAME_SIZE];
+    double amount;  // for a batch, the total of its pending lines
+
+    // TRANSFER_BATCH: the pending lines are journaled as one record, and
+    // marked LINE_OK or LINE_FAILED before done is called
+    struct transfer_line *lines;
+    int line_count;
+
+    transfer_done_fn done;
+    void *ctx;
+    uint64_t queued_at;  // set by transfer_engine_submit()
+    struct transfer_request *next;
+};
+
+// Start the single committer thread. Up to max_batch transfers, or whatever
+// arrives within max_wait_us of the first one, share one journal sync.
+int transfer_engine_start(int max_batch, int max_wait_us, int queue_depth);
+
+// Queue a transfer whose funds are already reserved with ledger_reserve().
+// Returns 0 if the queue is full; the caller still owns req and the reservation.
+int transfer_engine_submit(struct transfer_request *req);
+
+#endif
@@ -0,0 +1,150 @@
+#include "velocity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Standard, verified, merchant, and unlimited for system accounts and load tests
+static struct velocity_limits tiers[VELOCITY_TIERS] = {
+    {100000, 1000000, 30, 20},
+    {1000000, 10000000, 120, VELOCITY_RECIPIENTS},
+    {10000000, 100000000, 600, 0},
+    {0, 0, 0, 0}
+};
+
+static uint32_t hash_recipient(const char *username) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h ? h : 1;
+}
+
+// A bucket stamped with epoch counts if it is one of the window's last n
+static int in_window(uint32_t epoch, uint32_t stamp, int n) {
+    int32_t age = (int32_t)(epoch - stamp);
+    return age >= 0 && age < n;
+}
+
+static int recipient_fresh(const struct velocity *v, int i, uint32_t now) {
+    return v->recipient_hash[i] && (int64_t)now - v->recipient_seen[i] < VELOCITY_RECIPIENT_SECONDS;
+}
+
+void velocity_configure() {
+    printf("[INFO] Velocity limits per tier, 0 for none:\n");
+    for (int tier = 0; tier < VELOCITY_TIERS; tier++) {
+        char name[32];
+        snprintf(name, sizeof(name), "WALLET_VELOCITY_TIER%d", tier);
+        const char *value = getenv(name);
+        struct velocity_limits *l = &tiers[tier];
+
+        if (value && *value) {
+            double per_transfer, per_hour;
+            unsigned per_minute, recipients;
+            if (sscanf(value, "%lf,%lf,%u,%u", &per_transfer, &per_hour, &per_minute, &recipients) == 4 &&
+                per_transfer >= 0 && per_hour >= 0) {
+                l->max_paise = llround(per_transfer * 100.0);
+                l->max_paise_per_hour = llround(per_hour * 100.0);
+                l->max_per_minute = per_minute;
+                l->max_recipients_per_day = recipients;
+            } else {
+                printf("[ERROR] Ignoring %s='%s'; use per_transfer,per_hour,per_minute,recipients\n", name, value);
+            }
+        }
+        if (l->max_recipients_per_day > VELOCITY_RECIPIENTS) l->max_recipients_per_day = VELOCITY_RECIPIENTS;
+
+        printf("[INFO]   tier %d: ₹%.2f per transfer, ₹%.2f per hour, %u per minute, %u recipients per day\n",
+               tier, l->max_paise / 100.0, l->max_paise_per_hour / 100.0, l->max_per_minute,
+               l->max_recipients_per_day);
+    }
+}
+
+const struct velocity_limits *velocity_tier(int tier) {
+    return &tiers[tier >= 0 && tier < VELOCITY_TIERS ? tier : 0];
+}
+
+int velocity_tracked(const struct velocity_limits *limits) {
+    return limits->max_paise_per_hour || limits->max_per_minute || limits->max_recipients_per_day;
+}
+
+enum velocity_verdict velocity_check_request(const struct velocity *v, const struct velocity_limits *limits,
+                                             uint32_t now) {
+    if (!limits->max_per_minute) return VELOCITY_OK;
+
+    uint32_t epoch = now / VELOCITY_RATE_SECONDS, sent = 0;
+    for (int i = 0; i < VELOCITY_RATE_BUCKETS; i++)
+        if (in_window(epoch, v->rate_epoch[i], VELOCITY_RATE_BUCKETS)) sent += v->rate_count[i];
+    return sent >= limits->max_per_minute ? VELOCITY_OVER_RATE : VELOCITY_OK;
+}
+
+void velocity_record_request(struct velocity *v, uint32_t now) {
+    uint32_t epoch = now / VELOCITY_RATE_SECONDS;
+    int slot = epoch % VELOCITY_RATE_BUCKETS;
+    if (v->rate_epoch[slot] != epoch) {
+        if ((int32_t)(epoch - v->rate_epoch[slot]) < 0) return;  // older than the window
+        v->rate_epoch[slot] = epoch;
+        v->rate_count[slot] = 0;
+    }
+    v->rate_count[slot]++;
+}
+
+enum velocity_verdict velocity_check_payment(const struct velocity *v, const struct velocity_limits *limits,
+                                             uint32_t now, const char *receiver, int64_t paise) {
+    if (limits->max_paise && paise > limits->max_paise) return VELOCITY_OVER_AMOUNT;
+
+    if (limits->max_paise_per_hour) {
+        uint32_t epoch = now / VELOCITY_AMOUNT_SECONDS;
+        int64_t sent = 0;
+        for (int i = 0; i < VELOCITY_AMOUNT_BUCKETS; i++)
+            if (in_window(epoch, v->amount_epoch[i], VELOCITY_AMOUNT_BUCKETS)) sent += v->amount_paise[i];
+        if (sent + paise > limits->max_paise_per_hour) return VELOCITY_OVER_HOURLY;
+    }
+
+    if (limits->max_recipients_per_day) {
+        uint32_t hash = hash_recipient(receiver), fresh = 0;
+        for (int i = 0; i < VELOCITY_RECIPIENTS; i++) {
+            if (!recipient_fresh(v, i, now)) continue;
+            if (v->recipient_hash[i] == hash) return VELOCITY_OK;
+            fresh++;
+        }
+        if (fresh >= limits->max_recipients_per_day) return VELOCITY_OVER_RECIPIENTS;
+    }
+    return VELOCITY_OK;
+}
+
+void velocity_record_payment(struct velocity *v, const struct velocity_limits *limits, uint32_t now,
+                             const char *receiver, int64_t paise) {
+    uint32_t epoch = now / VELOCITY_AMOUNT_SECONDS;
+    int slot = epoch % VELOCITY_AMOUNT_BUCKETS;
+    if (v->amount_epoch[slot] == epoch) {
+        v->amount_paise[slot] += paise;
+    } else if ((int32_t)(epoch - v->amount_epoch[slot]) > 0) {
+        v->amount_epoch[slot] = epoch;
+        v->amount_paise[slot] = paise;
+    }
+
+    // Without a day limit there is nothing to remember recipients for
+    if (!limits->max_recipients_per_day) return;
+    uint32_t hash = hash_recipient(receiver);
+    int oldest = 0;
+    for (int i = 0; i < VELOCITY_RECIPIENTS; i++) {
+        if (v->recipient_hash[i] == hash) {
+            if ((int32_t)(now - v->recipient_seen[i]) > 0) v->recipient_seen[i] = now;
+            return;
+        }
+        if (!v->recipient_hash[i] || v->recipient_seen[i] < v->recipient_seen[oldest]) oldest = i;
+        if (!v->recipient_hash[oldest]) break;
+    }
+    v->recipient_hash[oldest] = hash;
+    v->recipient_seen[oldest] = now;
+}
+
+const char *velocity_verdict_text(enum velocity_verdict verdict) {
+    switch (verdict) {
+    case VELOCITY_OVER_AMOUNT:     return "over the per-transfer limit";
+    case VELOCITY_OVER_HOURLY:     return "over the hourly limit";
+    case VELOCITY_OVER_RATE:       return "too many transfers in the last minute";
+    case VELOCITY_OVER_RECIPIENTS: return "too many new recipients today";
+    default:                       return "within limits";
+    }
+}
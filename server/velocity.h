@@ -0,0 +1,72 @@
+#ifndef VELOCITY_H
+#define VELOCITY_H
+
+#include <stdint.h>
+
+// Sliding-window fraud limits on what one account sends: the size of each
+// transfer, the total sent in the last hour, transfers in the last minute and
+// distinct recipients in the last day. Each account's counters are small
+// time-bucketed rings, so a check reads a fixed number of slots and no SQL.
+// The ledger keeps them next to the balance and updates them under the same
+// stripe lock as the reservation.
+
+#define VELOCITY_TIERS 4
+#define VELOCITY_RATE_BUCKETS 6          // transfers per 10 s, covering the last minute
+#define VELOCITY_RATE_SECONDS 10
+#define VELOCITY_AMOUNT_BUCKETS 12       // paise per 5 min, covering the last hour
+#define VELOCITY_AMOUNT_SECONDS 300
+#define VELOCITY_RECIPIENTS 64           // most distinct recipients a day limit can allow
+#define VELOCITY_RECIPIENT_SECONDS 86400
+
+// What an account's tier allows; 0 leaves a limit off
+struct velocity_limits {
+    int64_t max_paise;            // per transfer
+    int64_t max_paise_per_hour;
+    uint32_t max_per_minute;      // a TRANSFER_BATCH counts once
+    uint32_t max_recipients_per_day;
+};
+
+enum velocity_verdict {
+    VELOCITY_OK,
+    VELOCITY_OVER_AMOUNT,
+    VELOCITY_OVER_HOURLY,
+    VELOCITY_OVER_RATE,
+    VELOCITY_OVER_RECIPIENTS
+};
+
+// One account's recent sends. Buckets are stamped with the window they count,
+// so a stale one reads as empty without being cleared.
+struct velocity {
+    uint32_t rate_epoch[VELOCITY_RATE_BUCKETS];
+    uint32_t rate_count[VELOCITY_RATE_BUCKETS];
+    uint32_t amount_epoch[VELOCITY_AMOUNT_BUCKETS];
+    int64_t amount_paise[VELOCITY_AMOUNT_BUCKETS];
+    uint32_t recipient_hash[VELOCITY_RECIPIENTS];  // 0 for an empty slot
+    uint32_t recipient_seen[VELOCITY_RECIPIENTS];  // Unix seconds
+};
+
+// Read WALLET_VELOCITY_TIER<n> overrides and print the limits in force.
+// Each is "per_transfer,per_hour,per_minute,recipients_per_day" with rupee amounts.
+void velocity_configure();
+
+// The limits for a tier; unknown tiers get tier 0's
+const struct velocity_limits *velocity_tier(int tier);
+
+// Whether any limit is on, i.e. whether the tier needs a struct velocity at all
+int velocity_tracked(const struct velocity_limits *limits);
+
+// Check, then count, one transfer request sent at now
+enum velocity_verdict velocity_check_request(const struct velocity *v, const struct velocity_limits *limits,
+                                             uint32_t now);
+void velocity_record_request(struct velocity *v, uint32_t now);
+
+// Check, then count, one payment of that request. A recipient already paid
+// in the last day does not count again.
+enum velocity_verdict velocity_check_payment(const struct velocity *v, const struct velocity_limits *limits,
+                                             uint32_t now, const char *receiver, int64_t paise);
+void velocity_record_payment(struct velocity *v, const struct velocity_limits *limits, uint32_t now,
+                             const char *receiver, int64_t paise);
+
+const char *velocity_verdict_text(enum velocity_verdict verdict);
+
+#endif
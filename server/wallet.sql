@@ -1,31 +1,111 @@
--- Reset existing tables
+-- Reset existing tables. Delete journal/, archive/, wallet.snapshot and any
+-- wallet.N.db shards as well, or the server will replay the old journal into
+-- the new tables.
+DROP TABLE IF EXISTS shard_info;
+DROP TABLE IF EXISTS archived_senders;
+DROP TABLE IF EXISTS archive_segments;
+DROP TABLE IF EXISTS journal_state;
+DROP TABLE IF EXISTS stats;
 DROP TABLE IF EXISTS transactions;
 DROP TABLE IF EXISTS users;
 
+-- Schema version 7: money is integer paise, transactions reference users.id,
+-- ADMIN_STATS totals live in the stats table, journal_state records how much
+-- of the journal the tables hold, users.tier picks the velocity limits, old
+-- transactions move out to archive segments, and shard_info says which
+-- database shard this file is
+PRAGMA user_version = 7;
+
 -- Create users table with is_admin flag
 CREATE TABLE users (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
     username TEXT UNIQUE NOT NULL,
     password TEXT NOT NULL,
     salt TEXT NOT NULL,
-    balance REAL DEFAULT 1000.0,
-    is_admin INTEGER DEFAULT 0  -- 0 = not admin, 1 = admin
+    balance INTEGER NOT NULL DEFAULT 100000,  -- paise (₹1000.00)
+    is_admin INTEGER DEFAULT 0,  -- 0 = not admin, 1 = admin
+    tier INTEGER NOT NULL DEFAULT 0  -- 0 standard, 1 verified, 2 merchant, 3 unlimited
 );
 
 -- Create transactions table
 CREATE TABLE transactions (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
-    sender TEXT NOT NULL,
-    receiver TEXT NOT NULL,
-    amount REAL NOT NULL,
-    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
-    FOREIGN KEY (sender) REFERENCES users(username) ON DELETE CASCADE,
-    FOREIGN KEY (receiver) REFERENCES users(username) ON DELETE CASCADE
+    sender_id INTEGER NOT NULL REFERENCES users(id),
+    receiver_id INTEGER NOT NULL REFERENCES users(id),
+    amount INTEGER NOT NULL,  -- paise
+    timestamp INTEGER NOT NULL DEFAULT (CAST(strftime('%s', 'now') AS INTEGER))  -- Unix seconds
 );
 
+-- HISTORY pages walk these newest-first
+CREATE INDEX idx_transactions_sender_id ON transactions (sender_id, timestamp, id);
+CREATE INDEX idx_transactions_receiver_id ON transactions (receiver_id, timestamp, id);
+
+-- Running totals for ADMIN_STATS; the triggers update them in the same transaction as each write
+CREATE TABLE stats (
+    name TEXT PRIMARY KEY,  -- 'users', 'balance' (paise) or 'transactions'
+    value INTEGER NOT NULL
+) WITHOUT ROWID;
+
+INSERT INTO stats (name, value) VALUES ('users', 0), ('balance', 0), ('transactions', 0);
+
+CREATE TRIGGER stats_user_insert AFTER INSERT ON users BEGIN
+    UPDATE stats SET value = value + 1 WHERE name = 'users';
+    UPDATE stats SET value = value + NEW.balance WHERE name = 'balance';
+END;
+
+CREATE TRIGGER stats_user_delete AFTER DELETE ON users BEGIN
+    UPDATE stats SET value = value - 1 WHERE name = 'users';
+    UPDATE stats SET value = value - OLD.balance WHERE name = 'balance';
+END;
+
+CREATE TRIGGER stats_user_balance AFTER UPDATE OF balance ON users
+WHEN NEW.balance <> OLD.balance BEGIN
+    UPDATE stats SET value = value + NEW.balance - OLD.balance WHERE name = 'balance';
+END;
+
+CREATE TRIGGER stats_transaction_insert AFTER INSERT ON transactions BEGIN
+    UPDATE stats SET value = value + 1 WHERE name = 'transactions';
+END;
+
+CREATE TRIGGER stats_transaction_delete AFTER DELETE ON transactions BEGIN
+    UPDATE stats SET value = value - 1 WHERE name = 'transactions';
+END;
+
+-- Last journal record applied to these tables
+CREATE TABLE journal_state (
+    id INTEGER PRIMARY KEY CHECK (id = 1),
+    applied_seq INTEGER NOT NULL
+);
+
+INSERT INTO journal_state (id, applied_seq) VALUES (1, 0);
+
+-- Segment files under archive/ holding transactions moved out of the table;
+-- 'transactions' in stats still counts them
+CREATE TABLE archive_segments (
+    id INTEGER PRIMARY KEY,  -- archive/<id as 16 hex digits>.wseg
+    rows INTEGER NOT NULL,
+    min_timestamp INTEGER NOT NULL,
+    max_timestamp INTEGER NOT NULL
+);
+
+-- Archived transactions per sender, for the busiest-senders list
+CREATE TABLE archived_senders (
+    sender_id INTEGER PRIMARY KEY,
+    transactions INTEGER NOT NULL
+);
+
+-- The only shard, until tools/wallet_reshard splits the accounts
+CREATE TABLE shard_info (
+    id INTEGER PRIMARY KEY CHECK (id = 1),
+    shard INTEGER NOT NULL,
+    shards INTEGER NOT NULL
+);
+
+INSERT INTO shard_info (id, shard, shards) VALUES (1, 0, 1);
+
 -- Insert dummy users (with admin for 'kashish')
 INSERT INTO users (username, password, salt, balance, is_admin)
-VALUES ('kashish', 'HASHED_PASSWORD_1', 'SALT_1', 5000.0, 1);
+VALUES ('kashish', 'HASHED_PASSWORD_1', 'SALT_1', 500000, 1);
 
 INSERT INTO users (username, password, salt, balance, is_admin)
-VALUES ('guddu', 'HASHED_PASSWORD_2', 'SALT_2', 3000.0, 0);
\ No newline at end of file
+VALUES ('guddu', 'HASHED_PASSWORD_2', 'SALT_2', 300000, 0);
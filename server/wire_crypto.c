@@ -0,0 +1,166 @@
+#include "wire_crypto.h"
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include <openssl/kdf.h>
+
+#define KEY_SIZE 32  // AES-256
+#define IV_SIZE 12
+
+// One direction of a channel: the key lives in the context, set up once
+struct wire_direction {
+    EVP_CIPHER_CTX *ctx;
+    unsigned char iv[IV_SIZE];
+    uint64_t records;  // sealed or opened so far; the nonce counter
+};
+
+struct wire_channel {
+    EVP_PKEY *key;  // ours, until the handshake is done
+    unsigned char public_key[WIRE_KEY_SIZE];
+    struct wire_direction seal, open;
+};
+
+struct wire_channel *wire_channel_new(unsigned char public_key[WIRE_KEY_SIZE]) {
+    struct wire_channel *ch = calloc(1, sizeof(*ch));
+    if (!ch) return NULL;
+
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, NULL);
+    size_t len = WIRE_KEY_SIZE;
+    int success = ctx && EVP_PKEY_keygen_init(ctx) > 0 && EVP_PKEY_keygen(ctx, &ch->key) > 0 &&
+                  EVP_PKEY_get_raw_public_key(ch->key, ch->public_key, &len) > 0 && len == WIRE_KEY_SIZE;
+    EVP_PKEY_CTX_free(ctx);
+    if (!success) {
+        wire_channel_free(ch);
+        return NULL;
+    }
+    memcpy(public_key, ch->public_key, WIRE_KEY_SIZE);
+    return ch;
+}
+
+static int shared_secret(EVP_PKEY *own, const unsigned char peer_public[WIRE_KEY_SIZE],
+                         unsigned char secret[WIRE_KEY_SIZE]) {
+    EVP_PKEY *peer = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, NULL, peer_public, WIRE_KEY_SIZE);
+    EVP_PKEY_CTX *ctx = peer ? EVP_PKEY_CTX_new(own, NULL) : NULL;
+    size_t len = WIRE_KEY_SIZE;
+    int success = ctx && EVP_PKEY_derive_init(ctx) > 0 && EVP_PKEY_derive_set_peer(ctx, peer) > 0 &&
+                  EVP_PKEY_derive(ctx, secret, &len) > 0 && len == WIRE_KEY_SIZE;
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(peer);
+
+    // A low-order peer key makes the secret all zeros, whatever our key was
+    unsigned char zero[WIRE_KEY_SIZE] = {0};
+    return success && CRYPTO_memcmp(secret, zero, WIRE_KEY_SIZE) != 0;
+}
+
+// HKDF-SHA256 into c2s key | c2s IV | s2c key | s2c IV
+static int expand_keys(const unsigned char secret[WIRE_KEY_SIZE], const unsigned char *client_public,
+                       const unsigned char *server_public, unsigned char *out, size_t out_len) {
+    unsigned char salt[2 * WIRE_KEY_SIZE];
+    memcpy(salt, client_public, WIRE_KEY_SIZE);
+    memcpy(salt + WIRE_KEY_SIZE, server_public, WIRE_KEY_SIZE);
+
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    size_t len = out_len;
+    int success = ctx && EVP_PKEY_derive_init(ctx) > 0 && EVP_PKEY_CTX_set_hkdf_md(ctx, EVP_sha256()) > 0 &&
+                  EVP_PKEY_CTX_set1_hkdf_salt(ctx, salt, sizeof(salt)) > 0 &&
+                  EVP_PKEY_CTX_set1_hkdf_key(ctx, secret, WIRE_KEY_SIZE) > 0 &&
+                  EVP_PKEY_CTX_add1_hkdf_info(ctx, (const unsigned char *)WIRE_SECURE_INFO,
+                                              strlen(WIRE_SECURE_INFO)) > 0 &&
+                  EVP_PKEY_derive(ctx, out, &len) > 0 && len == out_len;
+    EVP_PKEY_CTX_free(ctx);
+    return success;
+}
+
+static int init_direction(struct wire_direction *d, const unsigned char *key, const unsigned char *iv, int encrypt) {
+    d->ctx = EVP_CIPHER_CTX_new();
+    if (!d->ctx) return 0;
+    memcpy(d->iv, iv, IV_SIZE);
+    d->records = 0;
+    return EVP_CipherInit_ex(d->ctx, EVP_aes_256_gcm(), NULL, key, NULL, encrypt) > 0;
+}
+
+int wire_channel_accept(struct wire_channel *ch, const unsigned char peer_public[WIRE_KEY_SIZE], int server_side) {
+    if (!ch->key) return 0;
+
+    unsigned char secret[WIRE_KEY_SIZE];
+    unsigned char keys[2 * (KEY_SIZE + IV_SIZE)];
+    const unsigned char *client_public = server_side ? peer_public : ch->public_key;
+    const unsigned char *server_public = server_side ? ch->public_key : peer_public;
+    int success = shared_secret(ch->key, peer_public, secret) &&
+                  expand_keys(secret, client_public, server_public, keys, sizeof(keys));
+    EVP_PKEY_free(ch->key);
+    ch->key = NULL;
+
+    if (success) {
+        const unsigned char *c2s = keys, *s2c = keys + KEY_SIZE + IV_SIZE;
+        success = init_direction(&ch->seal, server_side ? s2c : c2s, (server_side ? s2c : c2s) + KEY_SIZE, 1) &&
+                  init_direction(&ch->open, server_side ? c2s : s2c, (server_side ? c2s : s2c) + KEY_SIZE, 0);
+    }
+    OPENSSL_cleanse(secret, sizeof(secret));
+    OPENSSL_cleanse(keys, sizeof(keys));
+    return success;
+}
+
+void wire_channel_free(struct wire_channel *ch) {
+    if (!ch) return;
+    EVP_PKEY_free(ch->key);
+    EVP_CIPHER_CTX_free(ch->seal.ctx);
+    EVP_CIPHER_CTX_free(ch->open.ctx);
+    free(ch);
+}
+
+// Set the next record's nonce and authenticate its header
+static int begin_record(struct wire_direction *d, const unsigned char header[WIRE_RECORD_HEADER]) {
+    if (!d->ctx) return 0;
+
+    unsigned char nonce[IV_SIZE];
+    memcpy(nonce, d->iv, IV_SIZE);
+    uint64_t n = d->records++;
+    for (int i = IV_SIZE - 1; i >= IV_SIZE - 8; i--, n >>= 8) nonce[i] ^= (unsigned char)n;
+
+    int len;
+    return EVP_CipherInit_ex(d->ctx, NULL, NULL, NULL, nonce, -1) > 0 &&
+           EVP_CipherUpdate(d->ctx, NULL, &len, header, WIRE_RECORD_HEADER) > 0;
+}
+
+// GCM is a stream cipher: every byte in gives one byte out, in place
+static int crypt_update(struct wire_direction *d, unsigned char *data, size_t len) {
+    while (len > 0) {
+        int step = len > 1 << 30 ? 1 << 30 : (int)len;
+        int out;
+        if (EVP_CipherUpdate(d->ctx, data, &out, data, step) <= 0 || out != step) return 0;
+        data += step;
+        len -= step;
+    }
+    return 1;
+}
+
+int wire_seal_begin(struct wire_channel *ch, const unsigned char header[WIRE_RECORD_HEADER]) {
+    return begin_record(&ch->seal, header);
+}
+
+int wire_seal_update(struct wire_channel *ch, unsigned char *data, size_t len) {
+    return crypt_update(&ch->seal, data, len);
+}
+
+int wire_seal_end(struct wire_channel *ch, unsigned char tag[WIRE_TAG_SIZE]) {
+    int len;
+    return EVP_EncryptFinal_ex(ch->seal.ctx, tag, &len) > 0 &&
+           EVP_CIPHER_CTX_ctrl(ch->seal.ctx, EVP_CTRL_GCM_GET_TAG, WIRE_TAG_SIZE, tag) > 0;
+}
+
+int wire_open(struct wire_channel *ch, const unsigned char header[WIRE_RECORD_HEADER], unsigned char *data,
+              size_t len, const unsigned char tag[WIRE_TAG_SIZE]) {
+    int final_len;
+    unsigned char expected[WIRE_TAG_SIZE];
+    memcpy(expected, tag, WIRE_TAG_SIZE);  // SET_TAG wants a writable buffer
+    if (begin_record(&ch->open, header) && crypt_update(&ch->open, data, len) &&
+        EVP_CIPHER_CTX_ctrl(ch->open.ctx, EVP_CTRL_GCM_SET_TAG, WIRE_TAG_SIZE, expected) > 0 &&
+        EVP_DecryptFinal_ex(ch->open.ctx, expected, &final_len) > 0)
+        return 1;
+
+    EVP_CIPHER_CTX_free(ch->open.ctx);
+    ch->open.ctx = NULL;
+    return 0;
+}
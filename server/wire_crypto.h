@@ -0,0 +1,42 @@
+#ifndef WIRE_CRYPTO_H
+#define WIRE_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "protocol.h"
+
+// The encrypted binary protocol (see protocol.h): an ephemeral X25519 key
+// exchange, HKDF-SHA256 over the shared secret, then AES-256-GCM records with a
+// key and nonce counter per direction. OpenSSL picks AES-NI and PCLMULQDQ when
+// the CPU has them. Records are sealed and opened in place, so a channel never
+// copies the bytes it protects.
+//
+// A channel belongs to one thread at a time: both ends of a connection keep
+// their own, and the server only touches it from the connection's event loop.
+
+struct wire_channel;
+
+// Start a handshake with a fresh key pair; its public half goes to public_key.
+// Returns NULL if OpenSSL cannot make one.
+struct wire_channel *wire_channel_new(unsigned char public_key[WIRE_KEY_SIZE]);
+
+// Finish the handshake with the peer's public key and derive the session keys.
+// server_side picks which direction each key is for. Returns 0 for a key that
+// gives no usable secret; the channel must be freed then.
+int wire_channel_accept(struct wire_channel *ch, const unsigned char peer_public[WIRE_KEY_SIZE], int server_side);
+
+void wire_channel_free(struct wire_channel *ch);
+
+// Seal one outgoing record, whose header already holds its length: begin, then
+// update over each piece of plaintext in order, then end to get the tag. The
+// pieces are encrypted where they are.
+int wire_seal_begin(struct wire_channel *ch, const unsigned char header[WIRE_RECORD_HEADER]);
+int wire_seal_update(struct wire_channel *ch, unsigned char *data, size_t len);
+int wire_seal_end(struct wire_channel *ch, unsigned char tag[WIRE_TAG_SIZE]);
+
+// Decrypt one incoming record in place. Returns 0 if it fails authentication,
+// which leaves the channel unusable.
+int wire_open(struct wire_channel *ch, const unsigned char header[WIRE_RECORD_HEADER], unsigned char *data,
+              size_t len, const unsigned char tag[WIRE_TAG_SIZE]);
+
+#endif
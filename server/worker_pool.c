@@ -0,0 +1,113 @@
+#include "worker_pool.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+struct job {
+    job_fn fn;
+    void *arg;
+    uint64_t queued_at;  // metrics_now() at submit
+};
+
+// Fixed-capacity ring of jobs plus the threads that drain it
+struct work_lane {
+    const char *name;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    void (*thread_start)(void);
+    struct job *ring;
+    int capacity;
+    int head;
+    int count;
+
+    // Operator-visible counters, guarded by lock
+    int high_water;
+    unsigned long submitted;
+    unsigned long rejected;
+};
+
+static const char *lane_names[LANE_COUNT] = { "auth", "write", "read", "report" };
+static struct work_lane lanes[LANE_COUNT];
+
+static void *worker_main(void *arg) {
+    struct work_lane *lane = arg;
+    if (lane->thread_start) lane->thread_start();
+
+    while (1) {
+        pthread_mutex_lock(&lane->lock);
+        while (lane->count == 0)
+            pthread_cond_wait(&lane->not_empty, &lane->lock);
+
+        struct job job = lane->ring[lane->head];
+        lane->head = (lane->head + 1) % lane->capacity;
+        lane->count--;
+        pthread_mutex_unlock(&lane->lock);
+
+        metrics_time(TIMER_LANE_WAIT_AUTH + (lane - lanes), metrics_now() - job.queued_at);
+        job.fn(job.arg);
+    }
+    return NULL;
+}
+
+int worker_pool_start(const struct lane_config config[LANE_COUNT]) {
+    for (int l = 0; l < LANE_COUNT; l++) {
+        struct work_lane *lane = &lanes[l];
+        lane->name = lane_names[l];
+        lane->capacity = config[l].depth > 0 ? config[l].depth : 1;
+        lane->thread_start = config[l].thread_start;
+        lane->ring = calloc(lane->capacity, sizeof(struct job));
+        if (!lane->ring) return 0;
+        pthread_mutex_init(&lane->lock, NULL);
+        pthread_cond_init(&lane->not_empty, NULL);
+
+        for (int i = 0; i < config[l].threads; i++) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, worker_main, lane) != 0) {
+                perror("Worker creation failed");
+                return 0;
+            }
+            pthread_detach(thread);
+        }
+    }
+    return 1;
+}
+
+int worker_pool_submit(enum lane l, job_fn fn, void *arg) {
+    struct work_lane *lane = &lanes[l];
+
+    pthread_mutex_lock(&lane->lock);
+    if (lane->count == lane->capacity) {
+        lane->rejected++;
+        pthread_mutex_unlock(&lane->lock);
+        return 0;
+    }
+
+    int tail = (lane->head + lane->count) % lane->capacity;
+    lane->ring[tail].fn = fn;
+    lane->ring[tail].arg = arg;
+    lane->ring[tail].queued_at = metrics_now();
+    lane->count++;
+    lane->submitted++;
+    if (lane->count > lane->high_water) lane->high_water = lane->count;
+    pthread_cond_signal(&lane->not_empty);
+    pthread_mutex_unlock(&lane->lock);
+    return 1;
+}
+
+void worker_pool_report(char *out, size_t size) {
+    size_t used = 0;
+    out[0] = '\0';
+
+    for (int l = 0; l < LANE_COUNT && used < size; l++) {
+        struct work_lane *lane = &lanes[l];
+        pthread_mutex_lock(&lane->lock);
+        int n = snprintf(out + used, size - used,
+                         "Lane %-6s depth %d/%d  peak %d  accepted %lu  rejected %lu\n",
+                         lane->name, lane->count, lane->capacity, lane->high_water,
+                         lane->submitted, lane->rejected);
+        pthread_mutex_unlock(&lane->lock);
+        if (n < 0) break;
+        used += (size_t)n;
+    }
+}
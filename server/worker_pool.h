@@ -0,0 +1,33 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+
+typedef void (*job_fn)(void *arg);
+
+// Each kind of work gets its own threads and its own bounded queue,
+// so a burst of one kind cannot starve the others.
+enum lane {
+    LANE_AUTH,   // LOGIN, SIGNUP (the hashing itself runs on the auth engine)
+    LANE_WRITE,  // database writes: TRANSFER
+    LANE_READ,   // BALANCE, HISTORY and the other short reads
+    LANE_REPORT, // SHOW_ALL_USERS and ADMIN_STATS, which can run for seconds
+    LANE_COUNT
+};
+
+struct lane_config {
+    int threads;
+    int depth;   // queued jobs allowed before submissions are refused
+    void (*thread_start)(void);  // run on each of the lane's threads before its first job, or NULL
+};
+
+// Start the worker threads for every lane
+int worker_pool_start(const struct lane_config config[LANE_COUNT]);
+
+// Queue a job on a lane. Returns 0 without queueing if the lane is full.
+int worker_pool_submit(enum lane lane, job_fn fn, void *arg);
+
+// Human-readable queue depth and rejection counts per lane
+void worker_pool_report(char *out, size_t size);
+
+#endif